@@ -0,0 +1,316 @@
+//
+//  bench.c
+//
+// Benchmark harness for imageinfo (Linux). Runs the program over a corpus
+// (see gencorpus.c) in each of its modes, with the page cache warm and
+// with the corpus evicted from it, and reports:
+//   files/sec     best wall clock time of several runs
+//   bytes/file    bytes returned by read calls (/proc/<pid>/io rchar);
+//                 memory mapped data shows up as page faults instead and
+//                 io_uring reads aren't counted at all
+//   syscalls/file counted in a separate run under ptrace, all threads
+//   faults/file   minor + major page faults
+//
+// usage: bench <imageinfo> <corpus dir> [runs]
+//
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+
+#define MAX_ARGS 8
+
+typedef struct tagMode
+{
+    const char *szName;
+    const char *szArgs[MAX_ARGS]; // "@" is replaced by the corpus directory
+    int bList;                    // reads the NUL-delimited list on stdin
+} MODE;
+
+static const MODE modes[] = {
+    {"single",   {"-j", "1", "-r", "@"}, 0}, // one scanner thread
+    {"batch",    {"-0"}, 1},                 // list of pathnames, one at a time
+    {"parallel", {"-r", "@"}, 0},            // one scanner thread per CPU
+    {"mmap",     {"-m", "-0"}, 1},
+    {"uring",    {"-u", "-0"}, 1},           // io_uring batch
+};
+#define MODE_COUNT (int)(sizeof(modes) / sizeof(modes[0]))
+
+typedef struct tagRunStats
+{
+    double dSeconds;
+    unsigned long long ullReadBytes; // rchar
+    unsigned long long ullSyscalls;
+    long lFaults;
+} RUN_STATS;
+
+static char *pList = NULL; // NUL-delimited pathnames of the corpus
+static size_t listLen = 0, listMax = 0;
+static int iFiles = 0;
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : AddFile(const char *, const struct stat *, int, FTW *)     *
+ *                                                                          *
+ *  PURPOSE    : nftw callback which adds each regular file to the list.    *
+ *                                                                          *
+ ****************************************************************************/
+static int AddFile(const char *szPath, const struct stat *pst, int iFlag, struct FTW *pFTW)
+{
+    size_t len = strlen(szPath) + 1;
+    char *p;
+
+    if (iFlag != FTW_F)
+        return 0;
+    if (listLen + len > listMax)
+    {
+        listMax = (listMax + len) * 2;
+        p = (char *)realloc(pList, listMax);
+        if (p == NULL)
+            return -1;
+        pList = p;
+    }
+    memcpy(&pList[listLen], szPath, len);
+    listLen += len;
+    iFiles++;
+    return 0;
+} /* AddFile() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : DropCache(void)                                            *
+ *                                                                          *
+ *  PURPOSE    : Evict the corpus from the page cache. Works without root   *
+ *               (unlike /proc/sys/vm/drop_caches) since the pages are      *
+ *               clean; directory and inode caches stay warm.               *
+ *                                                                          *
+ ****************************************************************************/
+static void DropCache(void)
+{
+    size_t i;
+    int fd;
+
+    for (i=0; i<listLen; i += strlen(&pList[i]) + 1)
+    {
+        fd = open(&pList[i], O_RDONLY);
+        if (fd < 0)
+            continue;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+} /* DropCache() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ReadProcIO(pid_t)                                          *
+ *                                                                          *
+ *  PURPOSE    : Return the bytes read by a process which has exited but    *
+ *               hasn't been reaped yet.                                    *
+ *                                                                          *
+ ****************************************************************************/
+static unsigned long long ReadProcIO(pid_t pid)
+{
+    char szLine[256];
+    unsigned long long ull = 0;
+    FILE *f;
+
+    snprintf(szLine, sizeof(szLine), "/proc/%d/io", (int)pid);
+    f = fopen(szLine, "r");
+    if (f == NULL)
+        return 0;
+    while (fgets(szLine, sizeof(szLine), f))
+    {
+        if (sscanf(szLine, "rchar: %llu", &ull) == 1)
+            break;
+    }
+    fclose(f);
+    return ull;
+} /* ReadProcIO() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CountSyscalls(pid_t)                                       *
+ *                                                                          *
+ *  PURPOSE    : Run a traced child to completion, counting the system      *
+ *               calls made by all of its threads. The child is reaped.     *
+ *                                                                          *
+ ****************************************************************************/
+static unsigned long long CountSyscalls(pid_t pid)
+{
+    unsigned long long ullStops = 0;
+    pid_t tid;
+    int iStatus, iSig;
+
+    if (waitpid(pid, &iStatus, __WALL) != pid || !WIFSTOPPED(iStatus))
+        return 0;
+    ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, pid, 0, 0);
+    while ((tid = waitpid(-1, &iStatus, __WALL)) > 0)
+    {
+        if (!WIFSTOPPED(iStatus))
+        {
+            if (tid == pid)
+                break;
+            continue;
+        }
+        iSig = WSTOPSIG(iStatus);
+        if (iSig == (SIGTRAP | 0x80)) // entry or exit of a syscall
+        {
+            ullStops++;
+            iSig = 0;
+        }
+        else if (iSig == SIGTRAP || iSig == SIGSTOP) // clone/exec event, new thread
+            iSig = 0;
+        ptrace(PTRACE_SYSCALL, tid, 0, iSig);
+    }
+    return ullStops / 2; // a stop on the way in and one on the way out
+} /* CountSyscalls() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : RunOnce(char *, char *, const MODE *, int, RUN_STATS *)    *
+ *                                                                          *
+ *  PURPOSE    : Run imageinfo once in the given mode with its output       *
+ *               going to /dev/null. With bTrace only the number of         *
+ *               system calls is measured.                                  *
+ *                                                                          *
+ *  RETURNS    : 0 if successful, -1 if it couldn't be run.                 *
+ *                                                                          *
+ ****************************************************************************/
+static int RunOnce(char *szProgram, char *szCorpus, int iListFD, const MODE *pMode, int bTrace, RUN_STATS *pStats)
+{
+    char *argv[MAX_ARGS + 2];
+    struct timespec ts0, ts1;
+    struct rusage ru;
+    siginfo_t si;
+    pid_t pid;
+    int i, fd;
+
+    argv[0] = szProgram;
+    for (i=0; i<MAX_ARGS && pMode->szArgs[i]; i++)
+        argv[i+1] = (strcmp(pMode->szArgs[i], "@") == 0) ? szCorpus : (char *)pMode->szArgs[i];
+    argv[i+1] = NULL;
+    lseek(iListFD, 0, SEEK_SET);
+    clock_gettime(CLOCK_MONOTONIC, &ts0);
+    pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0)
+    {
+        fd = open("/dev/null", O_WRONLY);
+        dup2(iListFD, 0);
+        dup2(fd, 1);
+        if (bTrace)
+        {
+            ptrace(PTRACE_TRACEME, 0, 0, 0);
+            raise(SIGSTOP);
+        }
+        execv(szProgram, argv);
+        _exit(127);
+    }
+    memset(pStats, 0, sizeof(RUN_STATS));
+    if (bTrace) // the child is reaped while tracing; only the count is known
+    {
+        pStats->ullSyscalls = CountSyscalls(pid);
+        return pStats->ullSyscalls ? 0 : -1;
+    }
+    // wait without reaping so /proc/<pid>/io can still be read
+    if (waitid(P_PID, pid, &si, WEXITED | WNOWAIT) != 0)
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &ts1);
+    pStats->ullReadBytes = ReadProcIO(pid);
+    if (wait4(pid, &i, 0, &ru) != pid || !WIFEXITED(i) || WEXITSTATUS(i) == 127)
+        return -1;
+    pStats->dSeconds = (double)(ts1.tv_sec - ts0.tv_sec) + (double)(ts1.tv_nsec - ts0.tv_nsec) / 1e9;
+    pStats->lFaults = ru.ru_minflt + ru.ru_majflt;
+    return 0;
+} /* RunOnce() */
+
+int main(int argc, char *argv[])
+{
+    char szList[] = "/tmp/imageinfo_bench_XXXXXX";
+    RUN_STATS stats, best, traced;
+    double dFiles;
+    int iMode, iCold, iRun, iRuns = 3;
+    int iListFD;
+    unsigned long long ullListBytes;
+
+    if (argc < 3)
+    {
+        printf("usage: bench <imageinfo> <corpus dir> [runs (default 3)]\n");
+        return 0;
+    }
+    if (argc > 3)
+        iRuns = atoi(argv[3]);
+    if (iRuns < 1)
+        iRuns = 1;
+    if (nftw(argv[2], AddFile, 64, FTW_PHYS) != 0 || iFiles == 0)
+    {
+        fprintf(stderr, "%s - no files found\n", argv[2]);
+        return -1;
+    }
+    iListFD = mkstemp(szList);
+    if (iListFD < 0 || write(iListFD, pList, listLen) != (ssize_t)listLen)
+    {
+        perror(szList);
+        return -1;
+    }
+    unlink(szList);
+    dFiles = (double)iFiles;
+    printf("%d files in %s, best of %d runs\n", iFiles, argv[2], iRuns);
+    printf("%-9s %-5s %10s %11s %14s %12s\n", "mode", "cache", "files/sec", "bytes/file", "syscalls/file", "faults/file");
+    for (iMode=0; iMode<MODE_COUNT; iMode++)
+    {
+        // the list itself is read from stdin; don't count it
+        ullListBytes = modes[iMode].bList ? (unsigned long long)listLen : 0;
+        if (RunOnce(argv[1], argv[2], iListFD, &modes[iMode], 1, &traced) != 0)
+        {
+            fprintf(stderr, "%s - unable to run\n", argv[1]);
+            return -1;
+        }
+        for (iCold=0; iCold<2; iCold++)
+        {
+            best.dSeconds = 0.0;
+            for (iRun=0; iRun<iRuns; iRun++)
+            {
+                if (iCold)
+                    DropCache();
+                else if (iRun == 0) // warm it up
+                    RunOnce(argv[1], argv[2], iListFD, &modes[iMode], 0, &stats);
+                if (RunOnce(argv[1], argv[2], iListFD, &modes[iMode], 0, &stats) != 0)
+                    return -1;
+                if (best.dSeconds == 0.0 || stats.dSeconds < best.dSeconds)
+                    best = stats;
+            }
+            if (best.ullReadBytes > ullListBytes)
+                best.ullReadBytes -= ullListBytes;
+            printf("%-9s %-5s %10.0f %11.0f %14.1f %12.1f\n", modes[iMode].szName, iCold ? "cold" : "warm",
+                   dFiles / best.dSeconds, (double)best.ullReadBytes / dFiles,
+                   (double)traced.ullSyscalls / dFiles, (double)best.lFaults / dFiles);
+        }
+    }
+    close(iListFD);
+    free(pList);
+    return 0;
+} /* main() */
@@ -0,0 +1,89 @@
+#!/bin/sh
+#
+#  check.sh
+#
+# Regression check for imageinfo (make check). Probes a small corpus from
+# gencorpus with the walkers (--pages, --scans, --frames, --verify-crc,
+# --check-complete), --archives and --thumb and compares the output with
+# bench/check.expected. The other ways of reading files (named files, -m,
+# -u, -0, one thread) and a second run answered from the cache must give
+# the same results as the first run.
+#
+# When a change is meant to alter the output, look over the differences
+# and rewrite the expected output with "bench/check.sh -u".
+#
+# usage: check.sh [-u]   (from the top directory, after make)
+#
+# Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#    http://www.apache.org/licenses/LICENSE-2.0
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#===========================================================================
+
+II=./imageinfo
+DIR=check_corpus   # paths are relative so the output doesn't depend on where we are
+OUT=check_out
+EXPECTED=bench/check.expected
+FAIL=0
+
+rm -rf $DIR $OUT
+mkdir $OUT || exit 1
+./bench/gencorpus $DIR 8 > /dev/null || exit 1
+
+# the expected output
+{
+    echo "== plain"
+    $II -r $DIR | sort
+    echo "== jsonl"
+    $II --format=jsonl -r $DIR | sort
+    echo "== walkers"
+    $II --pages --scans --frames --verify-crc --check-complete --archives -r $DIR 2> $OUT/walkers.err | sort
+    grep '^Complete:' $OUT/walkers.err
+    echo "== thumbnails"
+    mkdir $OUT/thumbs
+    $II --thumb $OUT/thumbs -r $DIR > /dev/null
+    $II --check-complete $OUT/thumbs/* 2> /dev/null | sort
+} > $OUT/check.out 2>&1
+
+if [ "$1" = "-u" ]; then
+    cp $OUT/check.out $EXPECTED
+    echo "$EXPECTED updated"
+elif ! diff $EXPECTED $OUT/check.out; then
+    echo "FAILED: output differs from $EXPECTED"
+    FAIL=1
+fi
+
+# every mode has to agree with the plain run
+sed -n '/^== plain$/,/^== jsonl$/p' $OUT/check.out | sed '1d;$d' > $OUT/plain
+find $DIR -type f | sort > $OUT/list
+compare()
+{
+    if ! diff $OUT/plain $OUT/mode > /dev/null; then
+        echo "FAILED: $1 differs from the plain run"
+        diff $OUT/plain $OUT/mode | head -10
+        FAIL=1
+    fi
+}
+xargs $II < $OUT/list | sort > $OUT/mode; compare "named files"
+xargs $II -m < $OUT/list | sort > $OUT/mode; compare "-m"
+xargs $II -u < $OUT/list | sort > $OUT/mode; compare "-u"
+tr '\n' '\0' < $OUT/list | $II -0 | sort > $OUT/mode; compare "-0"
+$II -j 1 -r $DIR | sort > $OUT/mode; compare "-j 1"
+$II -c $OUT/cache -r $DIR | sort > $OUT/mode; compare "-c (first run)"
+$II --stats -c $OUT/cache -r $DIR 2> $OUT/cache.err | sort > $OUT/mode; compare "-c (from the cache)"
+if grep -q '^PNG ' $OUT/cache.err; then
+    echo "FAILED: -c probed unchanged files again"
+    FAIL=1
+fi
+
+if [ $FAIL = 0 ]; then
+    echo "check passed"
+    rm -rf $DIR $OUT
+fi
+exit $FAIL
@@ -0,0 +1,170 @@
+//
+//  classify.c
+//
+// Microbenchmark of the batch file type classifier (imageinfo_classify).
+// The first bytes of every file in a corpus (see gencorpus.c) are loaded
+// into memory and classified over and over with each implementation the
+// CPU supports; every one must agree with the scalar code.
+//
+// usage: classify <corpus dir> [passes]
+//
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include "imageinfo.h"
+
+#define HEADER_SIZE 64     // bytes kept per file
+#define BATCH_SIZE 256     // headers per call, like a full io_uring pass
+
+static unsigned char *pHeaders = NULL; // HEADER_SIZE bytes per file
+static int *piLens = NULL;
+static int iFiles = 0, iMaxFiles = 0;
+
+static const char *szImpls[] = {"scalar", "sse4.1", "avx2"};
+#define IMPL_COUNT (int)(sizeof(szImpls) / sizeof(szImpls[0]))
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : AddFile(const char *, const struct stat *, int, FTW *)     *
+ *                                                                          *
+ *  PURPOSE    : nftw callback which loads the start of each regular file.  *
+ *                                                                          *
+ ****************************************************************************/
+static int AddFile(const char *szPath, const struct stat *pst, int iFlag, struct FTW *pFTW)
+{
+    void *p;
+    int fd, iLen;
+
+    if (iFlag != FTW_F)
+        return 0;
+    if (iFiles == iMaxFiles)
+    {
+        iMaxFiles = iMaxFiles ? iMaxFiles * 2 : 1024;
+        p = realloc(pHeaders, (size_t)iMaxFiles * HEADER_SIZE);
+        if (p == NULL)
+            return -1;
+        pHeaders = (unsigned char *)p;
+        p = realloc(piLens, iMaxFiles * sizeof(int));
+        if (p == NULL)
+            return -1;
+        piLens = (int *)p;
+    }
+    fd = open(szPath, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    iLen = (int)read(fd, &pHeaders[(size_t)iFiles * HEADER_SIZE], HEADER_SIZE);
+    close(fd);
+    if (iLen < 0)
+        iLen = 0;
+    piLens[iFiles++] = iLen;
+    return 0;
+} /* AddFile() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : Classify(const unsigned char **, int *, int)               *
+ *                                                                          *
+ *  PURPOSE    : Classify the whole corpus, a batch at a time.              *
+ *                                                                          *
+ ****************************************************************************/
+static void Classify(const unsigned char **ppHeaders, int *piTypes, int iPasses)
+{
+    int i, iPass, iCount;
+
+    for (iPass=0; iPass<iPasses; iPass++)
+    {
+        for (i=0; i<iFiles; i += BATCH_SIZE)
+        {
+            iCount = (iFiles - i < BATCH_SIZE) ? iFiles - i : BATCH_SIZE;
+            imageinfo_classify(&ppHeaders[i], &piLens[i], iCount, &piTypes[i]);
+        }
+    }
+} /* Classify() */
+
+int main(int argc, char *argv[])
+{
+    const unsigned char **ppHeaders;
+    int *piTypes, *piExpected;
+    int i, iImpl, iPasses = 200, iCounts[FILETYPE_COUNT];
+    struct timespec ts0, ts1;
+    double dSeconds, dScalar = 0.0;
+
+    if (argc < 2)
+    {
+        printf("usage: classify <corpus dir> [passes (default 200)]\n");
+        return 0;
+    }
+    if (argc > 2)
+        iPasses = atoi(argv[2]);
+    if (iPasses < 1)
+        iPasses = 1;
+    if (nftw(argv[1], AddFile, 64, FTW_PHYS) != 0 || iFiles == 0)
+    {
+        fprintf(stderr, "%s - no files found\n", argv[1]);
+        return -1;
+    }
+    ppHeaders = (const unsigned char **)malloc(iFiles * sizeof(unsigned char *));
+    piTypes = (int *)malloc(iFiles * sizeof(int));
+    piExpected = (int *)malloc(iFiles * sizeof(int));
+    if (ppHeaders == NULL || piTypes == NULL || piExpected == NULL)
+        return -1;
+    for (i=0; i<iFiles; i++)
+        ppHeaders[i] = &pHeaders[(size_t)i * HEADER_SIZE];
+    imageinfo_classify_impl("scalar");
+    Classify(ppHeaders, piExpected, 1);
+    memset(iCounts, 0, sizeof(iCounts));
+    for (i=0; i<iFiles; i++)
+        iCounts[piExpected[i]]++;
+    printf("%d headers, %d passes:", iFiles, iPasses);
+    for (i=0; i<FILETYPE_COUNT; i++)
+    {
+        if (iCounts[i])
+            printf(" %s %d", imageinfo_type_name(i), iCounts[i]);
+    }
+    printf("\n%-8s %12s %8s\n", "impl", "ns/header", "speedup");
+    for (iImpl=0; iImpl<IMPL_COUNT; iImpl++)
+    {
+        if (imageinfo_classify_impl(szImpls[iImpl]) == NULL)
+        {
+            printf("%-8s %12s\n", szImpls[iImpl], "n/a");
+            continue;
+        }
+        Classify(ppHeaders, piTypes, 1); // warm up and check
+        if (memcmp(piTypes, piExpected, iFiles * sizeof(int)) != 0)
+        {
+            fprintf(stderr, "%s - results differ from the scalar code\n", szImpls[iImpl]);
+            return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &ts0);
+        Classify(ppHeaders, piTypes, iPasses);
+        clock_gettime(CLOCK_MONOTONIC, &ts1);
+        dSeconds = (double)(ts1.tv_sec - ts0.tv_sec) + (double)(ts1.tv_nsec - ts0.tv_nsec) / 1e9;
+        if (iImpl == 0)
+            dScalar = dSeconds;
+        printf("%-8s %12.2f %7.2fx\n", szImpls[iImpl], dSeconds * 1e9 / ((double)iFiles * iPasses), dScalar / dSeconds);
+    }
+    free(ppHeaders);
+    free(piTypes);
+    free(piExpected);
+    free(pHeaders);
+    free(piLens);
+    return 0;
+} /* main() */
@@ -0,0 +1,117 @@
+//
+//  crc.c
+//
+// Microbenchmark of the CRC-32 used by --verify-crc (PILCRC32). A buffer
+// of random bytes is run through each implementation the CPU supports,
+// whole and as PNG sized chunks at odd alignments; every one must agree
+// with the table code.
+//
+// usage: crc [megabytes] [passes]
+//
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pil_crc.h"
+
+#define CHECK_COUNT 10000  // random pieces compared with the table code
+
+static const char *szImpls[] = {"slice8", "pclmul"};
+#define IMPL_COUNT (int)(sizeof(szImpls) / sizeof(szImpls[0]))
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CheckPieces(unsigned char *, int, uint32_t *)              *
+ *                                                                          *
+ *  PURPOSE    : CRCs of pseudo-random pieces of the buffer, each added in  *
+ *               two parts so running values are covered too.               *
+ *                                                                          *
+ ****************************************************************************/
+static void CheckPieces(unsigned char *pBuf, int iSize, uint32_t *pulCRCs)
+{
+    unsigned int uiSeed = 1;
+    int i, iOff, iLen, iSplit;
+
+    for (i=0; i<CHECK_COUNT; i++)
+    {
+        uiSeed = uiSeed * 1103515245 + 12345;
+        iOff = (uiSeed >> 8) % 64;
+        iLen = (uiSeed >> 4) % ((i & 7) ? 1024 : (iSize - 64));
+        iSplit = iLen / 3;
+        pulCRCs[i] = PILCRC32(PILCRC32(0, &pBuf[iOff], iSplit), &pBuf[iOff + iSplit], iLen - iSplit);
+    }
+} /* CheckPieces() */
+
+int main(int argc, char *argv[])
+{
+    unsigned char *pBuf;
+    uint32_t *pulExpected, *pulCRCs, ulCRC;
+    int i, iImpl, iPass, iSize = 64, iPasses = 20;
+    struct timespec ts0, ts1;
+    double dSeconds;
+
+    if (argc > 1)
+        iSize = atoi(argv[1]);
+    if (argc > 2)
+        iPasses = atoi(argv[2]);
+    if (iSize < 1)
+        iSize = 1;
+    if (iPasses < 1)
+        iPasses = 1;
+    iSize <<= 20;
+    pBuf = (unsigned char *)malloc(iSize);
+    pulExpected = (uint32_t *)malloc(CHECK_COUNT * sizeof(uint32_t));
+    pulCRCs = (uint32_t *)malloc(CHECK_COUNT * sizeof(uint32_t));
+    if (pBuf == NULL || pulExpected == NULL || pulCRCs == NULL)
+        return -1;
+    srand(1);
+    for (i=0; i<iSize; i++)
+        pBuf[i] = (unsigned char)rand();
+    // the CRC of "123456789" is the standard check value
+    PILCRCImpl("slice8");
+    if (PILCRC32(0, (const unsigned char *)"123456789", 9) != 0xcbf43926)
+    {
+        fprintf(stderr, "slice8 - wrong check value\n");
+        return -1;
+    }
+    CheckPieces(pBuf, iSize, pulExpected);
+    printf("%d MB, %d passes\n%-8s %10s\n", iSize >> 20, iPasses, "impl", "GB/s");
+    for (iImpl=0; iImpl<IMPL_COUNT; iImpl++)
+    {
+        if (PILCRCImpl(szImpls[iImpl]) == NULL)
+        {
+            printf("%-8s %10s\n", szImpls[iImpl], "n/a");
+            continue;
+        }
+        CheckPieces(pBuf, iSize, pulCRCs); // warm up and check
+        if (memcmp(pulCRCs, pulExpected, CHECK_COUNT * sizeof(uint32_t)) != 0)
+        {
+            fprintf(stderr, "%s - results differ from the table code\n", szImpls[iImpl]);
+            return -1;
+        }
+        ulCRC = 0;
+        clock_gettime(CLOCK_MONOTONIC, &ts0);
+        for (iPass=0; iPass<iPasses; iPass++)
+            ulCRC = PILCRC32(ulCRC, pBuf, iSize);
+        clock_gettime(CLOCK_MONOTONIC, &ts1);
+        dSeconds = (double)(ts1.tv_sec - ts0.tv_sec) + (double)(ts1.tv_nsec - ts0.tv_nsec) / 1e9;
+        printf("%-8s %10.2f  (%08x)\n", szImpls[iImpl], (double)iSize * iPasses / dSeconds / 1e9, ulCRC);
+    }
+    free(pBuf);
+    free(pulExpected);
+    free(pulCRCs);
+    return 0;
+} /* main() */
@@ -0,0 +1,949 @@
+//
+//  gencorpus.c
+//
+// Writes a reproducible corpus of synthetic image files for the benchmark
+// and for make check. Mostly only the headers are real; the rest of each
+// file is left as a hole, so a large corpus costs little disk space and
+// these files end up truncated. Every fourth JPEG, PNG, GIF and TIFF has a
+// complete body instead (its image data is still a hole): scans and EOI,
+// chunks up to IEND with their CRCs, frames and the trailer, strips which
+// fit in the file. Every FILETYPE_xxx is covered, along with the cases
+// which make the parser do extra work: JPEGs with large EXIF blocks (with
+// an orientation and usually a thumbnail) and many APPn markers, APNGs,
+// multi-page TIFFs and TIFFs of both byte orders whose IFD is far from the
+// header, PPMs with comments, and tar and zip archives of complete files.
+//
+// usage: gencorpus <dir> [files per type] [seed]
+//
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#define MAX_HEADER 0x20000  // biggest header we generate (EXIF JPEG)
+#define MAX_TAIL 4096       // biggest end of a complete file
+#define MAX_BODY 0x80000    // biggest hole in a complete file
+#define FILES_PER_DIR 250   // spread the files over subdirectories
+#define MAX_MEMBERS 4       // files in an archive
+
+static unsigned int uiSeed;
+static unsigned char ucBuf[MAX_HEADER];
+static int iLen; // bytes in ucBuf
+static unsigned char ucTail[MAX_TAIL];
+static int iTail; // bytes in ucTail, which go at the end of the file
+static long lSize; // size of the file, set by the complete ones
+static long lFar; // if non-zero, ucBuf[8...] goes at this offset (TIFF IFD)
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : Random(int, int)                                           *
+ *                                                                          *
+ *  PURPOSE    : Return a pseudo-random number in [iMin, iMax]. The same    *
+ *               seed always gives the same corpus on every platform.       *
+ *                                                                          *
+ ****************************************************************************/
+static int Random(int iMin, int iMax)
+{
+    uiSeed ^= uiSeed << 13; // xorshift32
+    uiSeed ^= uiSeed >> 17;
+    uiSeed ^= uiSeed << 5;
+    return iMin + (int)(uiSeed % (unsigned int)(iMax - iMin + 1));
+} /* Random() */
+
+// Append values to the header being built
+static void PutByte(int i) { ucBuf[iLen++] = (unsigned char)i; }
+static void PutBytes(const void *p, int i) { memcpy(&ucBuf[iLen], p, i); iLen += i; }
+static void PutFill(int c, int i) { memset(&ucBuf[iLen], c, i); iLen += i; }
+static void PutMoto16(int i) { PutByte(i >> 8); PutByte(i); }
+static void PutMoto32(unsigned int i) { PutMoto16((int)(i >> 16)); PutMoto16((int)(i & 0xffff)); }
+static void PutIntel16(int i) { PutByte(i); PutByte(i >> 8); }
+static void PutIntel32(unsigned int i) { PutIntel16((int)(i & 0xffff)); PutIntel16((int)(i >> 16)); }
+static void Put16(int i, int bMotorola) { if (bMotorola) PutMoto16(i); else PutIntel16(i); }
+static void Put32(unsigned int i, int bMotorola) { if (bMotorola) PutMoto32(i); else PutIntel32(i); }
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : MoveToTail(int)                                            *
+ *                                                                          *
+ *  PURPOSE    : Move what was put in ucBuf from iStart on to ucTail, to be *
+ *               written at the end of the file after the hole.             *
+ *                                                                          *
+ ****************************************************************************/
+static void MoveToTail(int iStart)
+{
+    iTail = iLen - iStart;
+    memcpy(ucTail, &ucBuf[iStart], iTail);
+    iLen = iStart;
+} /* MoveToTail() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : FileSize(void)                                             *
+ *                                                                          *
+ *  PURPOSE    : Pick a total file size at least as big as the header.      *
+ *               Sizes are spread from 1K to 4MB (log scale) so both the    *
+ *               read and memory map paths get used.                        *
+ *                                                                          *
+ ****************************************************************************/
+static long FileSize(void)
+{
+    long l = 1024L << Random(0, 12);
+
+    l += Random(0, (int)(l - 1));
+    if (l < iLen)
+        l = iLen;
+    return l;
+} /* FileSize() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : BodySize(void)                                             *
+ *                                                                          *
+ *  PURPOSE    : Pick the size of the image data of a complete file, from   *
+ *               1K to 512K (log scale); small enough to fit in an archive. *
+ *                                                                          *
+ ****************************************************************************/
+static long BodySize(void)
+{
+    long l = 1024L << Random(0, 8);
+
+    return l + Random(0, (int)(l - 1));
+} /* BodySize() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CRCZeros(uLong, long)                                      *
+ *                                                                          *
+ *  PURPOSE    : Continue a CRC-32 over lCount zero bytes (a hole).         *
+ *                                                                          *
+ ****************************************************************************/
+static uLong CRCZeros(uLong ulCRC, long lCount)
+{
+    static const unsigned char ucZeros[4096];
+    long l;
+
+    for (; lCount > 0; lCount -= l)
+    {
+        l = (lCount < (long)sizeof(ucZeros)) ? lCount : (long)sizeof(ucZeros);
+        ulCRC = crc32(ulCRC, ucZeros, (uInt)l);
+    }
+    return ulCRC;
+} /* CRCZeros() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : WriteFile(char *)                                          *
+ *                                                                          *
+ *  PURPOSE    : Write the header and the tail and extend the file to lSize *
+ *               bytes without writing the rest.                            *
+ *                                                                          *
+ ****************************************************************************/
+static int WriteFile(char *szName)
+{
+    int fd;
+
+    fd = open(szName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    if (lFar) // header at the start, the rest at the end
+    {
+        if (pwrite(fd, ucBuf, 8, 0) != 8 || pwrite(fd, &ucBuf[8], iLen - 8, (off_t)lFar) != iLen - 8)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else if (write(fd, ucBuf, iLen) != iLen || (lSize > iLen && ftruncate(fd, (off_t)lSize) != 0) ||
+             (iTail && pwrite(fd, ucTail, iTail, (off_t)(lSize - iTail)) != iTail))
+    {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+} /* WriteFile() */
+
+// Start a PNG chunk; returns where it starts for PutCRC()
+static int PutChunk(const char *szType, unsigned int uiLen)
+{
+    int i = iLen;
+
+    PutMoto32(uiLen);
+    PutBytes(szType, 4);
+    return i;
+} /* PutChunk() */
+
+static void PutCRC(int iChunk)
+{
+    PutMoto32((unsigned int)crc32(0, &ucBuf[iChunk + 4], (uInt)(iLen - iChunk - 4)));
+} /* PutCRC() */
+
+static void MakePNG(int bComplete)
+{
+    static const unsigned char ucSig[] = {0x89,'P','N','G',0x0d,0x0a,0x1a,0x0a};
+    static const int iTypes[] = {0, 2, 3, 4, 6};
+    char szTemp[64];
+    int i, j, iStart = 0, iWidth, iHeight, iW, iH, iFrames, iSeq = 0;
+    long lBody;
+
+    PutBytes(ucSig, 8);
+    i = PutChunk("IHDR", 13);
+    iWidth = Random(1, 20000);
+    iHeight = Random(1, 20000);
+    PutMoto32(iWidth);
+    PutMoto32(iHeight);
+    PutByte(8);
+    PutByte(iTypes[Random(0, 4)]);
+    PutByte(0); // compression
+    PutByte(0); // filter
+    PutByte(Random(0, 3) == 0); // interlace
+    PutCRC(i);
+    if (!bComplete)
+    {
+        PutFill(0, 256);
+        return;
+    }
+    if (Random(0, 1)) // DPI, in pixels per meter
+    {
+        j = (Random(72, 600) * 10000 + 127) / 254;
+        i = PutChunk("pHYs", 9);
+        PutMoto32(j);
+        PutMoto32(j);
+        PutByte(1);
+        PutCRC(i);
+    }
+    if (Random(0, 2) == 0) // ICC profile (not a real one)
+    {
+        j = Random(16, 400);
+        i = PutChunk("iCCP", 11 + j);
+        PutBytes("gencorpus\0\0", 11);
+        PutFill(Random(1, 0xff), j);
+        PutCRC(i);
+    }
+    for (j=Random(0, 3); j>0; j--)
+    {
+        sprintf(szTemp, "Comment%cwritten by gencorpus %d", 0, Random(0, 99999));
+        i = PutChunk("tEXt", (unsigned int)(8 + strlen(&szTemp[8])));
+        PutBytes(szTemp, 8 + (int)strlen(&szTemp[8]));
+        PutCRC(i);
+        if (Random(0, 7) == 0) // damaged
+            ucBuf[iLen - 1] ^= 1;
+    }
+    iFrames = (Random(0, 2) == 0) ? Random(2, 5) : 0; // APNG
+    if (iFrames)
+    {
+        i = PutChunk("acTL", 8);
+        PutMoto32(iFrames);
+        PutMoto32(Random(0, 3)); // loops, 0 = forever
+        PutCRC(i);
+    }
+    lBody = BodySize();
+    for (j=0; j<iFrames; j++)
+    {
+        if (j == 1) // the rest of the frames go after the IDAT hole
+        {
+            i = PutChunk("IDAT", (unsigned int)lBody);
+            iStart = iLen;
+            PutMoto32((unsigned int)CRCZeros(crc32(0, &ucBuf[i + 4], 4), lBody));
+        }
+        iW = Random(1, iWidth);
+        iH = Random(1, iHeight);
+        i = PutChunk("fcTL", 26);
+        PutMoto32(iSeq++);
+        PutMoto32(iW);
+        PutMoto32(iH);
+        PutMoto32(Random(0, iWidth - iW)); // x and y offsets
+        PutMoto32(Random(0, iHeight - iH));
+        PutMoto16(Random(1, 100)); // delay
+        PutMoto16(Random(0, 1) ? 100 : 0);
+        PutByte(0); // dispose
+        PutByte(0); // blend
+        PutCRC(i);
+        if (j > 0)
+        {
+            i = PutChunk("fdAT", 4 + 16);
+            PutMoto32(iSeq++);
+            PutFill(Random(0, 0xff), 16);
+            PutCRC(i);
+        }
+    }
+    if (iFrames < 2)
+    {
+        i = PutChunk("IDAT", (unsigned int)lBody);
+        iStart = iLen;
+        PutMoto32((unsigned int)CRCZeros(crc32(0, &ucBuf[i + 4], 4), lBody));
+    }
+    i = PutChunk("IEND", 0);
+    PutCRC(i);
+    MoveToTail(iStart);
+    lSize = iLen + lBody + iTail;
+} /* MakePNG() */
+
+// A small JPEG for the EXIF thumbnail
+static void PutThumb(void)
+{
+    int i;
+
+    PutMoto16(0xffd8);
+    PutMoto16(0xffdb);
+    PutMoto16(67);
+    PutByte(0);
+    for (i=0; i<64; i++)
+        PutByte(Random(1, 99));
+    PutMoto16(0xffc0);
+    PutMoto16(11);
+    PutByte(8);
+    PutMoto16(120);
+    PutMoto16(160);
+    PutByte(1);
+    PutByte(1); PutByte(0x11); PutByte(0);
+    PutMoto16(0xffda);
+    PutMoto16(8);
+    PutByte(1);
+    PutByte(1); PutByte(0);
+    PutByte(0); PutByte(63); PutByte(0);
+    for (i=Random(256, 4000); i>0; i--)
+        PutByte(Random(0, 0xfe)); // coded data never has an FF here
+    PutMoto16(0xffd9);
+} /* PutThumb() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : MakeEXIF(int, int)                                         *
+ *                                                                          *
+ *  PURPOSE    : A large APP1 Exif segment: IFD0 with the orientation and a *
+ *               pointer to the Exif IFD (which has the pixel dimensions),  *
+ *               then usually IFD1 with a thumbnail right after it.         *
+ *                                                                          *
+ ****************************************************************************/
+static void MakeEXIF(int iWidth, int iHeight)
+{
+    int j = Random(0, 1); // byte order of the EXIF data
+    int iSeg = Random(8000, 65000); // segment length
+    int bThumb = (Random(0, 3) != 0);
+    int iTIFF, iThumb, iEnd, i;
+
+    PutMoto16(0xffe1);
+    PutMoto16(iSeg);
+    PutBytes("Exif\0\0", 6);
+    iTIFF = iLen; // offsets are from the TIFF header
+    PutBytes(j ? "MM" : "II", 2);
+    Put16(42, j);
+    Put32(8, j);
+    Put16(2, j); // IFD0 at 8
+    Put16(0x0112, j); Put16(3, j); Put32(1, j); Put16(Random(1, 8), j); Put16(0, j); // orientation
+    Put16(0x8769, j); Put16(4, j); Put32(1, j); Put32(38, j); // Exif IFD
+    Put32(bThumb ? 68 : 0, j); // IFD1
+    Put16(2, j); // Exif IFD at 38
+    Put16(0xa002, j); Put16(4, j); Put32(1, j); Put32(iWidth, j);
+    Put16(0xa003, j); Put16(4, j); Put32(1, j); Put32(iHeight, j);
+    Put32(0, j);
+    if (bThumb)
+    {
+        Put16(3, j); // IFD1 at 68, the thumbnail at 110
+        Put16(0x0103, j); Put16(3, j); Put32(1, j); Put16(6, j); Put16(0, j); // JPEG compression
+        Put16(0x0201, j); Put16(4, j); Put32(1, j); Put32(110, j);
+        Put16(0x0202, j); Put16(4, j); Put32(1, j);
+        i = iLen;
+        Put32(0, j); // length, filled in below
+        Put32(0, j);
+        iThumb = iLen;
+        PutThumb();
+        iEnd = iLen;
+        iLen = i; // fill in the length
+        Put32(iEnd - iThumb, j);
+        iLen = iEnd;
+    }
+    PutFill(0, iSeg - 2 - 6 - (iLen - iTIFF));
+} /* MakeEXIF() */
+
+static void MakeJPEG(int iVariant, int bComplete)
+{
+    int i, j, iSegs, iWidth, iHeight, bProgressive;
+
+    iWidth = Random(1, 8000);
+    iHeight = Random(1, 8000);
+    PutMoto16(0xffd8);
+    PutMoto16(0xffe0); // JFIF
+    PutMoto16(16);
+    PutBytes("JFIF\0\1\1\0\0\1\0\1\0\0", 14);
+    if (iVariant == 1) // large EXIF block ahead of the frame header
+        MakeEXIF(iWidth, iHeight);
+    else if (iVariant == 2) // lots of small markers (APPn, COM)
+    {
+        iSegs = Random(10, 60);
+        for (i=0; i<iSegs; i++)
+        {
+            j = Random(4, 400);
+            PutMoto16(Random(0, 1) ? 0xffe2 + Random(0, 13) : 0xfffe);
+            PutMoto16(j);
+            PutFill(Random(1, 0x7f), j - 2);
+        }
+    }
+    PutMoto16(0xffdb); // quantization table
+    PutMoto16(67);
+    PutByte(0);
+    for (i=0; i<64; i++)
+        PutByte(Random(1, 99));
+    bProgressive = (Random(0, 2) == 0);
+    PutMoto16(bProgressive ? 0xffc2 : 0xffc0);
+    PutMoto16(17);
+    PutByte(8);
+    PutMoto16(iHeight);
+    PutMoto16(iWidth);
+    PutByte(3);
+    PutByte(1); PutByte(Random(0, 1) ? 0x22 : 0x11); PutByte(0);
+    PutByte(2); PutByte(0x11); PutByte(1);
+    PutByte(3); PutByte(0x11); PutByte(1);
+    PutMoto16(0xffda); // first scan, all three components
+    PutMoto16(12);
+    PutByte(3);
+    PutByte(1); PutByte(0x00);
+    PutByte(2); PutByte(0x11);
+    PutByte(3); PutByte(0x11);
+    PutByte(0); PutByte(bProgressive ? 0 : 63); PutByte(0);
+    if (!bComplete)
+    {
+        PutFill(0, 64);
+        return;
+    }
+    i = iLen; // the coded data is the hole; the other scans and the EOI go after it
+    for (iSegs = bProgressive ? Random(1, 9) : 0; iSegs > 0; iSegs--)
+    {
+        PutMoto16(0xffda);
+        PutMoto16(8);
+        PutByte(1);
+        PutByte(Random(1, 3)); PutByte(0x00);
+        PutByte(Random(1, 63)); PutByte(63); PutByte(Random(0, 1) ? 0x10 : 0x01);
+        for (j=Random(16, 64); j>0; j--)
+            PutByte(Random(0, 0xfe));
+    }
+    PutMoto16(0xffd9);
+    if (Random(0, 3) == 0) // something appended after the image
+        PutFill(' ', Random(1, 200));
+    MoveToTail(i);
+    lSize = iLen + BodySize() + iTail;
+} /* MakeJPEG() */
+
+static void MakeBMP(int bOS2)
+{
+    PutBytes("BM", 2);
+    PutIntel32(0); // file size
+    PutIntel32(0);
+    PutIntel32(bOS2 ? 26 : 54);
+    if (bOS2)
+    {
+        PutIntel32(12);
+        PutIntel16(Random(1, 4000));
+        PutIntel16(Random(1, 4000));
+        PutIntel16(1);
+        PutIntel16(Random(0, 1) ? 8 : 24);
+    }
+    else
+    {
+        PutIntel32(40);
+        PutIntel32(Random(1, 30000));
+        PutIntel32(Random(0, 1) ? Random(1, 30000) : 65536 - Random(1, 30000)); // bottom-up or top-down
+        PutIntel16(1);
+        PutIntel16(Random(0, 1) ? 8 : 24);
+        PutIntel32(0);
+    }
+    PutFill(0, 256);
+} /* MakeBMP() */
+
+static void MakeTIFF(int bComplete)
+{
+    int bMotorola = Random(0, 1);
+    int i, iTags = Random(8, 20);
+    int bPages = (bComplete && Random(0, 1)); // a second page after the first IFD
+    unsigned int uiStrip, uiStripLen;
+
+    PutBytes(bMotorola ? "MM" : "II", 2);
+    Put16(42, bMotorola);
+    if (Random(0, 2) == 0) // the IFD is written after the image data, like most encoders do
+    {
+        lFar = (1L << Random(20, 26)) + Random(0, 65535) * 2; // 1MB-64MB
+        bPages = 0;
+        uiStrip = 8; // the strip fills the space before the IFD
+        uiStripLen = (unsigned int)lFar - 8;
+        if (!bComplete)
+            uiStripLen *= 2;
+    }
+    else // the strip comes after the IFDs
+    {
+        uiStrip = 8 + 2 + iTags*12 + 4 + (bPages ? 2 + 5*12 + 4 : 0);
+        uiStripLen = bComplete ? (unsigned int)BodySize() : 0x1000000; // more than FileSize() gives
+    }
+    Put32(lFar ? (unsigned int)lFar : 8, bMotorola);
+    Put16(iTags, bMotorola);
+    for (i=0; i<iTags; i++) // tags must be in ascending order
+    {
+        switch (i)
+        {
+            case 0: Put16(256, bMotorola); Put16(4, bMotorola); Put32(1, bMotorola); Put32(Random(1, 60000), bMotorola); break;
+            case 1: Put16(257, bMotorola); Put16(4, bMotorola); Put32(1, bMotorola); Put32(Random(1, 60000), bMotorola); break;
+            case 2: Put16(258, bMotorola); Put16(3, bMotorola); Put32(1, bMotorola); Put16(8, bMotorola); Put16(0, bMotorola); break;
+            case 3: Put16(259, bMotorola); Put16(3, bMotorola); Put32(1, bMotorola); Put16(Random(0, 1) ? 5 : 1, bMotorola); Put16(0, bMotorola); break;
+            case 4: Put16(262, bMotorola); Put16(3, bMotorola); Put32(1, bMotorola); Put16(1, bMotorola); Put16(0, bMotorola); break;
+            case 5: Put16(273, bMotorola); Put16(4, bMotorola); Put32(1, bMotorola); Put32(uiStrip, bMotorola); break;
+            case 6: Put16(279, bMotorola); Put16(4, bMotorola); Put32(1, bMotorola); Put32(uiStripLen, bMotorola); break;
+            case 7: Put16(284, bMotorola); Put16(3, bMotorola); Put32(1, bMotorola); Put16(1, bMotorola); Put16(0, bMotorola); break;
+            default: Put16(300 + i, bMotorola); Put16(4, bMotorola); Put32(1, bMotorola); Put32(0, bMotorola); break;
+        }
+    }
+    Put32(bPages ? (unsigned int)iLen + 4 : 0, bMotorola); // next IFD
+    if (bPages) // a reduced size page
+    {
+        Put16(5, bMotorola);
+        Put16(256, bMotorola); Put16(3, bMotorola); Put32(1, bMotorola); Put16(Random(1, 4000), bMotorola); Put16(0, bMotorola);
+        Put16(257, bMotorola); Put16(3, bMotorola); Put32(1, bMotorola); Put16(Random(1, 4000), bMotorola); Put16(0, bMotorola);
+        Put16(258, bMotorola); Put16(3, bMotorola); Put32(1, bMotorola); Put16(Random(0, 1) ? 1 : 8, bMotorola); Put16(0, bMotorola);
+        Put16(259, bMotorola); Put16(3, bMotorola); Put32(1, bMotorola); Put16(Random(0, 1) ? 4 : 32773, bMotorola); Put16(0, bMotorola);
+        Put16(262, bMotorola); Put16(3, bMotorola); Put32(1, bMotorola); Put16(0, bMotorola); Put16(0, bMotorola);
+        Put32(0, bMotorola);
+    }
+    PutFill(0, 256);
+    if (bComplete && !lFar)
+        lSize = (long)uiStrip + uiStripLen;
+} /* MakeTIFF() */
+
+static void MakeGIF(int bComplete)
+{
+    int i, j, iFlags, iWidth, iHeight, iW, iH, bGIF89;
+
+    bGIF89 = Random(0, 1);
+    PutBytes(bGIF89 ? "GIF89a" : "GIF87a", 6);
+    iWidth = Random(1, 4000);
+    iHeight = Random(1, 4000);
+    PutIntel16(iWidth);
+    PutIntel16(iHeight);
+    iFlags = 0x80 | (Random(0, 1) ? 0x40 : 0) | Random(0, 7);
+    PutByte(iFlags);
+    PutByte(0);
+    PutByte(0);
+    if (!bComplete)
+    {
+        PutFill(0, 3*256 + 256);
+        return;
+    }
+    PutFill(0, 3 << ((iFlags & 7) + 1)); // global color table
+    if (bGIF89 && Random(0, 1)) // loop count
+    {
+        PutBytes("\x21\xff\x0bNETSCAPE2.0\x03\x01", 16);
+        PutIntel16(Random(0, 5));
+        PutByte(0);
+    }
+    for (i=Random(1, 6); i>0; i--)
+    {
+        if (bGIF89) // graphic control, with the delay
+        {
+            PutBytes("\x21\xf9\x04\x04", 4);
+            PutIntel16(Random(2, 50));
+            PutByte(0);
+            PutByte(0);
+        }
+        iW = Random(1, iWidth);
+        iH = Random(1, iHeight);
+        PutByte(0x2c);
+        PutIntel16(Random(0, iWidth - iW));
+        PutIntel16(Random(0, iHeight - iH));
+        PutIntel16(iW);
+        PutIntel16(iH);
+        PutByte(Random(0, 3) == 0 ? 0x40 : 0); // interlaced or not
+        PutByte(Random(2, 8)); // LZW minimum code size
+        for (j=Random(1, 8); j>0; j--) // data sub-blocks
+        {
+            iW = Random(1, 255);
+            PutByte(iW);
+            PutFill(Random(0, 0xff), iW);
+        }
+        PutByte(0);
+    }
+    PutByte(0x3b);
+    if (Random(0, 3) == 0) // padded with zeros
+        PutFill(0, Random(1, 100));
+    lSize = iLen;
+} /* MakeGIF() */
+static void MakePPM(void)
+{
+    char szTemp[256];
+    int i, iComments = Random(0, 4);
+
+    iLen = sprintf((char *)ucBuf, "P%d\n", Random(4, 6));
+    for (i=0; i<iComments; i++)
+    {
+        sprintf(szTemp, "# comment %d written by gencorpus\n", Random(0, 99999));
+        PutBytes(szTemp, (int)strlen(szTemp));
+    }
+    sprintf(szTemp, "%d %d\n255\n", Random(1, 30000), Random(1, 30000));
+    PutBytes(szTemp, (int)strlen(szTemp));
+    PutFill(0, 256);
+} /* MakePPM() */
+
+static void MakeTarga(void)
+{
+    static const int iTypes[] = {1, 2, 3, 9, 10, 11};
+
+    PutByte(0); // ID length
+    PutByte(0); // no color map
+    PutByte(iTypes[Random(0, 5)]);
+    PutFill(0, 9);
+    PutIntel16(Random(1, 8000));
+    PutIntel16(Random(1, 8000));
+    PutByte(Random(0, 1) ? 24 : 32);
+    PutByte(0);
+    PutFill(0, 256);
+} /* MakeTarga() */
+
+static void MakeJEDMICS(void)
+{
+    PutIntel32(0x80);
+    PutIntel16(Random(1, 8000)); // height
+    PutIntel16(Random(1, 1000)); // byte width
+    PutFill(0, 28);
+    PutByte(Random(0, 1) ? 4 : 6);
+    PutFill(0, 256);
+} /* MakeJEDMICS() */
+
+static void MakeCALS(void)
+{
+    char szTemp[64];
+
+    PutBytes("srcdocid: gencorpus", 19);
+    PutFill(' ', 2048 - iLen);
+    if (Random(0, 1)) // type 1
+    {
+        ucBuf[750] = '1';
+        sprintf(szTemp, "%d,%d\n", Random(1, 9999), Random(1, 9999));
+        memcpy(&ucBuf[1033], szTemp, strlen(szTemp));
+    }
+    else // type 2
+    {
+        sprintf(szTemp, "rpelcnt: %d,%d\n", Random(1, 9999), Random(1, 9999));
+        memcpy(&ucBuf[1024], szTemp, strlen(szTemp));
+    }
+} /* MakeCALS() */
+
+static void MakePCX(void)
+{
+    PutByte(0x0a);
+    PutByte(5);
+    PutByte(1);
+    PutByte(Random(0, 1) ? 8 : 1); // bits per plane
+    PutIntel16(0);
+    PutIntel16(0);
+    PutIntel16(Random(0, 4000));
+    PutIntel16(Random(0, 4000));
+    PutFill(0, 65 - iLen);
+    PutByte(Random(1, 3)); // planes
+    PutFill(0, 256);
+} /* MakePCX() */
+
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : MakeMember(unsigned char *, char *, int)                   *
+ *                                                                          *
+ *  PURPOSE    : Build a complete PNG, GIF or JPEG for an archive in pOut,  *
+ *               hole and all, and name it.                                 *
+ *                                                                          *
+ *  RETURNS    : Its size.                                                  *
+ *                                                                          *
+ ****************************************************************************/
+static long MakeMember(unsigned char *pOut, char *szName, int iMember)
+{
+    static const char *szExt[] = {"png", "gif", "jpg"};
+    int iKind = Random(0, 2);
+
+    iLen = iTail = 0;
+    lSize = 0;
+    switch (iKind)
+    {
+        case 0: MakePNG(1); break;
+        case 1: MakeGIF(1); break;
+        case 2: MakeJPEG(Random(0, 1), 1); break;
+    }
+    memcpy(pOut, ucBuf, iLen);
+    memset(&pOut[iLen], 0, lSize - iLen - iTail);
+    memcpy(&pOut[lSize - iTail], ucTail, iTail);
+    sprintf(szName, "images/%02d.%s", iMember, szExt[iKind]);
+    return lSize;
+} /* MakeMember() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : WriteSparse(FILE *, unsigned char *, long)                 *
+ *                                                                          *
+ *  PURPOSE    : Write data to an archive, seeking over 4K blocks of zeros  *
+ *               so the holes of the members stay holes.                    *
+ *                                                                          *
+ ****************************************************************************/
+static int WriteSparse(FILE *f, unsigned char *p, long lLen)
+{
+    static const unsigned char ucZeros[4096];
+    long l, lBlock;
+
+    for (l=0; l<lLen; l += lBlock)
+    {
+        lBlock = (lLen - l < (long)sizeof(ucZeros)) ? lLen - l : (long)sizeof(ucZeros);
+        if (lBlock == (long)sizeof(ucZeros) && memcmp(&p[l], ucZeros, lBlock) == 0)
+        {
+            if (fseek(f, lBlock, SEEK_CUR) != 0)
+                return -1;
+        }
+        else if (fwrite(&p[l], 1, lBlock, f) != (size_t)lBlock)
+            return -1;
+    }
+    return 0;
+} /* WriteSparse() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : MakeArchive(char *, int)                                   *
+ *                                                                          *
+ *  PURPOSE    : Write a ustar tar or a zip (members stored or deflated) of *
+ *               a few complete files.                                      *
+ *                                                                          *
+ ****************************************************************************/
+static int MakeArchive(char *szName, int bZip)
+{
+    char szMember[MAX_MEMBERS][32];
+    uLong ulCRC[MAX_MEMBERS];
+    long lMember[MAX_MEMBERS], lComp[MAX_MEMBERS], lOffset[MAX_MEMBERS], lPos = 0;
+    int iMethod[MAX_MEMBERS];
+    unsigned char *pData, *pComp, *p;
+    unsigned int uiSum;
+    int i, j, iMembers, rc = 0;
+    z_stream zs;
+    FILE *f;
+
+    pData = (unsigned char *)malloc(MAX_HEADER + MAX_BODY + MAX_TAIL);
+    pComp = (unsigned char *)malloc(MAX_HEADER + MAX_BODY + MAX_TAIL + 1024);
+    f = fopen(szName, "wb");
+    if (pData == NULL || pComp == NULL || f == NULL)
+    {
+        free(pData);
+        free(pComp);
+        if (f != NULL)
+            fclose(f);
+        return -1;
+    }
+    iMembers = Random(1, MAX_MEMBERS);
+    for (i=0; i<iMembers; i++)
+    {
+        lMember[i] = MakeMember(pData, szMember[i], i);
+        ulCRC[i] = crc32(0, pData, (uInt)lMember[i]);
+        p = pData;
+        lComp[i] = lMember[i];
+        iMethod[i] = 0;
+        if (bZip && Random(0, 1)) // deflated
+        {
+            memset(&zs, 0, sizeof(zs));
+            if (deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            {
+                rc = -1;
+                break;
+            }
+            zs.next_in = pData;
+            zs.avail_in = (uInt)lMember[i];
+            zs.next_out = pComp;
+            zs.avail_out = MAX_HEADER + MAX_BODY + MAX_TAIL + 1024;
+            j = deflate(&zs, Z_FINISH);
+            deflateEnd(&zs);
+            if (j != Z_STREAM_END)
+            {
+                rc = -1;
+                break;
+            }
+            p = pComp;
+            lComp[i] = (long)zs.total_out;
+            iMethod[i] = 8;
+        }
+        iLen = 0;
+        if (bZip) // local header
+        {
+            lOffset[i] = lPos;
+            PutIntel32(0x04034b50);
+            PutIntel16(20); // version needed
+            PutIntel16(0); // flags
+            PutIntel16(iMethod[i]);
+            PutIntel16(0); // time
+            PutIntel16(0x21); // date, 1980-01-01
+            PutIntel32((unsigned int)ulCRC[i]);
+            PutIntel32((unsigned int)lComp[i]);
+            PutIntel32((unsigned int)lMember[i]);
+            PutIntel16((int)strlen(szMember[i]));
+            PutIntel16(0); // extra field
+            PutBytes(szMember[i], (int)strlen(szMember[i]));
+        }
+        else // ustar header
+        {
+            PutFill(0, 512);
+            strcpy((char *)ucBuf, szMember[i]);
+            strcpy((char *)&ucBuf[100], "0000644");
+            strcpy((char *)&ucBuf[108], "0000000");
+            strcpy((char *)&ucBuf[116], "0000000");
+            sprintf((char *)&ucBuf[124], "%011lo", (unsigned long)lMember[i]);
+            sprintf((char *)&ucBuf[136], "%011lo", 1330000000UL);
+            memset(&ucBuf[148], ' ', 8); // the checksum counts as spaces
+            ucBuf[156] = '0';
+            memcpy(&ucBuf[257], "ustar\0" "00", 8);
+            for (j=0, uiSum=0; j<512; j++)
+                uiSum += ucBuf[j];
+            sprintf((char *)&ucBuf[148], "%06o", uiSum);
+            ucBuf[155] = ' ';
+        }
+        if (fwrite(ucBuf, 1, iLen, f) != (size_t)iLen || WriteSparse(f, p, lComp[i]) != 0)
+        {
+            rc = -1;
+            break;
+        }
+        lPos += iLen + lComp[i];
+        if (!bZip && (lComp[i] & 511)) // data padded to a whole block
+        {
+            memset(ucBuf, 0, 512);
+            j = 512 - (int)(lComp[i] & 511);
+            if (fwrite(ucBuf, 1, j, f) != (size_t)j)
+            {
+                rc = -1;
+                break;
+            }
+        }
+    }
+    iLen = 0;
+    if (rc == 0 && bZip) // central directory and end record
+    {
+        for (i=0; i<iMembers; i++)
+        {
+            PutIntel32(0x02014b50);
+            PutIntel16(20); // made by
+            PutIntel16(20); // version needed
+            PutIntel16(0);
+            PutIntel16(iMethod[i]);
+            PutIntel16(0);
+            PutIntel16(0x21);
+            PutIntel32((unsigned int)ulCRC[i]);
+            PutIntel32((unsigned int)lComp[i]);
+            PutIntel32((unsigned int)lMember[i]);
+            PutIntel16((int)strlen(szMember[i]));
+            PutIntel16(0); // extra field
+            PutIntel16(0); // comment
+            PutIntel16(0); // disk
+            PutIntel16(0); // internal attributes
+            PutIntel32(0); // external attributes
+            PutIntel32((unsigned int)lOffset[i]);
+            PutBytes(szMember[i], (int)strlen(szMember[i]));
+        }
+        i = iLen;
+        PutIntel32(0x06054b50);
+        PutIntel16(0);
+        PutIntel16(0);
+        PutIntel16(iMembers);
+        PutIntel16(iMembers);
+        PutIntel32(i); // central directory size
+        PutIntel32((unsigned int)lPos);
+        PutIntel16(0); // comment
+    }
+    else if (rc == 0) // two empty blocks end a tar
+        PutFill(0, 1024);
+    if (rc == 0 && fwrite(ucBuf, 1, iLen, f) != (size_t)iLen)
+        rc = -1;
+    if (fclose(f) != 0)
+        rc = -1;
+    free(pData);
+    free(pComp);
+    return rc;
+} /* MakeArchive() */
+
+// Kinds of files generated; every FILETYPE_xxx has at least one
+static const char *szKinds[] = {"png", "jpg", "exif.jpg", "markers.jpg", "bmp", "os2.bmp", "tif", "gif", "ppm", "tga", "jed", "cal", "pcx", "tar", "zip"};
+#define KIND_COUNT (int)(sizeof(szKinds) / sizeof(szKinds[0]))
+
+int main(int argc, char *argv[])
+{
+    char szName[4096];
+    int i, iKind, iFiles, iPerType = 1000, bComplete, iResult;
+
+    if (argc < 2)
+    {
+        printf("usage: gencorpus <dir> [files per type (default 1000)] [seed]\n");
+        return 0;
+    }
+    if (argc > 2)
+        iPerType = atoi(argv[2]);
+    uiSeed = (argc > 3) ? (unsigned int)strtoul(argv[3], NULL, 0) : 0x12345678;
+    if (uiSeed == 0)
+        uiSeed = 1;
+    if (mkdir(argv[1], 0755) != 0 && errno != EEXIST)
+    {
+        perror(argv[1]);
+        return -1;
+    }
+    iFiles = 0;
+    for (i=0; i<iPerType; i++)
+    {
+        bComplete = (i % 4 == 1); // the second of every four
+        for (iKind=0; iKind<KIND_COUNT; iKind++, iFiles++)
+        {
+            if (iFiles % FILES_PER_DIR == 0) // start a new subdirectory
+            {
+                snprintf(szName, sizeof(szName), "%s/%04d", argv[1], iFiles / FILES_PER_DIR);
+                if (mkdir(szName, 0755) != 0 && errno != EEXIST)
+                {
+                    perror(szName);
+                    return -1;
+                }
+            }
+            snprintf(szName, sizeof(szName), "%s/%04d/%06d.%s", argv[1], iFiles / FILES_PER_DIR, iFiles, szKinds[iKind]);
+            iLen = iTail = 0;
+            lSize = lFar = 0;
+            switch (iKind)
+            {
+                case 0: MakePNG(bComplete); break;
+                case 1: MakeJPEG(0, bComplete); break;
+                case 2: MakeJPEG(1, bComplete); break;
+                case 3: MakeJPEG(2, bComplete); break;
+                case 4: MakeBMP(0); break;
+                case 5: MakeBMP(1); break;
+                case 6: MakeTIFF(bComplete); break;
+                case 7: MakeGIF(bComplete); break;
+                case 8: MakePPM(); break;
+                case 9: MakeTarga(); break;
+                case 10: MakeJEDMICS(); break;
+                case 11: MakeCALS(); break;
+                case 12: MakePCX(); break;
+            }
+            if (iKind >= 13) // archives are written whole
+                iResult = MakeArchive(szName, iKind == 14);
+            else
+            {
+                if (lSize == 0)
+                    lSize = FileSize();
+                iResult = WriteFile(szName);
+            }
+            if (iResult != 0)
+            {
+                perror(szName);
+                return -1;
+            }
+        }
+    }
+    printf("%d files written to %s\n", iFiles, argv[1]);
+    return 0;
+} /* main() */
@@ -0,0 +1,215 @@
+//
+//  stream.c
+//
+// Microbenchmark of the push parser (imageinfo_stream_xxx). A few files
+// which make it collect many separate pieces (JPEGs with split ICC
+// profiles in large APP2 segments, a TIFF whose IFD is far from the
+// header) are built in memory and pushed in chunks of several sizes, with
+// and without the file size; every result must agree with
+// imageinfo_probe_buffer.
+//
+// usage: stream [passes]
+//
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "imageinfo.h"
+
+#define MAX_FILE 0x200000   // biggest file we build
+#define ICC_SEG_LEN 20000   // more than the parser's JPEG marker window
+
+static unsigned char ucBuf[MAX_FILE];
+static int iLen; // bytes in ucBuf
+
+static const int iChunks[] = {13, 4096, 65536, MAX_FILE};
+#define CHUNK_COUNT (int)(sizeof(iChunks) / sizeof(iChunks[0]))
+
+static void PutByte(int i)
+{
+    ucBuf[iLen++] = (unsigned char)i;
+}
+static void PutMoto16(int i)
+{
+    PutByte(i >> 8); PutByte(i);
+}
+static void PutIntel16(int i)
+{
+    PutByte(i); PutByte(i >> 8);
+}
+static void PutIntel32(unsigned int i)
+{
+    PutIntel16(i & 0xffff); PutIntel16(i >> 16);
+}
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : MakeJPEG(int)                                              *
+ *                                                                          *
+ *  PURPOSE    : A JPEG whose ICC profile is split over iSegs APP2          *
+ *               segments ahead of the frame header.                        *
+ *                                                                          *
+ ****************************************************************************/
+static void MakeJPEG(int iSegs)
+{
+    int i;
+
+    iLen = 0;
+    PutMoto16(0xffd8);
+    PutMoto16(0xffe0); // JFIF
+    PutMoto16(16);
+    memcpy(&ucBuf[iLen], "JFIF\0\1\1\0\0\1\0\1\0\0", 14);
+    iLen += 14;
+    for (i=0; i<iSegs; i++)
+    {
+        PutMoto16(0xffe2);
+        PutMoto16(ICC_SEG_LEN);
+        memcpy(&ucBuf[iLen], "ICC_PROFILE", 12);
+        iLen += 12;
+        PutByte(i + 1); // sequence number
+        PutByte(iSegs);
+        memset(&ucBuf[iLen], 0x55, ICC_SEG_LEN - 16);
+        iLen += ICC_SEG_LEN - 16;
+    }
+    PutMoto16(0xffdb); // quantization table
+    PutMoto16(67);
+    PutByte(0);
+    for (i=0; i<64; i++)
+        PutByte(i + 1);
+    PutMoto16(0xffc2); // progressive
+    PutMoto16(17);
+    PutByte(8);
+    PutMoto16(480);
+    PutMoto16(640);
+    PutByte(3);
+    PutByte(1); PutByte(0x22); PutByte(0);
+    PutByte(2); PutByte(0x11); PutByte(1);
+    PutByte(3); PutByte(0x11); PutByte(1);
+    PutMoto16(0xffda);
+    memset(&ucBuf[iLen], 0, 64);
+    iLen += 64;
+    PutMoto16(0xffd9);
+} /* MakeJPEG() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : MakeTIFF(void)                                             *
+ *                                                                          *
+ *  PURPOSE    : An Intel order TIFF with its IFD 1MB into the file.        *
+ *                                                                          *
+ ****************************************************************************/
+static void MakeTIFF(void)
+{
+    int iIFD = 0x100000;
+
+    memset(ucBuf, 0, iIFD);
+    iLen = 0;
+    PutByte('I'); PutByte('I');
+    PutIntel16(42);
+    PutIntel32(iIFD);
+    iLen = iIFD;
+    PutIntel16(5);
+    PutIntel16(256); PutIntel16(3); PutIntel32(1); PutIntel32(1200); // width
+    PutIntel16(257); PutIntel16(3); PutIntel32(1); PutIntel32(900);  // height
+    PutIntel16(258); PutIntel16(3); PutIntel32(1); PutIntel32(8);    // bits
+    PutIntel16(259); PutIntel16(3); PutIntel32(1); PutIntel32(1);    // none
+    PutIntel16(262); PutIntel16(3); PutIntel32(1); PutIntel32(1);    // gray
+    PutIntel32(0);
+} /* MakeTIFF() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : StreamFile(int, int, ImageInfo *)                          *
+ *                                                                          *
+ *  PURPOSE    : Push ucBuf to a new stream iChunk bytes at a time, telling *
+ *               it the file size if bSize is set.                          *
+ *                                                                          *
+ *  RETURNS    : The stream's result.                                       *
+ *                                                                          *
+ ****************************************************************************/
+static int StreamFile(int iChunk, int bSize, ImageInfo *pInfo)
+{
+    ImageInfoStream *pStream;
+    int i, iCount, iResult = IMAGEINFO_NEED_MORE;
+
+    pStream = imageinfo_stream_new(bSize ? (uint64_t)iLen : 0);
+    if (pStream == NULL)
+        return IMAGEINFO_IO_ERROR;
+    for (i=0; i<iLen && iResult == IMAGEINFO_NEED_MORE; i += iCount)
+    {
+        iCount = (iLen - i < iChunk) ? iLen - i : iChunk;
+        iResult = imageinfo_stream_push(pStream, &ucBuf[i], iCount, pInfo);
+    }
+    if (iResult == IMAGEINFO_NEED_MORE)
+        iResult = imageinfo_stream_push(pStream, NULL, 0, pInfo);
+    imageinfo_stream_free(pStream);
+    return iResult;
+} /* StreamFile() */
+
+int main(int argc, char *argv[])
+{
+    static const int iSegs[] = {4, 12, 60};
+    ImageInfo info, expected;
+    int i, iFile, iChunk, iSize, iPass, iPasses = 20, iResult, iExpected;
+    char szName[32];
+    struct timespec ts0, ts1;
+    double dSeconds;
+
+    if (argc > 1)
+        iPasses = atoi(argv[1]);
+    if (iPasses < 1)
+        iPasses = 1;
+    printf("%-16s %8s %12s\n", "file", "chunk", "us/stream");
+    for (iFile=0; iFile<=3; iFile++)
+    {
+        if (iFile < 3)
+        {
+            MakeJPEG(iSegs[iFile]);
+            snprintf(szName, sizeof(szName), "jpeg %d x APP2", iSegs[iFile]);
+        }
+        else
+        {
+            MakeTIFF();
+            strcpy(szName, "tiff far IFD");
+        }
+        iExpected = imageinfo_probe_buffer(ucBuf, iLen, &expected);
+        if (iExpected != IMAGEINFO_SUCCESS)
+        {
+            fprintf(stderr, "%s - probe failed (%d)\n", szName, iExpected);
+            return -1;
+        }
+        for (iChunk=0; iChunk<CHUNK_COUNT; iChunk++)
+        {
+            for (iSize=1; iSize>=0; iSize--) // known, then unknown size
+            {
+                iResult = StreamFile(iChunks[iChunk], iSize, &info);
+                if (iResult != iExpected || info.iType != expected.iType || info.iWidth != expected.iWidth || info.iHeight != expected.iHeight || info.iBpp != expected.iBpp || info.iQuality != expected.iQuality)
+                {
+                    fprintf(stderr, "%s - stream in %d byte chunks (%s size) differs: result %d, %d x %d\n", szName, iChunks[iChunk], iSize ? "known" : "unknown", iResult, info.iWidth, info.iHeight);
+                    return -1;
+                }
+            }
+            clock_gettime(CLOCK_MONOTONIC, &ts0);
+            for (iPass=0; iPass<iPasses; iPass++)
+                StreamFile(iChunks[iChunk], 1, &info);
+            clock_gettime(CLOCK_MONOTONIC, &ts1);
+            dSeconds = (double)(ts1.tv_sec - ts0.tv_sec) + (double)(ts1.tv_nsec - ts0.tv_nsec) / 1e9;
+            i = iChunks[iChunk] < iLen ? iChunks[iChunk] : iLen;
+            printf("%-16s %8d %12.1f\n", szName, i, dSeconds * 1e6 / iPasses);
+        }
+    }
+    return 0;
+} /* main() */
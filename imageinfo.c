@@ -0,0 +1,2168 @@
+/****************************************************************************
+ *                                                                          *
+ * MODULE:  IMAGEINFO.C                                                     *
+ *                                                                          *
+ * DESCRIPTION: Image file information library. Detects the file type      *
+ *              and gathers the size, bit depth and compression of an       *
+ *              image without decoding it. Results are returned in an       *
+ *              ImageInfo structure; nothing is displayed. The only global  *
+ *              state is the table of file type signatures, so once any     *
+ *              extra ones are registered it is safe to call from several   *
+ *              threads.                                                    *
+ *                                                                          *
+ * FUNCTIONS:                                                               *
+ *            imageinfo_probe_buffer - Probe a file already in memory       *
+ *            imageinfo_probe_prefix - Probe the start of a file in memory  *
+ *            imageinfo_probe_fd - Probe an open file descriptor            *
+ *            imageinfo_probe_handle - Probe a PILIO handle                 *
+ *            imageinfo_probe_handle_type - Same, type already classified   *
+ *            imageinfo_tiff_pages - Walk all of the pages of a TIFF        *
+ *            imageinfo_jpeg_scans - Count the scans of a JPEG              *
+ *            imageinfo_gif_frames - Walk the frames of an animated GIF     *
+ *            imageinfo_png_chunks - Walk the chunks of a PNG               *
+ *            imageinfo_check_complete - See if a file was cut short        *
+ *            imageinfo_stream_xxx - Push parser for streams and pipes      *
+ *            imageinfo_xxx_name - Names of the enumerated values           *
+ * COMMENTS:                                                                *
+ *            Split out of main.c so the parser can be embedded             *
+ ****************************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#include "my_windows.h"
+#include <stdlib.h>
+#include <string.h>
+#include "pil_io.h"
+#include "imageinfo.h"
+#include "imageinfo_sig.h"
+#include "pil_crc.h"
+
+#define TEMP_BUF_SIZE 4096
+#define DEFAULT_READ_SIZE 256
+#define MAX_TAGS 256
+#define TIFF_TAGSIZE 12
+#define BIGTIFF_TAGSIZE 20
+#define TIFF_MAX_BPP 0xffff /* more bits per pixel than this means a damaged tag */
+#define JPEG_WINDOW_SIZE 16384
+#define JPEG_SCAN_SIZE 65536 /* reads while skipping entropy coded data */
+// Start of frame: 0xffc0-0xffcf except DHT (c4), JPG (c8) and DAC (cc)
+#define JPEG_IS_SOF(m) (((m) & 0xfff0) == 0xffc0 && (m) != 0xffc4 && (m) != 0xffc8 && (m) != 0xffcc)
+#define UNKNOWN_FILE_SIZE ((PILOffset)1 << 48) /* streams of unknown length */
+#define TIFF_TAIL_ENTRIES 64 /* strips read from the end of the lists */
+#define TIFF_HASH(ll) ((unsigned int)((ll) ^ ((ll) >> 32)) * 2654435761U)
+#define STREAM_MAX_MERGE 0x1000000 /* gap a stream collects once it's out of pieces */
+
+static const char *szJPEGTypes[] = {"BASELINE", "EXTENDED", "PROGRESSIVE", "LOSSLESS"};
+static const char *szType[] = {"Unknown", "PNG","JFIF","Win BMP","OS/2 BMP","TIFF","GIF","Portable Pixmap","Targa","JEDMICS","CALS","PCX"};
+static const char *szComp[] = {"Unknown", "Flate","JPEG","None","RLE","LZW","G3","G4","Packbits","Modified Huffman","Thunderscan RLE","JBIG (T.85)"};
+static const char *szPhotometric[] = {"WhiteIsZero","BlackIsZero","RGB","Palette Color","Transparency Mask","CMYK","YCbCr","Unknown"};
+static const char *szPlanar[] = {"Unknown","Chunky","Planar"};
+
+// The IJG (libjpeg) luminance and chrominance quantization tables for
+// quality 50, in the zigzag order they are stored in a DQT segment
+static const unsigned char ucIJGTables[2][64] = {
+   {16,11,12,14,12,10,16,14,13,14,18,17,16,19,24,40,
+    26,24,22,22,24,49,35,37,29,40,58,51,61,60,57,51,
+    56,55,64,72,92,78,64,68,87,69,55,56,80,109,81,87,
+    95,98,103,104,103,62,77,113,121,112,100,120,92,101,103,99},
+   {17,18,18,24,21,24,47,26,26,47,99,66,56,66,99,99,
+    99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,
+    99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,
+    99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99}};
+
+// A large window onto a file for walks which cover most of it; in place
+// for mapped and memory handles, otherwise read into pBuf
+typedef struct tagFileWindow
+{
+    unsigned char *pData;   // file data at llStart
+    PILOffset llStart;
+    int iLen;               // valid bytes at pData
+    int iReadSize;          // bytes to read at a time, up to JPEG_SCAN_SIZE
+    unsigned char *pBuf;    // JPEG_SCAN_SIZE bytes
+} FILE_WINDOW;
+
+// Quantization tables 0 and 1 of a JPEG, as far as the DQT segments go
+typedef struct tagJPEGTables
+{
+    int iHave;          // bit n set = table n was defined
+    int i16Bit;         // bit n set = table n has 16-bit values
+    unsigned short usTable[2][64];
+} JPEG_TABLES;
+
+// Geometry from the tags of one TIFF IFD
+typedef struct tagTIFFIFD
+{
+    int iWidth;
+    int iHeight;
+    int iBpp;
+    int iCompression;
+    int iPhotometric;
+    int iPlanar;
+    uint64_t ullStrips[2];      // StripOffsets (or TileOffsets) and StripByteCounts,
+    uint64_t ullStripCount[2];  // as in ImageInfo
+    int iStripSize[2];
+} TIFF_IFD;
+
+// A piece of a stream which the parser asked for
+typedef struct tagStreamPiece
+{
+    uint64_t ullOffset;     // file offset of pData[0]
+    unsigned long ulLen;    // bytes received so far
+    unsigned long ulAlloc;
+    unsigned char *pData;
+} STREAM_PIECE;
+
+struct tagImageInfoStream
+{
+    uint64_t ullFileSize;      // 0 until known
+    uint64_t ullPos;           // number of bytes pushed so far
+    uint64_t ullWantStart;     // range the parser is waiting for
+    uint64_t ullWantEnd;
+    int iResult;               // IMAGEINFO_NEED_MORE until we're done
+    int iPieceCount;
+    STREAM_PIECE pieces[PILIO_MAX_SEGS];
+    ImageInfo info;
+};
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TIFFSHORT(char *, BOOL)                                    *
+ *                                                                          *
+ *  PURPOSE    : Retrieve a short value from a TIFF tag.                    *
+ *                                                                          *
+ ****************************************************************************/
+static unsigned short TIFFSHORT(unsigned char *p, BOOL bMotorola)
+{
+    unsigned short s;
+    
+    if (bMotorola)
+        s = *p * 0x100 + *(p+1);
+    else
+        s = *p + *(p+1)*0x100;
+    
+    return s;
+} /* TIFFSHORT() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TIFFLONG(char *, BOOL)                                     *
+ *                                                                          *
+ *  PURPOSE    : Retrieve a long value from a TIFF tag.                     *
+ *                                                                          *
+ ****************************************************************************/
+static uint32_t TIFFLONG(unsigned char *p, BOOL bMotorola)
+{
+    uint32_t l;
+    
+    if (bMotorola)
+        l = (uint32_t)*p * 0x1000000 + *(p+1) * 0x10000 + *(p+2) * 0x100 + *(p+3);
+    else
+        l = *p + *(p+1) * 0x100 + *(p+2) * 0x10000 + (uint32_t)*(p+3) * 0x1000000;
+    
+    return l;
+} /* TIFFLONG() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TIFFLONG64(char *, BOOL)                                   *
+ *                                                                          *
+ *  PURPOSE    : Retrieve a 64-bit value from a BigTIFF tag or header.      *
+ *                                                                          *
+ ****************************************************************************/
+static uint64_t TIFFLONG64(unsigned char *p, BOOL bMotorola)
+{
+    if (bMotorola)
+        return ((uint64_t)TIFFLONG(p, TRUE) << 32) | TIFFLONG(p+4, TRUE);
+    else
+        return ((uint64_t)TIFFLONG(p+4, FALSE) << 32) | TIFFLONG(p, FALSE);
+} /* TIFFLONG64() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TIFFOFFSET(char *, BOOL, BOOL)                             *
+ *                                                                          *
+ *  PURPOSE    : Retrieve a file offset (32-bits, or 64-bits in BigTIFF).   *
+ *               Offsets too large to be real come back negative.           *
+ *                                                                          *
+ ****************************************************************************/
+static PILOffset TIFFOFFSET(unsigned char *p, BOOL bMotorola, BOOL bBig)
+{
+    if (bBig)
+        return (PILOffset)TIFFLONG64(p, bMotorola);
+    return (PILOffset)TIFFLONG(p, bMotorola);
+} /* TIFFOFFSET() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TIFFCOUNT(char *, BOOL, BOOL)                              *
+ *                                                                          *
+ *  PURPOSE    : Retrieve the tag count of an IFD (a short, or a 64-bit     *
+ *               value in BigTIFF which is limited to the same range).      *
+ *                                                                          *
+ ****************************************************************************/
+static int TIFFCOUNT(unsigned char *p, BOOL bMotorola, BOOL bBig)
+{
+    uint64_t ullCount;
+
+    if (!bBig)
+        return TIFFSHORT(p, bMotorola);
+    ullCount = TIFFLONG64(p, bMotorola);
+    return (ullCount > 0xffff) ? 0xffff : (int)ullCount;
+} /* TIFFCOUNT() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TIFFVALUE(char *, BOOL, BOOL)                              *
+ *                                                                          *
+ *  PURPOSE    : Retrieve the value from a TIFF tag. BigTIFF tags have an   *
+ *               8 byte count and an 8 byte value (or offset) field.        *
+ *                                                                          *
+ ****************************************************************************/
+static int TIFFVALUE(unsigned char *p, BOOL bMotorola, BOOL bBig)
+{
+    int i, iType;
+    unsigned char *pValue = bBig ? p+12 : p+8;
+    
+    iType = TIFFSHORT(p+2, bMotorola);
+    /* If pointer to a list of items, must be a long */
+    if (bBig ? (TIFFLONG64(p+4, bMotorola) > 1) : (TIFFSHORT(p+4, bMotorola) > 1))
+        iType = bBig ? 16 : 4;
+    switch (iType)
+    {
+        case 3: /* Short */
+            i = TIFFSHORT(pValue, bMotorola);
+            break;
+        case 4: /* Long */
+        case 7: // undefined (treat it as a long since it's usually a multibyte buffer)
+            i = TIFFLONG(pValue, bMotorola);
+            break;
+        case 6: // signed byte
+            i = (signed char)pValue[0];
+            break;
+        case 2: /* ASCII */
+        case 5: /* Unsigned Rational */
+        case 10: /* Signed Rational */
+            i = TIFFLONG(pValue, bMotorola);
+            break;
+        case 16: // BigTIFF long8
+        case 17: // signed long8
+        case 18: // IFD8
+            i = (int)TIFFLONG64(pValue, bMotorola);
+            break;
+        default: /* to suppress compiler warning */
+            i = 0;
+            break;
+    }
+    return i;
+    
+} /* TIFFVALUE() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ParseNumber(char *, int *)                                 *
+ *                                                                          *
+ *  PURPOSE    : Read the ascii string and convert to a number.             *
+ *                                                                          *
+ ****************************************************************************/
+static int ParseNumber(unsigned char *buf, int *iOff, int iLength)
+{
+    int i, iOffset;
+    
+    i = 0;
+    iOffset = *iOff;
+    
+    while (iOffset < iLength && buf[iOffset] >= '0' && buf[iOffset] <= '9')
+    {
+        i *= 10;
+        i += (int)(buf[iOffset++] - '0');
+    }
+    *iOff = iOffset+1; /* Skip ending char */
+    return i;
+    
+} /* ParseNumber() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ReadBlock(void *, unsigned char *, int, PILOffset,         *
+ *                         PILOffset, int, unsigned char *, int *)          *
+ *                                                                          *
+ *  PURPOSE    : Return a pointer to iLen bytes at llOffset in the file.    *
+ *               If the header buffer or a memory mapping already holds     *
+ *               them they are used in place (no system call or copy),      *
+ *               otherwise they are read into pTemp. *piBytes receives the  *
+ *               number of bytes available.                                 *
+ *                                                                          *
+ ****************************************************************************/
+static unsigned char * ReadBlock(void *iHandle, unsigned char *pHeader, int iHeaderLen, PILOffset llFileSize, PILOffset llOffset, int iLen, unsigned char *pTemp, int *piBytes)
+{
+    unsigned char *p;
+    
+    if (llOffset >= 0 && llOffset < iHeaderLen && (llOffset + iLen <= iHeaderLen || iHeaderLen >= llFileSize))
+    {
+        *piBytes = (llOffset + iLen <= iHeaderLen) ? iLen : iHeaderLen - (int)llOffset; // whole file is in the header
+        return &pHeader[llOffset];
+    }
+    if (llOffset < 0)
+    {
+        *piBytes = 0;
+        return pTemp;
+    }
+    p = PILIOData(iHandle, llOffset, iLen, piBytes); // mapped or memory handle?
+    if (p != NULL && (*piBytes == iLen || llOffset + *piBytes >= llFileSize))
+        return p;
+    PILIOSeek(iHandle, llOffset, 0);
+    *piBytes = PILIORead(iHandle, pTemp, iLen);
+    return pTemp;
+} /* ReadBlock() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TIFFReadIFD(void *, PILOffset, int, PILOffset, ...)        *
+ *                                                                          *
+ *  PURPOSE    : Return iLen bytes of the file at llOffset, in place if the *
+ *               handle is mapped or in memory, otherwise read into pTemp.  *
+ *               *piBytes receives the number of bytes available.           *
+ *                                                                          *
+ ****************************************************************************/
+static unsigned char * TIFFReadIFD(void *iHandle, PILOffset llOffset, int iLen, PILOffset llFileSize, unsigned char *pTemp, int *piBytes)
+{
+    unsigned char *p;
+
+    if (iLen > llFileSize - llOffset)
+        iLen = (int)(llFileSize - llOffset);
+    p = PILIOData(iHandle, llOffset, iLen, piBytes);
+    if (p != NULL && *piBytes >= iLen)
+        return p;
+    PILIOSeek(iHandle, llOffset, 0);
+    *piBytes = PILIORead(iHandle, pTemp, iLen);
+    if (*piBytes < 0)
+        *piBytes = 0;
+    return pTemp;
+} /* TIFFReadIFD() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TIFFParseTags(void *, unsigned char *, int, PILOffset, ...) *
+ *                                                                          *
+ *  PURPOSE    : Gather the image geometry from the tags of one IFD.        *
+ *               pData points to the first of iTags tags (BigTIFF tags if   *
+ *               bBig); values stored elsewhere are read with ReadBlock()   *
+ *               (the header is cBuf, iHeaderBytes long). Where the strip   *
+ *               or tile lists are is kept for imageinfo_check_complete().  *
+ *                                                                          *
+ ****************************************************************************/
+static void TIFFParseTags(void *iHandle, unsigned char *cBuf, int iHeaderBytes, PILOffset llFileSize, unsigned char *pData, int iTags, BOOL bMotorola, BOOL bBig, TIFF_IFD *pIFD)
+{
+    unsigned char cBPS[2];
+    int i, k, iOffset, iMarker, iBytes;
+    uint64_t ullCount, ullBpp;
+    PILOffset llList;
+
+    // Some TIFF files don't specify everything, so set up some default values
+    pIFD->iWidth = pIFD->iHeight = 0;
+    pIFD->iBpp = 1;
+    pIFD->iPlanar = 1;
+    pIFD->iCompression = COMPTYPE_NONE;
+    pIFD->iPhotometric = 7; // if not specified, set to "unknown"
+    pIFD->ullStrips[0] = pIFD->ullStrips[1] = pIFD->ullStripCount[0] = pIFD->ullStripCount[1] = 0;
+    pIFD->iStripSize[0] = pIFD->iStripSize[1] = 0;
+    iOffset = 0;
+    // Each TIFF tag is made up of 12 bytes
+    // byte 0-1: Tag value (short)
+    // byte 2-3: data type (short)
+    // byte 4-7: number of values (long)
+    // byte 8-11: value or offset to list of values
+    // BigTIFF tags are 20 bytes, with an 8 byte count at 4 and an 8 byte
+    // value or offset at 12
+    for (i=0; i<iTags; i++) // search tags for the info we care about
+    {
+        iMarker = TIFFSHORT(&pData[iOffset], bMotorola); // get the TIFF tag
+        switch (iMarker) // only read the tags we care about...
+        {
+            case 256: // image width
+                pIFD->iWidth = TIFFVALUE(&pData[iOffset], bMotorola, bBig);
+                break;
+            case 257: // image length
+                pIFD->iHeight = TIFFVALUE(&pData[iOffset], bMotorola, bBig);
+                break;
+            case 258: // bits per sample
+                ullCount = bBig ? TIFFLONG64(&pData[iOffset+4], bMotorola) : TIFFLONG(&pData[iOffset+4], bMotorola); /* Get the count */
+                ullBpp = 0;
+                if (ullCount == 1)
+                    pIFD->iBpp = TIFFVALUE(&pData[iOffset], bMotorola, bBig);
+                else if (ullCount > 0xffff) // SamplesPerPixel is a short, the count is damaged
+                    break;
+                else if (bBig && ullCount <= 4) // up to 4 shorts fit in the tag
+                    ullBpp = ullCount * TIFFSHORT(&pData[iOffset+12], bMotorola);
+                else // need to read the first value from the list (they should all be equal)
+                {
+                    llList = TIFFOFFSET(&pData[iOffset + (bBig ? 12 : 8)], bMotorola, bBig);
+                    if (llList < llFileSize)
+                    {
+                        unsigned char *pBPS = ReadBlock(iHandle, cBuf, iHeaderBytes, llFileSize, llList, 2, cBPS, &iBytes);
+                        if (iBytes == 2)
+                            ullBpp = ullCount * TIFFSHORT(pBPS, bMotorola);
+                    }
+                }
+                if (ullBpp != 0 && ullBpp <= TIFF_MAX_BPP) // in 64 bits so a damaged value can't wrap
+                    pIFD->iBpp = (int)ullBpp;
+                break;
+            case 259: // compression
+                k = TIFFVALUE(&pData[iOffset], bMotorola, bBig);
+                if (k == 1)
+                    pIFD->iCompression = COMPTYPE_NONE;
+                else if (k == 2)
+                    pIFD->iCompression = COMPTYPE_HUFFMAN;
+                else if (k == 3)
+                    pIFD->iCompression = COMPTYPE_G3;
+                else if (k == 4)
+                    pIFD->iCompression = COMPTYPE_G4;
+                else if (k == 5)
+                    pIFD->iCompression = COMPTYPE_LZW;
+                else if (k == 6 || k == 7)
+                    pIFD->iCompression = COMPTYPE_JPEG;
+                else if (k == 8 || k == 32946)
+                    pIFD->iCompression = COMPTYPE_FLATE;
+                else if (k == 9)
+                    pIFD->iCompression = COMPTYPE_JBIG;
+                else if (k == 32773)
+                    pIFD->iCompression = COMPTYPE_PACKBITS;
+                else if (k == 32809)
+                    pIFD->iCompression = COMPTYPE_THUNDERSCAN;
+                else
+                    pIFD->iCompression = COMPTYPE_UNKNOWN;
+                break;
+            case 262: // photometric value
+                pIFD->iPhotometric = TIFFVALUE(&pData[iOffset], bMotorola, bBig);
+                if (pIFD->iPhotometric > 6)
+                    pIFD->iPhotometric = 7; // unknown
+                break;
+            case 284: // planar/chunky
+                pIFD->iPlanar = TIFFVALUE(&pData[iOffset], bMotorola, bBig);
+                if (pIFD->iPlanar < 1 || pIFD->iPlanar > 2) // unknown value
+                    pIFD->iPlanar = 0; // unknown
+                break;
+            case 273: // strip offsets
+            case 279: // strip byte counts
+            case 324: // tile offsets
+            case 325: // tile byte counts
+                k = (iMarker == 273 || iMarker == 324) ? 0 : 1;
+                pIFD->iStripSize[k] = TIFFSHORT(&pData[iOffset+2], bMotorola); // type
+                pIFD->iStripSize[k] = (pIFD->iStripSize[k] == 3) ? 2 : (pIFD->iStripSize[k] == 4 || pIFD->iStripSize[k] == 13) ? 4 : 8;
+                pIFD->ullStripCount[k] = bBig ? TIFFLONG64(&pData[iOffset+4], bMotorola) : TIFFLONG(&pData[iOffset+4], bMotorola);
+                pIFD->ullStrips[k] = 0;
+                if (pIFD->ullStripCount[k] * pIFD->iStripSize[k] <= (uint64_t)(bBig ? 8 : 4)) // the values are in the tag
+                    memcpy(&pIFD->ullStrips[k], &pData[iOffset + (bBig ? 12 : 8)], bBig ? 8 : 4);
+                else
+                    pIFD->ullStrips[k] = (uint64_t)TIFFOFFSET(&pData[iOffset + (bBig ? 12 : 8)], bMotorola, bBig);
+                break;
+        } // switch on tiff tag
+        iOffset += bBig ? BIGTIFF_TAGSIZE : TIFF_TAGSIZE;
+    } // for each tag
+} /* TIFFParseTags() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : JPEGBlock(void *, unsigned char *, int, PILOffset, ...)    *
+ *                                                                          *
+ *  PURPOSE    : Return iLen bytes of the file at llOffset, in place if     *
+ *               they are inside the JPEG marker window (pWin, iWinLen      *
+ *               bytes at file offset llWinStart), otherwise with           *
+ *               TIFFReadIFD(). *piBytes receives the number available.     *
+ *                                                                          *
+ ****************************************************************************/
+static unsigned char * JPEGBlock(void *iHandle, unsigned char *pWin, int iWinLen, PILOffset llWinStart, PILOffset llOffset, int iLen, PILOffset llFileSize, unsigned char *pTemp, int *piBytes)
+{
+    if (llOffset >= llWinStart && llOffset + iLen <= llWinStart + iWinLen)
+    {
+        *piBytes = iLen;
+        return &pWin[llOffset - llWinStart];
+    }
+    return TIFFReadIFD(iHandle, llOffset, iLen, llFileSize, pTemp, piBytes);
+} /* JPEGBlock() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : EXIFParseIFD(void *, unsigned char *, int, PILOffset, ...) *
+ *                                                                          *
+ *  PURPOSE    : Gather what we want from one IFD of the TIFF structure in  *
+ *               an APP1 Exif segment. The TIFF header is at file offset    *
+ *               llTIFF and the IFD at uiIFD from there; nothing outside    *
+ *               the iTIFFLen bytes of the segment is used. iIFD is 0 for   *
+ *               IFD0, 1 for the Exif IFD and 2 for IFD1 (the thumbnail).   *
+ *                                                                          *
+ *  RETURNS    : Offset of the next IFD in the chain, 0 if none.            *
+ *                                                                          *
+ ****************************************************************************/
+static uint32_t EXIFParseIFD(void *iHandle, unsigned char *pWin, int iWinLen, PILOffset llWinStart, PILOffset llTIFF, int iTIFFLen, PILOffset llFileSize, uint32_t uiIFD, int iIFD, BOOL bMotorola, uint32_t *puiExifIFD, ImageInfo *pInfo)
+{
+    unsigned char cIFD[2 + MAX_TAGS*TIFF_TAGSIZE + 4];
+    unsigned char *p;
+    int i, iTags, iLen, iBytes;
+    uint32_t uiThumb = 0, uiThumbLen = 0;
+
+    if (uiIFD < 8 || uiIFD + 2 > (uint32_t)iTIFFLen)
+        return 0;
+    p = JPEGBlock(iHandle, pWin, iWinLen, llWinStart, llTIFF + uiIFD, 2, llFileSize, cIFD, &iBytes);
+    if (iBytes < 2)
+        return 0;
+    iTags = TIFFSHORT(p, bMotorola);
+    if (iTags > MAX_TAGS)
+        iTags = MAX_TAGS;
+    iLen = 2 + iTags*TIFF_TAGSIZE + 4; // tags and the next IFD offset
+    if (iLen > iTIFFLen - (int)uiIFD)
+        iLen = iTIFFLen - (int)uiIFD;
+    p = JPEGBlock(iHandle, pWin, iWinLen, llWinStart, llTIFF + uiIFD, iLen, llFileSize, cIFD, &iBytes);
+    if (iTags > (iBytes - 2) / TIFF_TAGSIZE) // don't walk past what we have
+        iTags = (iBytes - 2) / TIFF_TAGSIZE;
+    for (i=0; i<iTags; i++)
+    {
+        unsigned char *pTag = &p[2 + i*TIFF_TAGSIZE];
+        switch (TIFFSHORT(pTag, bMotorola))
+        {
+            case 0x0112: // orientation
+                if (iIFD == 0)
+                    pInfo->iOrientation = TIFFVALUE(pTag, bMotorola, FALSE);
+                break;
+            case 0x8769: // Exif IFD pointer
+                if (iIFD == 0)
+                    *puiExifIFD = TIFFLONG(&pTag[8], bMotorola);
+                break;
+            case 0xa002: // PixelXDimension
+                if (iIFD == 1)
+                    pInfo->iExifWidth = TIFFVALUE(pTag, bMotorola, FALSE);
+                break;
+            case 0xa003: // PixelYDimension
+                if (iIFD == 1)
+                    pInfo->iExifHeight = TIFFVALUE(pTag, bMotorola, FALSE);
+                break;
+            case 0x0201: // JPEGInterchangeFormat
+                if (iIFD == 2)
+                    uiThumb = TIFFLONG(&pTag[8], bMotorola);
+                break;
+            case 0x0202: // JPEGInterchangeFormatLength
+                if (iIFD == 2)
+                    uiThumbLen = TIFFLONG(&pTag[8], bMotorola);
+                break;
+        }
+    }
+    if (pInfo->iOrientation < 1 || pInfo->iOrientation > 8) // not a valid value
+        pInfo->iOrientation = 0;
+    // the thumbnail has to be inside the segment
+    if (uiThumb >= 8 && uiThumbLen > 0 && uiThumb < (uint32_t)iTIFFLen && uiThumbLen <= (uint32_t)iTIFFLen - uiThumb)
+    {
+        pInfo->ullThumbOffset = (uint64_t)(llTIFF + uiThumb);
+        pInfo->uiThumbLen = uiThumbLen;
+    }
+    if (iBytes < 2 + iTags*TIFF_TAGSIZE + 4)
+        return 0;
+    return TIFFLONG(&p[2 + iTags*TIFF_TAGSIZE], bMotorola);
+} /* EXIFParseIFD() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : JPEGParseEXIF(void *, unsigned char *, int, ...)           *
+ *                                                                          *
+ *  PURPOSE    : Parse the APP1 Exif segment at pWin[i] (the JPEG marker    *
+ *               window, iWinLen bytes at file offset llWinStart) for the   *
+ *               orientation, the capture size and where the embedded       *
+ *               thumbnail is. The IFDs are normally inside the window      *
+ *               already; any which aren't are read individually, never     *
+ *               the whole segment.                                         *
+ *                                                                          *
+ ****************************************************************************/
+static void JPEGParseEXIF(void *iHandle, unsigned char *pWin, int iWinLen, PILOffset llWinStart, int i, PILOffset llFileSize, ImageInfo *pInfo)
+{
+    PILOffset llTIFF = llWinStart + i + 10; // TIFF header follows "Exif\0\0"
+    int iTIFFLen = MOTOSHORT(&pWin[i+2]) - 8;
+    unsigned char *p, cHeader[8];
+    int iBytes;
+    BOOL bMotorola;
+    uint32_t uiIFD1, uiExifIFD = 0;
+
+    if (iTIFFLen < 8)
+        return;
+    p = JPEGBlock(iHandle, pWin, iWinLen, llWinStart, llTIFF, 8, llFileSize, cHeader, &iBytes);
+    if (iBytes < 8 || p[0] != p[1] || (p[0] != 'M' && p[0] != 'I'))
+        return;
+    bMotorola = (p[0] == 'M');
+    pInfo->bMotorola = bMotorola;
+    uiIFD1 = EXIFParseIFD(iHandle, pWin, iWinLen, llWinStart, llTIFF, iTIFFLen, llFileSize, TIFFLONG(&p[4], bMotorola), 0, bMotorola, &uiExifIFD, pInfo);
+    if (uiExifIFD)
+        EXIFParseIFD(iHandle, pWin, iWinLen, llWinStart, llTIFF, iTIFFLen, llFileSize, uiExifIFD, 1, bMotorola, &uiExifIFD, pInfo);
+    if (uiIFD1)
+        EXIFParseIFD(iHandle, pWin, iWinLen, llWinStart, llTIFF, iTIFFLen, llFileSize, uiIFD1, 2, bMotorola, &uiExifIFD, pInfo);
+} /* JPEGParseEXIF() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : JPEGParseDQT(void *, unsigned char *, int, PILOffset, ...) *
+ *                                                                          *
+ *  PURPOSE    : Keep quantization tables 0 and 1 from the DQT segment at   *
+ *               pWin[i] (the JPEG marker window, iWinLen bytes at file     *
+ *               offset llWinStart).                                        *
+ *                                                                          *
+ ****************************************************************************/
+static void JPEGParseDQT(void *iHandle, unsigned char *pWin, int iWinLen, PILOffset llWinStart, int i, PILOffset llFileSize, JPEG_TABLES *pTables)
+{
+    unsigned char cDQT[4 * (1 + 128)]; // the most a segment normally holds
+    unsigned char *p;
+    int j, k, iLen, iBytes, iTable, iSize;
+
+    iLen = MOTOSHORT(&pWin[i+2]) - 2;
+    if (iLen > (int)sizeof(cDQT))
+        iLen = (int)sizeof(cDQT);
+    if (iLen <= 0)
+        return;
+    p = JPEGBlock(iHandle, pWin, iWinLen, llWinStart, llWinStart + i + 4, iLen, llFileSize, cDQT, &iBytes);
+    for (j=0; j < iBytes; j += 1 + iSize)
+    {
+        iTable = p[j] & 0xf;
+        iSize = (p[j] & 0xf0) ? 128 : 64; // 16 or 8-bit values
+        if (j + 1 + iSize > iBytes)
+            break;
+        if (iTable > 1) // only the luminance and (first) chrominance tables matter
+            continue;
+        for (k=0; k<64; k++)
+            pTables->usTable[iTable][k] = (iSize == 128) ? MOTOSHORT(&p[j+1+k*2]) : p[j+1+k];
+        pTables->iHave |= 1 << iTable;
+        if (iSize == 128)
+            pTables->i16Bit |= 1 << iTable;
+        else
+            pTables->i16Bit &= ~(1 << iTable);
+    }
+} /* JPEGParseDQT() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : JPEGQuality(JPEG_TABLES *)                                 *
+ *                                                                          *
+ *  PURPOSE    : Estimate the IJG quality setting (1-100) which produced    *
+ *               the quantization tables. The ratio of their sums to those  *
+ *               of the standard tables gives a first guess, then the       *
+ *               qualities around it are scaled the way libjpeg does and    *
+ *               the closest match wins, so tables written by libjpeg give  *
+ *               their exact setting (the lowest settings clip to the same  *
+ *               tables, so they can't all be told apart).                  *
+ *                                                                          *
+ *  RETURNS    : The quality, or 0 if there is no luminance table.          *
+ *                                                                          *
+ ****************************************************************************/
+static int JPEGQuality(JPEG_TABLES *pTables)
+{
+    int i, k, iQ, iScale, iValue, iMax, iLimit, iErr, iBestErr, iBest;
+    unsigned int uiSum, uiStdSum;
+
+    if (!(pTables->iHave & 1))
+        return 0;
+    uiSum = uiStdSum = 0;
+    for (i=0; i<2; i++)
+    {
+        if (!(pTables->iHave & (1 << i)))
+            continue;
+        for (k=0; k<64; k++)
+        {
+            uiSum += pTables->usTable[i][k];
+            uiStdSum += ucIJGTables[i][k];
+        }
+    }
+    iScale = (int)((uiSum * 100 + uiStdSum/2) / uiStdSum); // percent of the quality 50 tables
+    if (iScale <= 100)
+        iQ = (200 - iScale + 1) / 2;
+    else
+        iQ = 5000 / iScale;
+    iBest = 0;
+    iBestErr = 0x7fffffff;
+    iMax = iQ + 5;
+    if (iQ <= 30) // below this the values reach 255, the sums say too little
+        iQ = 1;
+    else
+        iQ -= 5;
+    for (; iQ <= iMax && iQ <= 100; iQ++)
+    {
+        iScale = (iQ < 50) ? 5000 / iQ : 200 - iQ*2;
+        iErr = 0;
+        for (k=0; k<128; k++)
+        {
+            if (!(pTables->iHave & (1 << (k >> 6))))
+                continue;
+            iLimit = (pTables->i16Bit & (1 << (k >> 6))) ? 32767 : 255;
+            iValue = (ucIJGTables[k >> 6][k & 63] * iScale + 50) / 100;
+            if (iValue < 1)
+                iValue = 1;
+            else if (iValue > iLimit)
+                iValue = iLimit;
+            iErr += abs(iValue - pTables->usTable[k >> 6][k & 63]);
+        }
+        if (iErr < iBestErr)
+        {
+            iBestErr = iErr;
+            iBest = iQ;
+        }
+    }
+    return iBest;
+} /* JPEGQuality() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : JPEGFindSOF(void *, unsigned char *, int, PILOffset, ...)  *
+ *                                                                          *
+ *  PURPOSE    : Walk the JPEG markers looking for the start of frame.      *
+ *               Markers are parsed out of a large window (the header at    *
+ *               first) and segments which end inside the window are        *
+ *               skipped without any I/O. The window is only refilled when  *
+ *               a segment length jumps past its end, so typical files      *
+ *               need one or two reads instead of one per segment.          *
+ *               *piRead receives the number of bytes read from the file.   *
+ *               The first APP1 Exif segment is parsed into pInfo and the   *
+ *               quantization tables passed on the way give its quality.    *
+ *               Every SOFn counts, including arithmetic coding and the     *
+ *               frames of hierarchical files (whose size is in DHP).       *
+ *                                                                          *
+ *  RETURNS    : Pointer to the SOF marker or NULL if not found.            *
+ *                                                                          *
+ ****************************************************************************/
+static unsigned char * JPEGFindSOF(void *iHandle, unsigned char *pHeader, int iHeaderLen, PILOffset llFileSize, unsigned char *pWindow, int *piRead, ImageInfo *pInfo)
+{
+    unsigned char *p = pHeader;
+    PILOffset llStart = 0; // file offset of p[0]
+    PILOffset llPos; // file offset of the next marker
+    int iLen = iHeaderLen; // valid bytes at p
+    int i, iSkip, iMarker;
+    BOOL bEXIF = FALSE;
+    JPEG_TABLES tables;
+    
+    tables.iHave = tables.i16Bit = 0;
+    *piRead = 0;
+    llPos = 2; /* Start at offset of first marker */
+    iSkip = 2;
+    while (iSkip < 32 && llPos < llFileSize)
+    {
+        if (llPos + 12 > llStart + iLen) // marker crosses the end of the window, refill it
+        {
+            if (llStart + iLen >= llFileSize)
+                return NULL; // truncated marker at the end of the file
+            p = PILIOData(iHandle, llPos, JPEG_WINDOW_SIZE, &iLen); // mapped or memory handle?
+            if (p == NULL || iLen < 12)
+            {
+                p = pWindow;
+                PILIOSeek(iHandle, llPos, 0);
+                iLen = PILIORead(iHandle, pWindow, JPEG_WINDOW_SIZE);
+                if (iLen > 0)
+                    *piRead += iLen;
+            }
+            llStart = llPos;
+            if (iLen < 12)
+                return NULL;
+        }
+        i = (int)(llPos - llStart);
+        iMarker = MOTOSHORT(&p[i]);
+        if (iMarker < 0xff00) // invalid marker, could be generated by "Arles Image Web Page Creator" or Accusoft
+        {
+            llPos += 2;
+            iSkip += 2;
+            continue; // skip 2 bytes and try to resync
+        }
+        if (iMarker == 0xffe1 && p[i+4] == 'E' && p[i+5] == 'x' && !bEXIF) // EXIF, check for thumbnail
+        {
+            JPEGParseEXIF(iHandle, p, iLen, llStart, i, llFileSize, pInfo);
+            bEXIF = TRUE; // only the first one counts
+        }
+        else if (iMarker == 0xffdb) // quantization tables
+            JPEGParseDQT(iHandle, p, iLen, llStart, i, llFileSize, &tables);
+        else if (iMarker == 0xffde) // DHP, the size of the final frame of a hierarchical file
+        {
+            pInfo->bHierarchical = TRUE;
+            pInfo->iHeight = MOTOSHORT(&p[i+5]);
+            pInfo->iWidth = MOTOSHORT(&p[i+7]);
+        }
+        if (JPEG_IS_SOF(iMarker)) // the one we're looking for
+        {
+            pInfo->iQuality = JPEGQuality(&tables);
+            return &p[i];
+        }
+        llPos += 2 + MOTOSHORT(&p[i+2]); /* Skip to next marker */
+        iSkip = 0;
+    } // while
+    return NULL;
+} /* JPEGFindSOF() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_probe_handle_type(void *, uint64_t, ...)         *
+ *                                                                          *
+ *  PURPOSE    : Gather information about an open PILIO handle. iType is    *
+ *               the FILETYPE_xxx from imageinfo_classify(), or -1 to       *
+ *               detect it here.                                            *
+ *                                                                          *
+ *  RETURNS    : IMAGEINFO_SUCCESS, or IMAGEINFO_NEED_MORE if the handle    *
+ *               is a memory handle which is missing part of the file       *
+ *               (pInfo->ullNeedOffset/uiNeedLen say which part), or one of *
+ *               the error codes.                                           *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_probe_handle_type(void *iHandle, uint64_t ullFileSize, int iType, ImageInfo *pInfo)
+{
+    int i, j;
+    int iBytes;
+    int iResult = IMAGEINFO_INVALID;
+    int iCountSize, iTagSize; // TIFF or BigTIFF IFD layout
+    PILOffset llFileSize, llOffset;
+    int iFileType = FILETYPE_UNKNOWN;
+    int iCompression = COMPTYPE_UNKNOWN;
+    unsigned char ucHeader[TEMP_BUF_SIZE]; // small buffer to load header info
+    unsigned char *cBuf; // header bytes, either in ucHeader or mapped memory
+    unsigned char cTemp[8 + MAX_TAGS*BIGTIFF_TAGSIZE]; // for data beyond the header
+    unsigned char cWindow[JPEG_WINDOW_SIZE]; // JPEG marker window
+    unsigned char *pData;
+    const ImageInfoSignature *pSig;
+    TIFF_IFD ifd;
+    int iHeaderBytes; // valid bytes in cBuf
+    int iBpp = 0;
+    int iWidth = 0;
+    int iHeight = 0;
+    BOOL bMotorola = FALSE;
+    
+    memset(pInfo, 0, sizeof(ImageInfo));
+    pInfo->iCRCErrors = -1; // not checked
+    pInfo->ullFileSize = ullFileSize;
+    llFileSize = (PILOffset)ullFileSize;
+    // Detect the file type by its header
+    // Read a full page up front; it costs the same as a few hundred bytes
+    // and usually holds everything we need
+    cBuf = PILIOData(iHandle, 0, TEMP_BUF_SIZE, &iBytes);
+    if (cBuf == NULL || (iBytes < DEFAULT_READ_SIZE && iBytes < llFileSize))
+    {
+        cBuf = ucHeader;
+        iBytes = PILIORead(iHandle, cBuf, TEMP_BUF_SIZE);
+    }
+    if (iBytes < DEFAULT_READ_SIZE)
+        goto process_exit; // too small
+    iHeaderBytes = iBytes;
+    if (iType < 0 || iType >= FILETYPE_COUNT) // not classified yet, or a registered type
+    {
+        pSig = SigDetect(cBuf, iHeaderBytes);
+        iType = (pSig == NULL) ? FILETYPE_UNKNOWN : pSig->iType;
+        if (pSig != NULL && pSig->pfnParse != NULL) // registered type, it fills in the info itself
+        {
+            iResult = (*pSig->pfnParse)(cBuf, iHeaderBytes, pInfo);
+            pInfo->iType = iType;
+            pInfo->ullFileSize = ullFileSize;
+            goto process_exit;
+        }
+    }
+    if (iType == FILETYPE_UNKNOWN)
+    {
+        iResult = IMAGEINFO_UNKNOWN_TYPE;
+        goto process_exit;
+    }
+    iFileType = iType;
+    // Get info specific to each type of file
+    switch (iFileType)
+    {
+	case FILETYPE_PCX:
+	   iWidth = 1 + INTELSHORT(&cBuf[8]) - INTELSHORT(&cBuf[4]);
+           iHeight = 1 + INTELSHORT(&cBuf[10]) - INTELSHORT(&cBuf[6]);
+	   iCompression = COMPTYPE_PACKBITS;
+	   iBpp = cBuf[3] * cBuf[65];
+	   break;
+
+        case FILETYPE_PNG:
+            if (MOTOLONG(&cBuf[12]) == 0x49484452/*'IHDR'*/)
+            {
+                iWidth = MOTOLONG(&cBuf[16]);
+                iHeight = MOTOLONG(&cBuf[20]);
+                iCompression = COMPTYPE_FLATE;
+                i = cBuf[24]; // bits per pixel
+                j = cBuf[25]; // pixel type
+                switch (j)
+                {
+                    case 0: // grayscale
+                    case 3: // palette image
+                        iBpp = i;
+                        break;
+                    case 2: // RGB triple
+                        iBpp = i * 3;
+                        break;
+                    case 4: // grayscale + alpha channel
+                        iBpp = i * 2;
+                        break;
+                    case 6: // RGB + alpha
+                        iBpp = i * 4;
+                        break;
+                }
+                pInfo->bInterlaced = (cBuf[28] == 1); // interlace flag
+            }
+            break;
+        case FILETYPE_TARGA:
+            iWidth = INTELSHORT(&cBuf[12]);
+            iHeight = INTELSHORT(&cBuf[14]);
+            iBpp = cBuf[16];
+            if (cBuf[2] == 3 || cBuf[2] == 11) // monochrome
+                iBpp = 1;
+            if (cBuf[2] < 9)
+                iCompression = COMPTYPE_NONE;
+            else
+                iCompression = COMPTYPE_RLE;
+            break;
+        case FILETYPE_PPM:
+            if (cBuf[1] == '4')
+                iBpp = 1;
+            else if (cBuf[1] == '5')
+                iBpp = 8;
+            else if (cBuf[1] == '6')
+                iBpp = 24;
+            j = 2;
+            while ((cBuf[j] == 0xa || cBuf[j] == 0xd) && j<DEFAULT_READ_SIZE)
+                j++; // skip newline/cr
+            while (cBuf[j] == '#' && j < DEFAULT_READ_SIZE) // skip over comments
+            {
+                while (cBuf[j] != 0xa && cBuf[j] != 0xd && j < DEFAULT_READ_SIZE)
+                    j++;
+                while ((cBuf[j] == 0xa || cBuf[j] == 0xd) && j<DEFAULT_READ_SIZE)
+                    j++; // skip newline/cr
+            }
+            // get width and height
+            iWidth = ParseNumber(cBuf, &j, DEFAULT_READ_SIZE);
+            iHeight = ParseNumber(cBuf, &j, DEFAULT_READ_SIZE);
+            iCompression = COMPTYPE_NONE;
+            break;
+        case FILETYPE_BMP:
+            iCompression = COMPTYPE_NONE;
+            iWidth = INTELSHORT(&cBuf[18]);
+            iHeight = INTELSHORT(&cBuf[22]);
+            if (iHeight & 0x8000) // upside down
+                iHeight = 65536 - iHeight;
+            iBpp = cBuf[28]; /* Number of bits per plane */
+            iBpp *= cBuf[26]; /* Number of planes */
+            if (cBuf[30] && (iBpp == 4 || iBpp == 8)) // if biCompression is non-zero (2=4bit rle, 1=8bit rle,4=24bit rle)
+                iCompression = COMPTYPE_RLE; // windows run-length
+            break;
+        case FILETYPE_OS2BMP:
+            iCompression = COMPTYPE_NONE;
+            if (cBuf[14] == 12) // version 1.2
+            {
+                iWidth = INTELSHORT(&cBuf[18]);
+                iHeight = INTELSHORT(&cBuf[20]);
+                iBpp = cBuf[22]; /* Number of bits per plane */
+                iBpp *= cBuf[24]; /* Number of planes */
+            }
+            else
+            {
+                iWidth = INTELSHORT(&cBuf[18]);
+                iHeight = INTELSHORT(&cBuf[22]);
+                iBpp = cBuf[28]; /* Number of bits per plane */
+                iBpp *= cBuf[26]; /* Number of planes */
+            }
+            if (iHeight & 0x8000) // upside down
+                iHeight = 65536 - iHeight;
+            if (cBuf[30] == 1 || cBuf[30] == 2 || cBuf[30] == 4) // if biCompression is non-zero (2=4bit rle, 1=8bit rle,4=24bit rle)
+                iCompression = COMPTYPE_RLE; // windows run-length
+            break;
+        case FILETYPE_JEDMICS:
+            iBpp = 1;
+            iWidth = INTELSHORT(&cBuf[6]);
+            iWidth <<= 3; // convert byte width to pixel width
+            iHeight = INTELSHORT(&cBuf[4]);
+            iCompression = COMPTYPE_G4;
+            break;
+        case FILETYPE_CALS:
+            iBpp = 1;
+            iCompression = COMPTYPE_G4;
+            pData = ReadBlock(iHandle, cBuf, iHeaderBytes, llFileSize, 750, 1, cTemp, &iBytes);
+            if (iBytes == 1 && pData[0] == '1') // type 1 file
+            {
+                pData = ReadBlock(iHandle, cBuf, iHeaderBytes, llFileSize, 1033, 256, cTemp, &iBytes);
+                i = 0;
+                iWidth = ParseNumber(pData, &i, iBytes);
+                iHeight = ParseNumber(pData, &i, iBytes);
+            }
+            else // type 2
+            {
+                pData = ReadBlock(iHandle, cBuf, iHeaderBytes, llFileSize, 1024, 128, cTemp, &iBytes);
+                if (iBytes >= 8 && MOTOLONG(pData) == 0x7270656c && MOTOLONG(&pData[4]) == 0x636e743a) // "rpelcnt:"
+                {
+                    i = 9;
+                    iWidth = ParseNumber(pData, &i, iBytes);
+                    iHeight = ParseNumber(pData, &i, iBytes);
+                }
+            }
+            break;
+        case FILETYPE_JPEG:
+            iCompression = COMPTYPE_JPEG;
+            pData = JPEGFindSOF(iHandle, cBuf, iHeaderBytes, llFileSize, cWindow, &iBytes, pInfo);
+            bMotorola = pInfo->bMotorola; // from the EXIF segment
+            if (pData == NULL)
+                goto process_exit; // error - invalid file?
+            else
+            {
+                iBpp = pData[4]; // bits per sample
+                iHeight = pInfo->bHierarchical ? pInfo->iHeight : MOTOSHORT(&pData[5]);
+                iWidth = pInfo->bHierarchical ? pInfo->iWidth : MOTOSHORT(&pData[7]);
+                iBpp = iBpp * pData[9]; /* Bpp = number of components * bits per sample */
+                pInfo->iSubSample = pData[11];
+                pInfo->iJPEGType = MOTOSHORT(pData) & 3;
+                pInfo->bArithmetic = ((pData[1] & 8) != 0); // SOF9-SOF15
+            }
+            break;
+        case FILETYPE_GIF:
+            iCompression = COMPTYPE_LZW;
+            iWidth = INTELSHORT(&cBuf[6]);
+            iHeight = INTELSHORT(&cBuf[8]);
+            iBpp = (cBuf[10] & 7) + 1;
+            pInfo->bInterlaced = ((cBuf[10] & 64) != 0); // interlace flag
+            break;
+        case FILETYPE_TIFF:
+            bMotorola = (cBuf[0] == 'M'); // determine endianness of TIFF data
+            pInfo->bBigTIFF = (TIFFSHORT(&cBuf[2], bMotorola) == 43); // 64-bit offsets
+            iCountSize = pInfo->bBigTIFF ? 8 : 2;
+            iTagSize = pInfo->bBigTIFF ? BIGTIFF_TAGSIZE : TIFF_TAGSIZE;
+            // get first IFD offset
+            llOffset = TIFFOFFSET(&cBuf[pInfo->bBigTIFF ? 8 : 4], bMotorola, pInfo->bBigTIFF);
+            if (llOffset >= 0 && llOffset + iCountSize <= iHeaderBytes) // we know the tag count, only ask for that many tags
+                j = iCountSize + iTagSize * TIFFCOUNT(&cBuf[llOffset], bMotorola, pInfo->bBigTIFF);
+            else // read the entire tag directory
+                j = iCountSize + MAX_TAGS*iTagSize;
+            if (j > iCountSize + MAX_TAGS*iTagSize)
+                j = iCountSize + MAX_TAGS*iTagSize;
+            pData = ReadBlock(iHandle, cBuf, iHeaderBytes, llFileSize, llOffset, j, cTemp, &iBytes);
+            j = TIFFCOUNT(pData, bMotorola, pInfo->bBigTIFF); // get the tag count
+            // where the IFD ends (a cut one ends past the end of the file)
+            if (llOffset >= 8)
+                pInfo->ullIFDEnd = (uint64_t)(llOffset + iCountSize);
+            if (llOffset >= 8 && iBytes >= iCountSize)
+                pInfo->ullIFDEnd += (uint64_t)j * iTagSize + (pInfo->bBigTIFF ? 8 : 4); // and the next IFD offset
+            if (iBytes < iCountSize)
+                j = 0;
+            else if (j > (iBytes-iCountSize) / iTagSize) // don't walk past what we read
+                j = (iBytes-iCountSize) / iTagSize;
+            TIFFParseTags(iHandle, cBuf, iHeaderBytes, llFileSize, &pData[iCountSize], j, bMotorola, pInfo->bBigTIFF, &ifd);
+            memcpy(pInfo->ullStrips, ifd.ullStrips, sizeof(ifd.ullStrips));
+            memcpy(pInfo->ullStripCount, ifd.ullStripCount, sizeof(ifd.ullStripCount));
+            memcpy(pInfo->iStripSize, ifd.iStripSize, sizeof(ifd.iStripSize));
+            iWidth = ifd.iWidth;
+            iHeight = ifd.iHeight;
+            iBpp = ifd.iBpp;
+            iCompression = ifd.iCompression;
+            pInfo->iPhotometric = ifd.iPhotometric;
+            pInfo->iPlanar = ifd.iPlanar;
+            break;
+    } // switch
+    pInfo->iType = iFileType;
+    pInfo->iCompression = iCompression;
+    pInfo->iWidth = iWidth;
+    pInfo->iHeight = iHeight;
+    pInfo->iBpp = iBpp;
+    pInfo->bMotorola = bMotorola;
+    iResult = IMAGEINFO_SUCCESS;
+process_exit:
+    if (PILIONeedMore(iHandle, &llOffset, &pInfo->uiNeedLen))
+    {
+        pInfo->ullNeedOffset = (uint64_t)llOffset;
+        iResult = IMAGEINFO_NEED_MORE; // some of what we read wasn't there
+    }
+    return iResult;
+} /* imageinfo_probe_handle_type() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_probe_handle(void *, uint64_t, ImageInfo *)      *
+ *                                                                          *
+ *  PURPOSE    : Gather information about an open PILIO handle.             *
+ *                                                                          *
+ *  RETURNS    : IMAGEINFO_SUCCESS, or IMAGEINFO_NEED_MORE if the handle    *
+ *               is a memory handle which is missing part of the file       *
+ *               (pInfo->ullNeedOffset/uiNeedLen say which part), or one of *
+ *               the error codes.                                           *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_probe_handle(void *iHandle, uint64_t ullFileSize, ImageInfo *pInfo)
+{
+    return imageinfo_probe_handle_type(iHandle, ullFileSize, -1, pInfo);
+} /* imageinfo_probe_handle() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TIFFSeen(PILOffset **, int *, int *, PILOffset)            *
+ *                                                                          *
+ *  PURPOSE    : Add an IFD offset to the set of those already visited.     *
+ *               The set is an open addressed hash table which doubles      *
+ *               when half full, in the thread's arena (PILIOArenaAlloc).   *
+ *                                                                          *
+ *  RETURNS    : TRUE if it was already there (or out of memory).           *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL TIFFSeen(PILOffset **ppTable, int *piSize, int *piUsed, PILOffset llOffset)
+{
+    PILOffset *pOld = *ppTable, *pNew;
+    int i, j, iOldSize = *piSize;
+
+    if (*piUsed * 2 >= iOldSize) // grow it first
+    {
+        *piSize = iOldSize ? iOldSize * 2 : 64;
+        pNew = (PILOffset *)PILIOArenaAlloc(*piSize * sizeof(PILOffset));
+        if (pNew == NULL)
+            return TRUE;
+        memset(pNew, 0, *piSize * sizeof(PILOffset));
+        for (i=0; i<iOldSize; i++)
+        {
+            if (pOld[i] == 0)
+                continue;
+            for (j=TIFF_HASH(pOld[i]) & (*piSize - 1); pNew[j] != 0; j = (j+1) & (*piSize - 1))
+                ;
+            pNew[j] = pOld[i];
+        }
+        *ppTable = pNew;
+    }
+    for (j=TIFF_HASH(llOffset) & (*piSize - 1); (*ppTable)[j] != 0; j = (j+1) & (*piSize - 1))
+    {
+        if ((*ppTable)[j] == llOffset)
+            return TRUE;
+    }
+    (*ppTable)[j] = llOffset; // offsets are never 0
+    (*piUsed)++;
+    return FALSE;
+} /* TIFFSeen() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_tiff_pages(void *, uint64_t, ...)                *
+ *                                                                          *
+ *  PURPOSE    : Walk the chain of IFDs of a TIFF file, calling pfnPage     *
+ *               with the geometry of each page. Only the tag count, tags   *
+ *               and next pointer of each IFD are read; the read is sized   *
+ *               for the tag count of the previous IFD plus the count of    *
+ *               the next, so a chain of similar pages takes one read per   *
+ *               page. While the IFDs are back to back the reads cover      *
+ *               twice as many each time, so a block of them costs a few    *
+ *               reads. A chain which loops back on itself ends at the      *
+ *               first IFD seen twice. BigTIFF IFDs (8 byte counts and      *
+ *               offsets, 20 byte tags) are walked the same way.            *
+ *                                                                          *
+ *  RETURNS    : IMAGEINFO_SUCCESS with the number of pages in *piPages,    *
+ *               IMAGEINFO_NEED_MORE as for imageinfo_probe_handle() (the   *
+ *               walk has to be repeated from the start), or an error.      *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_tiff_pages(void *iHandle, uint64_t ullFileSize, IMAGEINFO_PAGE_CALLBACK pfnPage, void *pUser, int *piPages)
+{
+    unsigned char ucHeader[TEMP_BUF_SIZE];
+    unsigned char cIFD[JPEG_WINDOW_SIZE]; // IFDs read ahead
+    unsigned char cNext[8];
+    unsigned char *cBuf, *pWin, *p;
+    PILOffset *pllSeen = NULL;
+    void *pArenaMark = PILIOArenaMark(); // pllSeen is released with it
+    PILOffset llFileSize, llOffset, llNext;
+    PILOffset llWinStart, llPos; // file offset of pWin, IFD offset within it
+    unsigned int uiNeedLen;
+    int iSeenSize = 0, iSeenUsed = 0;
+    int iHeaderBytes, iBytes;
+    int iWinLen; // length of pWin
+    int iCountSize, iTagSize, iNextSize; // TIFF or BigTIFF IFD layout
+    int i, iTags, iGuess, iLen, iRun;
+    BOOL bMotorola, bBig;
+    TIFF_IFD ifd;
+    ImageInfoPage page;
+
+    *piPages = 0;
+    llFileSize = (PILOffset)ullFileSize;
+    cBuf = PILIOData(iHandle, 0, TEMP_BUF_SIZE, &iBytes);
+    if (cBuf == NULL || (iBytes < DEFAULT_READ_SIZE && iBytes < llFileSize))
+    {
+        cBuf = ucHeader;
+        PILIOSeek(iHandle, 0, 0);
+        iBytes = PILIORead(iHandle, cBuf, TEMP_BUF_SIZE);
+    }
+    if (iBytes < 8)
+        goto pages_exit;
+    if ((cBuf[0] != 'I' || cBuf[1] != 'I') && (cBuf[0] != 'M' || cBuf[1] != 'M'))
+        return IMAGEINFO_UNKNOWN_TYPE;
+    iHeaderBytes = iBytes;
+    bMotorola = (cBuf[0] == 'M');
+    bBig = (TIFFSHORT(&cBuf[2], bMotorola) == 43);
+    if (bBig && iBytes < 16)
+        goto pages_exit;
+    iCountSize = bBig ? 8 : 2;
+    iTagSize = bBig ? BIGTIFF_TAGSIZE : TIFF_TAGSIZE;
+    iNextSize = bBig ? 8 : 4;
+    pWin = cBuf;
+    llWinStart = 0;
+    iWinLen = iHeaderBytes;
+    iGuess = 16; // typical for the first IFD if it isn't in the header
+    iRun = 1; // IFDs to read at once, doubles while they are back to back
+    llOffset = TIFFOFFSET(&cBuf[bBig ? 8 : 4], bMotorola, bBig);
+    while (llOffset >= 8 && llOffset < llFileSize - iCountSize) // an offset of 0 ends the chain
+    {
+        if (TIFFSeen(&pllSeen, &iSeenSize, &iSeenUsed, llOffset))
+            break; // loop
+        llPos = llOffset - llWinStart;
+        if (llPos >= 0 && llPos + iCountSize <= iWinLen) // count is in hand
+            iTags = TIFFCOUNT(&pWin[llPos], bMotorola, bBig);
+        else
+            iTags = iGuess;
+        iLen = iCountSize + ((iTags > MAX_TAGS) ? MAX_TAGS : iTags) * iTagSize + iNextSize;
+        if (llPos < 0 || llPos + iCountSize > iWinLen || (llPos + iLen > iWinLen && llWinStart + iWinLen < llFileSize))
+        {
+            i = iLen * iRun + iCountSize; // and the count of the next
+            if (i > (int)sizeof(cIFD))
+                i = (int)sizeof(cIFD);
+            pWin = TIFFReadIFD(iHandle, llOffset, i, llFileSize, cIFD, &iWinLen);
+            llWinStart = llOffset;
+            llPos = 0;
+            if (iWinLen < iCountSize)
+                break; // truncated
+            iTags = TIFFCOUNT(pWin, bMotorola, bBig);
+            iLen = iCountSize + ((iTags > MAX_TAGS) ? MAX_TAGS : iTags) * iTagSize + iNextSize;
+            if (iLen > iWinLen && iWinLen < llFileSize - llOffset) // more tags than expected
+                pWin = TIFFReadIFD(iHandle, llOffset, iLen + iCountSize, llFileSize, cIFD, &iWinLen);
+        }
+        i = (int)llPos;
+        iGuess = (iTags > MAX_TAGS) ? MAX_TAGS : iTags;
+        iLen = (iWinLen - i - iCountSize) / iTagSize; // don't walk past what we read
+        TIFFParseTags(iHandle, cBuf, iHeaderBytes, llFileSize, &pWin[i+iCountSize], (iTags < iLen) ? iTags : iLen, bMotorola, bBig, &ifd);
+        if (pfnPage != NULL)
+        {
+            page.iWidth = ifd.iWidth;
+            page.iHeight = ifd.iHeight;
+            page.iBpp = ifd.iBpp;
+            page.iCompression = ifd.iCompression;
+            (*pfnPage)(pUser, *piPages, &page);
+        }
+        (*piPages)++;
+        // find the next IFD
+        iLen = iCountSize + iTags * iTagSize; // offset of the pointer
+        if (i + iLen + iNextSize <= iWinLen)
+        {
+            llNext = TIFFOFFSET(&pWin[i + iLen], bMotorola, bBig);
+            if (llNext == llOffset + iLen + iNextSize) // back to back, read more of them at a time
+                iRun = (iRun < 256) ? iRun * 2 : iRun;
+            else
+                iRun = 1;
+            llOffset = llNext;
+        }
+        else if (llOffset + iLen + iNextSize <= llFileSize) // huge IFD
+        {
+            p = TIFFReadIFD(iHandle, llOffset + iLen, iNextSize, llFileSize, cNext, &iBytes);
+            llOffset = (iBytes == iNextSize) ? TIFFOFFSET(p, bMotorola, bBig) : 0;
+        }
+        else
+            llOffset = 0; // truncated
+    }
+pages_exit:
+    PILIOArenaRelease(pArenaMark);
+    if (PILIONeedMore(iHandle, &llOffset, &uiNeedLen))
+        return IMAGEINFO_NEED_MORE; // some of what we read wasn't there
+    return (*piPages == 0) ? IMAGEINFO_INVALID : IMAGEINFO_SUCCESS;
+} /* imageinfo_tiff_pages() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_jpeg_scans(void *, uint64_t, int *)              *
+ *                                                                          *
+ *  PURPOSE    : Count the scans (SOS markers) of a JPEG; a baseline file   *
+ *               normally has one and a progressive file one per pass.      *
+ *               The scans aren't described anywhere in the header, so the  *
+ *               whole file is read: segments are skipped by their length   *
+ *               and the entropy coded data after each SOS is searched for  *
+ *               the next marker with memchr(), in place for mapped and     *
+ *               memory handles and in large reads otherwise.               *
+ *                                                                          *
+ *  RETURNS    : IMAGEINFO_SUCCESS, IMAGEINFO_NEED_MORE for a memory handle *
+ *               which is missing part of the file, or one of the errors.   *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_jpeg_scans(void *iHandle, uint64_t ullFileSize, int *piScans)
+{
+    unsigned char ucWindow[JPEG_SCAN_SIZE];
+    unsigned char *p, *pFF;
+    PILOffset llFileSize, llStart, llPos;
+    unsigned int uiNeedLen;
+    int i, iLen, iMarker;
+    BOOL bEntropy = FALSE; // in the coded data of a scan
+
+    *piScans = 0;
+    llFileSize = (PILOffset)ullFileSize;
+    p = ucWindow;
+    llStart = llPos = 0;
+    iLen = 0;
+    while (llPos < llFileSize)
+    {
+        if (llPos + (bEntropy ? 2 : 4) > llStart + iLen) // refill the window at llPos
+        {
+            if (iLen && llStart + iLen >= llFileSize)
+                break; // truncated
+            p = PILIOData(iHandle, llPos, JPEG_SCAN_SIZE, &iLen); // mapped or memory handle?
+            if (p == NULL || iLen < 4)
+            {
+                p = ucWindow;
+                PILIOSeek(iHandle, llPos, 0);
+                iLen = PILIORead(iHandle, ucWindow, JPEG_SCAN_SIZE);
+            }
+            llStart = llPos;
+            if (iLen < 2)
+                break;
+            if (llPos == 0 && MOTOSHORT(p) != 0xffd8)
+                return IMAGEINFO_UNKNOWN_TYPE;
+        }
+        i = (int)(llPos - llStart);
+        if (bEntropy) // FF 00 is a coded FF and RSTn markers are part of the data
+        {
+            pFF = (unsigned char *)memchr(&p[i], 0xff, iLen - i - 1); // the byte after it has to be here too
+            if (pFF == NULL)
+            {
+                llPos = llStart + iLen - 1;
+                continue;
+            }
+            llPos = llStart + (pFF - p);
+            if (pFF[1] == 0xff) // fill byte
+                llPos++;
+            else if (pFF[1] == 0 || (pFF[1] >= 0xd0 && pFF[1] <= 0xd7))
+                llPos += 2;
+            else
+                bEntropy = FALSE; // the next marker
+            continue;
+        }
+        if (iLen - i < 4) // at the end of the file
+            break;
+        iMarker = MOTOSHORT(&p[i]);
+        if (iMarker < 0xff00 || iMarker == 0xffd9) // damaged, or the end of the image
+            break;
+        if (iMarker == 0xffff) // fill byte
+            llPos++;
+        else if ((iMarker >= 0xffd0 && iMarker <= 0xffd8) || iMarker == 0xff01) // no length
+            llPos += 2;
+        else
+        {
+            if (iMarker == 0xffda) // start of scan
+            {
+                (*piScans)++;
+                bEntropy = TRUE;
+            }
+            llPos += 2 + MOTOSHORT(&p[i+2]);
+        }
+    }
+    if (PILIONeedMore(iHandle, &llPos, &uiNeedLen))
+        return IMAGEINFO_NEED_MORE; // some of what we read wasn't there
+    return (*piScans == 0) ? IMAGEINFO_INVALID : IMAGEINFO_SUCCESS;
+} /* imageinfo_jpeg_scans() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : WindowGet(void *, FILE_WINDOW *, PILOffset, int)           *
+ *                                                                          *
+ *  PURPOSE    : Return a pointer to iNeed bytes of the file at llPos. If   *
+ *               they aren't in the window it is moved to start at llPos,   *
+ *               so a walk forward costs one read per iReadSize bytes.      *
+ *                                                                          *
+ *  RETURNS    : Pointer to the data, NULL past the end of the file (or a   *
+ *               piece missing from a memory handle).                       *
+ *                                                                          *
+ ****************************************************************************/
+static unsigned char * WindowGet(void *iHandle, FILE_WINDOW *pWin, PILOffset llPos, int iNeed)
+{
+    if (llPos >= pWin->llStart && llPos + iNeed <= pWin->llStart + pWin->iLen)
+        return &pWin->pData[llPos - pWin->llStart];
+    pWin->pData = PILIOData(iHandle, llPos, pWin->iReadSize, &pWin->iLen); // mapped or memory handle?
+    if (pWin->pData == NULL || pWin->iLen < iNeed)
+    {
+        pWin->pData = pWin->pBuf;
+        PILIOSeek(iHandle, llPos, 0);
+        pWin->iLen = PILIORead(iHandle, pWin->pBuf, pWin->iReadSize);
+    }
+    pWin->llStart = llPos;
+    if (pWin->iLen < iNeed)
+        return NULL;
+    return pWin->pData;
+} /* WindowGet() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : GIFSkipBlocks(void *, FILE_WINDOW *, PILOffset *)          *
+ *                                                                          *
+ *  PURPOSE    : Skip a chain of data sub-blocks (LZW data or the rest of   *
+ *               an extension) by hopping from length byte to length byte.  *
+ *                                                                          *
+ *  RETURNS    : TRUE with *pllPos after the terminator, FALSE if the file  *
+ *               ends first.                                                *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL GIFSkipBlocks(void *iHandle, FILE_WINDOW *pWin, PILOffset *pllPos)
+{
+    PILOffset llPos = *pllPos;
+    unsigned char *p;
+
+    while ((p = WindowGet(iHandle, pWin, llPos, 1)) != NULL)
+    {
+        llPos += 1 + p[0];
+        if (p[0] == 0) // terminator
+        {
+            *pllPos = llPos;
+            return TRUE;
+        }
+    }
+    return FALSE;
+} /* GIFSkipBlocks() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_gif_frames(void *, uint64_t, ImageInfo *)        *
+ *                                                                          *
+ *  PURPOSE    : Walk the blocks of a GIF for the animation fields of pInfo *
+ *               (iFrames, iLoops, ullDuration, iFrameWidth/Height). The    *
+ *               graphic control extensions give the delays and the         *
+ *               NETSCAPE2.0 (or ANIMEXTS1.0) extension the loop count;     *
+ *               image data is skipped without being decoded by hopping     *
+ *               over its sub-blocks in a large window.                     *
+ *                                                                          *
+ *  RETURNS    : IMAGEINFO_SUCCESS, IMAGEINFO_NEED_MORE for a memory handle *
+ *               which is missing part of the file, or one of the errors.   *
+ *               A truncated file keeps the frames found before the end.    *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_gif_frames(void *iHandle, uint64_t ullFileSize, ImageInfo *pInfo)
+{
+    unsigned char ucWindow[JPEG_SCAN_SIZE];
+    unsigned char *p;
+    FILE_WINDOW win;
+    PILOffset llFileSize, llPos;
+    unsigned int uiNeedLen;
+    int i;
+
+    pInfo->iFrames = 0;
+    pInfo->iLoops = -1; // plays once unless there's a loop extension
+    pInfo->ullDuration = 0;
+    pInfo->iFrameWidth = pInfo->iFrameHeight = 0;
+    llFileSize = (PILOffset)ullFileSize;
+    win.pBuf = ucWindow;
+    win.pData = NULL;
+    win.llStart = win.iLen = 0;
+    win.iReadSize = JPEG_SCAN_SIZE;
+    p = WindowGet(iHandle, &win, 0, 13); // header and logical screen descriptor
+    if (p == NULL)
+        goto frames_exit;
+    if (MOTOLONG(p) != 0x47494638) // "GIF8"
+        return IMAGEINFO_UNKNOWN_TYPE;
+    llPos = 13;
+    if (p[10] & 0x80) // global color table
+        llPos += 3 << ((p[10] & 7) + 1);
+    while (llPos < llFileSize && (p = WindowGet(iHandle, &win, llPos, 1)) != NULL)
+    {
+        if (p[0] == 0x2c) // image descriptor
+        {
+            p = WindowGet(iHandle, &win, llPos, 11); // and the LZW code size
+            if (p == NULL)
+                break;
+            pInfo->iFrames++;
+            i = INTELSHORT(&p[1]) + INTELSHORT(&p[5]); // left + width
+            if (i > pInfo->iFrameWidth)
+                pInfo->iFrameWidth = i;
+            i = INTELSHORT(&p[3]) + INTELSHORT(&p[7]); // top + height
+            if (i > pInfo->iFrameHeight)
+                pInfo->iFrameHeight = i;
+            llPos += 10;
+            if (p[9] & 0x80) // local color table
+                llPos += 3 << ((p[9] & 7) + 1);
+            llPos++; // LZW minimum code size
+        }
+        else if (p[0] == 0x21) // extension
+        {
+            p = WindowGet(iHandle, &win, llPos, 2);
+            if (p == NULL)
+                break;
+            if (p[1] == 0xf9) // graphic control, the delay of the next frame
+            {
+                p = WindowGet(iHandle, &win, llPos, 8);
+                if (p != NULL && p[2] >= 4)
+                    pInfo->ullDuration += (uint64_t)INTELSHORT(&p[4]) * 10; // 1/100ths of a second
+            }
+            else if (p[1] == 0xff) // application
+            {
+                p = WindowGet(iHandle, &win, llPos, 19);
+                if (p != NULL && p[2] == 11 && (memcmp(&p[3], "NETSCAPE2.0", 11) == 0 || memcmp(&p[3], "ANIMEXTS1.0", 11) == 0) && p[14] >= 3 && p[15] == 1)
+                    pInfo->iLoops = INTELSHORT(&p[16]);
+            }
+            llPos += 2;
+        }
+        else // trailer (0x3b) or something we can't follow
+            break;
+        if (!GIFSkipBlocks(iHandle, &win, &llPos))
+            break;
+    }
+frames_exit:
+    if (PILIONeedMore(iHandle, &llPos, &uiNeedLen))
+        return IMAGEINFO_NEED_MORE; // some of what we read wasn't there
+    return (pInfo->iFrames == 0) ? IMAGEINFO_INVALID : IMAGEINFO_SUCCESS;
+} /* imageinfo_gif_frames() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PNGCheckCRC(void *, FILE_WINDOW *, PILOffset, uint32_t)    *
+ *                                                                          *
+ *  PURPOSE    : Check the CRC of the chunk at llPos (of its type and data, *
+ *               uiLen bytes) against the one stored after it. The data is  *
+ *               run through the CRC a window at a time.                    *
+ *                                                                          *
+ *  RETURNS    : 1 if it matches, 0 if not, -1 if the file ends first.      *
+ *                                                                          *
+ ****************************************************************************/
+static int PNGCheckCRC(void *iHandle, FILE_WINDOW *pWin, PILOffset llPos, uint32_t uiLen)
+{
+    unsigned char *p;
+    PILOffset llEnd;
+    uint32_t ulCRC = 0;
+    int iLen;
+
+    llPos += 4; // the CRC covers the type and the data
+    llEnd = llPos + 4 + uiLen;
+    while (llPos < llEnd)
+    {
+        p = WindowGet(iHandle, pWin, llPos, 1);
+        if (p == NULL)
+            return -1;
+        iLen = (int)(pWin->llStart + pWin->iLen - llPos);
+        if (iLen > llEnd - llPos)
+            iLen = (int)(llEnd - llPos);
+        ulCRC = PILCRC32(ulCRC, p, iLen);
+        llPos += iLen;
+    }
+    p = WindowGet(iHandle, pWin, llEnd, 4);
+    if (p == NULL)
+        return -1;
+    return (TIFFLONG(p, TRUE) == ulCRC);
+} /* PNGCheckCRC() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_png_chunks(void *, uint64_t, int, ImageInfo *)   *
+ *                                                                          *
+ *  PURPOSE    : Walk the chunks of a PNG for the chunk fields of pInfo:    *
+ *               the number of chunks, whether IEND is there, the pHYs      *
+ *               resolution, an iCCP profile, the text chunks and, for an   *
+ *               APNG, the frame and play counts (acTL) and the delays and  *
+ *               extent of the frames (fcTL). Only the chunk headers and    *
+ *               the small chunks we look at are read, 256 bytes at a time, *
+ *               so the image data is skipped. With bVerifyCRC every chunk  *
+ *               is read in large windows and its CRC checked.              *
+ *                                                                          *
+ *  RETURNS    : IMAGEINFO_SUCCESS, IMAGEINFO_NEED_MORE for a memory handle *
+ *               which is missing part of the file, or one of the errors.   *
+ *               A truncated file keeps the chunks found before the end.    *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_png_chunks(void *iHandle, uint64_t ullFileSize, int bVerifyCRC, ImageInfo *pInfo)
+{
+    unsigned char ucWindow[JPEG_SCAN_SIZE];
+    unsigned char *p;
+    FILE_WINDOW win;
+    PILOffset llFileSize, llPos;
+    unsigned int uiNeedLen;
+    uint32_t uiLen, uiDelay, uiDen;
+    int i;
+
+    pInfo->iChunks = 0;
+    pInfo->bIEND = FALSE;
+    pInfo->iXDPI = pInfo->iYDPI = 0;
+    pInfo->bICC = FALSE;
+    pInfo->iTextChunks = 0;
+    pInfo->ullTextBytes = 0;
+    pInfo->iCRCErrors = bVerifyCRC ? 0 : -1;
+    pInfo->iFrames = 0;
+    pInfo->iLoops = -1;
+    pInfo->ullDuration = 0;
+    pInfo->iFrameWidth = pInfo->iFrameHeight = 0;
+    llFileSize = (PILOffset)ullFileSize;
+    win.pBuf = ucWindow;
+    win.pData = NULL;
+    win.llStart = win.iLen = 0;
+    win.iReadSize = bVerifyCRC ? JPEG_SCAN_SIZE : DEFAULT_READ_SIZE;
+    llPos = 8;
+    p = WindowGet(iHandle, &win, 0, 8);
+    if (p == NULL)
+        goto chunks_exit;
+    if (memcmp(p, "\x89PNG\r\n\x1a\n", 8) != 0)
+        return IMAGEINFO_UNKNOWN_TYPE;
+    while (llPos + 12 <= llFileSize && (p = WindowGet(iHandle, &win, llPos, 8)) != NULL)
+    {
+        uiLen = TIFFLONG(p, TRUE);
+        if (uiLen > 0x7fffffff || llPos + 12 + uiLen > llFileSize) // damaged or truncated
+            break;
+        pInfo->iChunks++;
+        switch (TIFFLONG(&p[4], TRUE))
+        {
+            case 0x49454e44: // 'IEND'
+                pInfo->bIEND = TRUE;
+                break;
+            case 0x70485973: // 'pHYs'
+                p = WindowGet(iHandle, &win, llPos + 8, 9);
+                if (p != NULL && uiLen >= 9 && p[8] == 1) // pixels per meter
+                {
+                    pInfo->iXDPI = (int)(((uint64_t)TIFFLONG(p, TRUE) * 254 + 5000) / 10000);
+                    pInfo->iYDPI = (int)(((uint64_t)TIFFLONG(&p[4], TRUE) * 254 + 5000) / 10000);
+                }
+                break;
+            case 0x69434350: // 'iCCP'
+                pInfo->bICC = TRUE;
+                break;
+            case 0x74455874: // 'tEXt'
+            case 0x7a545874: // 'zTXt'
+            case 0x69545874: // 'iTXt'
+                pInfo->iTextChunks++;
+                pInfo->ullTextBytes += uiLen;
+                break;
+            case 0x6163544c: // 'acTL' animation control
+                p = WindowGet(iHandle, &win, llPos + 8, 8);
+                if (p != NULL && uiLen >= 8)
+                {
+                    pInfo->iFrames = (int)TIFFLONG(p, TRUE);
+                    pInfo->iLoops = (int)TIFFLONG(&p[4], TRUE);
+                }
+                break;
+            case 0x6663544c: // 'fcTL' frame control
+                p = WindowGet(iHandle, &win, llPos + 8, 26);
+                if (p != NULL && uiLen >= 26)
+                {
+                    i = (int)(TIFFLONG(&p[12], TRUE) + TIFFLONG(&p[4], TRUE)); // x offset + width
+                    if (i > pInfo->iFrameWidth)
+                        pInfo->iFrameWidth = i;
+                    i = (int)(TIFFLONG(&p[16], TRUE) + TIFFLONG(&p[8], TRUE)); // y offset + height
+                    if (i > pInfo->iFrameHeight)
+                        pInfo->iFrameHeight = i;
+                    uiDelay = MOTOSHORT(&p[20]);
+                    uiDen = MOTOSHORT(&p[22]);
+                    pInfo->ullDuration += (uint64_t)uiDelay * 1000 / (uiDen ? uiDen : 100); // a 0 denominator means 1/100ths
+                }
+                break;
+        }
+        if (bVerifyCRC)
+        {
+            i = PNGCheckCRC(iHandle, &win, llPos, uiLen);
+            if (i < 0)
+                break;
+            if (i == 0)
+                pInfo->iCRCErrors++;
+        }
+        llPos += 12 + uiLen;
+        if (pInfo->bIEND)
+            break;
+    }
+chunks_exit:
+    if (PILIONeedMore(iHandle, &llPos, &uiNeedLen))
+        return IMAGEINFO_NEED_MORE; // some of what we read wasn't there
+    return (pInfo->iChunks == 0) ? IMAGEINFO_INVALID : IMAGEINFO_SUCCESS;
+} /* imageinfo_png_chunks() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TIFFListValue(unsigned char *, int, BOOL)                  *
+ *                                                                          *
+ *  PURPOSE    : Retrieve one entry of a strip or tile list (SHORT, LONG or *
+ *               LONG8 values, iSize bytes each).                           *
+ *                                                                          *
+ ****************************************************************************/
+static PILOffset TIFFListValue(unsigned char *p, int iSize, BOOL bMotorola)
+{
+    if (iSize == 2)
+        return TIFFSHORT(p, bMotorola);
+    if (iSize == 4)
+        return TIFFLONG(p, bMotorola);
+    return (PILOffset)TIFFLONG64(p, bMotorola);
+} /* TIFFListValue() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TIFFDataEnd(void *, PILOffset, ImageInfo *)                *
+ *                                                                          *
+ *  PURPOSE    : Find where the data of the first page of a TIFF ends: the  *
+ *               end of its IFD and of the last TIFF_TAIL_ENTRIES strips    *
+ *               (or tiles), from the StripOffsets and StripByteCounts      *
+ *               lists. The probe already read the IFD and left where they  *
+ *               are in pInfo, so only the ends of the lists are read;      *
+ *               writers put the strips in order.                           *
+ *                                                                          *
+ *  RETURNS    : The offset of the end, or 0 if it can't be told.           *
+ *                                                                          *
+ ****************************************************************************/
+static PILOffset TIFFDataEnd(void *iHandle, PILOffset llFileSize, ImageInfo *pInfo)
+{
+    unsigned char cList[2][TIFF_TAIL_ENTRIES * 8];
+    unsigned char *pList[2];
+    PILOffset llEnd, llList, ll;
+    uint64_t ullCount[2];
+    int i, j, iBytes, iEntries;
+    BOOL bMotorola = pInfo->bMotorola;
+
+    llEnd = (PILOffset)pInfo->ullIFDEnd;
+    if (llEnd == 0) // no IFD
+        return 0;
+    pList[0] = pList[1] = NULL;
+    for (j=0; j<2; j++)
+    {
+        ullCount[j] = pInfo->ullStripCount[j];
+        if (ullCount[j] == 0) // no such tag
+            continue;
+        if (ullCount[j] * pInfo->iStripSize[j] <= (uint64_t)(pInfo->bBigTIFF ? 8 : 4)) // the values are in the tag
+            pList[j] = (unsigned char *)&pInfo->ullStrips[j];
+        else
+        {
+            iEntries = (ullCount[j] > TIFF_TAIL_ENTRIES) ? TIFF_TAIL_ENTRIES : (int)ullCount[j];
+            if (pInfo->ullStrips[j] >= (uint64_t)llFileSize)
+                return llFileSize + 1; // the list isn't there
+            llList = (PILOffset)pInfo->ullStrips[j] + (PILOffset)(ullCount[j] - iEntries) * pInfo->iStripSize[j];
+            pList[j] = ReadBlock(iHandle, NULL, 0, llFileSize, llList, iEntries * pInfo->iStripSize[j], cList[j], &iBytes);
+            if (iBytes < iEntries * pInfo->iStripSize[j])
+                return llFileSize + 1;
+            ullCount[j] = iEntries;
+        }
+    }
+    if (pList[0] == NULL || pList[1] == NULL) // no strips we can see
+        return (llEnd > llFileSize) ? llEnd : 0; // only a cut IFD tells us anything
+    iEntries = (ullCount[0] < ullCount[1]) ? (int)ullCount[0] : (int)ullCount[1];
+    for (i=1; i<=iEntries; i++) // match up the last entries of the two lists
+    {
+        ll = TIFFListValue(&pList[0][(ullCount[0] - i) * pInfo->iStripSize[0]], pInfo->iStripSize[0], bMotorola) + TIFFListValue(&pList[1][(ullCount[1] - i) * pInfo->iStripSize[1]], pInfo->iStripSize[1], bMotorola);
+        if (ll > llEnd)
+            llEnd = ll;
+    }
+    return llEnd;
+} /* TIFFDataEnd() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_check_complete(void *, uint64_t, ImageInfo *)    *
+ *                                                                          *
+ *  PURPOSE    : See if a file which has been probed (pInfo) ends where     *
+ *               its format says it should, from one small read at the end  *
+ *               of the file: the EOI marker of a JPEG (searched for        *
+ *               backwards, so trailing data is allowed and counted in      *
+ *               ullTrailing), the IEND chunk of a PNG (the same) or the    *
+ *               block terminator and trailer of a GIF (after any padding   *
+ *               with zeros). For a TIFF, the ends of the first IFD's strip *
+ *               lists (found by the probe) are read and the last strips    *
+ *               have to fit in the file. Sets pInfo->iComplete to 1 or -1, *
+ *               or leaves 0 for other types and TIFFs without strip lists. *
+ *                                                                          *
+ *  RETURNS    : IMAGEINFO_SUCCESS, or IMAGEINFO_NEED_MORE for a memory     *
+ *               handle which is missing part of the file.                  *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_check_complete(void *iHandle, uint64_t ullFileSize, ImageInfo *pInfo)
+{
+    unsigned char cTemp[TEMP_BUF_SIZE];
+    unsigned char *p;
+    PILOffset llFileSize, llStart, llMin, llEnd;
+    unsigned int uiNeedLen;
+    int i, iBytes;
+
+    pInfo->iComplete = 0;
+    pInfo->ullTrailing = 0;
+    llFileSize = (PILOffset)ullFileSize;
+    llStart = (llFileSize > TEMP_BUF_SIZE) ? llFileSize - TEMP_BUF_SIZE : 0;
+    switch (pInfo->iType)
+    {
+        case FILETYPE_JPEG:
+        case FILETYPE_PNG:
+            p = ReadBlock(iHandle, NULL, 0, llFileSize, llStart, (int)(llFileSize - llStart), cTemp, &iBytes);
+            pInfo->iComplete = -1;
+            // a JPEG's EOI can't be the one of the EXIF thumbnail
+            llMin = (PILOffset)(pInfo->ullThumbOffset + pInfo->uiThumbLen);
+            for (i = iBytes - 2; pInfo->iType == FILETYPE_JPEG && i >= 0 && llStart + i >= llMin; i--)
+            {
+                if (p[i] == 0xff && p[i+1] == 0xd9) // FF D9 never appears in coded data
+                {
+                    pInfo->iComplete = 1;
+                    pInfo->ullTrailing = (uint64_t)(iBytes - i - 2);
+                    break;
+                }
+            }
+            for (i = iBytes - 12; pInfo->iType == FILETYPE_PNG && i >= 0; i--)
+            {
+                if (memcmp(&p[i], "\0\0\0\0IEND\xae\x42\x60\x82", 12) == 0) // the CRC makes a false match unlikely
+                {
+                    pInfo->iComplete = 1;
+                    pInfo->ullTrailing = (uint64_t)(iBytes - i - 12);
+                    break;
+                }
+            }
+            break;
+        case FILETYPE_GIF:
+            p = ReadBlock(iHandle, NULL, 0, llFileSize, llStart, (int)(llFileSize - llStart), cTemp, &iBytes);
+            for (i = iBytes - 1; i > 0 && p[i] == 0; i--) // some writers pad the file with zeros
+                ;
+            if (i > 0 && p[i] == 0x3b && p[i-1] == 0) // last sub-block terminator and the trailer
+            {
+                pInfo->iComplete = 1;
+                pInfo->ullTrailing = (uint64_t)(iBytes - i - 1);
+            }
+            else
+                pInfo->iComplete = -1;
+            break;
+        case FILETYPE_TIFF:
+            llEnd = TIFFDataEnd(iHandle, llFileSize, pInfo);
+            if (llEnd > 0)
+                pInfo->iComplete = (llEnd <= llFileSize) ? 1 : -1;
+            break;
+    }
+    if (PILIONeedMore(iHandle, &llStart, &uiNeedLen))
+        return IMAGEINFO_NEED_MORE; // some of what we read wasn't there
+    return IMAGEINFO_SUCCESS;
+} /* imageinfo_check_complete() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_probe_prefix(const uint8_t *, size_t, ...)       *
+ *                                                                          *
+ *  PURPOSE    : Gather information about the start of a file which is     *
+ *               already in memory. The data is parsed in place. Anything   *
+ *               needed past the end of the buffer is reported back with    *
+ *               IMAGEINFO_NEED_MORE. ullFileSize is the size of the whole  *
+ *               file or 0 if it isn't known.                               *
+ *                                                                          *
+ *  RETURNS    : Same as imageinfo_probe_handle()                           *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_probe_prefix(const uint8_t *pData, size_t len, uint64_t ullFileSize, ImageInfo *pInfo)
+{
+    void *iHandle;
+    int iResult;
+    BOOL bUnknown = (ullFileSize == 0);
+    
+    if (bUnknown)
+        ullFileSize = UNKNOWN_FILE_SIZE;
+    iHandle = PILIOOpenMem((void *)pData, (unsigned long)len, ullFileSize);
+    if (iHandle == (void *)-1)
+    {
+        memset(pInfo, 0, sizeof(ImageInfo));
+        pInfo->iCRCErrors = -1;
+        return IMAGEINFO_IO_ERROR;
+    }
+    iResult = imageinfo_probe_handle(iHandle, ullFileSize, pInfo);
+    if (bUnknown)
+        pInfo->ullFileSize = 0;
+    PILIOClose(iHandle);
+    return iResult;
+} /* imageinfo_probe_prefix() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_probe_buffer(const uint8_t *, size_t, ...)       *
+ *                                                                          *
+ *  PURPOSE    : Gather information about a complete file in memory.        *
+ *                                                                          *
+ *  RETURNS    : Same as imageinfo_probe_handle()                           *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_probe_buffer(const uint8_t *pData, size_t len, ImageInfo *pInfo)
+{
+    return imageinfo_probe_prefix(pData, len, (uint64_t)len, pInfo);
+} /* imageinfo_probe_buffer() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_probe_fd(int, ImageInfo *)                       *
+ *                                                                          *
+ *  PURPOSE    : Gather information about a file opened by the caller.      *
+ *                                                                          *
+ *  RETURNS    : Same as imageinfo_probe_handle()                           *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_probe_fd(int iFD, ImageInfo *pInfo)
+{
+    void *iHandle;
+    int iResult;
+    
+    iHandle = PILIOOpenFD(iFD);
+    if (iHandle == (void *)-1)
+    {
+        memset(pInfo, 0, sizeof(ImageInfo));
+        pInfo->iCRCErrors = -1;
+        return IMAGEINFO_IO_ERROR;
+    }
+    iResult = imageinfo_probe_handle(iHandle, PILIOSize(iHandle), pInfo);
+    PILIOClose(iHandle); // leaves iFD open
+    return iResult;
+} /* imageinfo_probe_fd() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : StreamWant(ImageInfoStream *, uint64_t, unsigned int)      *
+ *                                                                          *
+ *  PURPOSE    : Set up the stream to collect a range the parser needs.     *
+ *               Bytes ahead of it will be skipped. A range which continues *
+ *               the last piece extends it, otherwise a new piece is added. *
+ *               The parser starts over each time, so it needs every piece  *
+ *               again; once they run out (e.g. a JPEG with many large      *
+ *               APPn segments) the last one takes in the bytes up to the   *
+ *               range instead of skipping them.                            *
+ *                                                                          *
+ *  RETURNS    : TRUE if successful, FALSE if the range was already         *
+ *               skipped (streams can't go backwards) or out of memory.     *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL StreamWant(ImageInfoStream *pStream, uint64_t ullOffset, unsigned int uiLen)
+{
+    STREAM_PIECE *pPiece = NULL;
+    uint64_t ullEnd = ullOffset + uiLen, ullAlloc;
+    unsigned char *p;
+    
+    if (pStream->ullFileSize != 0 && ullEnd > pStream->ullFileSize)
+        ullEnd = pStream->ullFileSize;
+    if (ullEnd <= pStream->ullPos) // already went by
+        return FALSE;
+    if (pStream->iPieceCount)
+    {
+        pPiece = &pStream->pieces[pStream->iPieceCount-1];
+        if (pPiece->ullOffset + pPiece->ulLen != pStream->ullPos || ullOffset < pPiece->ullOffset || ullOffset > pStream->ullPos)
+            pPiece = NULL; // doesn't continue the last piece
+    }
+    if (pPiece == NULL && pStream->iPieceCount >= PILIO_MAX_SEGS && ullOffset >= pStream->ullPos)
+    {
+        pPiece = &pStream->pieces[pStream->iPieceCount-1];
+        if (pPiece->ullOffset + pPiece->ulLen != pStream->ullPos || ullEnd - pPiece->ullOffset > STREAM_MAX_MERGE)
+            return FALSE;
+        ullOffset = pStream->ullPos; // merge the gap into the last piece
+    }
+    if (pPiece == NULL)
+    {
+        if (ullOffset < pStream->ullPos || pStream->iPieceCount >= PILIO_MAX_SEGS || (pStream->iPieceCount == 0 && ullOffset != 0))
+            return FALSE;
+        pPiece = &pStream->pieces[pStream->iPieceCount++];
+        pPiece->ullOffset = ullOffset;
+    }
+    if (ullEnd - pPiece->ullOffset > pPiece->ulAlloc)
+    {
+        ullAlloc = ullEnd - pPiece->ullOffset;
+        if (pPiece->ulAlloc != 0 && ullAlloc < pPiece->ulAlloc * 2ULL) // it keeps growing
+            ullAlloc = pPiece->ulAlloc * 2ULL;
+        p = (unsigned char *)realloc(pPiece->pData, ullAlloc);
+        if (p == NULL)
+            return FALSE;
+        pPiece->pData = p;
+        pPiece->ulAlloc = (unsigned long)ullAlloc;
+    }
+    pStream->ullWantStart = (ullOffset > pStream->ullPos) ? ullOffset : pStream->ullPos;
+    pStream->ullWantEnd = ullEnd;
+    return TRUE;
+} /* StreamWant() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : StreamRun(ImageInfoStream *)                               *
+ *                                                                          *
+ *  PURPOSE    : Run the parser over the pieces collected so far and set up *
+ *               the next range to collect if it needs more.                *
+ *                                                                          *
+ ****************************************************************************/
+static void StreamRun(ImageInfoStream *pStream)
+{
+    void *iHandle;
+    uint64_t ullSize;
+    int i;
+    
+    ullSize = pStream->ullFileSize ? pStream->ullFileSize : UNKNOWN_FILE_SIZE;
+    iHandle = PILIOOpenMem(pStream->pieces[0].pData, pStream->pieces[0].ulLen, ullSize);
+    if (iHandle == (void *)-1)
+    {
+        pStream->iResult = IMAGEINFO_IO_ERROR;
+        return;
+    }
+    for (i=1; i<pStream->iPieceCount; i++)
+        PILIOAddMem(iHandle, pStream->pieces[i].ullOffset, pStream->pieces[i].pData, pStream->pieces[i].ulLen);
+    pStream->iResult = imageinfo_probe_handle(iHandle, ullSize, &pStream->info);
+    PILIOClose(iHandle);
+    if (pStream->ullFileSize == 0)
+        pStream->info.ullFileSize = 0; // unknown
+    if (pStream->iResult == IMAGEINFO_NEED_MORE && !StreamWant(pStream, pStream->info.ullNeedOffset, pStream->info.uiNeedLen))
+        pStream->iResult = IMAGEINFO_INVALID;
+} /* StreamRun() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_stream_new(uint64_t)                             *
+ *                                                                          *
+ *  PURPOSE    : Start a push parser for a file of ullFileSize bytes (0 if  *
+ *               unknown, e.g. a pipe).                                     *
+ *                                                                          *
+ *  RETURNS    : The stream or NULL if out of memory.                       *
+ *                                                                          *
+ ****************************************************************************/
+ImageInfoStream * imageinfo_stream_new(uint64_t ullFileSize)
+{
+    ImageInfoStream *pStream;
+    
+    pStream = (ImageInfoStream *)calloc(1, sizeof(ImageInfoStream));
+    if (pStream == NULL)
+        return NULL;
+    pStream->ullFileSize = ullFileSize;
+    pStream->iResult = IMAGEINFO_NEED_MORE;
+    // the parser needs at least this much to tell the file type
+    if (!StreamWant(pStream, 0, DEFAULT_READ_SIZE))
+    {
+        free(pStream);
+        return NULL;
+    }
+    return pStream;
+} /* imageinfo_stream_new() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_stream_need(ImageInfoStream *, ...)              *
+ *                                                                          *
+ *  PURPOSE    : Tell the caller which bytes the parser is waiting for.     *
+ *               Anything pushed before *pullOffset is skipped.             *
+ *                                                                          *
+ *  RETURNS    : IMAGEINFO_NEED_MORE or the final result.                   *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_stream_need(ImageInfoStream *pStream, uint64_t *pullOffset, unsigned int *puiLen)
+{
+    *pullOffset = pStream->ullWantStart;
+    *puiLen = 0;
+    if (pStream->iResult == IMAGEINFO_NEED_MORE && pStream->ullWantEnd > pStream->ullWantStart)
+        *puiLen = (unsigned int)(pStream->ullWantEnd - pStream->ullWantStart);
+    return pStream->iResult;
+} /* imageinfo_stream_need() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_stream_push(ImageInfoStream *, const uint8_t *,  *
+ *                                     size_t, ImageInfo *)                 *
+ *                                                                          *
+ *  PURPOSE    : Feed the next chunk of the stream (any size) to the        *
+ *               parser. Only the ranges it asks for are kept; JPEG         *
+ *               segments and the data ahead of a TIFF IFD are skipped      *
+ *               over. The parser runs again after each chunk which adds    *
+ *               to the range it wants, so the result comes back with the   *
+ *               chunk holding the last byte it depends on.                 *
+ *               Push a length of 0 at the end of the stream.               *
+ *                                                                          *
+ *  RETURNS    : IMAGEINFO_NEED_MORE (with the next range wanted in         *
+ *               pInfo->ullNeedOffset/uiNeedLen) or the final result. Any   *
+ *               data pushed after the result is known is ignored.          *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_stream_push(ImageInfoStream *pStream, const uint8_t *pData, size_t len, ImageInfo *pInfo)
+{
+    STREAM_PIECE *pPiece;
+    uint64_t ullCount;
+    BOOL bCollected = FALSE; // got part of the range wanted
+    
+    if (pStream->iResult == IMAGEINFO_NEED_MORE && len == 0) // end of the stream
+    {
+        pStream->ullFileSize = pStream->ullPos;
+        if (pStream->iPieceCount == 0 || pStream->ullFileSize == 0)
+            pStream->iResult = IMAGEINFO_INVALID;
+        else
+            StreamRun(pStream);
+        if (pStream->iResult == IMAGEINFO_NEED_MORE) // it wants something we skipped
+            pStream->iResult = IMAGEINFO_INVALID;
+    }
+    while (len != 0 && pStream->iResult == IMAGEINFO_NEED_MORE)
+    {
+        if (pStream->ullPos < pStream->ullWantStart) // skip ahead
+        {
+            ullCount = pStream->ullWantStart - pStream->ullPos;
+            if (ullCount > len)
+                ullCount = (uint64_t)len;
+        }
+        else // collect it
+        {
+            pPiece = &pStream->pieces[pStream->iPieceCount-1];
+            ullCount = pStream->ullWantEnd - pStream->ullPos;
+            if (ullCount > len)
+                ullCount = (uint64_t)len;
+            memcpy(&pPiece->pData[pStream->ullPos - pPiece->ullOffset], pData, ullCount);
+            pPiece->ulLen += ullCount;
+            bCollected = TRUE;
+        }
+        pStream->ullPos += ullCount;
+        pData += ullCount;
+        len -= ullCount;
+        if (pStream->ullPos >= pStream->ullWantEnd || (pStream->ullFileSize != 0 && pStream->ullPos >= pStream->ullFileSize))
+        {
+            StreamRun(pStream);
+            bCollected = FALSE;
+        }
+    }
+    // The parser often needs only the start of a range (e.g. the next JPEG
+    // marker in a window), so try again with what we have
+    if (bCollected && pStream->iResult == IMAGEINFO_NEED_MORE && pStream->ullPos >= DEFAULT_READ_SIZE)
+        StreamRun(pStream);
+    memcpy(pInfo, &pStream->info, sizeof(ImageInfo));
+    if (pStream->iResult == IMAGEINFO_NEED_MORE)
+    {
+        pInfo->ullNeedOffset = pStream->ullWantStart;
+        pInfo->uiNeedLen = (unsigned int)(pStream->ullWantEnd - pStream->ullWantStart);
+    }
+    return pStream->iResult;
+} /* imageinfo_stream_push() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_stream_free(ImageInfoStream *)                   *
+ *                                                                          *
+ *  PURPOSE    : Free a push parser and the pieces it collected.            *
+ *                                                                          *
+ ****************************************************************************/
+void imageinfo_stream_free(ImageInfoStream *pStream)
+{
+    int i;
+    
+    if (pStream == NULL)
+        return;
+    for (i=0; i<pStream->iPieceCount; i++)
+        free(pStream->pieces[i].pData);
+    free(pStream);
+} /* imageinfo_stream_free() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_xxx_name(int)                                    *
+ *                                                                          *
+ *  PURPOSE    : Return the display name of an enumerated value.            *
+ *                                                                          *
+ ****************************************************************************/
+const char * imageinfo_type_name(int iType)
+{
+    const char *szName;
+
+    if (iType >= FILETYPE_COUNT && (szName = SigTypeName(iType)) != NULL)
+        return szName;
+    if (iType < 0 || iType >= FILETYPE_COUNT)
+        iType = FILETYPE_UNKNOWN;
+    return szType[iType];
+} /* imageinfo_type_name() */
+
+const char * imageinfo_compression_name(int iCompression)
+{
+    if (iCompression < 0 || iCompression >= COMPTYPE_COUNT)
+        iCompression = COMPTYPE_UNKNOWN;
+    return szComp[iCompression];
+} /* imageinfo_compression_name() */
+
+const char * imageinfo_jpeg_type_name(int iJPEGType)
+{
+    return szJPEGTypes[iJPEGType & 3];
+} /* imageinfo_jpeg_type_name() */
+
+const char * imageinfo_photometric_name(int iPhotometric)
+{
+    if (iPhotometric < 0 || iPhotometric > 7)
+        iPhotometric = 7;
+    return szPhotometric[iPhotometric];
+} /* imageinfo_photometric_name() */
+
+const char * imageinfo_planar_name(int iPlanar)
+{
+    if (iPlanar < 0 || iPlanar > 2)
+        iPlanar = 0;
+    return szPlanar[iPlanar];
+} /* imageinfo_planar_name() */
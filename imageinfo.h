@@ -0,0 +1,241 @@
+/************************************************************/
+/*--- Image file information library                     ---*/
+/* Copyright (c) 2017 BitBank Software, Inc.                */
+/************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#ifndef _IMAGEINFO_H_
+#define _IMAGEINFO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum
+{
+    FILETYPE_UNKNOWN = 0,
+    FILETYPE_PNG,
+    FILETYPE_JPEG,
+    FILETYPE_BMP,
+    FILETYPE_OS2BMP,
+    FILETYPE_TIFF,
+    FILETYPE_GIF,
+    FILETYPE_PPM,
+    FILETYPE_TARGA,
+    FILETYPE_JEDMICS,
+    FILETYPE_CALS,
+    FILETYPE_PCX,
+    FILETYPE_COUNT
+};
+
+enum
+{
+    COMPTYPE_UNKNOWN = 0,
+    COMPTYPE_FLATE,
+    COMPTYPE_JPEG,
+    COMPTYPE_NONE,
+    COMPTYPE_RLE,
+    COMPTYPE_LZW,
+    COMPTYPE_G3,
+    COMPTYPE_G4,
+    COMPTYPE_PACKBITS,
+    COMPTYPE_HUFFMAN,
+    COMPTYPE_THUNDERSCAN,
+    COMPTYPE_JBIG,
+    COMPTYPE_COUNT
+};
+
+// Return values of the probe functions
+enum
+{
+    IMAGEINFO_SUCCESS = 0,
+    IMAGEINFO_NEED_MORE = 1,     // ullNeedOffset/uiNeedLen tell what's missing
+    IMAGEINFO_UNKNOWN_TYPE = -1, // not a file type we recognize
+    IMAGEINFO_INVALID = -2,      // too small or the header is damaged
+    IMAGEINFO_IO_ERROR = -3
+};
+
+// Everything we learned about an image. The format specific fields are
+// only meaningful for the file types noted.
+typedef struct tagImageInfo
+{
+    int iType;          // FILETYPE_xxx
+    int iCompression;   // COMPTYPE_xxx
+    int iWidth;
+    int iHeight;
+    int iBpp;           // bits per pixel
+    int bInterlaced;    // PNG (with IHDR), GIF
+    int iJPEGType;      // JPEG: 0=baseline, 1=extended, 2=progressive, 3=lossless
+    int iSubSample;     // JPEG: color subsampling, horizontal<<4 | vertical
+    int iQuality;       // JPEG: IJG quality (1-100) estimated from the
+                        // quantization tables, 0 = no tables before the SOF
+    int bArithmetic;    // JPEG: arithmetic coding (SOF9-SOF15)
+    int bHierarchical;  // JPEG: hierarchical (DHP), the size is the final frame's
+    int iScans;         // JPEG: 0 unless counted with imageinfo_jpeg_scans()
+    int iFrames;        // GIF, APNG: 0 unless walked with imageinfo_gif_frames()
+                        // or imageinfo_png_chunks() (APNG: from acTL)
+    int iLoops;         // GIF: NETSCAPE2.0 loop count, APNG: num_plays;
+                        // 0 = forever, -1 = none
+    int iFrameWidth;    // GIF, APNG: extent of all the frames (left + width,
+    int iFrameHeight;   // top + height), which can exceed the screen
+    int iChunks;        // PNG: 0 unless walked with imageinfo_png_chunks()
+    int bIEND;          // PNG: the IEND chunk was reached
+    int iXDPI;          // PNG: resolution from pHYs in dots per inch, 0 if
+    int iYDPI;          // not given or only the aspect ratio is
+    int bICC;           // PNG: has an ICC profile (iCCP)
+    int iTextChunks;    // PNG: number of tEXt, zTXt and iTXt chunks
+    int iCRCErrors;     // PNG: chunks with a bad CRC, -1 = not checked
+    int iComplete;      // JPEG, PNG, GIF, TIFF: 1 = the file ends where its
+                        // format says, -1 = it was cut short, 0 = not
+                        // checked with imageinfo_check_complete()
+    int bMotorola;      // TIFF, JPEG EXIF: big-endian byte order
+    int iPhotometric;   // TIFF: 0-6 as in the spec, 7 = unknown
+    int iPlanar;        // TIFF: 1=chunky, 2=planar, 0=unknown
+    int bBigTIFF;       // TIFF: BigTIFF (version 43, 64-bit offsets)
+    int iStripSize[2];          // TIFF: for imageinfo_check_complete(), the
+    uint64_t ullStripCount[2];  // StripOffsets (or TileOffsets) and
+    uint64_t ullStrips[2];      // StripByteCounts of the first page: bytes
+                                // per entry, entries (0 = no such tag) and
+                                // the file offset of the list, or the values
+                                // themselves when they fit in the tag
+    uint64_t ullIFDEnd;         // TIFF: end of the first IFD, 0 if none
+    int iOrientation;   // JPEG EXIF: 1-8 as in the spec, 0 = not given
+    int iExifWidth;     // JPEG EXIF: PixelXDimension and PixelYDimension
+    int iExifHeight;    // (the size at capture), 0 if not given
+    unsigned int uiThumbLen;   // JPEG EXIF: length and file offset of the
+    uint64_t ullThumbOffset;   // embedded JPEG thumbnail, 0 if there is none
+    uint64_t ullDuration;      // GIF, APNG: total of the frame delays in ms
+    uint64_t ullTextBytes;     // PNG: total length of the text chunks
+    uint64_t ullTrailing;      // JPEG, PNG: bytes after the EOI or IEND
+    uint64_t ullFileSize;   // total size, if known
+    uint64_t ullNeedOffset; // IMAGEINFO_NEED_MORE: file offset of the
+    unsigned int uiNeedLen; // bytes which have to be provided
+} ImageInfo;
+
+// Probe a complete file already in memory. No system calls are made and
+// the data isn't copied.
+extern int imageinfo_probe_buffer(const uint8_t *pData, size_t len, ImageInfo *pInfo);
+// Probe the first len bytes of a file of ullFileSize bytes (0 if unknown).
+// If the parser needs bytes past the end of the buffer, IMAGEINFO_NEED_MORE
+// is returned along with where they are; probe again with a buffer which
+// covers them.
+extern int imageinfo_probe_prefix(const uint8_t *pData, size_t len, uint64_t ullFileSize, ImageInfo *pInfo);
+// Probe an open file descriptor. It is read with pread, so its file
+// position is left alone, and it is not closed.
+extern int imageinfo_probe_fd(int iFD, ImageInfo *pInfo);
+// Probe a PILIO handle (file, mapped or memory) of the given size
+extern int imageinfo_probe_handle(void *iHandle, uint64_t ullFileSize, ImageInfo *pInfo);
+// The same for a file whose type is already known from imageinfo_classify();
+// only the parser for that type runs. An iType of -1 detects it as usual.
+extern int imageinfo_probe_handle_type(void *iHandle, uint64_t ullFileSize, int iType, ImageInfo *pInfo);
+
+// One page (IFD) of a multi-page TIFF
+typedef struct tagImageInfoPage
+{
+    int iWidth;
+    int iHeight;
+    int iBpp;
+    int iCompression;   // COMPTYPE_xxx
+} ImageInfoPage;
+typedef void (*IMAGEINFO_PAGE_CALLBACK)(void *pUser, int iPage, const ImageInfoPage *pPage);
+// Walk the whole IFD chain of a TIFF, calling pfnPage (if not NULL) for
+// each page in order; the number of pages is returned in *piPages. Only the
+// IFDs are read and a chain which loops stops at the first repeated IFD.
+// With a memory handle this can return IMAGEINFO_NEED_MORE like the probe
+// functions; add the piece and walk again from the start.
+extern int imageinfo_tiff_pages(void *iHandle, uint64_t ullFileSize, IMAGEINFO_PAGE_CALLBACK pfnPage, void *pUser, int *piPages);
+// Count the scans of a JPEG (more than one for progressive files). Unlike
+// everything else this reads the whole file, since the scans can only be
+// found by searching the coded data between them. Memory handles can
+// return IMAGEINFO_NEED_MORE as above.
+extern int imageinfo_jpeg_scans(void *iHandle, uint64_t ullFileSize, int *piScans);
+// Walk the blocks of a GIF for the frame count, loop count, total of the
+// frame delays and the extent of the frames (the animation fields of
+// pInfo; the rest are left alone). The image data is skipped, not decoded,
+// but the whole file is read. Memory handles can return IMAGEINFO_NEED_MORE.
+extern int imageinfo_gif_frames(void *iHandle, uint64_t ullFileSize, ImageInfo *pInfo);
+// Walk the chunks of a PNG for the chunk fields of pInfo (iChunks, bIEND,
+// the resolution, ICC profile and text chunks, and the animation fields of
+// an APNG). Chunk data which isn't needed (IDAT) is skipped without being
+// read, unless bVerifyCRC is set; then every chunk's CRC is checked and the
+// bad ones counted in iCRCErrors, which reads the whole file. Memory handles
+// can return IMAGEINFO_NEED_MORE.
+extern int imageinfo_png_chunks(void *iHandle, uint64_t ullFileSize, int bVerifyCRC, ImageInfo *pInfo);
+// See if a probed file (pInfo from one of the probe functions) was cut
+// short, without reading it all: one small read at the end finds the
+// terminator of a JPEG (EOI, allowing up to 4K of trailing data), PNG (IEND)
+// or GIF (trailer); for a TIFF the last strips of the first page have to be
+// inside the file. Sets iComplete and ullTrailing. Memory handles can return
+// IMAGEINFO_NEED_MORE.
+extern int imageinfo_check_complete(void *iHandle, uint64_t ullFileSize, ImageInfo *pInfo);
+
+// Push parser for data arriving as a stream (uploads, pipes). Chunks of
+// any size are pushed in order; only the pieces the parser asks for are
+// kept and the rest is skipped. Each push returns IMAGEINFO_NEED_MORE
+// with the next range wanted, or the result as soon as it is known.
+// Push a length of 0 at the end of the stream.
+typedef struct tagImageInfoStream ImageInfoStream;
+extern ImageInfoStream * imageinfo_stream_new(uint64_t ullFileSize);
+extern int imageinfo_stream_push(ImageInfoStream *pStream, const uint8_t *pData, size_t len, ImageInfo *pInfo);
+extern int imageinfo_stream_need(ImageInfoStream *pStream, uint64_t *pullOffset, unsigned int *puiLen);
+extern void imageinfo_stream_free(ImageInfoStream *pStream);
+
+// File type signatures. A file matches when the first iLen bytes, ANDed
+// with ucMask, equal ucBytes and pfnCheck (if any) returns non-zero. Of
+// the matching signatures the one with the highest iConfidence wins, ties
+// going to the built-in types and then to the order of registration. The
+// built-in types use confidences of 10 (Targa, which has no magic number)
+// to 100 (PNG, GIF, CALS).
+#define IMAGEINFO_SIG_LEN 16
+typedef struct tagImageInfoSignature
+{
+    int iType;          // FILETYPE_xxx, or FILETYPE_UNKNOWN for a new type
+    int iConfidence;
+    int iLen;           // bytes compared, 1 to IMAGEINFO_SIG_LEN
+    uint8_t ucBytes[IMAGEINFO_SIG_LEN];
+    uint8_t ucMask[IMAGEINFO_SIG_LEN];
+    int (*pfnCheck)(const uint8_t *pHeader, int iLen); // optional extra test
+    // New types only: fill in pInfo from the start of the file (at least
+    // 256 bytes, or the whole file) and return IMAGEINFO_xxx
+    int (*pfnParse)(const uint8_t *pHeader, int iLen, ImageInfo *pInfo);
+    const char *szName; // new types only: for imageinfo_type_name()
+} ImageInfoSignature;
+// Add a signature, before any probing is done. Returns its file type (new
+// types are numbered from FILETYPE_COUNT up) or -1 if it isn't valid or
+// too many have been registered.
+extern int imageinfo_register_signature(const ImageInfoSignature *pSig);
+
+// Detect the file types of a batch of files at once from the start of each
+// (ppHeaders[i], piLens[i] bytes), with the same result as the probe
+// functions. Headers of at least IMAGEINFO_SIG_LEN bytes are compared with
+// SSE4.1 or AVX2 instructions when the CPU has them.
+extern void imageinfo_classify(const uint8_t * const *ppHeaders, const int *piLens, int iCount, int *piTypes);
+// Choose the classifier by name ("scalar", "sse4.1" or "avx2"), or the
+// fastest available for NULL (the default). Returns the name of the one in
+// use, or NULL if the one asked for isn't available.
+extern const char * imageinfo_classify_impl(const char *szName);
+
+extern const char * imageinfo_type_name(int iType);
+extern const char * imageinfo_compression_name(int iCompression);
+extern const char * imageinfo_jpeg_type_name(int iJPEGType);
+extern const char * imageinfo_photometric_name(int iPhotometric);
+extern const char * imageinfo_planar_name(int iPlanar);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // #ifndef _IMAGEINFO_H_
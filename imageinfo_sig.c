@@ -0,0 +1,539 @@
+/****************************************************************************
+ *                                                                          *
+ * MODULE:  IMAGEINFO_SIG.C                                                 *
+ *                                                                          *
+ * DESCRIPTION: Table driven file type detection                            *
+ *                                                                          *
+ * FUNCTIONS:                                                               *
+ *            imageinfo_register_signature - Add a file type signature      *
+ *            imageinfo_classify - Detect the types of a batch of files     *
+ *            imageinfo_classify_impl - Choose the SIMD code to use         *
+ *            SigDetect - Find the type matching the start of a file        *
+ *            SigTypeName - Name of a registered type                       *
+ * COMMENTS:                                                                *
+ *            Each type is described by masked bytes at the start of the    *
+ *            file, an optional extra test and a confidence. The table is   *
+ *            compiled into a list of candidates for each possible first    *
+ *            byte, sorted by confidence (then table order), so detection   *
+ *            is one lookup followed by a few masked compares and the       *
+ *            first match wins. Weak heuristics like Targa's can only       *
+ *            claim files nothing else matches. The batch classifier does   *
+ *            each masked compare as a single SSE4.1 or AVX2 (two           *
+ *            candidates at once) operation, picked at run time.            *
+ ****************************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#include "my_windows.h"
+#include <stdlib.h>
+#include <string.h>
+#include "imageinfo.h"
+#include "imageinfo_sig.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIG_X86
+#include <immintrin.h>
+#endif
+
+#define SIG_MAX_REGISTERED 32
+
+// The dispatch table is built on first use and replaced when a signature
+// is registered; readers pick it up with an acquire load
+#if defined(__GNUC__) || defined(__clang__)
+#define SIG_LOAD(pp) __atomic_load_n(pp, __ATOMIC_ACQUIRE)
+#define SIG_PUBLISH(pp, pOld, pNew) __atomic_compare_exchange_n(pp, &pOld, pNew, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define SIG_STORE(pp, v) __atomic_store_n(pp, v, __ATOMIC_RELEASE)
+#else // single threaded builds
+#define SIG_LOAD(pp) (*(pp))
+#define SIG_STORE(pp, v) (*(pp) = (v))
+#define SIG_PUBLISH(pp, pOld, pNew) (*(pp) == pOld ? (*(pp) = pNew, TRUE) : FALSE)
+#endif
+
+typedef struct tagSigDispatch
+{
+    int iStart[257]; // candidates for first byte b are pSigs[iStart[b]] to pSigs[iStart[b+1]-1]
+    const ImageInfoSignature **pSigs;
+    // Copies of the candidates' bytes and masks for the vector compares,
+    // zero past iLen, with one more entry which never matches so pairs
+    // can be loaded
+    uint8_t (*ucBytes)[IMAGEINFO_SIG_LEN];
+    uint8_t (*ucMask)[IMAGEINFO_SIG_LEN];
+} SIG_DISPATCH;
+
+typedef void (*SIG_CLASSIFY)(SIG_DISPATCH *pD, const uint8_t * const *ppHeaders, const int *piLens, int iCount, int *piTypes);
+
+enum
+{
+    SIG_IMPL_SCALAR = 0,
+    SIG_IMPL_SSE41,
+    SIG_IMPL_AVX2,
+    SIG_IMPL_COUNT
+};
+static const char *szImplName[SIG_IMPL_COUNT] = {"scalar", "sse4.1", "avx2"};
+
+static int PCXCheck(const uint8_t *p, int iLen)
+{
+    return p[1] < 6; // version
+} /* PCXCheck() */
+
+static int JEDMICSCheck(const uint8_t *p, int iLen)
+{
+    return iLen > 36 && (p[36] == 4 || p[36] == 6);
+} /* JEDMICSCheck() */
+
+static int TargaCheck(const uint8_t *p, int iLen)
+{
+    // image type 1-3 or 9-11 (the mask leaves 0 and 8), and not an MPEG stream
+    // (00 00 01 BA/B3); the signature only covers 3 bytes, so p[3] may not be there
+    return (p[2] & 3) != 0 && !(iLen > 3 && p[0] == 0 && p[1] == 0 && p[2] == 1 && (p[3] == 0xba || p[3] == 0xb3));
+} /* TargaCheck() */
+
+// Built-in types. Only types which share first bytes need distinct
+// confidences: Windows BMP (info header of 40 bytes) over OS/2 BMP, and
+// Targa, which has no magic number, below everything else.
+static const ImageInfoSignature builtinSigs[] = {
+    {FILETYPE_PNG, 100, 4, {0x89,'P','N','G'}, {0xff,0xff,0xff,0xff}, NULL, NULL, NULL},
+    {FILETYPE_BMP, 60, 15, {'B','M',0,0,0,0,0,0,0,0,0,0,0,0,0x28}, {0xff,0xff,0,0,0,0,0,0,0,0,0,0,0,0,0xff}, NULL, NULL, NULL},
+    {FILETYPE_OS2BMP, 55, 2, {'B','M'}, {0xff,0xff}, NULL, NULL, NULL},
+    {FILETYPE_PCX, 50, 3, {0x0a,0,0x01}, {0xff,0,0xff}, PCXCheck, NULL, NULL},
+    {FILETYPE_JEDMICS, 80, 4, {0x80,0,0,0}, {0xff,0xff,0xff,0xff}, JEDMICSCheck, NULL, NULL},
+    {FILETYPE_CALS, 100, 4, {'s','r','c','d'}, {0xff,0xff,0xff,0xff}, NULL, NULL, NULL},
+    {FILETYPE_JPEG, 90, 3, {0xff,0xd8,0xff}, {0xff,0xff,0xff}, NULL, NULL, NULL},
+    {FILETYPE_GIF, 100, 4, {'G','I','F','8'}, {0xff,0xff,0xff,0xff}, NULL, NULL, NULL},
+    {FILETYPE_TIFF, 50, 2, {'I','I'}, {0xff,0xff}, NULL, NULL, NULL},
+    {FILETYPE_TIFF, 50, 2, {'M','M'}, {0xff,0xff}, NULL, NULL, NULL},
+    {FILETYPE_PPM, 50, 4, {'P','4',0,0}, {0xff,0xff,0x80,0x80}, NULL, NULL, NULL}, // bitmap
+    {FILETYPE_PPM, 50, 4, {'P','5',0,0}, {0xff,0xff,0x80,0x80}, NULL, NULL, NULL}, // graymap
+    {FILETYPE_PPM, 50, 4, {'P','6',0,0}, {0xff,0xff,0x80,0x80}, NULL, NULL, NULL}, // pixmap
+    {FILETYPE_TARGA, 10, 3, {0,0,0}, {0,0xfe,0xf4}, TargaCheck, NULL, NULL},
+};
+#define BUILTIN_COUNT (int)(sizeof(builtinSigs) / sizeof(builtinSigs[0]))
+
+static ImageInfoSignature registeredSigs[SIG_MAX_REGISTERED];
+static int iRegistered = 0;
+static int iNextType = FILETYPE_COUNT; // numbers given to new types
+static SIG_DISPATCH *pDispatch = NULL;
+static int iImpl = -1; // SIG_IMPL_xxx used by imageinfo_classify(), -1 until chosen
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : SigBefore(const ImageInfoSignature *, int, ...)            *
+ *                                                                          *
+ *  PURPOSE    : Order of the candidates: higher confidence first, then     *
+ *               the order of the table (registered ones after built-in).   *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL SigBefore(const ImageInfoSignature *pA, int iA, const ImageInfoSignature *pB, int iB)
+{
+    if (pA->iConfidence != pB->iConfidence)
+        return pA->iConfidence > pB->iConfidence;
+    return iA < iB;
+} /* SigBefore() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : SigBuild(void)                                             *
+ *                                                                          *
+ *  PURPOSE    : Compile the signatures into the first byte dispatch table. *
+ *                                                                          *
+ *  RETURNS    : The table or NULL if out of memory.                        *
+ *                                                                          *
+ ****************************************************************************/
+static SIG_DISPATCH * SigBuild(void)
+{
+    const ImageInfoSignature *pAll[BUILTIN_COUNT + SIG_MAX_REGISTERED];
+    const ImageInfoSignature *pSig;
+    SIG_DISPATCH *pD;
+    int i, j, k, b, iCount, iTotal;
+
+    iCount = 0;
+    for (i=0; i<BUILTIN_COUNT; i++)
+        pAll[iCount++] = &builtinSigs[i];
+    for (i=0; i<iRegistered; i++)
+        pAll[iCount++] = &registeredSigs[i];
+    // sort by priority (insertion sort, the table is small)
+    for (i=1; i<iCount; i++)
+    {
+        pSig = pAll[i];
+        for (j=i; j>0 && SigBefore(pSig, i, pAll[j-1], j-1); j--)
+            pAll[j] = pAll[j-1];
+        pAll[j] = pSig;
+    }
+    // size the table; a signature with a wildcard first byte is a candidate for several
+    iTotal = 0;
+    for (b=0; b<256; b++)
+    {
+        for (i=0; i<iCount; i++)
+        {
+            if ((b & pAll[i]->ucMask[0]) == pAll[i]->ucBytes[0])
+                iTotal++;
+        }
+    }
+    // one block: the table, the byte and mask copies, then the pointers
+    pD = (SIG_DISPATCH *)malloc(sizeof(SIG_DISPATCH) + (iTotal + 1) * 2 * IMAGEINFO_SIG_LEN + iTotal * sizeof(ImageInfoSignature *));
+    if (pD == NULL)
+        return NULL;
+    pD->ucBytes = (uint8_t (*)[IMAGEINFO_SIG_LEN])&pD[1];
+    pD->ucMask = &pD->ucBytes[iTotal + 1];
+    pD->pSigs = (const ImageInfoSignature **)&pD->ucMask[iTotal + 1];
+    memset(pD->ucBytes, 0, (iTotal + 1) * 2 * IMAGEINFO_SIG_LEN);
+    pD->ucBytes[iTotal][0] = 1; // (x & 0) != 1
+    k = 0;
+    for (b=0; b<256; b++)
+    {
+        pD->iStart[b] = k;
+        for (i=0; i<iCount; i++)
+        {
+            pSig = pAll[i];
+            if ((b & pSig->ucMask[0]) == pSig->ucBytes[0])
+            {
+                pD->pSigs[k] = pSig;
+                memcpy(pD->ucBytes[k], pSig->ucBytes, pSig->iLen);
+                memcpy(pD->ucMask[k], pSig->ucMask, pSig->iLen);
+                k++;
+            }
+        }
+    }
+    pD->iStart[256] = k;
+    return pD;
+} /* SigBuild() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : SigGetDispatch(void)                                       *
+ *                                                                          *
+ *  PURPOSE    : Return the dispatch table, building it on first use.       *
+ *                                                                          *
+ ****************************************************************************/
+static SIG_DISPATCH * SigGetDispatch(void)
+{
+    SIG_DISPATCH *pD, *pOld = NULL;
+
+    pD = SIG_LOAD(&pDispatch);
+    if (pD == NULL) // first use
+    {
+        pD = SigBuild();
+        if (pD == NULL)
+            return NULL;
+        if (!SIG_PUBLISH(&pDispatch, pOld, pD)) // another thread beat us to it
+        {
+            free(pD);
+            pD = pOld;
+        }
+    }
+    return pD;
+} /* SigGetDispatch() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : SigFind(SIG_DISPATCH *, const uint8_t *, int)              *
+ *                                                                          *
+ *  PURPOSE    : Try the candidates for the first byte one byte at a time.  *
+ *                                                                          *
+ ****************************************************************************/
+static const ImageInfoSignature * SigFind(SIG_DISPATCH *pD, const uint8_t *pHeader, int iLen)
+{
+    const ImageInfoSignature *pSig;
+    int i, j, iEnd;
+
+    if (iLen < 1)
+        return NULL;
+    iEnd = pD->iStart[pHeader[0] + 1];
+    for (i=pD->iStart[pHeader[0]]; i<iEnd; i++)
+    {
+        pSig = pD->pSigs[i];
+        if (pSig->iLen > iLen)
+            continue;
+        for (j=1; j<pSig->iLen; j++)
+        {
+            if ((pHeader[j] & pSig->ucMask[j]) != pSig->ucBytes[j])
+                break;
+        }
+        if (j == pSig->iLen && (pSig->pfnCheck == NULL || (*pSig->pfnCheck)(pHeader, iLen)))
+            return pSig;
+    }
+    return NULL;
+} /* SigFind() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : SigDetect(const uint8_t *, int)                            *
+ *                                                                          *
+ *  PURPOSE    : Find the best signature matching the start of a file.      *
+ *                                                                          *
+ *  RETURNS    : The signature or NULL if the type is unknown.              *
+ *                                                                          *
+ ****************************************************************************/
+const ImageInfoSignature * SigDetect(const uint8_t *pHeader, int iLen)
+{
+    SIG_DISPATCH *pD = SigGetDispatch();
+
+    return (pD == NULL) ? NULL : SigFind(pD, pHeader, iLen);
+} /* SigDetect() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ClassifyScalar(SIG_DISPATCH *, ...)                        *
+ *                                                                          *
+ *  PURPOSE    : Batch classifier for CPUs without the vector extensions.   *
+ *                                                                          *
+ ****************************************************************************/
+static void ClassifyScalar(SIG_DISPATCH *pD, const uint8_t * const *ppHeaders, const int *piLens, int iCount, int *piTypes)
+{
+    const ImageInfoSignature *pSig;
+    int i;
+
+    for (i=0; i<iCount; i++)
+    {
+        pSig = SigFind(pD, ppHeaders[i], piLens[i]);
+        piTypes[i] = (pSig == NULL) ? FILETYPE_UNKNOWN : pSig->iType;
+    }
+} /* ClassifyScalar() */
+
+#ifdef SIG_X86
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ClassifySSE41(SIG_DISPATCH *, ...)                         *
+ *                                                                          *
+ *  PURPOSE    : Batch classifier doing each masked compare of the first    *
+ *               16 bytes with one AND, XOR and PTEST.                      *
+ *                                                                          *
+ ****************************************************************************/
+__attribute__((target("sse4.1")))
+static void ClassifySSE41(SIG_DISPATCH *pD, const uint8_t * const *ppHeaders, const int *piLens, int iCount, int *piTypes)
+{
+    const ImageInfoSignature *pSig;
+    const uint8_t *p;
+    __m128i xHeader, x;
+    int i, k, iEnd, iType;
+
+    for (i=0; i<iCount; i++)
+    {
+        p = ppHeaders[i];
+        if (piLens[i] < IMAGEINFO_SIG_LEN) // too short to load a vector
+        {
+            pSig = SigFind(pD, p, piLens[i]);
+            piTypes[i] = (pSig == NULL) ? FILETYPE_UNKNOWN : pSig->iType;
+            continue;
+        }
+        xHeader = _mm_loadu_si128((const __m128i *)p);
+        iType = FILETYPE_UNKNOWN;
+        iEnd = pD->iStart[p[0] + 1];
+        for (k=pD->iStart[p[0]]; k<iEnd; k++)
+        {
+            x = _mm_and_si128(xHeader, _mm_loadu_si128((const __m128i *)pD->ucMask[k]));
+            x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)pD->ucBytes[k]));
+            if (!_mm_testz_si128(x, x))
+                continue;
+            pSig = pD->pSigs[k];
+            if (pSig->pfnCheck == NULL || (*pSig->pfnCheck)(p, piLens[i]))
+            {
+                iType = pSig->iType;
+                break;
+            }
+        }
+        piTypes[i] = iType;
+    }
+} /* ClassifySSE41() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ClassifyAVX2(SIG_DISPATCH *, ...)                          *
+ *                                                                          *
+ *  PURPOSE    : Batch classifier comparing the first 16 bytes against two  *
+ *               candidates per 256-bit operation.                          *
+ *                                                                          *
+ ****************************************************************************/
+__attribute__((target("avx2")))
+static void ClassifyAVX2(SIG_DISPATCH *pD, const uint8_t * const *ppHeaders, const int *piLens, int iCount, int *piTypes)
+{
+    const ImageInfoSignature *pSig;
+    const uint8_t *p;
+    __m256i yHeader, y, yZero = _mm256_setzero_si256();
+    unsigned int uiEqual;
+    int i, k, iEnd, iType;
+
+    for (i=0; i<iCount; i++)
+    {
+        p = ppHeaders[i];
+        if (piLens[i] < IMAGEINFO_SIG_LEN) // too short to load a vector
+        {
+            pSig = SigFind(pD, p, piLens[i]);
+            piTypes[i] = (pSig == NULL) ? FILETYPE_UNKNOWN : pSig->iType;
+            continue;
+        }
+        yHeader = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)p));
+        iType = FILETYPE_UNKNOWN;
+        iEnd = pD->iStart[p[0] + 1];
+        for (k=pD->iStart[p[0]]; k<iEnd && iType == FILETYPE_UNKNOWN; k+=2)
+        {
+            // candidates k and k+1 (which may belong to the next list; ignore it then)
+            y = _mm256_and_si256(yHeader, _mm256_loadu_si256((const __m256i *)pD->ucMask[k]));
+            y = _mm256_xor_si256(y, _mm256_loadu_si256((const __m256i *)pD->ucBytes[k]));
+            uiEqual = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(y, yZero));
+            if ((uiEqual & 0xffff) == 0xffff)
+            {
+                pSig = pD->pSigs[k];
+                if (pSig->pfnCheck == NULL || (*pSig->pfnCheck)(p, piLens[i]))
+                    iType = pSig->iType;
+            }
+            if (iType == FILETYPE_UNKNOWN && (uiEqual >> 16) == 0xffff && k+1 < iEnd)
+            {
+                pSig = pD->pSigs[k+1];
+                if (pSig->pfnCheck == NULL || (*pSig->pfnCheck)(p, piLens[i]))
+                    iType = pSig->iType;
+            }
+        }
+        piTypes[i] = iType;
+    }
+} /* ClassifyAVX2() */
+#endif // SIG_X86
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : SigImplSupported(int)                                      *
+ *                                                                          *
+ *  PURPOSE    : See if the CPU can run one of the classifiers.             *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL SigImplSupported(int i)
+{
+#ifdef SIG_X86
+    __builtin_cpu_init(); // in case we're called from a constructor
+    if (i == SIG_IMPL_SSE41)
+        return __builtin_cpu_supports("sse4.1");
+    if (i == SIG_IMPL_AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return (i == SIG_IMPL_SCALAR);
+} /* SigImplSupported() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_classify_impl(const char *)                      *
+ *                                                                          *
+ *  PURPOSE    : Choose the classifier by name ("scalar", "sse4.1" or       *
+ *               "avx2"), or the fastest one the CPU supports for NULL.     *
+ *                                                                          *
+ *  RETURNS    : The name of the one in use, NULL if the one asked for      *
+ *               isn't available (the choice is left alone then).           *
+ *                                                                          *
+ ****************************************************************************/
+const char * imageinfo_classify_impl(const char *szName)
+{
+    int i;
+
+    if (szName == NULL)
+    {
+        for (i=SIG_IMPL_COUNT-1; !SigImplSupported(i); i--)
+            ;
+    }
+    else
+    {
+        for (i=0; i<SIG_IMPL_COUNT && strcmp(szName, szImplName[i]) != 0; i++)
+            ;
+        if (i == SIG_IMPL_COUNT || !SigImplSupported(i))
+            return NULL;
+    }
+    SIG_STORE(&iImpl, i);
+    return szImplName[i];
+} /* imageinfo_classify_impl() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_classify(const uint8_t * const *, ...)           *
+ *                                                                          *
+ *  PURPOSE    : Detect the types of a batch of files from the start of     *
+ *               each, with the same result as the probe functions.         *
+ *                                                                          *
+ ****************************************************************************/
+void imageinfo_classify(const uint8_t * const *ppHeaders, const int *piLens, int iCount, int *piTypes)
+{
+    SIG_DISPATCH *pD;
+    SIG_CLASSIFY pfnClassify = ClassifyScalar;
+    int i;
+
+    pD = SigGetDispatch();
+    if (pD == NULL)
+    {
+        for (i=0; i<iCount; i++)
+            piTypes[i] = FILETYPE_UNKNOWN;
+        return;
+    }
+    if (SIG_LOAD(&iImpl) < 0)
+        imageinfo_classify_impl(NULL);
+#ifdef SIG_X86
+    if (SIG_LOAD(&iImpl) == SIG_IMPL_SSE41)
+        pfnClassify = ClassifySSE41;
+    else if (SIG_LOAD(&iImpl) == SIG_IMPL_AVX2)
+        pfnClassify = ClassifyAVX2;
+#endif
+    (*pfnClassify)(pD, ppHeaders, piLens, iCount, piTypes);
+} /* imageinfo_classify() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : imageinfo_register_signature(const ImageInfoSignature *)   *
+ *                                                                          *
+ *  PURPOSE    : Add a signature. With iType = FILETYPE_UNKNOWN it is a     *
+ *               new type, which needs pfnParse and szName, and gets the    *
+ *               next free type number. Otherwise it is another way to      *
+ *               recognize a built-in type. Call it before probing; it      *
+ *               isn't safe while other threads are probing.                *
+ *                                                                          *
+ *  RETURNS    : The file type of the signature, or -1 if it is invalid or  *
+ *               the table is full.                                         *
+ *                                                                          *
+ ****************************************************************************/
+int imageinfo_register_signature(const ImageInfoSignature *pSig)
+{
+    ImageInfoSignature *pNew;
+    SIG_DISPATCH *pD, *pOld;
+
+    if (iRegistered >= SIG_MAX_REGISTERED || pSig->iLen < 1 || pSig->iLen > IMAGEINFO_SIG_LEN)
+        return -1;
+    if (pSig->iType == FILETYPE_UNKNOWN ? (pSig->pfnParse == NULL || pSig->szName == NULL) : (pSig->iType < 0 || pSig->iType >= iNextType))
+        return -1;
+    pNew = &registeredSigs[iRegistered++];
+    memcpy(pNew, pSig, sizeof(ImageInfoSignature));
+    if (pNew->iType == FILETYPE_UNKNOWN)
+        pNew->iType = iNextType++;
+    pD = SigBuild(); // switch to a table which includes it
+    if (pD == NULL)
+    {
+        iRegistered--;
+        return -1;
+    }
+    pOld = SIG_LOAD(&pDispatch);
+    pDispatch = pD;
+    free(pOld);
+    return pNew->iType;
+} /* imageinfo_register_signature() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : SigTypeName(int)                                           *
+ *                                                                          *
+ *  PURPOSE    : Return the name of a registered file type.                 *
+ *                                                                          *
+ ****************************************************************************/
+const char * SigTypeName(int iType)
+{
+    int i;
+
+    for (i=0; i<iRegistered; i++)
+    {
+        if (registeredSigs[i].iType == iType && registeredSigs[i].szName != NULL)
+            return registeredSigs[i].szName;
+    }
+    return NULL;
+} /* SigTypeName() */
@@ -0,0 +1,29 @@
+/************************************************************/
+/*--- File type signatures (internal to the library)     ---*/
+/* Copyright (c) 2017 BitBank Software, Inc.                */
+/************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#ifndef _IMAGEINFO_SIG_H_
+#define _IMAGEINFO_SIG_H_
+
+#include "imageinfo.h"
+
+// Find the signature of the best (highest confidence) type matching the
+// start of a file, or NULL if none does. iLen should be at least
+// IMAGEINFO_SIG_LEN; signatures longer than the data never match.
+extern const ImageInfoSignature * SigDetect(const uint8_t *pHeader, int iLen);
+// Name of a registered file type, NULL if iType isn't one
+extern const char * SigTypeName(int iType);
+
+#endif // #ifndef _IMAGEINFO_SIG_H_
@@ -32,619 +32,1712 @@
 
 #include "my_windows.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#define read _read
+#define open _open
+#define close _close
+#define unlink _unlink
+#else
+#include <unistd.h>
+#define O_BINARY 0
+#endif
 #include "pil_io.h"
+#include "pil_out.h"
+#include "imageinfo.h"
+#include "pil_crc.h"
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <pthread.h>
+#include "pil_scan.h"
+#include "pil_uring.h"
+#include "pil_cache.h"
+#include "pil_archive.h"
+#include "pil_serve.h"
+#endif
 
-#define TEMP_BUF_SIZE 4096
-#define DEFAULT_READ_SIZE 256
-#define MAX_TAGS 256
-#define TIFF_TAGSIZE 12
+#define LIST_BUF_SIZE 65536
+#define STREAM_BUF_SIZE 4096
 
 #ifdef _WIN32
 #define PILIO_SLASH_CHAR '\\'
 #else
 #define PILIO_SLASH_CHAR '/'
 #endif
+#define PILIO_MAX_PATH 4096
 
-typedef unsigned int uint32_t;
-
-const char *szJPEGTypes[] = {"BASELINE", "EXTENDED", "PROGRESSIVE", "LOSSLESS"};
-const char *szType[] = {"Unknown", "PNG","JFIF","Win BMP","OS/2 BMP","TIFF","GIF","Portable Pixmap","Targa","JEDMICS","CALS","PCX"};
-const char *szComp[] = {"Unknown", "Flate","JPEG","None","RLE","LZW","G3","G4","Packbits","Modified Huffman","Thunderscan RLE","JBIG (T.85)"};
-const char *szPhotometric[] = {"WhiteIsZero","BlackIsZero","RGB","Palette Color","Transparency Mask","CMYK","YCbCr","Unknown"};
-const char *szPlanar[] = {"Unknown","Chunky","Planar"};
-
+// Output formats (--format=)
 enum
 {
-    FILETYPE_UNKNOWN = 0,
-    FILETYPE_PNG,
-    FILETYPE_JPEG,
-    FILETYPE_BMP,
-    FILETYPE_OS2BMP,
-    FILETYPE_TIFF,
-    FILETYPE_GIF,
-    FILETYPE_PPM,
-    FILETYPE_TARGA,
-    FILETYPE_JEDMICS,
-    FILETYPE_CALS,
-    FILETYPE_PCX
+    FORMAT_TEXT = 0,
+    FORMAT_JSONL,
+    FORMAT_CSV,
+    FORMAT_BIN
 };
+static int iFormat = FORMAT_TEXT;
 
-enum
+// Every page of multi-page TIFFs (--pages)
+typedef struct tagPageList
 {
-    COMPTYPE_UNKNOWN = 0,
-    COMPTYPE_FLATE,
-    COMPTYPE_JPEG,
-    COMPTYPE_NONE,
-    COMPTYPE_RLE,
-    COMPTYPE_LZW,
-    COMPTYPE_G3,
-    COMPTYPE_G4,
-    COMPTYPE_PACKBITS,
-    COMPTYPE_HUFFMAN,
-    COMPTYPE_THUNDERSCAN,
-    COMPTYPE_JBIG
-};
+    int iPages;
+    int iMax;
+    ImageInfoPage *pPages;
+} PAGE_LIST;
+static BOOL bPages = FALSE;
+static BOOL bScans = FALSE; // count the scans of JPEGs (--scans)
+static BOOL bFrames = FALSE; // walk the frames of GIFs (--frames)
+static BOOL bChunks = FALSE; // walk the chunks of PNGs (--chunks)
+static BOOL bVerifyCRC = FALSE; // and check their CRCs (--verify-crc)
+static BOOL bCheckComplete = FALSE; // look for truncated files (--check-complete)
+#ifndef _WIN32
+static BOOL bArchives = FALSE; // probe the members of tar and zip files (--archives)
+#define TYPE_MEMBER -2 // iType of archive members, which aren't searched for archives
+BOOL ProcessArchive(void *pOut, void *iHandle, char *szFileName);
+#endif
+// Totals shown at the end with --verify-crc and --check-complete
+static unsigned long long ullCRCBytes = 0, ullCRCNs = 0;
+static unsigned int uiCRCFiles = 0, uiCRCBad = 0;
+static unsigned int uiChecked = 0, uiTruncated = 0, uiTrailing = 0;
+#ifndef _WIN32
+static pthread_mutex_t totalsMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+// Embedded JPEG thumbnails are copied to files in this directory (--thumb)
+static char *szThumbDir = NULL;
+
+// One record of --format=bin. The pathname is in the block's string table
+// (see pil_out.h); the fields hold the values of the ImageInfo structure.
+typedef struct tagInfoRecord
+{
+    uint64_t ullFileSize;
+    uint32_t uiName;        // offset of the pathname in the string table
+    int32_t iResult;        // IMAGEINFO_xxx, IO_ERROR = file not found
+    int32_t iType;
+    int32_t iCompression;
+    int32_t iWidth;
+    int32_t iHeight;
+    int32_t iBpp;
+    int32_t bInterlaced;
+    int32_t iJPEGType;
+    int32_t iSubSample;
+    int32_t bMotorola;
+    int32_t iPhotometric;
+    int32_t iPlanar;
+    int32_t iPages;         // TIFF with --pages, otherwise 0
+    int32_t iOrientation;
+    int32_t iExifWidth;
+    int32_t iExifHeight;
+    uint32_t uiThumbLen;
+    uint64_t ullThumbOffset;
+    int32_t iQuality;
+    int32_t bArithmetic;
+    int32_t bHierarchical;
+    int32_t iScans;         // JPEG with --scans, otherwise 0
+    uint64_t ullDuration;   // GIF with --frames, APNG with --chunks, else 0
+    int32_t iFrames;
+    int32_t iLoops;
+    int32_t iFrameWidth;
+    int32_t iFrameHeight;
+    uint64_t ullTextBytes;  // PNG with --chunks, otherwise 0 (all eight)
+    int32_t iChunks;
+    int32_t bIEND;
+    int32_t iXDPI;
+    int32_t iYDPI;
+    int32_t bICC;
+    int32_t iTextChunks;
+    int32_t iCRCErrors;     // -1 unless --verify-crc
+    int32_t iComplete;      // with --check-complete, otherwise 0 (both)
+    uint64_t ullTrailing;
+} INFO_RECORD;
+
+// A writer for the main thread and one for each scanner thread
+#define MAX_WRITERS 257
+static void *pWriters[MAX_WRITERS];
 
 /****************************************************************************
  *                                                                          *
- *  FUNCTION   : TIFFSHORT(char *, BOOL)                                    *
+ *  FUNCTION   : GetWriter(int)                                             *
  *                                                                          *
- *  PURPOSE    : Retrieve a short value from a TIFF tag.                    *
+ *  PURPOSE    : Return the output writer of a thread (0 = main thread,     *
+ *               n+1 = scanner thread n), creating it on first use. Each    *
+ *               slot is only used by one thread at a time.                 *
  *                                                                          *
  ****************************************************************************/
-unsigned short TIFFSHORT(unsigned char *p, BOOL bMotorola)
+void * GetWriter(int iSlot)
 {
-    unsigned short s;
-    
-    if (bMotorola)
-        s = *p * 0x100 + *(p+1);
-    else
-        s = *p + *(p+1)*0x100;
-    
-    return s;
-} /* TIFFSHORT() */
+    if (pWriters[iSlot] == NULL)
+    {
+        pWriters[iSlot] = PILOutOpen(1, iFormat == FORMAT_BIN ? (int)sizeof(INFO_RECORD) : 0);
+        if (pWriters[iSlot] == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(-1);
+        }
+    }
+    return pWriters[iSlot];
+} /* GetWriter() */
 
 /****************************************************************************
  *                                                                          *
- *  FUNCTION   : TIFFLONG(char *, BOOL)                                     *
+ *  FUNCTION   : FlushWriters(BOOL)                                         *
  *                                                                          *
- *  PURPOSE    : Retrieve a long value from a TIFF tag.                     *
+ *  PURPOSE    : Write out everything buffered, optionally freeing the      *
+ *               writers. Only call it when no other thread is writing.     *
  *                                                                          *
  ****************************************************************************/
-uint32_t TIFFLONG(unsigned char *p, BOOL bMotorola)
+void FlushWriters(BOOL bClose)
 {
-    uint32_t l;
-    
-    if (bMotorola)
-        l = *p * 0x1000000 + *(p+1) * 0x10000 + *(p+2) * 0x100 + *(p+3);
-    else
-        l = *p + *(p+1) * 0x100 + *(p+2) * 0x10000 + *(p+3) * 0x1000000;
+    int i;
     
-    return l;
-} /* TIFFLONG() */
+    for (i=0; i<MAX_WRITERS; i++)
+    {
+        if (pWriters[i] == NULL)
+            continue;
+        if (bClose)
+        {
+            PILOutClose(pWriters[i]);
+            pWriters[i] = NULL;
+        }
+        else
+            PILOutFlush(pWriters[i]);
+    }
+} /* FlushWriters() */
 
 /****************************************************************************
  *                                                                          *
- *  FUNCTION   : TIFFVALUE(char *, BOOL)                                    *
+ *  FUNCTION   : QuoteString(char *, char *, BOOL)                          *
  *                                                                          *
- *  PURPOSE    : Retrieve the value from a TIFF tag.                        *
+ *  PURPOSE    : Write a string as a quoted JSON (bCSV = FALSE) or CSV      *
+ *               field. The destination needs room for 6 times the length  *
+ *               of the string plus 3.                                      *
+ *                                                                          *
+ *  RETURNS    : Number of bytes written, not counting the terminator.      *
  *                                                                          *
  ****************************************************************************/
-int TIFFVALUE(unsigned char *p, BOOL bMotorola)
+int QuoteString(char *pDest, char *szString, BOOL bCSV)
 {
-    int i, iType;
+    static const char szHex[] = "0123456789abcdef";
+    unsigned char c;
+    char *d = pDest;
     
-    iType = TIFFSHORT(p+2, bMotorola);
-    /* If pointer to a list of items, must be a long */
-    if (TIFFSHORT(p+4, bMotorola) > 1)
-        iType = 4;
-    switch (iType)
-    {
-        case 3: /* Short */
-            i = TIFFSHORT(p+8, bMotorola);
-            break;
-        case 4: /* Long */
-        case 7: // undefined (treat it as a long since it's usually a multibyte buffer)
-            i = TIFFLONG(p+8, bMotorola);
-            break;
-        case 6: // signed byte
-            i = (signed char)p[8];
-            break;
-        case 2: /* ASCII */
-        case 5: /* Unsigned Rational */
-        case 10: /* Signed Rational */
-            i = TIFFLONG(p+8, bMotorola);
-            break;
-        default: /* to suppress compiler warning */
-            i = 0;
-            break;
+    *d++ = '"';
+    while ((c = (unsigned char)*szString++) != 0)
+    {
+        if (c == '"')
+        {
+            *d++ = bCSV ? '"' : '\\'; // CSV doubles quotes
+            *d++ = '"';
+        }
+        else if (!bCSV && c == '\\')
+        {
+            *d++ = '\\';
+            *d++ = '\\';
+        }
+        else if (!bCSV && c < 0x20)
+        {
+            memcpy(d, "\\u00", 4);
+            d[4] = szHex[c >> 4];
+            d[5] = szHex[c & 0xf];
+            d += 6;
+        }
+        else
+            *d++ = (char)c;
     }
-    return i;
-    
-} /* TIFFVALUE() */
+    *d++ = '"';
+    *d = '\0';
+    return (int)(d - pDest);
+} /* QuoteString() */
 
 /****************************************************************************
  *                                                                          *
- *  FUNCTION   : ParseNumber(char *, int *)                                 *
+ *  FUNCTION   : FillRecord(INFO_RECORD *, int, ImageInfo *, PAGE_LIST *)   *
  *                                                                          *
- *  PURPOSE    : Read the ascii string and convert to a number.             *
+ *  PURPOSE    : Fill in a binary record (--format=bin and --serve) from a  *
+ *               result. pInfo is NULL unless the file was identified; the  *
+ *               record is expected to be zeroed and uiName is left alone.  *
  *                                                                          *
  ****************************************************************************/
-int ParseNumber(unsigned char *buf, int *iOff, int iLength)
+void FillRecord(INFO_RECORD *pRec, int iResult, ImageInfo *pInfo, PAGE_LIST *pPages)
 {
-    int i, iOffset;
-    
-    i = 0;
-    iOffset = *iOff;
-    
-    while (iOffset < iLength && buf[iOffset] >= '0' && buf[iOffset] <= '9')
-    {
-        i *= 10;
-        i += (int)(buf[iOffset++] - '0');
-    }
-    *iOff = iOffset+1; /* Skip ending char */
-    return i;
-    
-} /* ParseNumber() */
+    pRec->iResult = iResult;
+    pRec->iCRCErrors = -1; // not checked
+    if (pInfo == NULL)
+        return;
+    pRec->ullFileSize = pInfo->ullFileSize;
+    pRec->iType = pInfo->iType;
+    pRec->iCompression = pInfo->iCompression;
+    pRec->iWidth = pInfo->iWidth;
+    pRec->iHeight = pInfo->iHeight;
+    pRec->iBpp = pInfo->iBpp;
+    pRec->bInterlaced = pInfo->bInterlaced;
+    pRec->iJPEGType = pInfo->iJPEGType;
+    pRec->iSubSample = pInfo->iSubSample;
+    pRec->bMotorola = pInfo->bMotorola;
+    pRec->iPhotometric = pInfo->iPhotometric;
+    pRec->iPlanar = pInfo->iPlanar;
+    pRec->iOrientation = pInfo->iOrientation;
+    pRec->iExifWidth = pInfo->iExifWidth;
+    pRec->iExifHeight = pInfo->iExifHeight;
+    pRec->uiThumbLen = pInfo->uiThumbLen;
+    pRec->ullThumbOffset = pInfo->ullThumbOffset;
+    pRec->iQuality = pInfo->iQuality;
+    pRec->bArithmetic = pInfo->bArithmetic;
+    pRec->bHierarchical = pInfo->bHierarchical;
+    pRec->iScans = pInfo->iScans;
+    pRec->ullDuration = pInfo->ullDuration;
+    pRec->iFrames = pInfo->iFrames;
+    pRec->iLoops = pInfo->iLoops;
+    pRec->iFrameWidth = pInfo->iFrameWidth;
+    pRec->iFrameHeight = pInfo->iFrameHeight;
+    pRec->ullTextBytes = pInfo->ullTextBytes;
+    pRec->iChunks = pInfo->iChunks;
+    pRec->bIEND = pInfo->bIEND;
+    pRec->iXDPI = pInfo->iXDPI;
+    pRec->iYDPI = pInfo->iYDPI;
+    pRec->bICC = pInfo->bICC;
+    pRec->iTextChunks = pInfo->iTextChunks;
+    pRec->iCRCErrors = pInfo->iCRCErrors;
+    pRec->iComplete = pInfo->iComplete;
+    pRec->ullTrailing = pInfo->ullTrailing;
+    if (pPages != NULL)
+        pRec->iPages = pPages->iPages;
+} /* FillRecord() */
 
 /****************************************************************************
  *                                                                          *
- *  FUNCTION   : ProcessFile(char *, int)                                   *
+ *  FUNCTION   : DisplayInfoEx(void *, char *, int, ImageInfo *, char *,    *
+ *                             PAGE_LIST *)                                 *
  *                                                                          *
- *  PURPOSE    : Gather and display information about a specific file.      *
+ *  PURPOSE    : Display the result of probing a file in the chosen output  *
+ *               format. szError overrides the result for problems found    *
+ *               before probing (e.g. "file not found"). The text format    *
+ *               only shows unknown types and errors passed in szError;     *
+ *               the other formats have a record for every file.            *
+ *               pPages (--pages) adds each page of a TIFF to the text and  *
+ *               JSON formats and the page count to JSON and binary.        *
  *                                                                          *
  ****************************************************************************/
-void ProcessFile(char *szFileName, int iFileSize)
+void DisplayInfoEx(void *pOut, char *szFileName, int iResult, ImageInfo *pInfo, char *szError, PAGE_LIST *pPages)
 {
-    int i, j, k;
-    void * iHandle;
-    int iBytes;
-    int iFileType = FILETYPE_UNKNOWN;
-    int iCompression = COMPTYPE_UNKNOWN;
-    unsigned char cBuf[TEMP_BUF_SIZE]; // small buffer to load header info
-    int iBpp = 0;
-    int iWidth = 0;
-    int iHeight = 0;
-    int iOffset;
-    int iMarker;
-    int iPhotoMetric;
-    int iPlanar;
-    int iCount;
-    unsigned char ucSubSample;
-    BOOL bMotorola;
-    char szOptions[256];
-    
-    // Detect the file type by its header
-    iHandle = PILIOOpenRO(szFileName);
-    if (iHandle == (void *)-1)
-    {
-        return;
-    }
-    iBytes = PILIORead(iHandle, cBuf, DEFAULT_READ_SIZE);
-    if (iBytes != DEFAULT_READ_SIZE)
-        return; // too small
-    if (MOTOLONG(cBuf) == 0x89504e47) // PNG
-        iFileType = FILETYPE_PNG;
-    else if (cBuf[0] == 'B' && cBuf[1] == 'M') // BMP
-    {
-        if (cBuf[14] == 0x28) // Windows
-            iFileType = FILETYPE_BMP;
-        else 
-            iFileType = FILETYPE_OS2BMP;
-    }
+    char szOptions[512];
+    char *p;
+    int i, iLen;
+    ImageInfoPage *pPage;
+    unsigned int uiName;
+    INFO_RECORD *pRec;
 
-    else if (cBuf[0] == 0x0a && cBuf[1] < 0x6 && cBuf[2] == 0x01)
-    {
-	iFileType = FILETYPE_PCX;
-    }
-    else if (INTELLONG(cBuf) == 0x80 && (cBuf[36] == 4 || cBuf[36] == 6))
-    {
-        iFileType = FILETYPE_JEDMICS;
-    }
-    else if (INTELLONG(cBuf) == 0x64637273)
+    if (szError == NULL && iResult != IMAGEINFO_SUCCESS)
     {
-        iFileType = FILETYPE_CALS;
+        if (iResult == IMAGEINFO_UNKNOWN_TYPE)
+            szError = "unknown file type";
+        else if (iFormat == FORMAT_TEXT)
+            return;
+        else
+            szError = (iResult == IMAGEINFO_IO_ERROR) ? "read error" : "invalid file";
     }
-    else if ((MOTOLONG(cBuf) & 0xffffff00) == 0xffd8ff00) // JPEG
-        iFileType = FILETYPE_JPEG;
-    else if (MOTOLONG(cBuf) == 0x47494638 /*'GIF8'*/) // GIF
-        iFileType = FILETYPE_GIF;
-    else if ((cBuf[0] == 'I' && cBuf[1] == 'I') || (cBuf[0] == 'M' && cBuf[1] == 'M'))
-        iFileType = FILETYPE_TIFF;
-    else
+    if (iFormat == FORMAT_BIN)
     {
-        i = MOTOLONG(cBuf) & 0xffff8080;
-        if (i == 0x50360000 || i == 0x50350000 || i == 0x50340000) // Portable bitmap/graymap/pixmap
-            iFileType = FILETYPE_PPM;
+        pRec = (INFO_RECORD *)PILOutRecord(pOut, szFileName, &uiName);
+        if (pRec == NULL)
+            return;
+        pRec->uiName = uiName;
+        FillRecord(pRec, iResult, (iResult == IMAGEINFO_SUCCESS && szError == NULL) ? pInfo : NULL, pPages);
+        return;
     }
-    // Check for Truvision Targa
-    i = cBuf[1] & 0xfe;
-    j = cBuf[2];
-    // make sure it is not a MPEG file (starts with 00 00 01 BA)
-    if (MOTOLONG(cBuf) != 0x1ba && MOTOLONG(cBuf) != 0x1b3 && i == 0 && (j == 1 || j == 2 || j == 3 || j == 9 || j == 10 || j == 11))
-        iFileType = FILETYPE_TARGA;
-    
-    if (iFileType == FILETYPE_UNKNOWN)
+    if (szError != NULL || iResult != IMAGEINFO_SUCCESS)
+        pPages = NULL;
+    // room for the quoted name and everything else
+    i = (pPages == NULL) ? 0 : pPages->iPages * (128 + (iFormat == FORMAT_TEXT ? (int)strlen(szFileName) : 0));
+    p = PILOutReserve(pOut, (int)strlen(szFileName)*6 + 768 + i);
+    if (p == NULL)
+        return;
+    iLen = 0;
+    if (szError != NULL)
     {
-        printf("%s - unknown file type\n", szFileName);
-        goto process_exit;
+        switch (iFormat)
+        {
+            case FORMAT_TEXT:
+                iLen = sprintf(p, "%s - %s\n", szFileName, szError);
+                break;
+            case FORMAT_JSONL:
+                iLen = sprintf(p, "{\"file\":");
+                iLen += QuoteString(&p[iLen], szFileName, FALSE);
+                iLen += sprintf(&p[iLen], ",\"error\":\"%s\"}\n", szError);
+                break;
+            case FORMAT_CSV:
+                iLen = QuoteString(p, szFileName, TRUE);
+                iLen += sprintf(&p[iLen], ",,,,,,,,,,,,,%s\n", szError);
+                break;
+        }
+        PILOutCommit(pOut, iLen);
+        return;
     }
     szOptions[0] = '\0'; // info specific to each file type
-    // Get info specific to each type of file
-    switch (iFileType)
-    {
-	case FILETYPE_PCX:
-	   iWidth = 1 + INTELSHORT(&cBuf[8]) - INTELSHORT(&cBuf[4]);
-           iHeight = 1 + INTELSHORT(&cBuf[10]) - INTELSHORT(&cBuf[6]);
-	   iCompression = COMPTYPE_PACKBITS;
-	   iBpp = cBuf[3] * cBuf[65];
-	   break;
-
-        case FILETYPE_PNG:
-            if (MOTOLONG(&cBuf[12]) == 0x49484452/*'IHDR'*/)
+    switch (iFormat)
+    {
+        case FORMAT_TEXT:
+            switch (pInfo->iType)
             {
-                iWidth = MOTOLONG(&cBuf[16]);
-                iHeight = MOTOLONG(&cBuf[20]);
-                iCompression = COMPTYPE_FLATE;
-                i = cBuf[24]; // bits per pixel
-                j = cBuf[25]; // pixel type
-                switch (j)
-                {
-                    case 0: // grayscale
-                    case 3: // palette image
-                        iBpp = i;
-                        break;
-                    case 2: // RGB triple
-                        iBpp = i * 3;
-                        break;
-                    case 4: // grayscale + alpha channel
-                        iBpp = i * 2;
+                case FILETYPE_PNG:
+                    if (pInfo->iCompression != COMPTYPE_FLATE) // no IHDR
                         break;
-                    case 6: // RGB + alpha
-                        iBpp = i * 4;
-                        break;
-                }
-                if (cBuf[28] == 1) // interlace flag
-                    strcpy(szOptions, ", Interlaced");
-                else
-                    strcpy(szOptions, ", Not interlaced");
-            }
-            break;
-        case FILETYPE_TARGA:
-            iWidth = INTELSHORT(&cBuf[12]);
-            iHeight = INTELSHORT(&cBuf[14]);
-            iBpp = cBuf[16];
-            if (cBuf[2] == 3 || cBuf[2] == 11) // monochrome
-                iBpp = 1;
-            if (cBuf[2] < 9)
-                iCompression = COMPTYPE_NONE;
-            else
-                iCompression = COMPTYPE_RLE;
-            break;
-        case FILETYPE_PPM:
-            if (cBuf[1] == '4')
-                iBpp = 1;
-            else if (cBuf[1] == '5')
-                iBpp = 8;
-            else if (cBuf[1] == '6')
-                iBpp = 24;
-            j = 2;
-            while ((cBuf[j] == 0xa || cBuf[j] == 0xd) && j<DEFAULT_READ_SIZE)
-                j++; // skip newline/cr
-            while (cBuf[j] == '#' && j < DEFAULT_READ_SIZE) // skip over comments
-            {
-                while (cBuf[j] != 0xa && cBuf[j] != 0xd && j < DEFAULT_READ_SIZE)
-                    j++;
-                while ((cBuf[j] == 0xa || cBuf[j] == 0xd) && j<DEFAULT_READ_SIZE)
-                    j++; // skip newline/cr
+                    // fall through
+                case FILETYPE_GIF:
+                    i = sprintf(szOptions, pInfo->bInterlaced ? ", Interlaced" : ", Not interlaced");
+                    if (pInfo->iFrames) // GIF with --frames or APNG with --chunks
+                    {
+                        i += sprintf(&szOptions[i], ", Frames=%d", pInfo->iFrames);
+                        if (pInfo->iFrameWidth || pInfo->iFrameHeight) // frame headers seen (fcTL in an APNG)
+                            i += sprintf(&szOptions[i], ", Duration=%llums, Frame extent: %d x %d", (unsigned long long)pInfo->ullDuration, pInfo->iFrameWidth, pInfo->iFrameHeight);
+                        if (pInfo->iLoops == 0)
+                            i += sprintf(&szOptions[i], ", Loops forever");
+                        else if (pInfo->iLoops > 0)
+                            i += sprintf(&szOptions[i], ", Loops=%d", pInfo->iLoops);
+                    }
+                    if (pInfo->iType == FILETYPE_PNG && pInfo->iChunks)
+                    {
+                        i += sprintf(&szOptions[i], ", Chunks=%d", pInfo->iChunks);
+                        if (pInfo->iXDPI || pInfo->iYDPI)
+                            i += sprintf(&szOptions[i], ", DPI: %d x %d", pInfo->iXDPI, pInfo->iYDPI);
+                        if (pInfo->bICC)
+                            i += sprintf(&szOptions[i], ", ICC profile");
+                        if (pInfo->iTextChunks)
+                            i += sprintf(&szOptions[i], ", Text chunks=%d (%llu bytes)", pInfo->iTextChunks, (unsigned long long)pInfo->ullTextBytes);
+                        if (pInfo->iCRCErrors >= 0)
+                            i += sprintf(&szOptions[i], ", CRC errors=%d", pInfo->iCRCErrors);
+                        if (!pInfo->bIEND)
+                            sprintf(&szOptions[i], ", No IEND");
+                    }
+                    break;
+                case FILETYPE_JPEG:
+                    i = sprintf(szOptions, ", type = %s, color subsampling = %d:%d", imageinfo_jpeg_type_name(pInfo->iJPEGType), (pInfo->iSubSample>>4),(pInfo->iSubSample & 0xf));
+                    if (pInfo->bArithmetic)
+                        i += sprintf(&szOptions[i], ", arithmetic coding");
+                    if (pInfo->bHierarchical)
+                        i += sprintf(&szOptions[i], ", hierarchical");
+                    if (pInfo->iQuality)
+                        i += sprintf(&szOptions[i], ", quality = %d", pInfo->iQuality);
+                    if (pInfo->iScans)
+                        i += sprintf(&szOptions[i], ", scans = %d", pInfo->iScans);
+                    if (pInfo->iOrientation)
+                        i += sprintf(&szOptions[i], ", orientation = %d", pInfo->iOrientation);
+                    if (pInfo->uiThumbLen)
+                        sprintf(&szOptions[i], ", thumbnail = %u bytes at %llu", pInfo->uiThumbLen, (unsigned long long)pInfo->ullThumbOffset);
+                    break;
+                case FILETYPE_TIFF:
+                    i = sprintf(szOptions, ", Photometric = %s, Planar config = %s", imageinfo_photometric_name(pInfo->iPhotometric), imageinfo_planar_name(pInfo->iPlanar));
+                    if (pInfo->bBigTIFF)
+                        i += sprintf(&szOptions[i], ", BigTIFF");
+                    if (pPages != NULL)
+                        sprintf(&szOptions[i], ", Pages=%d", pPages->iPages);
+                    break;
             }
-            // get width and height
-            iWidth = ParseNumber(cBuf, &j, DEFAULT_READ_SIZE);
-            iHeight = ParseNumber(cBuf, &j, DEFAULT_READ_SIZE);
-            iCompression = COMPTYPE_NONE;
-            break;
-        case FILETYPE_BMP:
-            iCompression = COMPTYPE_NONE;
-            iWidth = INTELSHORT(&cBuf[18]);
-            iHeight = INTELSHORT(&cBuf[22]);
-            if (iHeight & 0x8000) // upside down
-                iHeight = 65536 - iHeight;
-            iBpp = cBuf[28]; /* Number of bits per plane */
-            iBpp *= cBuf[26]; /* Number of planes */
-            if (cBuf[30] && (iBpp == 4 || iBpp == 8)) // if biCompression is non-zero (2=4bit rle, 1=8bit rle,4=24bit rle)
-                iCompression = COMPTYPE_RLE; // windows run-length
-            break;
-        case FILETYPE_OS2BMP:
-            iCompression = COMPTYPE_NONE;
-            if (cBuf[14] == 12) // version 1.2
+            i = (int)strlen(szOptions);
+            if (pInfo->iComplete < 0)
+                sprintf(&szOptions[i], ", Truncated");
+            else if (pInfo->iComplete > 0)
             {
-                iWidth = INTELSHORT(&cBuf[18]);
-                iHeight = INTELSHORT(&cBuf[20]);
-                iBpp = cBuf[22]; /* Number of bits per plane */
-                iBpp *= cBuf[24]; /* Number of planes */
+                i += sprintf(&szOptions[i], ", Complete");
+                if (pInfo->ullTrailing)
+                    sprintf(&szOptions[i], ", %llu bytes after the end", (unsigned long long)pInfo->ullTrailing);
             }
-            else
+            iLen = sprintf(p, "%s: Type=%s, Compression=%s, Size: %d x %d, %d-Bpp%s\n", szFileName, imageinfo_type_name(pInfo->iType), imageinfo_compression_name(pInfo->iCompression), pInfo->iWidth, pInfo->iHeight, pInfo->iBpp, szOptions);
+            for (i=0; pPages != NULL && i<pPages->iPages && i<pPages->iMax; i++)
             {
-                iWidth = INTELSHORT(&cBuf[18]);
-                iHeight = INTELSHORT(&cBuf[22]);
-                iBpp = cBuf[28]; /* Number of bits per plane */
-                iBpp *= cBuf[26]; /* Number of planes */
+                pPage = &pPages->pPages[i];
+                iLen += sprintf(&p[iLen], "%s: Page %d of %d, Compression=%s, Size: %d x %d, %d-Bpp\n", szFileName, i+1, pPages->iPages, imageinfo_compression_name(pPage->iCompression), pPage->iWidth, pPage->iHeight, pPage->iBpp);
             }
-            if (iHeight & 0x8000) // upside down
-                iHeight = 65536 - iHeight;
-            if (cBuf[30] == 1 || cBuf[30] == 2 || cBuf[30] == 4) // if biCompression is non-zero (2=4bit rle, 1=8bit rle,4=24bit rle)
-                iCompression = COMPTYPE_RLE; // windows run-length
             break;
-        case FILETYPE_JEDMICS:
-            iBpp = 1;
-            iWidth = INTELSHORT(&cBuf[6]);
-            iWidth <<= 3; // convert byte width to pixel width
-            iHeight = INTELSHORT(&cBuf[4]);
-            iCompression = COMPTYPE_G4;
-            break;
-        case FILETYPE_CALS:
-            iBpp = 1;
-            iCompression = COMPTYPE_G4;
-            PILIOSeek(iHandle, 750, 0); // read some more
-            iBytes = PILIORead(iHandle, cBuf, 1);
-            if (cBuf[0] == '1') // type 1 file
+        case FORMAT_JSONL:
+            switch (pInfo->iType)
             {
-                PILIOSeek(iHandle, 1033, 0); // read some more
-                iBytes = PILIORead(iHandle, cBuf, 256);
-                i = 0;
-                iWidth = ParseNumber(cBuf, &i, 256);
-                iHeight = ParseNumber(cBuf, &i, 256);
+                case FILETYPE_PNG:
+                    if (pInfo->iCompression != COMPTYPE_FLATE)
+                        break;
+                    // fall through
+                case FILETYPE_GIF:
+                    i = sprintf(szOptions, ",\"interlaced\":%s", pInfo->bInterlaced ? "true" : "false");
+                    if (pInfo->iFrames)
+                    {
+                        i += sprintf(&szOptions[i], ",\"frames\":%d", pInfo->iFrames);
+                        if (pInfo->iFrameWidth || pInfo->iFrameHeight)
+                            i += sprintf(&szOptions[i], ",\"duration_ms\":%llu,\"frame_width\":%d,\"frame_height\":%d", (unsigned long long)pInfo->ullDuration, pInfo->iFrameWidth, pInfo->iFrameHeight);
+                        if (pInfo->iLoops >= 0)
+                            i += sprintf(&szOptions[i], ",\"loops\":%d", pInfo->iLoops);
+                    }
+                    if (pInfo->iType == FILETYPE_PNG && pInfo->iChunks)
+                    {
+                        i += sprintf(&szOptions[i], ",\"chunks\":%d,\"iend\":%s", pInfo->iChunks, pInfo->bIEND ? "true" : "false");
+                        if (pInfo->iXDPI || pInfo->iYDPI)
+                            i += sprintf(&szOptions[i], ",\"dpi_x\":%d,\"dpi_y\":%d", pInfo->iXDPI, pInfo->iYDPI);
+                        if (pInfo->bICC)
+                            i += sprintf(&szOptions[i], ",\"icc\":true");
+                        if (pInfo->iTextChunks)
+                            i += sprintf(&szOptions[i], ",\"text_chunks\":%d,\"text_bytes\":%llu", pInfo->iTextChunks, (unsigned long long)pInfo->ullTextBytes);
+                        if (pInfo->iCRCErrors >= 0)
+                            sprintf(&szOptions[i], ",\"crc_errors\":%d", pInfo->iCRCErrors);
+                    }
+                    break;
+                case FILETYPE_JPEG:
+                    i = sprintf(szOptions, ",\"jpeg_type\":\"%s\",\"subsampling\":\"%d:%d\"", imageinfo_jpeg_type_name(pInfo->iJPEGType), (pInfo->iSubSample>>4),(pInfo->iSubSample & 0xf));
+                    if (pInfo->bArithmetic)
+                        i += sprintf(&szOptions[i], ",\"arithmetic\":true");
+                    if (pInfo->bHierarchical)
+                        i += sprintf(&szOptions[i], ",\"hierarchical\":true");
+                    if (pInfo->iQuality)
+                        i += sprintf(&szOptions[i], ",\"quality\":%d", pInfo->iQuality);
+                    if (pInfo->iScans)
+                        i += sprintf(&szOptions[i], ",\"scans\":%d", pInfo->iScans);
+                    if (pInfo->iOrientation)
+                        i += sprintf(&szOptions[i], ",\"orientation\":%d", pInfo->iOrientation);
+                    if (pInfo->iExifWidth && pInfo->iExifHeight)
+                        i += sprintf(&szOptions[i], ",\"exif_width\":%d,\"exif_height\":%d", pInfo->iExifWidth, pInfo->iExifHeight);
+                    if (pInfo->uiThumbLen)
+                        sprintf(&szOptions[i], ",\"thumb_offset\":%llu,\"thumb_length\":%u", (unsigned long long)pInfo->ullThumbOffset, pInfo->uiThumbLen);
+                    break;
+                case FILETYPE_TIFF:
+                    sprintf(szOptions, ",\"photometric\":\"%s\",\"planar\":\"%s\"%s", imageinfo_photometric_name(pInfo->iPhotometric), imageinfo_planar_name(pInfo->iPlanar), pInfo->bBigTIFF ? ",\"bigtiff\":true" : "");
+                    break;
             }
-            else // type 2
+            i = (int)strlen(szOptions);
+            if (pInfo->iComplete)
             {
-                PILIOSeek(iHandle, 1024, 0); // read some more
-                iBytes = PILIORead(iHandle, cBuf, 128);
-                if (MOTOLONG(cBuf) == 0x7270656c && MOTOLONG(&cBuf[4]) == 0x636e743a) // "rpelcnt:"
-                {
-                    i = 9;
-                    iWidth = ParseNumber(cBuf, &i, 256);
-                    iHeight = ParseNumber(cBuf, &i, 256);
-                }
+                i += sprintf(&szOptions[i], ",\"complete\":%s", pInfo->iComplete > 0 ? "true" : "false");
+                if (pInfo->ullTrailing)
+                    sprintf(&szOptions[i], ",\"trailing_bytes\":%llu", (unsigned long long)pInfo->ullTrailing);
             }
-            break;
-        case FILETYPE_JPEG:
-            iCompression = COMPTYPE_JPEG;
-            i = j = 2; /* Start at offset of first marker */
-            iMarker = 0; /* Search for SOF (start of frame) marker */
-            while (i < 32 && iMarker != 0xffc0 && j < iFileSize)
+            iLen = sprintf(p, "{\"file\":");
+            iLen += QuoteString(&p[iLen], szFileName, FALSE);
+            iLen += sprintf(&p[iLen], ",\"size\":%llu,\"type\":\"%s\",\"compression\":\"%s\",\"width\":%d,\"height\":%d,\"bpp\":%d%s", (unsigned long long)pInfo->ullFileSize, imageinfo_type_name(pInfo->iType), imageinfo_compression_name(pInfo->iCompression), pInfo->iWidth, pInfo->iHeight, pInfo->iBpp, szOptions);
+            if (pPages != NULL)
             {
-                iMarker = MOTOSHORT(&cBuf[i]) & 0xfffc;
-                if (iMarker < 0xff00) // invalid marker, could be generated by "Arles Image Web Page Creator" or Accusoft
-                {
-                    i += 2;
-                    continue; // skip 2 bytes and try to resync
-                }
-                if (iMarker == 0xffe0 && cBuf[i+4] == 'E' && cBuf[i+5] == 'x') // EXIF, check for thumbnail
+                iLen += sprintf(&p[iLen], ",\"pages\":%d,\"page_list\":[", pPages->iPages);
+                for (i=0; i<pPages->iPages && i<pPages->iMax; i++)
                 {
-                    unsigned char cTemp[1024];
-                    //               int iOff;
-                    memcpy(cTemp, cBuf, 32);
-                    iBytes = PILIORead(iHandle, &cTemp[32], 1024-32);
-                    bMotorola = (cTemp[i+10] == 'M');
-                    // Future - do something with the thumbnail
-                    //               iOff = PILTIFFLONG(&cTemp[i+14], bMotorola); // get offset to first IFD (info)
-                    //               PILTIFFMiniInfo(pFile, bMotorola, j + 10 + iOff, TRUE);
+                    pPage = &pPages->pPages[i];
+                    iLen += sprintf(&p[iLen], "%s{\"width\":%d,\"height\":%d,\"bpp\":%d,\"compression\":\"%s\"}", i ? "," : "", pPage->iWidth, pPage->iHeight, pPage->iBpp, imageinfo_compression_name(pPage->iCompression));
                 }
-                if (iMarker == 0xffc0) // the one we're looking for
-                    break;
-                j += 2 + MOTOSHORT(&cBuf[i+2]); /* Skip to next marker */
-                if (j < iFileSize) // need to read more
-                {
-                    PILIOSeek(iHandle, j, 0); // read some more
-                    iBytes = PILIORead(iHandle, cBuf, 32);
-                    i = 0;
-                }
-            } // while
-            if (iMarker != 0xffc0)
-                goto process_exit; // error - invalid file?
-            else
-            {
-                iBpp = cBuf[i+4]; // bits per sample
-                iHeight = MOTOSHORT(&cBuf[i+5]);
-                iWidth = MOTOSHORT(&cBuf[i+7]);
-                iBpp = iBpp * cBuf[i+9]; /* Bpp = number of components * bits per sample */
-                ucSubSample = cBuf[i+11];
-                iMarker = MOTOSHORT(&cBuf[i]);
-                sprintf(szOptions, ", type = %s, color subsampling = %d:%d", szJPEGTypes[iMarker & 3], (ucSubSample>>4),(ucSubSample & 0xf));
+                p[iLen++] = ']';
             }
+            iLen += sprintf(&p[iLen], "}\n");
             break;
-        case FILETYPE_GIF:
-            iCompression = COMPTYPE_LZW;
-            iWidth = INTELSHORT(&cBuf[6]);
-            iHeight = INTELSHORT(&cBuf[8]);
-            iBpp = (cBuf[10] & 7) + 1;
-            if (cBuf[10] & 64) // interlace flag
-                strcpy(szOptions, ", Interlaced");
-            else
-                strcpy(szOptions, ", Not interlaced");
-            break;
-        case FILETYPE_TIFF:
-            bMotorola = (cBuf[0] == 'M'); // determine endianness of TIFF data
-            i = TIFFLONG(&cBuf[4], bMotorola); // get first IFD offset
-            PILIOSeek(iHandle, i, 0); // read the entire tag directory
-            iBytes = PILIORead(iHandle, cBuf, MAX_TAGS*TIFF_TAGSIZE);
-            j = TIFFSHORT(cBuf, bMotorola); // get the tag count
-            iOffset = 2; // point to start of TIFF tag directory
-            // Some TIFF files don't specify everything, so set up some default values
-            iBpp = 1;
-            iPlanar = 1;
-            iCompression = COMPTYPE_NONE;
-            iPhotoMetric = 7; // if not specified, set to "unknown"
-            // Each TIFF tag is made up of 12 bytes
-            // byte 0-1: Tag value (short)
-            // byte 2-3: data type (short)
-            // byte 4-7: number of values (long)
-            // byte 8-11: value or offset to list of values
-            for (i=0; i<j; i++) // search tags for the info we care about
+        case FORMAT_CSV: // columns as in the header written by main()
+            switch (pInfo->iType)
             {
-                iMarker = TIFFSHORT(&cBuf[iOffset], bMotorola); // get the TIFF tag
-                switch (iMarker) // only read the tags we care about...
-                {
-                    case 256: // image width
-                        iWidth = TIFFVALUE(&cBuf[iOffset], bMotorola);
-                        break;
-                    case 257: // image length
-                        iHeight = TIFFVALUE(&cBuf[iOffset], bMotorola);
-                        break;
-                    case 258: // bits per sample
-                        iCount = TIFFLONG(&cBuf[iOffset+4], bMotorola); /* Get the count */
-                        if (iCount == 1)
-                            iBpp = TIFFVALUE(&cBuf[iOffset], bMotorola);
-                        else // need to read the first value from the list (they should all be equal)
-                        {
-                            k = TIFFLONG(&cBuf[iOffset+8], bMotorola);
-                            if (k < iFileSize)
-                            {
-                                PILIOSeek(iHandle, k, 0);
-                                iBytes = PILIORead(iHandle, &cBuf[iOffset], 2); // okay to overwrite the value we just used
-                                iBpp = iCount * TIFFSHORT(&cBuf[iOffset], bMotorola);
-                            }
-                        }
-                        break;
-                    case 259: // compression
-                        k = TIFFVALUE(&cBuf[iOffset], bMotorola);
-                        if (k == 1)
-                            iCompression = COMPTYPE_NONE;
-                        else if (k == 2)
-                            iCompression = COMPTYPE_HUFFMAN;
-                        else if (k == 3)
-                            iCompression = COMPTYPE_G3;
-                        else if (k == 4)
-                            iCompression = COMPTYPE_G4;
-                        else if (k == 5)
-                            iCompression = COMPTYPE_LZW;
-                        else if (k == 6 || k == 7)
-                            iCompression = COMPTYPE_JPEG;
-                        else if (k == 8 || k == 32946)
-                            iCompression = COMPTYPE_FLATE;
-			else if (k == 9)
-			    iCompression = COMPTYPE_JBIG;
-                        else if (k == 32773)
-                            iCompression = COMPTYPE_PACKBITS;
-                        else if (k == 32809)
-                            iCompression = COMPTYPE_THUNDERSCAN;
-                        else
-                            iCompression = COMPTYPE_UNKNOWN;
-                        break;
-                    case 262: // photometric value
-                        iPhotoMetric = TIFFVALUE(&cBuf[iOffset], bMotorola);
-                        if (iPhotoMetric > 6)
-                            iPhotoMetric = 7; // unknown
+                case FILETYPE_PNG:
+                    if (pInfo->iCompression != COMPTYPE_FLATE)
+                    {
+                        strcpy(szOptions, ",,,,,");
                         break;
-                    case 284: // planar/chunky
-                        iPlanar = TIFFVALUE(&cBuf[iOffset], bMotorola);
-                        if (iPlanar < 1 || iPlanar > 2) // unknown value
-                            iPlanar = 0; // unknown
-                        break;
-                } // switch on tiff tag
-                iOffset += TIFF_TAGSIZE;
-            } // for each tag
-            sprintf(szOptions, ", Photometric = %s, Planar config = %s", szPhotometric[iPhotoMetric], szPlanar[iPlanar]);
+                    }
+                    // fall through
+                case FILETYPE_GIF:
+                    sprintf(szOptions, "%d,,,,,", pInfo->bInterlaced);
+                    break;
+                case FILETYPE_JPEG:
+                    i = sprintf(szOptions, ",%s,%d:%d,", imageinfo_jpeg_type_name(pInfo->iJPEGType), (pInfo->iSubSample>>4),(pInfo->iSubSample & 0xf));
+                    if (pInfo->iQuality) // empty when there's no estimate
+                        i += sprintf(&szOptions[i], "%d", pInfo->iQuality);
+                    strcpy(&szOptions[i], ",,");
+                    break;
+                case FILETYPE_TIFF:
+                    sprintf(szOptions, ",,,,%s,%s", imageinfo_photometric_name(pInfo->iPhotometric), imageinfo_planar_name(pInfo->iPlanar));
+                    break;
+                default:
+                    strcpy(szOptions, ",,,,,");
+                    break;
+            }
+            iLen = QuoteString(p, szFileName, TRUE);
+            iLen += sprintf(&p[iLen], ",%llu,%s,%s,%d,%d,%d,%s,\n", (unsigned long long)pInfo->ullFileSize, imageinfo_type_name(pInfo->iType), imageinfo_compression_name(pInfo->iCompression), pInfo->iWidth, pInfo->iHeight, pInfo->iBpp, szOptions);
             break;
-    } // switch
-    printf("%s: Type=%s, Compression=%s, Size: %d x %d, %d-Bpp%s\n", szFileName, szType[iFileType], szComp[iCompression], iWidth, iHeight, iBpp, szOptions);
-process_exit:
-    PILIOClose(iHandle);
-} /* ProcessFile() */
+    }
+    PILOutCommit(pOut, iLen);
+} /* DisplayInfoEx() */
 
 /****************************************************************************
  *                                                                          *
- *  FUNCTION   : main(int, char**)                                          *
+ *  FUNCTION   : DisplayInfo(void *, char *, int, ImageInfo *, char *)      *
+ *                                                                          *
+ *  PURPOSE    : DisplayInfoEx() without the pages.                         *
  *                                                                          *
  ****************************************************************************/
-int main( int argc, char *argv[ ])
+void DisplayInfo(void *pOut, char *szFileName, int iResult, ImageInfo *pInfo, char *szError)
 {
-#ifdef _WIN32_bad
-    PILIOFINDFILE ff;
-    void * iHandle;
-    BOOL bMoreFiles;
-    int iFileCount = 0;
+    DisplayInfoEx(pOut, szFileName, iResult, pInfo, szError, NULL);
+} /* DisplayInfo() */
+
+// I/O and timing statistics (--stats), totals for each file type
+#define STATS_BUCKETS 24 // latency histogram, bucket n = under 2^n microseconds
+typedef struct tagTypeStats
+{
+    unsigned int uiFiles;
+    unsigned long long ullOpenNs;
+    unsigned long long ullReadNs;
+    unsigned long long ullParseNs;
+    unsigned long long ullBytes;
+    unsigned long long ullReads;
+    unsigned long long ullSeeks;
+    unsigned int uiHist[STATS_BUCKETS];
+} TYPE_STATS;
+static BOOL bStats = FALSE;
+static TYPE_STATS typeStats[FILETYPE_COUNT]; // unknown types and errors under FILETYPE_UNKNOWN
+#ifndef _WIN32
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
 #endif
-    char szDir[256], szFile[256];
-    int i, iLen;
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : AddStats(char *, int, PILIO_STATS *, unsigned long long)   *
+ *                                                                          *
+ *  PURPOSE    : Show the statistics of one file and add them to the        *
+ *               totals of its type. ullProbeNs includes the read time.     *
+ *                                                                          *
+ ****************************************************************************/
+void AddStats(char *szFileName, int iType, PILIO_STATS *pIO, unsigned long long ullProbeNs)
+{
+    TYPE_STATS *pTS;
+    unsigned long long ullParseNs, ullTotalUs;
+    int i;
     
-    if (argc != 2)
-    {
-        printf("Image Info 1.4 Copyright (c) 2012-2017 BitBank Software, Inc.\n");
-        printf("Usage: IMAGEINFO <pathname>\n");
-        printf("Supports: TIFF,GIF,JPEG,BMP,PNG,PBM,PGM,PPM,TGA,JEDMICS,CALS,PCX\n");
-        return 0;
-    }
-    // Find the source dir since FindFirstFile only returns leaf names
-    iLen = (int)strlen(argv[1]);
-    for (i=iLen-1; i>0; i--)
+    // registered types are counted with the unknown ones
+    pTS = &typeStats[(iType > 0 && iType < FILETYPE_COUNT) ? iType : FILETYPE_UNKNOWN];
+    ullParseNs = (ullProbeNs > pIO->ullReadNs) ? ullProbeNs - pIO->ullReadNs : 0;
+    fprintf(stderr, "%s: %s, open %.1f us, read %.1f us (%u reads, %llu bytes), parse %.1f us, %u seeks\n", szFileName, imageinfo_type_name(iType), (double)pIO->ullOpenNs / 1000.0, (double)pIO->ullReadNs / 1000.0, pIO->uiReads, pIO->ullBytes, (double)ullParseNs / 1000.0, pIO->uiSeeks);
+    ullTotalUs = (pIO->ullOpenNs + ullProbeNs) / 1000;
+    for (i=0; i<STATS_BUCKETS-1 && (ullTotalUs >> i) != 0; i++)
+        ;
+#ifndef _WIN32
+    pthread_mutex_lock(&statsMutex);
+#endif
+    pTS->uiFiles++;
+    pTS->ullOpenNs += pIO->ullOpenNs;
+    pTS->ullReadNs += pIO->ullReadNs;
+    pTS->ullParseNs += ullParseNs;
+    pTS->ullBytes += pIO->ullBytes;
+    pTS->ullReads += pIO->uiReads;
+    pTS->ullSeeks += pIO->uiSeeks;
+    pTS->uiHist[i]++;
+#ifndef _WIN32
+    pthread_mutex_unlock(&statsMutex);
+#endif
+} /* AddStats() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : StatsPercentile(TYPE_STATS *, int)                         *
+ *                                                                          *
+ *  PURPOSE    : Find the histogram bucket holding a percentile.            *
+ *                                                                          *
+ *  RETURNS    : Upper bound of the bucket in microseconds.                 *
+ *                                                                          *
+ ****************************************************************************/
+unsigned long StatsPercentile(TYPE_STATS *pTS, int iPercent)
+{
+    unsigned int uiCount = 0;
+    unsigned int uiTarget = (unsigned int)(((unsigned long long)pTS->uiFiles * iPercent + 99) / 100);
+    int i;
+    
+    for (i=0; i<STATS_BUCKETS-1; i++)
     {
-        if (argv[1][i] == PILIO_SLASH_CHAR) // Search backwards for first slash
+        uiCount += pTS->uiHist[i];
+        if (uiCount >= uiTarget)
             break;
     }
-    if (i==0) // Leaf name provided, so current directory must have been referenced
+    return 1UL << i;
+} /* StatsPercentile() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PrintStats(void)                                           *
+ *                                                                          *
+ *  PURPOSE    : Show the totals and latency histograms of each file type,  *
+ *               then the memory high water mark and any leaked blocks.     *
+ *                                                                          *
+ ****************************************************************************/
+void PrintStats(void)
+{
+    TYPE_STATS all, *pTS;
+    PILOffset llBytes, llPeak;
+    double d;
+    int i, iType, iBlocks;
+    
+    memset(&all, 0, sizeof(all));
+    fprintf(stderr, "\n%-16s %8s %9s %9s %9s %10s %6s %6s %8s %8s\n", "type", "files", "open us", "read us", "parse us", "bytes", "reads", "seeks", "p50 us", "p99 us");
+    for (iType=0; iType<=FILETYPE_COUNT; iType++)
     {
-        PILIOGetCurDir(256, szDir);
-        strcpy(szFile, szDir);
-        iLen = strlen(szFile);
-	if (szFile[iLen-1] != PILIO_SLASH_CHAR) // add missing slash
-	{
-		szFile[iLen] = PILIO_SLASH_CHAR;
-		szFile[iLen+1] = '\0';
-	}
-        strcat(szFile, argv[1]); // create a complete pathname
+        if (iType == FILETYPE_COUNT) // totals
+            pTS = &all;
+        else
+        {
+            pTS = &typeStats[iType];
+            all.uiFiles += pTS->uiFiles;
+            all.ullOpenNs += pTS->ullOpenNs;
+            all.ullReadNs += pTS->ullReadNs;
+            all.ullParseNs += pTS->ullParseNs;
+            all.ullBytes += pTS->ullBytes;
+            all.ullReads += pTS->ullReads;
+            all.ullSeeks += pTS->ullSeeks;
+            for (i=0; i<STATS_BUCKETS; i++)
+                all.uiHist[i] += pTS->uiHist[i];
+        }
+        if (pTS->uiFiles == 0)
+            continue;
+        d = (double)pTS->uiFiles; // averages per file
+        fprintf(stderr, "%-16s %8u %9.1f %9.1f %9.1f %10.0f %6.1f %6.1f %8lu %8lu\n", (iType == FILETYPE_COUNT) ? "all" : (iType == FILETYPE_UNKNOWN ? "unknown/error" : imageinfo_type_name(iType)),
+                pTS->uiFiles, pTS->ullOpenNs / d / 1000.0, pTS->ullReadNs / d / 1000.0, pTS->ullParseNs / d / 1000.0, pTS->ullBytes / d,
+                pTS->ullReads / d, pTS->ullSeeks / d, StatsPercentile(pTS, 50), StatsPercentile(pTS, 99));
     }
-    else // Extract the directory from the pathname passed
+    fprintf(stderr, "\nlatency (open + probe) histogram, files under n us:\n");
+    for (iType=0; iType<FILETYPE_COUNT; iType++)
     {
-        strcpy(szFile, argv[1]);
-        szDir[i+1] = '\0';
-        for (;i>=0; i--)
+        pTS = &typeStats[iType];
+        if (pTS->uiFiles == 0)
+            continue;
+        fprintf(stderr, "%-16s", iType == FILETYPE_UNKNOWN ? "unknown/error" : imageinfo_type_name(iType));
+        for (i=0; i<STATS_BUCKETS; i++)
         {
-            szDir[i] = argv[1][i];
+            if (pTS->uiHist[i])
+                fprintf(stderr, " <%lu:%u", 1UL << i, pTS->uiHist[i]);
         }
+        fprintf(stderr, "\n");
     }
-    if (strcspn(szFile, "*?") == strlen(szFile)) // no wildcard characters, use the pathname as-is
+    PILIOMemStats(&iBlocks, &llBytes, &llPeak);
+    fprintf(stderr, "\nmemory: peak %.1f KB, %d blocks (%lld bytes) not freed at the end\n", (double)llPeak / 1024.0, iBlocks, llBytes);
+} /* PrintStats() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PageCallback(void *, int, const ImageInfoPage *)           *
+ *                                                                          *
+ *  PURPOSE    : Add a page to a PAGE_LIST as the TIFF walk finds it.       *
+ *                                                                          *
+ ****************************************************************************/
+void PageCallback(void *pUser, int iPage, const ImageInfoPage *pPage)
+{
+    PAGE_LIST *pList = (PAGE_LIST *)pUser;
+    ImageInfoPage *p;
+    
+    if (iPage >= pList->iMax)
     {
-        void * iHandle;
-        int iSize;
-        iHandle = PILIOOpenRO(szFile);
-        if (iHandle != (void *)-1)
+        p = (ImageInfoPage *)realloc(pList->pPages, (pList->iMax + 64) * 2 * sizeof(ImageInfoPage));
+        if (p == NULL)
+            return; // the count will still be right
+        pList->pPages = p;
+        pList->iMax = (pList->iMax + 64) * 2;
+    }
+    pList->pPages[iPage] = *pPage;
+} /* PageCallback() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ProbeHandle(void *, PILOffset, int, char *, ...)          *
+ *                                                                          *
+ *  PURPOSE    : imageinfo_probe_handle_type() plus the statistics          *
+ *               (--stats). iType is negative unless the file was           *
+ *               classified.                                                *
+ *               With pPages, every page of a TIFF is gathered into it.     *
+ *               With --scans, the scans of a JPEG are counted, with        *
+ *               --frames, the frames of a GIF and with --chunks, the       *
+ *               chunks of a PNG (timed for the --verify-crc totals).       *
+ *               --check-complete looks at the end of the file.             *
+ *                                                                          *
+ ****************************************************************************/
+int ProbeHandle(void *iHandle, PILOffset llFileSize, int iType, char *szFileName, ImageInfo *pInfo, PAGE_LIST *pPages)
+{
+    PILIO_STATS io;
+    unsigned long long ullStart = 0, ullCRCStart;
+    int iResult;
+    
+    if (bStats)
+        ullStart = PILIOTime();
+    iResult = imageinfo_probe_handle_type(iHandle, (uint64_t)llFileSize, iType, pInfo);
+    if (pPages != NULL && iResult == IMAGEINFO_SUCCESS && pInfo->iType == FILETYPE_TIFF)
+    {
+        pPages->iPages = 0;
+        if (imageinfo_tiff_pages(iHandle, (uint64_t)llFileSize, PageCallback, pPages, &pPages->iPages) == IMAGEINFO_NEED_MORE)
+            iResult = IMAGEINFO_NEED_MORE; // walk again when the rest is there
+    }
+    if (bScans && iResult == IMAGEINFO_SUCCESS && pInfo->iType == FILETYPE_JPEG)
+    {
+        if (imageinfo_jpeg_scans(iHandle, (uint64_t)llFileSize, &pInfo->iScans) == IMAGEINFO_NEED_MORE)
+            iResult = IMAGEINFO_NEED_MORE;
+    }
+    if (bFrames && iResult == IMAGEINFO_SUCCESS && pInfo->iType == FILETYPE_GIF)
+    {
+        if (imageinfo_gif_frames(iHandle, (uint64_t)llFileSize, pInfo) == IMAGEINFO_NEED_MORE)
+            iResult = IMAGEINFO_NEED_MORE;
+    }
+    if (bChunks && iResult == IMAGEINFO_SUCCESS && pInfo->iType == FILETYPE_PNG)
+    {
+        ullCRCStart = PILIOTime();
+        if (imageinfo_png_chunks(iHandle, (uint64_t)llFileSize, bVerifyCRC, pInfo) == IMAGEINFO_NEED_MORE)
+            iResult = IMAGEINFO_NEED_MORE;
+        else if (bVerifyCRC)
         {
-            iSize = (int)PILIOSize(iHandle);
-            PILIOClose(iHandle);
-            ProcessFile(szFile, iSize);
-            return 0;
+#ifndef _WIN32
+            pthread_mutex_lock(&totalsMutex);
+#endif
+            uiCRCFiles++;
+            if (pInfo->iCRCErrors != 0 || !pInfo->bIEND)
+                uiCRCBad++;
+            ullCRCBytes += (unsigned long long)llFileSize;
+            ullCRCNs += PILIOTime() - ullCRCStart;
+#ifndef _WIN32
+            pthread_mutex_unlock(&totalsMutex);
+#endif
         }
-        else
+    }
+    if (bCheckComplete && iResult == IMAGEINFO_SUCCESS)
+    {
+        if (imageinfo_check_complete(iHandle, (uint64_t)llFileSize, pInfo) == IMAGEINFO_NEED_MORE)
+            iResult = IMAGEINFO_NEED_MORE;
+        else if (pInfo->iComplete)
         {
-            printf("%s - file not found\n", argv[1]);
-            return -1; // none found, leave
+#ifndef _WIN32
+            pthread_mutex_lock(&totalsMutex);
+#endif
+            uiChecked++;
+            if (pInfo->iComplete < 0)
+                uiTruncated++;
+            else if (pInfo->ullTrailing)
+                uiTrailing++;
+#ifndef _WIN32
+            pthread_mutex_unlock(&totalsMutex);
+#endif
         }
     }
-#ifdef _WIN32_bad
-    iHandle = PILIOFindFirst(szFile, &ff);
-    if (iHandle == -1)
+    if (!bStats)
+        return iResult;
+    if (iResult != IMAGEINFO_NEED_MORE) // it will be tried again
     {
-        printf("%s - file not found\n", argv[1]);
-        return -1; // none found, leave
+        ullStart = PILIOTime() - ullStart;
+        PILIOGetStats(iHandle, &io);
+        AddStats(szFileName, iResult == IMAGEINFO_SUCCESS ? pInfo->iType : FILETYPE_UNKNOWN, &io, ullStart);
     }
-    bMoreFiles = TRUE;
-    // Search for matching filenames which aren't directories
-    while (bMoreFiles)
+    return iResult;
+} /* ProbeHandle() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : WriteThumb(void *, char *, ImageInfo *)                    *
+ *                                                                          *
+ *  PURPOSE    : Copy a JPEG's embedded thumbnail to its own file in the    *
+ *               --thumb directory, named after the image's pathname with   *
+ *               the separators turned into '_' and ".thumb.jpg" added, so  *
+ *               images of the same name in different directories don't     *
+ *               collide. The bytes go from the file to the output within   *
+ *               the kernel where it can (PILIOCopy). A memory handle (-u)  *
+ *               only holds the start of the file, so if the thumbnail      *
+ *               isn't in it the file is opened again by name.              *
+ *                                                                          *
+ ****************************************************************************/
+void WriteThumb(void *iHandle, char *szFileName, ImageInfo *pInfo)
+{
+    char szThumb[PILIO_MAX_PATH];
+    char *p;
+    void *iFile;
+    PILOffset llLen = -1;
+    int i, iFD;
+    
+    i = snprintf(szThumb, sizeof(szThumb), "%s%c", szThumbDir, PILIO_SLASH_CHAR);
+    for (p = szFileName; *p == '/' || *p == '\\'; p++) // no leading separators
+        ;
+    snprintf(&szThumb[i], sizeof(szThumb) - i, "%s.thumb.jpg", p);
+    for (; szThumb[i] != '\0'; i++)
     {
-        if ((ff.ucFlags & PIL_ATTR_DIR) == 0)
+        if (szThumb[i] == '/' || szThumb[i] == '\\' || szThumb[i] == ':')
+            szThumb[i] = '_';
+    }
+    iFD = open(szThumb, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (iFD >= 0)
+    {
+        llLen = PILIOCopy(iHandle, (PILOffset)pInfo->ullThumbOffset, pInfo->uiThumbLen, iFD);
+        if (llLen < 0)
         {
-            iFileCount++;
-            strcpy(szFile, szDir);
-            strcat(szFile, ff.szLeafName);         
-            ProcessFile(szFile, ff.ulFileSize);
+            iFile = PILIOOpenRO(szFileName);
+            if (iFile != (void *)-1)
+            {
+                llLen = PILIOCopy(iFile, (PILOffset)pInfo->ullThumbOffset, pInfo->uiThumbLen, iFD);
+                PILIOClose(iFile);
+            }
         }
-        bMoreFiles = PILIOFindNext(iHandle, &ff);
-    } // while more files to read
-    PILIOFindClose(iHandle);
-    myprintf("%d file(s) found\n", iFileCount);
+        close(iFD);
+        if (llLen < 0)
+            unlink(szThumb);
+    }
+    if (llLen < 0)
+        fprintf(stderr, "%s - unable to copy the thumbnail to %s\n", szFileName, szThumb);
+} /* WriteThumb() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ProcessHandle(void *, void *, char *, PILOffset, int)      *
+ *                                                                          *
+ *  PURPOSE    : Gather and display information about an open file.         *
+ *               Only locals are used, so it is safe to call from several   *
+ *               threads at once. With --archives, the members of a tar or  *
+ *               zip file are shown instead of the file itself.             *
+ *                                                                          *
+ *  RETURNS    : 0 when finished, 1 if the handle is a memory handle which  *
+ *               is missing part of the file (see PILIONeedMore); nothing   *
+ *               is displayed in that case and the caller should add the    *
+ *               missing piece and try again.                               *
+ *                                                                          *
+ ****************************************************************************/
+int ProcessHandle(void *pOut, void *iHandle, char *szFileName, PILOffset llFileSize, int iType)
+{
+    ImageInfo info;
+    PAGE_LIST pages;
+    int iResult;
+    
+#ifndef _WIN32
+    if (bArchives && iType == -1 && ProcessArchive(pOut, iHandle, szFileName))
+        return 0;
 #endif
+    memset(&pages, 0, sizeof(pages));
+    iResult = ProbeHandle(iHandle, llFileSize, iType, szFileName, &info, bPages ? &pages : NULL);
+    if (iResult != IMAGEINFO_NEED_MORE)
+        DisplayInfoEx(pOut, szFileName, iResult, &info, NULL, (bPages && info.iType == FILETYPE_TIFF) ? &pages : NULL);
+    if (iResult == IMAGEINFO_SUCCESS && szThumbDir != NULL && info.uiThumbLen)
+        WriteThumb(iHandle, szFileName, &info);
+    free(pages.pPages);
+    return (iResult == IMAGEINFO_NEED_MORE);
+} /* ProcessHandle() */
+
+#ifndef _WIN32
+// Where the members of an archive go (--archives)
+typedef struct tagArchiveWalk
+{
+    void *pOut;
+    char *szArchive;
+} ARCHIVE_WALK;
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ArchiveCallback(void *, char *, void *, PILOffset, char *) *
+ *                                                                          *
+ *  PURPOSE    : Called by the archive walker with each member, which is    *
+ *               shown as "archive:member".                                 *
+ *                                                                          *
+ ****************************************************************************/
+int ArchiveCallback(void *pUser, char *szName, void *iHandle, PILOffset llSize, char *szError)
+{
+    ARCHIVE_WALK *pWalk = (ARCHIVE_WALK *)pUser;
+    char szFile[PILIO_MAX_PATH];
     
-    return 0;
+    snprintf(szFile, sizeof(szFile), "%s:%s", pWalk->szArchive, szName);
+    if (iHandle == (void *)-1)
+    {
+        DisplayInfo(pWalk->pOut, szFile, IMAGEINFO_IO_ERROR, NULL, szError);
+        return 0;
+    }
+    return ProcessHandle(pWalk->pOut, iHandle, szFile, llSize, TYPE_MEMBER);
+} /* ArchiveCallback() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ProcessArchive(void *, void *, char *)                     *
+ *                                                                          *
+ *  PURPOSE    : If an open file is a tar or zip archive, gather and        *
+ *               display information about each file in it, reading them    *
+ *               in place (see pil_archive.c).                              *
+ *                                                                          *
+ *  RETURNS    : TRUE if it was an archive.                                 *
+ *                                                                          *
+ ****************************************************************************/
+BOOL ProcessArchive(void *pOut, void *iHandle, char *szFileName)
+{
+    ARCHIVE_WALK walk;
+    int iType;
+    
+    iType = PILArchiveType(iHandle);
+    if (iType == PIL_ARCHIVE_NONE)
+        return FALSE;
+    walk.pOut = pOut;
+    walk.szArchive = szFileName;
+    if (PILArchiveWalk(iHandle, iType, ArchiveCallback, &walk) < 0)
+        DisplayInfo(pOut, szFileName, IMAGEINFO_INVALID, NULL, "archive is damaged or cut short");
+    return TRUE;
+} /* ProcessArchive() */
+#endif // !_WIN32
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ProcessStdin(void)                                         *
+ *                                                                          *
+ *  PURPOSE    : Gather and display information about a file arriving on   *
+ *               stdin. It is pushed through the incremental parser and     *
+ *               read with unbuffered reads no larger than what the parser  *
+ *               asks for, so only the minimum prefix is consumed and the   *
+ *               rest is left in the pipe.                                  *
+ *                                                                          *
+ *  RETURNS    : 0 if successful, -1 if the stream couldn't be read.        *
+ *                                                                          *
+ ****************************************************************************/
+int ProcessStdin(void)
+{
+    ImageInfoStream *pStream;
+    ImageInfo info;
+    unsigned char ucBuf[STREAM_BUF_SIZE];
+    uint64_t ullPos = 0; // bytes consumed
+    uint64_t ullOffset;
+    unsigned int uiLen;
+    int iLen, iResult;
+    
+#ifdef _WIN32
+    _setmode(0, _O_BINARY);
+#endif
+    pStream = imageinfo_stream_new(0); // size unknown
+    if (pStream == NULL)
+        return -1;
+    iResult = imageinfo_stream_need(pStream, &ullOffset, &uiLen);
+    while (iResult == IMAGEINFO_NEED_MORE)
+    {
+        // read up to the end of the range wanted, but no further
+        if (ullOffset + uiLen - ullPos > STREAM_BUF_SIZE)
+            iLen = STREAM_BUF_SIZE;
+        else
+            iLen = (int)(ullOffset + uiLen - ullPos);
+        do
+        {
+            iLen = (int)read(0, ucBuf, iLen);
+        } while (iLen < 0 && errno == EINTR);
+        if (iLen < 0)
+            break;
+        ullPos += iLen;
+        iResult = imageinfo_stream_push(pStream, ucBuf, iLen, &info); // 0 = end of stream
+        ullOffset = info.ullNeedOffset;
+        uiLen = info.uiNeedLen;
+    }
+    imageinfo_stream_free(pStream);
+    if (iResult == IMAGEINFO_NEED_MORE) // read error
+        return -1;
+    DisplayInfo(GetWriter(0), "-", iResult, &info, NULL);
+    return 0;
+} /* ProcessStdin() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ProcessFile(char *, PILOffset)                             *
+ *                                                                          *
+ *  PURPOSE    : Gather and display information about a specific file.      *
+ *                                                                          *
+ ****************************************************************************/
+void ProcessFile(char *szFileName, PILOffset llFileSize)
+{
+    void * iHandle;
+    
+    iHandle = PILIOOpenRO(szFileName);
+    if (iHandle == (void *)-1)
+    {
+        return;
+    }
+    ProcessHandle(GetWriter(0), iHandle, szFileName, llFileSize, -1);
+    PILIOClose(iHandle);
+} /* ProcessFile() */
+
+static BOOL bMap = FALSE; // memory map files instead of reading them (-m)
+
+#ifndef _WIN32
+// What the result cache (-c) holds for each file
+typedef struct tagCachedResult
+{
+    int iResult;
+    ImageInfo info;
+} CACHED_RESULT;
+// Change the top byte when the meaning of ImageInfo changes
+#define CACHE_FORMAT (0x08000000 | (unsigned int)sizeof(CACHED_RESULT))
+
+static void *pCache = NULL; // results of previous runs (-c)
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheDisplay(void *, char *, struct stat *)                *
+ *                                                                          *
+ *  PURPOSE    : Display a file's result from the cache if it is there and  *
+ *               the file hasn't changed since.                             *
+ *                                                                          *
+ *  RETURNS    : TRUE if it was displayed.                                  *
+ *                                                                          *
+ ****************************************************************************/
+BOOL CacheDisplay(void *pOut, char *szFileName, struct stat *pst)
+{
+    CACHED_RESULT *pResult;
+    int iLen;
+    
+    pResult = (CACHED_RESULT *)PILCacheFind(pCache, PIL_CACHE_FILE, pst, &iLen);
+    if (pResult == NULL || iLen != sizeof(CACHED_RESULT))
+        return FALSE;
+    DisplayInfo(pOut, szFileName, pResult->iResult, &pResult->info, NULL);
+    return TRUE;
+} /* CacheDisplay() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheProcessHandle(void *, void *, char *, PILOffset, int, *
+ *                                    struct stat *)                        *
+ *                                                                          *
+ *  PURPOSE    : Gather and display information about an open file and     *
+ *               add the result to the cache.                               *
+ *                                                                          *
+ *  RETURNS    : 1 if a memory handle needs another piece (see              *
+ *               ProcessHandle), otherwise 0.                               *
+ *                                                                          *
+ ****************************************************************************/
+int CacheProcessHandle(void *pOut, void *iHandle, char *szFileName, PILOffset llFileSize, int iType, struct stat *pst)
+{
+    CACHED_RESULT result;
+    
+    memset(&result, 0, sizeof(result));
+    result.iResult = ProbeHandle(iHandle, llFileSize, iType, szFileName, &result.info, NULL);
+    if (result.iResult == IMAGEINFO_NEED_MORE)
+        return 1;
+    if (result.iResult != IMAGEINFO_IO_ERROR)
+        PILCacheAdd(pCache, PIL_CACHE_FILE, pst, &result, sizeof(result));
+    DisplayInfo(pOut, szFileName, result.iResult, &result.info, NULL);
+    return 0;
+} /* CacheProcessHandle() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : DirListCallback / DirReadCallback                          *
+ *                                                                          *
+ *  PURPOSE    : Scanner hooks which keep the contents of each directory    *
+ *               in the cache, so a directory which hasn't changed since    *
+ *               the last run is not read again.                            *
+ *                                                                          *
+ ****************************************************************************/
+unsigned char * DirListCallback(void *pUser, struct stat *pst, char *szDir, int *piLen)
+{
+    return (unsigned char *)PILCacheFind(pCache, PIL_CACHE_DIR, pst, piLen);
+} /* DirListCallback() */
+
+void DirReadCallback(void *pUser, struct stat *pst, char *szDir, unsigned char *pList, int iLen)
+{
+    PILCacheAdd(pCache, PIL_CACHE_DIR, pst, pList, iLen);
+} /* DirReadCallback() */
+
+static PIL_SCAN_HOOKS cacheHooks = {DirListCallback, DirReadCallback};
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ScanCallback(void *, int, int, char *, char *)             *
+ *                                                                          *
+ *  PURPOSE    : Called by the directory scanner's worker threads for each  *
+ *               file found. The file is opened relative to its directory   *
+ *               so the kernel doesn't walk the full path again. With a     *
+ *               cache, an unchanged file costs one fstatat and no open.    *
+ *               Directories which can't be opened are shown as errors.     *
+ *                                                                          *
+ ****************************************************************************/
+void ScanCallback(void *pUser, int iThread, int iDirFD, char *szDir, char *szName)
+{
+    char szFile[PILIO_MAX_PATH];
+    struct stat st;
+    void * iHandle;
+    void * pOut = GetWriter(iThread + 1);
+    
+    if (iDirFD < 0)
+    {
+        DisplayInfo(pOut, szDir, IMAGEINFO_IO_ERROR, NULL, "unable to open directory");
+        return;
+    }
+    snprintf(szFile, sizeof(szFile), "%s%c%s", szDir, PILIO_SLASH_CHAR, szName);
+    if (pCache != NULL)
+    {
+        if (fstatat(iDirFD, szName, &st, 0) != 0)
+            return;
+        if (CacheDisplay(pOut, szFile, &st))
+            return;
+    }
+    iHandle = bMap ? PILIOMapAt(iDirFD, szName, 0) : PILIOOpenAtRO(iDirFD, szName);
+    if (iHandle == (void *)-1)
+        return;
+    if (pCache != NULL)
+        CacheProcessHandle(pOut, iHandle, szFile, PILIOSize(iHandle), -1, &st);
+    else
+        ProcessHandle(pOut, iHandle, szFile, PILIOSize(iHandle), -1);
+    PILIOClose(iHandle);
+} /* ScanCallback() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeCallback(void *, int, char *, int, void *)            *
+ *                                                                          *
+ *  PURPOSE    : Called by the server's worker threads (--serve) for each   *
+ *               request, a pathname or a descriptor sent by the client.    *
+ *               The answer is an INFO_RECORD, as in --format=bin, with     *
+ *               uiName 0. The cache (-c) is used the same way as by -r.    *
+ *                                                                          *
+ ****************************************************************************/
+void ServeCallback(void *pUser, int iThread, char *szPath, int iFD, void *pResult)
+{
+    INFO_RECORD *pRec = (INFO_RECORD *)pResult;
+    CACHED_RESULT result, *pCached;
+    PAGE_LIST pages;
+    struct stat st;
+    void * iHandle;
+    char *szName = szPath ? szPath : "(descriptor)";
+    int iLen;
+    BOOL bStat = FALSE;
+    
+    if (pCache != NULL)
+        bStat = ((szPath ? stat(szPath, &st) : fstat(iFD, &st)) == 0);
+    if (bStat)
+    {
+        pCached = (CACHED_RESULT *)PILCacheFind(pCache, PIL_CACHE_FILE, &st, &iLen);
+        if (pCached != NULL && iLen == sizeof(CACHED_RESULT))
+        {
+            FillRecord(pRec, pCached->iResult, pCached->iResult == IMAGEINFO_SUCCESS ? &pCached->info : NULL, NULL);
+            return;
+        }
+    }
+    else if (iFD < 0 && szPath == NULL)
+    {
+        FillRecord(pRec, IMAGEINFO_IO_ERROR, NULL, NULL); // its descriptor didn't arrive
+        return;
+    }
+    if (szPath != NULL)
+        iHandle = bMap ? PILIOMap(szPath, 0) : PILIOOpenRO(szPath);
+    else
+        iHandle = PILIOOpenFD(iFD);
+    if (iHandle == (void *)-1)
+    {
+        FillRecord(pRec, IMAGEINFO_IO_ERROR, NULL, NULL);
+        return;
+    }
+    memset(&result, 0, sizeof(result));
+    memset(&pages, 0, sizeof(pages));
+    result.iResult = ProbeHandle(iHandle, PILIOSize(iHandle), -1, szName, &result.info, bPages ? &pages : NULL);
+    if (bStat && result.iResult != IMAGEINFO_IO_ERROR && result.iResult != IMAGEINFO_NEED_MORE)
+        PILCacheAdd(pCache, PIL_CACHE_FILE, &st, &result, sizeof(result));
+    FillRecord(pRec, result.iResult, result.iResult == IMAGEINFO_SUCCESS ? &result.info : NULL, (bPages && result.info.iType == FILETYPE_TIFF) ? &pages : NULL);
+    free(pages.pPages);
+    PILIOClose(iHandle);
+} /* ServeCallback() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : UringCallback(void *, char *, void *, PILOffset, int)      *
+ *                                                                          *
+ *  PURPOSE    : Called by the io_uring engine once the start of a file     *
+ *               (and any follow-up piece asked for) has been read. The     *
+ *               engine has already classified it with imageinfo_classify() *
+ *               so only the parser for its type runs. An archive needs     *
+ *               more than the start, so it is opened again by name. With a *
+ *               cache, the result is added under the file's stat unless    *
+ *               its size no longer matches what was read.                  *
+ *                                                                          *
+ ****************************************************************************/
+int UringCallback(void *pUser, char *szName, void *iHandle, PILOffset llSize, int iType)
+{
+    void *iFile;
+    struct stat st;
+    
+    if (iHandle == (void *)-1)
+    {
+        DisplayInfo(GetWriter(0), szName, IMAGEINFO_IO_ERROR, NULL, "file not found");
+        return 0;
+    }
+    if (bArchives && PILArchiveType(iHandle) != PIL_ARCHIVE_NONE)
+    {
+        iFile = PILIOOpenRO(szName);
+        if (iFile == (void *)-1)
+            DisplayInfo(GetWriter(0), szName, IMAGEINFO_IO_ERROR, NULL, "file not found");
+        else
+        {
+            ProcessArchive(GetWriter(0), iFile, szName);
+            PILIOClose(iFile);
+        }
+        return 0;
+    }
+    if (pCache != NULL && stat(szName, &st) == 0 && (PILOffset)st.st_size == llSize)
+        return CacheProcessHandle(GetWriter(0), iHandle, szName, llSize, iType, &st);
+    return ProcessHandle(GetWriter(0), iHandle, szName, llSize, iType);
+} /* UringCallback() */
+
+static void *pUring = NULL; // asynchronous reader for batch mode (-u)
+#endif // !_WIN32
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : GrowBuffer(char **, int *, int)                            *
+ *                                                                          *
+ *  PURPOSE    : Make sure a reusable string buffer can hold iLen bytes.    *
+ *                                                                          *
+ *  RETURNS    : TRUE if successful, FALSE if out of memory.                *
+ *                                                                          *
+ ****************************************************************************/
+BOOL GrowBuffer(char **ppBuf, int *piSize, int iLen)
+{
+    char *p;
+    
+    if (iLen <= *piSize)
+        return TRUE;
+    iLen = (iLen + 255) & ~255; // grow in reasonable steps
+    p = (char *)realloc(*ppBuf, iLen);
+    if (p == NULL)
+        return FALSE;
+    *ppBuf = p;
+    *piSize = iLen;
+    return TRUE;
+} /* GrowBuffer() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ProcessPath(char *)                                        *
+ *                                                                          *
+ *  PURPOSE    : Display info about one pathname (or wildcard on Windows).  *
+ *                                                                          *
+ *  RETURNS    : 0 if successful, -1 if the file was not found.             *
+ *                                                                          *
+ ****************************************************************************/
+int ProcessPath(char *szPath)
+{
+#ifdef _WIN32_bad
+    PILIOFINDFILE ff;
+    void * iHandle;
+    BOOL bMoreFiles;
+    int iFileCount = 0;
+    char szDir[256];
+#endif
+    static char szCurDir[256] = {0}; // only ask the OS once per run
+    static char *szFile = NULL; // reused across calls in batch mode
+    static int iFileSize = 0;
+    char *p;
+    int iLen;
+    
+    iLen = (int)strlen(szPath);
+    p = strrchr(szPath, PILIO_SLASH_CHAR);
+    if (p == NULL) // Leaf name provided, so current directory must have been referenced
+    {
+        if (szCurDir[0] == '\0')
+        {
+            PILIOGetCurDir(sizeof(szCurDir)-1, szCurDir);
+            iLen = (int)strlen(szCurDir);
+            if (iLen && szCurDir[iLen-1] != PILIO_SLASH_CHAR) // add missing slash
+            {
+                szCurDir[iLen] = PILIO_SLASH_CHAR;
+                szCurDir[iLen+1] = '\0';
+            }
+        }
+        if (!GrowBuffer(&szFile, &iFileSize, (int)strlen(szCurDir) + (int)strlen(szPath) + 1))
+            return -1;
+        strcpy(szFile, szCurDir);
+        strcat(szFile, szPath); // create a complete pathname
+    }
+    else
+    {
+        if (!GrowBuffer(&szFile, &iFileSize, iLen + 1))
+            return -1;
+        strcpy(szFile, szPath);
+    }
+    if (strcspn(szFile, "*?") == strlen(szFile)) // no wildcard characters, use the pathname as-is
+    {
+        void * iHandle;
+#ifndef _WIN32
+        struct stat st;
+        BOOL bStat = FALSE;
+        
+        if (pCache != NULL)
+        {
+            bStat = (stat(szFile, &st) == 0);
+            if (bStat && CacheDisplay(GetWriter(0), szFile, &st))
+                return 0;
+        }
+        if (pUring != NULL) // the results will show up as the reads complete
+        {
+            PILUringAdd(pUring, szFile);
+            return 0;
+        }
+#endif
+        iHandle = bMap ? PILIOMap(szFile, 0) : PILIOOpenRO(szFile);
+        if (iHandle != (void *)-1)
+        {
+#ifndef _WIN32
+            if (bStat)
+            {
+                CacheProcessHandle(GetWriter(0), iHandle, szFile, PILIOSize(iHandle), -1, &st);
+                PILIOClose(iHandle);
+                return 0;
+            }
+#endif
+            ProcessHandle(GetWriter(0), iHandle, szFile, PILIOSize(iHandle), -1);
+            PILIOClose(iHandle);
+            return 0;
+        }
+        else
+        {
+            DisplayInfo(GetWriter(0), szPath, IMAGEINFO_IO_ERROR, NULL, "file not found");
+            return -1;
+        }
+    }
+#ifdef _WIN32_bad
+    // Find the source dir since FindFirstFile only returns leaf names
+    iLen = (int)(strrchr(szFile, PILIO_SLASH_CHAR) - szFile) + 1;
+    memcpy(szDir, szFile, iLen);
+    szDir[iLen] = '\0';
+    iHandle = PILIOFindFirst(szFile, &ff);
+    if (iHandle == -1)
+    {
+        printf("%s - file not found\n", szPath);
+        return -1; // none found, leave
+    }
+    bMoreFiles = TRUE;
+    // Search for matching filenames which aren't directories
+    while (bMoreFiles)
+    {
+        if ((ff.ucFlags & PIL_ATTR_DIR) == 0)
+        {
+            iFileCount++;
+            strcpy(szFile, szDir);
+            strcat(szFile, ff.szLeafName);         
+            ProcessFile(szFile, ff.ulFileSize);
+        }
+        bMoreFiles = PILIOFindNext(iHandle, &ff);
+    } // while more files to read
+    PILIOFindClose(iHandle);
+    myprintf("%d file(s) found\n", iFileCount);
+#endif
+    return 0;
+} /* ProcessPath() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ProcessFileList(FILE *)                                    *
+ *                                                                          *
+ *  PURPOSE    : Process a NUL-delimited list of pathnames (find -print0).  *
+ *               The list is streamed through a fixed buffer so that it     *
+ *               never needs to fit in memory.                              *
+ *                                                                          *
+ *  RETURNS    : 0 if all files were found, -1 otherwise.                   *
+ *                                                                          *
+ ****************************************************************************/
+int ProcessFileList(FILE *pList)
+{
+    static unsigned char ucList[LIST_BUF_SIZE];
+    char *szName = NULL;
+    int iNameSize = 0;
+    int iNameLen = 0;
+    int iBytes, i, iStart;
+    int rc = 0;
+    
+    while ((iBytes = (int)fread(ucList, 1, LIST_BUF_SIZE, pList)) > 0)
+    {
+        iStart = 0;
+        for (i=0; i<iBytes; i++)
+        {
+            if (ucList[i] != 0)
+                continue;
+            // end of a name; append the piece in this buffer and process it
+            if (!GrowBuffer(&szName, &iNameSize, iNameLen + (i-iStart) + 1))
+                return -1;
+            memcpy(&szName[iNameLen], &ucList[iStart], i-iStart);
+            iNameLen += i-iStart;
+            szName[iNameLen] = '\0';
+            if (iNameLen && ProcessPath(szName) != 0)
+                rc = -1;
+            iNameLen = 0;
+            iStart = i+1;
+        }
+        if (iStart < iBytes) // name continues in the next buffer
+        {
+            if (!GrowBuffer(&szName, &iNameSize, iNameLen + (iBytes-iStart) + 1))
+                return -1;
+            memcpy(&szName[iNameLen], &ucList[iStart], iBytes-iStart);
+            iNameLen += iBytes-iStart;
+        }
+    }
+    if (iNameLen) // last name wasn't terminated
+    {
+        szName[iNameLen] = '\0';
+        if (ProcessPath(szName) != 0)
+            rc = -1;
+    }
+    free(szName);
+    return rc;
+} /* ProcessFileList() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : SetFormat(char *)                                          *
+ *                                                                          *
+ *  PURPOSE    : Select the output format by name. Anything already        *
+ *               buffered is written in the old format first.               *
+ *                                                                          *
+ *  RETURNS    : 0 if successful, -1 for an unknown format.                 *
+ *                                                                          *
+ ****************************************************************************/
+int SetFormat(char *szFormat)
+{
+    static const char *szFormats[] = {"text", "jsonl", "csv", "bin"};
+    static BOOL bCSVHeader = FALSE;
+    void *pOut;
+    char *p;
+    int i;
+    
+    for (i=0; i<4; i++)
+    {
+        if (strcmp(szFormat, szFormats[i]) == 0)
+            break;
+    }
+    if (i == 4)
+        return -1;
+    FlushWriters(TRUE); // the writers depend on the format
+    iFormat = i;
+#ifdef _WIN32
+    if (iFormat == FORMAT_BIN)
+        _setmode(1, _O_BINARY);
+#endif
+    if (iFormat == FORMAT_CSV && !bCSVHeader)
+    {
+        bCSVHeader = TRUE;
+        pOut = GetWriter(0);
+        p = PILOutReserve(pOut, 256);
+        if (p != NULL)
+            PILOutCommit(pOut, sprintf(p, "file,size,type,compression,width,height,bpp,interlaced,jpeg_type,subsampling,quality,photometric,planar,error\n"));
+    }
+    return 0;
+} /* SetFormat() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : main(int, char**)                                          *
+ *                                                                          *
+ ****************************************************************************/
+int main( int argc, char *argv[ ])
+{
+    int i;
+    int rc = 0;
+    int iThreads = 0; // 0 = one per CPU
+#ifndef _WIN32
+    int iScan;
+    struct stat st;
+#endif
+    BOOL bOptions = TRUE;
+    
+    if (argc < 2)
+    {
+        printf("Image Info 1.4 Copyright (c) 2012-2017 BitBank Software, Inc.\n");
+        printf("Usage: IMAGEINFO [options] <pathname> [pathname ...]\n");
+        printf("  -         read one image from stdin, consuming only what's needed\n");
+        printf("  -0        read a NUL-delimited list of pathnames from stdin\n");
+        printf("            (e.g. find -print0)\n");
+        printf("  -m        memory map files (64K and larger) instead of reading them\n");
+#ifndef _WIN32
+        printf("  -r <dir>  recursively scan a directory tree with a pool of threads\n");
+        printf("  -j <n>    number of threads for -r (default = one per CPU)\n");
+        printf("  -u        read file headers asynchronously with io_uring (Linux)\n");
+        printf("  -c <file> keep results in a cache file and skip files and directories\n");
+        printf("            which haven't changed since the last run\n");
+        printf("  --serve <socket>  answer probe requests on a Unix domain socket until\n");
+        printf("            SIGINT or SIGTERM (Linux; -j threads, see README)\n");
+#endif
+        printf("  --pages   walk every page of multi-page TIFFs (not in CSV; turns off -c)\n");
+        printf("  --scans   count the scans of JPEGs (reads the whole file; turns off -c)\n");
+        printf("  --frames  frame count, loop count, duration and frame extent of GIFs\n");
+        printf("            (reads the whole file; turns off -c)\n");
+        printf("  --chunks  walk the chunks of PNGs: APNG frames, DPI, ICC profile, text\n");
+        printf("            and IEND (skips the image data; turns off -c)\n");
+        printf("  --verify-crc  --chunks and check every chunk's CRC (reads the whole\n");
+        printf("            file; the throughput is shown on stderr at the end)\n");
+        printf("  --check-complete  look for JPEGs, PNGs, GIFs and TIFFs which were cut\n");
+        printf("            short, from a small read at the end (turns off -c)\n");
+#ifndef _WIN32
+        printf("  --archives  show the files inside tar and zip archives (as archive:member)\n");
+        printf("            instead of the archives, without extracting them (turns off -c)\n");
+#endif
+        printf("  --thumb <dir>  copy the EXIF thumbnail of each JPEG to its own file in\n");
+        printf("            a directory (not for stdin or -c)\n");
+        printf("  --stats   show I/O counts and timings of each file, totals by type\n");
+        printf("            and memory use (on stderr)\n");
+        printf("  --format=text|jsonl|csv|bin  output format (bin: blocks of fixed size\n");
+        printf("            records followed by their pathnames, see pil_out.h)\n");
+        printf("Supports: TIFF,GIF,JPEG,BMP,PNG,PBM,PGM,PPM,TGA,JEDMICS,CALS,PCX\n");
+        return 0;
+    }
+    for (i=1; i<argc; i++)
+    {
+        if (bOptions && argv[i][0] == '-')
+        {
+            if (strcmp(argv[i], "--") == 0) // everything after this is a pathname
+                bOptions = FALSE;
+            else if (strncmp(argv[i], "--format=", 9) == 0)
+            {
+                if (SetFormat(&argv[i][9]) != 0)
+                {
+                    fprintf(stderr, "%s - unknown format\n", argv[i]);
+                    rc = -1;
+                }
+            }
+            else if (strcmp(argv[i], "-") == 0) // a file on stdin
+            {
+                if (ProcessStdin() != 0)
+                    rc = -1;
+            }
+            else if (strcmp(argv[i], "-m") == 0)
+            {
+                bMap = TRUE;
+            }
+            else if (strcmp(argv[i], "--pages") == 0)
+            {
+                bPages = TRUE;
+#ifndef _WIN32
+                if (pCache != NULL) // it only holds the first page
+                {
+                    fprintf(stderr, "--pages - not using the cache\n");
+                    PILCacheClose(pCache);
+                    pCache = NULL;
+                }
+#endif
+            }
+            else if (strcmp(argv[i], "--scans") == 0 || strcmp(argv[i], "--frames") == 0 || strcmp(argv[i], "--chunks") == 0 || strcmp(argv[i], "--verify-crc") == 0 || strcmp(argv[i], "--check-complete") == 0)
+            {
+                if (argv[i][2] == 's')
+                    bScans = TRUE;
+                else if (argv[i][2] == 'f')
+                    bFrames = TRUE;
+                else if (strcmp(argv[i], "--check-complete") == 0)
+                    bCheckComplete = TRUE;
+                else
+                {
+                    bChunks = TRUE;
+                    if (argv[i][2] == 'v')
+                        bVerifyCRC = TRUE;
+                }
+#ifndef _WIN32
+                if (pCache != NULL) // it doesn't hold them
+                {
+                    fprintf(stderr, "%s - not using the cache\n", argv[i]);
+                    PILCacheClose(pCache);
+                    pCache = NULL;
+                }
+#endif
+            }
+#ifndef _WIN32
+            else if (strcmp(argv[i], "--archives") == 0)
+            {
+                bArchives = TRUE;
+                if (pCache != NULL) // it holds one result per file
+                {
+                    fprintf(stderr, "--archives - not using the cache\n");
+                    PILCacheClose(pCache);
+                    pCache = NULL;
+                }
+            }
+#endif
+            else if (strcmp(argv[i], "--thumb") == 0 && i+1 < argc)
+            {
+                szThumbDir = argv[++i];
+#ifndef _WIN32
+                if (stat(szThumbDir, &st) != 0 || !S_ISDIR(st.st_mode))
+                {
+                    fprintf(stderr, "%s - not a directory\n", szThumbDir);
+                    szThumbDir = NULL;
+                    rc = -1;
+                }
+#endif
+#ifndef _WIN32
+                if (pCache != NULL) // hits would skip the file
+                {
+                    fprintf(stderr, "--thumb - not using the cache\n");
+                    PILCacheClose(pCache);
+                    pCache = NULL;
+                }
+#endif
+            }
+            else if (strcmp(argv[i], "--stats") == 0)
+            {
+                bStats = TRUE;
+                PILIOSetStats(TRUE);
+                PILIOTraceMem(TRUE);
+            }
+            else if (strcmp(argv[i], "-0") == 0)
+            {
+                if (ProcessFileList(stdin) != 0)
+                    rc = -1;
+            }
+#ifndef _WIN32
+            else if (strcmp(argv[i], "-u") == 0)
+            {
+                if (pUring == NULL) // falls back to blocking reads if unavailable
+                {
+                    pUring = PILUringInit(0, UringCallback, NULL);
+                    if (pUring != NULL)
+                        PILUringSetClassifier(pUring, imageinfo_classify);
+                }
+            }
+            else if (strcmp(argv[i], "-c") == 0 && i+1 < argc)
+            {
+                i++;
+                PILCacheClose(pCache); // only one at a time
+                pCache = NULL;
+                if (bPages || bScans || bFrames || bChunks || bCheckComplete || bArchives || szThumbDir != NULL)
+                    fprintf(stderr, "%s - not using the cache with --pages, --scans, --frames, --chunks, --check-complete, --archives or --thumb\n", argv[i]);
+                else
+                {
+                    pCache = PILCacheOpen(argv[i], CACHE_FORMAT);
+                    if (pCache == NULL)
+                        fprintf(stderr, "%s - unable to open cache (in use?), continuing without it\n", argv[i]);
+                }
+            }
+            else if (strcmp(argv[i], "-j") == 0 && i+1 < argc)
+            {
+                iThreads = atoi(argv[++i]);
+            }
+            else if (strcmp(argv[i], "--serve") == 0 && i+1 < argc)
+            {
+                i++;
+                FlushWriters(FALSE);
+                if (PILServe(argv[i], iThreads, (int)sizeof(INFO_RECORD), ServeCallback, NULL) != 0)
+                {
+                    fprintf(stderr, "%s - unable to serve on this socket\n", argv[i]);
+                    rc = -1;
+                }
+            }
+            else if (strcmp(argv[i], "-r") == 0 && i+1 < argc)
+            {
+                i++;
+                FlushWriters(FALSE); // keep the output in order
+                iScan = PILScanTreeEx(argv[i], iThreads, ScanCallback, pCache ? &cacheHooks : NULL, NULL);
+                if (iScan < 0)
+                {
+                    DisplayInfo(GetWriter(0), argv[i], IMAGEINFO_IO_ERROR, NULL, "directory not found");
+                    rc = -1;
+                }
+                else if (iScan > 0)
+                {
+                    fprintf(stderr, "%s - out of memory, some files were skipped\n", argv[i]);
+                    rc = -1;
+                }
+                FlushWriters(FALSE);
+            }
+#endif
+            else
+            {
+                fprintf(stderr, "%s - unknown option\n", argv[i]);
+                rc = -1;
+            }
+            continue;
+        }
+        if (ProcessPath(argv[i]) != 0)
+            rc = -1;
+    }
+#ifndef _WIN32
+    PILUringFinish(pUring);
+    PILCacheClose(pCache);
+#endif
+    FlushWriters(TRUE);
+    PILIOThreadDone();
+    if (bStats)
+        PrintStats();
+    if (bVerifyCRC && uiCRCFiles)
+        fprintf(stderr, "CRC: %u PNG files (%u damaged or incomplete), %.1f MB checked at %.2f GB/s per thread with %s\n", uiCRCFiles, uiCRCBad, (double)ullCRCBytes / 1e6, ullCRCNs ? (double)ullCRCBytes / (double)ullCRCNs : 0.0, PILCRCImpl(NULL));
+    if (bCheckComplete)
+        fprintf(stderr, "Complete: %u files checked, %u truncated, %u with data after the end\n", uiChecked, uiTruncated, uiTrailing);
+    return rc;
 } /* main() */
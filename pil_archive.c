@@ -0,0 +1,671 @@
+/****************************************************************************
+ *                                                                          *
+ * MODULE:  PIL_ARCHIVE.C                                                   *
+ *                                                                          *
+ * DESCRIPTION: Walk the members of tar and zip archives in place           *
+ *                                                                          *
+ * FUNCTIONS:                                                               *
+ *            PILArchiveType - Tell whether a file is a tar or zip archive  *
+ *            PILArchiveWalk - Call back with each member as a handle       *
+ * COMMENTS:                                                                *
+ *            Nothing is extracted. A tar is walked from one 512 byte       *
+ *            header to the next, seeking over the data. A zip is walked    *
+ *            through its central directory, found from the end record,     *
+ *            and only the local header of each member is read. Tar and     *
+ *            stored zip members are handed out as ranges of the archive    *
+ *            (PILIOOpenRange), so the probe reads them like any file.      *
+ *            Deflated members are inflated into memory, only as far as     *
+ *            the probe gets (16K at first, doubling, up to 1MB).           *
+ ****************************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#include "my_windows.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "pil_io.h"
+#include "pil_archive.h"
+
+#define ARCHIVE_BLOCK 512              // tar headers and data padding
+#define ARCHIVE_MAX_NAME 4096          // longer member names are cut short
+#define ARCHIVE_TAIL_SIZE 1024         // first look for the zip end record here
+#define ARCHIVE_EOCD_SIZE 22           // zip end record without the comment
+#define ARCHIVE_COMMENT_MAX 65535      // then look back this much further
+#define ARCHIVE_CD_SIZE 0x40000        // central directory window, holds any entry
+#define ARCHIVE_INFLATE_SIZE 16384     // inflated at first from deflated members
+#define ARCHIVE_INFLATE_MAX 0x100000   // and never more than this
+#define ARCHIVE_READ_SIZE 16384        // compressed data read at a time
+
+// little-endian fields of zip records
+#define ZIPSHORT(p) ((unsigned int)(p)[0] | ((unsigned int)(p)[1] << 8))
+#define ZIPLONG(p) ((uint32_t)ZIPSHORT(p) | ((uint32_t)ZIPSHORT(&(p)[2]) << 16))
+#define ZIPLONGLONG(p) ((uint64_t)ZIPLONG(p) | ((uint64_t)ZIPLONG(&(p)[4]) << 32))
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ArchiveRead(void *, PILOffset, void *, int)                *
+ *                                                                          *
+ *  PURPOSE    : Read a block at an offset.                                 *
+ *                                                                          *
+ *  RETURNS    : Number of bytes read.                                      *
+ *                                                                          *
+ ****************************************************************************/
+static int ArchiveRead(void *iHandle, PILOffset llOffset, void *pBuf, int iLen)
+{
+   PILIOSeek(iHandle, llOffset, 0);
+   return PILIORead(iHandle, pBuf, iLen);
+} /* ArchiveRead() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TarNumber(unsigned char *, int)                            *
+ *                                                                          *
+ *  PURPOSE    : Value of a tar header number field; octal digits padded    *
+ *               with spaces or NULs, or the GNU base-256 form for sizes    *
+ *               of 8GB and more (first byte has the top bit set).          *
+ *                                                                          *
+ *  RETURNS    : The value or -1 if there are no digits.                    *
+ *                                                                          *
+ ****************************************************************************/
+static PILOffset TarNumber(unsigned char *p, int iLen)
+{
+PILOffset llValue = 0;
+int i = 0;
+
+   if (p[0] & 0x80)
+      {
+      llValue = p[0] & 0x3f; // the 0x40 bit would make it negative
+      for (i=1; i<iLen; i++)
+         llValue = (llValue << 8) | p[i];
+      return llValue;
+      }
+   while (i < iLen && p[i] == ' ')
+      i++;
+   if (i == iLen || p[i] < '0' || p[i] > '7')
+      return -1;
+   while (i < iLen && p[i] >= '0' && p[i] <= '7')
+      llValue = (llValue << 3) + (p[i++] - '0');
+   return llValue;
+} /* TarNumber() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TarChecksum(unsigned char *)                               *
+ *                                                                          *
+ *  PURPOSE    : Check the checksum of a tar header block. Some old tars    *
+ *               summed signed bytes, so either sum is accepted.            *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL TarChecksum(unsigned char *pHeader)
+{
+PILOffset llSum;
+int i, iSum = 0, iSigned = 0;
+
+   llSum = TarNumber(&pHeader[148], 8);
+   if (llSum < 0)
+      return FALSE;
+   for (i=0; i<ARCHIVE_BLOCK; i++)
+      {
+      if (i >= 148 && i < 156) // the checksum itself counts as spaces
+         {
+         iSum += ' ';
+         iSigned += ' ';
+         }
+      else
+         {
+         iSum += pHeader[i];
+         iSigned += (signed char)pHeader[i];
+         }
+      }
+   return (llSum == iSum || llSum == iSigned);
+} /* TarChecksum() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TarPax(unsigned char *, int, char *, PILOffset *)          *
+ *                                                                          *
+ *  PURPOSE    : Take the path and size from the records of a pax extended  *
+ *               header ("<length> <key>=<value>\n"), which override the    *
+ *               fields of the header after it.                             *
+ *                                                                          *
+ ****************************************************************************/
+static void TarPax(unsigned char *pData, int iLen, char *szPath, PILOffset *pllSize)
+{
+char *p = (char *)pData, *pEnd = (char *)pData + iLen, *pKey, *pValue;
+int iRecord, iValue;
+
+   while (p < pEnd)
+      {
+      iRecord = 0;
+      for (pKey = p; pKey < pEnd && *pKey >= '0' && *pKey <= '9'; pKey++)
+         iRecord = iRecord * 10 + (*pKey - '0');
+      if (iRecord <= 0 || iRecord > pEnd - p || pKey >= pEnd || *pKey != ' ')
+         return; // damaged (or cut short by our buffer)
+      pKey++;
+      for (pValue = pKey; pValue < p + iRecord && *pValue != '='; pValue++)
+         {
+         }
+      if (pValue < p + iRecord)
+         {
+         pValue++;
+         iValue = (int)(p + iRecord - 1 - pValue); // without the newline
+         if (pValue - pKey == 5 && memcmp(pKey, "path=", 5) == 0 && iValue > 0 && iValue < ARCHIVE_MAX_NAME)
+            {
+            memcpy(szPath, pValue, iValue);
+            szPath[iValue] = '\0';
+            }
+         else if (pValue - pKey == 5 && memcmp(pKey, "size=", 5) == 0)
+            *pllSize = TarNumber((unsigned char *)pValue, iValue);
+         }
+      p += iRecord;
+      }
+} /* TarPax() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TarWalk(void *, PIL_ARCHIVE_CALLBACK, void *)              *
+ *                                                                          *
+ *  PURPOSE    : Call back with each regular file of a tar archive. Only    *
+ *               the headers are read; GNU long names and pax headers are   *
+ *               understood so long paths and sizes of 8GB and more work.   *
+ *                                                                          *
+ *  RETURNS    : Number of members or -1 if the archive is damaged or cut   *
+ *               short (after calling back with the members before that).   *
+ *                                                                          *
+ ****************************************************************************/
+static int TarWalk(void *iHandle, PIL_ARCHIVE_CALLBACK pfnCallback, void *pUser)
+{
+unsigned char ucHeader[ARCHIVE_BLOCK];
+unsigned char ucData[ARCHIVE_MAX_NAME]; // long name or pax header
+char szName[ARCHIVE_MAX_NAME];
+char szLong[ARCHIVE_MAX_NAME]; // name for the next member, from a previous one
+PILOffset llPos, llSize, llFileSize, llPaxSize = -1;
+void *iMember;
+int i, iLen, iCount = 0;
+
+   llFileSize = PILIOSize(iHandle);
+   szLong[0] = '\0';
+   for (llPos = 0; ; llPos += ARCHIVE_BLOCK + ((llSize + ARCHIVE_BLOCK - 1) & ~(PILOffset)(ARCHIVE_BLOCK - 1)))
+      {
+      if (ArchiveRead(iHandle, llPos, ucHeader, ARCHIVE_BLOCK) != ARCHIVE_BLOCK)
+         return -1;
+      for (i=0; i<ARCHIVE_BLOCK && ucHeader[i] == 0; i++)
+         {
+         }
+      if (i == ARCHIVE_BLOCK) // a zero block marks the end
+         return iCount;
+      if (!TarChecksum(ucHeader))
+         return -1;
+      llSize = TarNumber(&ucHeader[124], 12);
+      if (llSize < 0)
+         return -1;
+      switch (ucHeader[156]) // type of entry
+         {
+         case 'L': // GNU long name of the next entry
+         case 'x': // pax extended header of the next entry
+            iLen = (llSize < ARCHIVE_MAX_NAME) ? (int)llSize : ARCHIVE_MAX_NAME - 1;
+            if (ArchiveRead(iHandle, llPos + ARCHIVE_BLOCK, ucData, iLen) != iLen)
+               return -1;
+            if (ucHeader[156] == 'x')
+               TarPax(ucData, iLen, szLong, &llPaxSize);
+            else
+               {
+               memcpy(szLong, ucData, iLen);
+               szLong[iLen] = '\0';
+               }
+            continue; // keep them for the next header
+         case '0':
+         case '7': // contiguous file
+         case '\0': // regular file (old tars)
+            if (szLong[0])
+               strcpy(szName, szLong);
+            else if (memcmp(&ucHeader[257], "ustar", 6) == 0 && ucHeader[345]) // POSIX prefix
+               snprintf(szName, sizeof(szName), "%.155s/%.100s", (char *)&ucHeader[345], (char *)ucHeader);
+            else
+               snprintf(szName, sizeof(szName), "%.100s", (char *)ucHeader);
+            if (llPaxSize >= 0)
+               llSize = llPaxSize;
+            iLen = (int)strlen(szName);
+            if (iLen && szName[iLen-1] == '/') // a directory in an old tar
+               break;
+            iCount++;
+            if (llPos + ARCHIVE_BLOCK + llSize > llFileSize)
+               {
+               (*pfnCallback)(pUser, szName, (void *)-1, llSize, "member is cut short");
+               return -1;
+               }
+            iMember = PILIOOpenRange(iHandle, llPos + ARCHIVE_BLOCK, llSize);
+            if (iMember == (void *)-1)
+               return -1;
+            (*pfnCallback)(pUser, szName, iMember, llSize, NULL); // ranges never need more
+            PILIOClose(iMember);
+            break;
+         default: // directories, links, devices and headers we don't use
+            break;
+         }
+      szLong[0] = '\0';
+      llPaxSize = -1;
+      }
+} /* TarWalk() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ZipWindow(void *, unsigned char *, PILOffset *, ...)       *
+ *                                                                          *
+ *  PURPOSE    : Return iLen bytes of the central directory at llPos from   *
+ *               the window in pBuf, moving the window there if they        *
+ *               aren't in it. Any entry fits in the window.                *
+ *                                                                          *
+ *  RETURNS    : Pointer to the bytes or NULL if they are past llEnd or     *
+ *               couldn't be read.                                          *
+ *                                                                          *
+ ****************************************************************************/
+static unsigned char * ZipWindow(void *iHandle, unsigned char *pBuf, PILOffset *pllWin, int *piWin, PILOffset llPos, PILOffset llEnd, int iLen)
+{
+int iRead;
+
+   if (llPos + iLen > llEnd)
+      return NULL;
+   if (llPos < *pllWin || llPos + iLen > *pllWin + *piWin)
+      {
+      iRead = (llEnd - llPos > ARCHIVE_CD_SIZE) ? ARCHIVE_CD_SIZE : (int)(llEnd - llPos);
+      *pllWin = llPos;
+      *piWin = ArchiveRead(iHandle, llPos, pBuf, iRead);
+      if (*piWin < iLen)
+         return NULL;
+      }
+   return &pBuf[llPos - *pllWin];
+} /* ZipWindow() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ZipExtra64(unsigned char *, int, uint64_t *, ...)          *
+ *                                                                          *
+ *  PURPOSE    : Take the sizes and offset which didn't fit in 32 bits      *
+ *               (0xffffffff) from the Zip64 extra field of an entry.       *
+ *                                                                          *
+ ****************************************************************************/
+static void ZipExtra64(unsigned char *p, int iLen, uint64_t *pullSize, uint64_t *pullComp, uint64_t *pullLocal)
+{
+int iID, iSize;
+
+   while (iLen >= 4)
+      {
+      iID = ZIPSHORT(p);
+      iSize = ZIPSHORT(&p[2]);
+      if (iSize + 4 > iLen)
+         return;
+      if (iID == 1) // the values are there only for the fields which overflowed, in this order
+         {
+         p += 4;
+         if (*pullSize == 0xffffffff && iSize >= 8)
+            {
+            *pullSize = ZIPLONGLONG(p);
+            p += 8;
+            iSize -= 8;
+            }
+         if (*pullComp == 0xffffffff && iSize >= 8)
+            {
+            *pullComp = ZIPLONGLONG(p);
+            p += 8;
+            iSize -= 8;
+            }
+         if (*pullLocal == 0xffffffff && iSize >= 8)
+            *pullLocal = ZIPLONGLONG(p);
+         return;
+         }
+      p += 4 + iSize;
+      iLen -= 4 + iSize;
+      }
+} /* ZipExtra64() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ZipAlloc(voidpf, uInt, uInt)                               *
+ *                                                                          *
+ *  PURPOSE    : zlib allocator; inflate's state lives in the arena.        *
+ *                                                                          *
+ ****************************************************************************/
+static voidpf ZipAlloc(voidpf pOpaque, uInt uiItems, uInt uiSize)
+{
+   return PILIOArenaAlloc((unsigned long)uiItems * uiSize);
+} /* ZipAlloc() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ZipFree(voidpf, voidpf)                                    *
+ *                                                                          *
+ *  PURPOSE    : zlib free; nothing to do, the arena is released instead.   *
+ *                                                                          *
+ ****************************************************************************/
+static void ZipFree(voidpf pOpaque, voidpf p)
+{
+} /* ZipFree() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ZipInflate(void *, char *, PILOffset, PILOffset, ...)      *
+ *                                                                          *
+ *  PURPOSE    : Call back with the start of a deflated member in memory.   *
+ *               ARCHIVE_INFLATE_SIZE bytes are inflated at first; while    *
+ *               the callback asks for more, enough is added to cover what  *
+ *               it asked for (at least double), up to ARCHIVE_INFLATE_MAX. *
+ *               The output and zlib's state come from the thread's arena.  *
+ *                                                                          *
+ ****************************************************************************/
+static void ZipInflate(void *iHandle, char *szName, PILOffset llData, PILOffset llComp, PILOffset llSize, PIL_ARCHIVE_CALLBACK pfnCallback, void *pUser)
+{
+z_stream zs;
+unsigned char ucIn[ARCHIVE_READ_SIZE], *pIn, *pOut = NULL, *pNew;
+void *pMark = PILIOArenaMark();
+PILOffset llIn = 0; // compressed bytes taken so far
+PILOffset llNeed;
+unsigned long ulWant, ulMax;
+unsigned int uiNeed;
+char *szError = NULL;
+void *iMember;
+int rc = Z_OK, iLen;
+
+   memset(&zs, 0, sizeof(zs));
+   zs.zalloc = ZipAlloc;
+   zs.zfree = ZipFree;
+   if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) // raw deflate data, no zlib header
+      {
+      (*pfnCallback)(pUser, szName, (void *)-1, llSize, "out of memory");
+      PILIOArenaRelease(pMark);
+      return;
+      }
+   ulMax = (llSize < ARCHIVE_INFLATE_MAX) ? (unsigned long)llSize : ARCHIVE_INFLATE_MAX;
+   ulWant = (ulMax < ARCHIVE_INFLATE_SIZE) ? ulMax : ARCHIVE_INFLATE_SIZE;
+   while (szError == NULL)
+      {
+      pNew = (unsigned char *)PILIOArenaAlloc(ulWant ? ulWant : 1);
+      if (pNew == NULL)
+         {
+         szError = "out of memory";
+         break;
+         }
+      if (zs.total_out)
+         memcpy(pNew, pOut, zs.total_out);
+      pOut = pNew;
+      while (zs.total_out < ulWant && rc == Z_OK)
+         {
+         if (zs.avail_in == 0)
+            {
+            iLen = (llComp - llIn > ARCHIVE_READ_SIZE) ? ARCHIVE_READ_SIZE : (int)(llComp - llIn);
+            pIn = PILIOData(iHandle, llData + llIn, iLen, &iLen);
+            if (pIn == NULL)
+               {
+               pIn = ucIn;
+               iLen = ArchiveRead(iHandle, llData + llIn, ucIn, iLen);
+               }
+            if (iLen <= 0) // ran out before the end of the stream
+               {
+               rc = Z_DATA_ERROR;
+               break;
+               }
+            llIn += iLen;
+            zs.next_in = pIn;
+            zs.avail_in = iLen;
+            }
+         zs.next_out = &pOut[zs.total_out];
+         zs.avail_out = (unsigned int)(ulWant - zs.total_out);
+         rc = inflate(&zs, Z_NO_FLUSH);
+         }
+      if ((rc != Z_OK && rc != Z_STREAM_END) || (rc == Z_STREAM_END && zs.total_out < ulWant))
+         {
+         szError = "damaged deflate data";
+         break;
+         }
+      iMember = PILIOOpenMem(pOut, zs.total_out, llSize);
+      if (iMember == (void *)-1)
+         {
+         szError = "out of memory";
+         break;
+         }
+      if ((*pfnCallback)(pUser, szName, iMember, llSize, NULL) == 0)
+         {
+         PILIOClose(iMember);
+         break; // done
+         }
+      PILIONeedMore(iMember, &llNeed, &uiNeed);
+      PILIOClose(iMember);
+      if (ulWant == ulMax) // there's no more to give
+         {
+         szError = ((PILOffset)ulMax == llSize) ? "damaged file" : "the first 1MB inflated isn't enough";
+         break;
+         }
+      ulWant *= 2;
+      if (llNeed + uiNeed > (PILOffset)ulWant)
+         ulWant = (unsigned long)(llNeed + uiNeed);
+      if (ulWant > ulMax)
+         ulWant = ulMax;
+      }
+   if (szError != NULL)
+      (*pfnCallback)(pUser, szName, (void *)-1, llSize, szError);
+   inflateEnd(&zs);
+   PILIOArenaRelease(pMark);
+} /* ZipInflate() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ZipMember(void *, char *, int, int, PILOffset, ...)        *
+ *                                                                          *
+ *  PURPOSE    : Call back with a member of a zip archive, after reading    *
+ *               its local header to find where the data starts.            *
+ *                                                                          *
+ ****************************************************************************/
+static void ZipMember(void *iHandle, char *szName, int iFlags, int iMethod, PILOffset llLocal, PILOffset llComp, PILOffset llSize, PIL_ARCHIVE_CALLBACK pfnCallback, void *pUser)
+{
+unsigned char ucLocal[30];
+char szError[64];
+PILOffset llData;
+void *iMember;
+
+   if (iFlags & 1)
+      {
+      (*pfnCallback)(pUser, szName, (void *)-1, llSize, "encrypted");
+      return;
+      }
+   if (iMethod != 0 && iMethod != 8) // stored or deflated
+      {
+      sprintf(szError, "compression method %d not supported", iMethod);
+      (*pfnCallback)(pUser, szName, (void *)-1, llSize, szError);
+      return;
+      }
+   if (ArchiveRead(iHandle, llLocal, ucLocal, 30) != 30 || ZIPLONG(ucLocal) != 0x04034b50)
+      {
+      (*pfnCallback)(pUser, szName, (void *)-1, llSize, "local header not found");
+      return;
+      }
+   llData = llLocal + 30 + ZIPSHORT(&ucLocal[26]) + ZIPSHORT(&ucLocal[28]);
+   if (llData + llComp > PILIOSize(iHandle) || (iMethod == 0 && llComp != llSize))
+      {
+      (*pfnCallback)(pUser, szName, (void *)-1, llSize, "member is cut short");
+      return;
+      }
+   if (iMethod == 8)
+      {
+      ZipInflate(iHandle, szName, llData, llComp, llSize, pfnCallback, pUser);
+      return;
+      }
+   iMember = PILIOOpenRange(iHandle, llData, llSize);
+   if (iMember == (void *)-1)
+      {
+      (*pfnCallback)(pUser, szName, (void *)-1, llSize, "out of memory");
+      return;
+      }
+   (*pfnCallback)(pUser, szName, iMember, llSize, NULL);
+   PILIOClose(iMember);
+} /* ZipMember() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ZipWalk(void *, PIL_ARCHIVE_CALLBACK, void *)              *
+ *                                                                          *
+ *  PURPOSE    : Call back with each file of a zip archive, in the order    *
+ *               of the central directory. The end record is looked for in  *
+ *               the last 1K, then as far back as the longest comment.      *
+ *               Zip64 archives (more than 65535 members, or over 4GB)      *
+ *               work too.                                                  *
+ *                                                                          *
+ *  RETURNS    : Number of members or -1 if the archive is damaged.         *
+ *                                                                          *
+ ****************************************************************************/
+static int ZipWalk(void *iHandle, PIL_ARCHIVE_CALLBACK pfnCallback, void *pUser)
+{
+unsigned char *pBuf, *p;
+void *pMark;
+char szName[ARCHIVE_MAX_NAME];
+PILOffset llFileSize, llTail, llEnd, llPos, llWin = 0;
+uint64_t ullCount, ullCDSize, ullCDOffset, ullSize, ullComp, ullLocal, ull;
+int i, iLen, iWin = 0, iNameLen, iExtraLen, iCount = 0;
+
+   pMark = PILIOArenaMark();
+   pBuf = (unsigned char *)PILIOArenaAlloc(ARCHIVE_CD_SIZE);
+   if (pBuf == NULL)
+      return -1;
+   llFileSize = PILIOSize(iHandle);
+   iLen = (llFileSize < ARCHIVE_TAIL_SIZE) ? (int)llFileSize : ARCHIVE_TAIL_SIZE;
+   for (;;)
+      {
+      llTail = llFileSize - iLen;
+      if (ArchiveRead(iHandle, llTail, pBuf, iLen) != iLen)
+         goto zip_error;
+      for (i = iLen - ARCHIVE_EOCD_SIZE; i >= 0 && ZIPLONG(&pBuf[i]) != 0x06054b50; i--)
+         {
+         }
+      if (i >= 0)
+         break;
+      if (iLen == llFileSize || iLen == ARCHIVE_EOCD_SIZE + ARCHIVE_COMMENT_MAX)
+         goto zip_error; // not there
+      iLen = (llFileSize < ARCHIVE_EOCD_SIZE + ARCHIVE_COMMENT_MAX) ? (int)llFileSize : ARCHIVE_EOCD_SIZE + ARCHIVE_COMMENT_MAX;
+      }
+   p = &pBuf[i];
+   ullCount = ZIPSHORT(&p[10]);
+   ullCDSize = ZIPLONG(&p[12]);
+   ullCDOffset = ZIPLONG(&p[16]);
+   if (ullCount == 0xffff || ullCDSize == 0xffffffff || ullCDOffset == 0xffffffff)
+      {
+      // Zip64; the locator just before the end record gives the Zip64 end record
+      // (without one, the values really are that big)
+      llPos = llTail + i - 20;
+      if (llPos >= 0 && ArchiveRead(iHandle, llPos, pBuf, 20) == 20 && ZIPLONG(pBuf) == 0x07064b50)
+         {
+         ull = ZIPLONGLONG(&pBuf[8]);
+         if (ull > (uint64_t)llFileSize || ArchiveRead(iHandle, (PILOffset)ull, pBuf, 56) != 56 || ZIPLONG(pBuf) != 0x06064b50)
+            goto zip_error;
+         ullCount = ZIPLONGLONG(&pBuf[32]);
+         ullCDSize = ZIPLONGLONG(&pBuf[40]);
+         ullCDOffset = ZIPLONGLONG(&pBuf[48]);
+         }
+      }
+   if (ullCDOffset > (uint64_t)llFileSize || ullCDSize > (uint64_t)llFileSize - ullCDOffset)
+      goto zip_error;
+   llEnd = (PILOffset)(ullCDOffset + ullCDSize);
+   llPos = (PILOffset)ullCDOffset;
+   iWin = 0; // nothing in the window yet
+   for (ull = 0; ull < ullCount; ull++)
+      {
+      p = ZipWindow(iHandle, pBuf, &llWin, &iWin, llPos, llEnd, 46);
+      if (p == NULL || ZIPLONG(p) != 0x02014b50)
+         goto zip_error;
+      iNameLen = ZIPSHORT(&p[28]);
+      iExtraLen = ZIPSHORT(&p[30]);
+      iLen = 46 + iNameLen + iExtraLen + ZIPSHORT(&p[32]); // and the comment
+      p = ZipWindow(iHandle, pBuf, &llWin, &iWin, llPos, llEnd, iLen);
+      if (p == NULL)
+         goto zip_error;
+      llPos += iLen;
+      if (iNameLen == 0 || p[46 + iNameLen - 1] == '/') // a directory
+         continue;
+      ullComp = ZIPLONG(&p[20]);
+      ullSize = ZIPLONG(&p[24]);
+      ullLocal = ZIPLONG(&p[42]);
+      ZipExtra64(&p[46 + iNameLen], iExtraLen, &ullSize, &ullComp, &ullLocal);
+      if (iNameLen >= ARCHIVE_MAX_NAME)
+         iNameLen = ARCHIVE_MAX_NAME - 1;
+      memcpy(szName, &p[46], iNameLen);
+      szName[iNameLen] = '\0';
+      iCount++;
+      if (ullLocal > (uint64_t)llFileSize || ullComp > (uint64_t)llFileSize || ullSize > (uint64_t)INT64_MAX)
+         {
+         (*pfnCallback)(pUser, szName, (void *)-1, (PILOffset)0, "damaged directory entry");
+         continue;
+         }
+      ZipMember(iHandle, szName, ZIPSHORT(&p[8]), ZIPSHORT(&p[10]), (PILOffset)ullLocal, (PILOffset)ullComp, (PILOffset)ullSize, pfnCallback, pUser);
+      }
+   PILIOArenaRelease(pMark);
+   return iCount;
+zip_error:
+   PILIOArenaRelease(pMark);
+   return -1;
+} /* ZipWalk() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILArchiveType(void *)                                     *
+ *                                                                          *
+ *  PURPOSE    : Tell whether an open file is an archive we can walk, from  *
+ *               its first 512 bytes: a zip starts with a local header (or  *
+ *               the end record if it's empty) and a tar with a header      *
+ *               block whose checksum is right.                             *
+ *                                                                          *
+ *  RETURNS    : PIL_ARCHIVE_TAR, PIL_ARCHIVE_ZIP or PIL_ARCHIVE_NONE.      *
+ *                                                                          *
+ ****************************************************************************/
+int PILArchiveType(void *iHandle)
+{
+unsigned char ucHeader[ARCHIVE_BLOCK], *p;
+int iLen;
+
+   p = PILIOData(iHandle, 0, ARCHIVE_BLOCK, &iLen);
+   if (p == NULL)
+      {
+      p = ucHeader;
+      iLen = ArchiveRead(iHandle, 0, ucHeader, ARCHIVE_BLOCK);
+      PILIOSeek(iHandle, 0, 0); // the probe reads from the start without seeking
+      }
+   if (iLen >= 4 && (ZIPLONG(p) == 0x04034b50 || ZIPLONG(p) == 0x06054b50))
+      return PIL_ARCHIVE_ZIP;
+   if (iLen == ARCHIVE_BLOCK && TarChecksum(p))
+      return PIL_ARCHIVE_TAR;
+   return PIL_ARCHIVE_NONE;
+} /* PILArchiveType() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILArchiveWalk(void *, int, PIL_ARCHIVE_CALLBACK, void *)  *
+ *                                                                          *
+ *  PURPOSE    : Call back with each regular file in an archive of the      *
+ *               type given by PILArchiveType(). Directories, links and     *
+ *               the like are skipped.                                      *
+ *                                                                          *
+ *  RETURNS    : Number of members or -1 if the archive is damaged or cut   *
+ *               short (after calling back with the members before that).   *
+ *                                                                          *
+ ****************************************************************************/
+int PILArchiveWalk(void *iHandle, int iType, PIL_ARCHIVE_CALLBACK pfnCallback, void *pUser)
+{
+   switch (iType)
+      {
+      case PIL_ARCHIVE_TAR:
+         return TarWalk(iHandle, pfnCallback, pUser);
+      case PIL_ARCHIVE_ZIP:
+         return ZipWalk(iHandle, pfnCallback, pUser);
+      }
+   return -1;
+} /* PILArchiveWalk() */
@@ -0,0 +1,46 @@
+/************************************************************/
+/*--- Walk the members of tar and zip archives in place  ---*/
+/* Copyright (c) 2017 BitBank Software, Inc.                */
+/************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#ifndef _PIL_ARCHIVE_H_
+#define _PIL_ARCHIVE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Kinds of archives (PILArchiveType)
+#define PIL_ARCHIVE_NONE 0
+#define PIL_ARCHIVE_TAR 1
+#define PIL_ARCHIVE_ZIP 2
+
+// Called for each member which is a regular file, in the order they are
+// stored. szName is its path in the archive and llSize its (uncompressed)
+// size. iHandle reads the member as a file of its own: a range of the
+// archive (see PILIOOpenRange) for tar and stored zip members, or a memory
+// handle (see PILIOOpenMem) holding the start of a deflated member.
+// Return 0 when done with the member or 1 if PILIONeedMore() reports a
+// piece beyond what was inflated; more is inflated and the call repeated.
+// iHandle is -1 if the member can't be read and szError says why.
+typedef int (*PIL_ARCHIVE_CALLBACK)(void *pUser, char *szName, void *iHandle, PILOffset llSize, char *szError);
+
+extern int PILArchiveType(void *iHandle);
+extern int PILArchiveWalk(void *iHandle, int iType, PIL_ARCHIVE_CALLBACK pfnCallback, void *pUser);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // #ifndef _PIL_ARCHIVE_H_
@@ -0,0 +1,818 @@
+/****************************************************************************
+ *                                                                          *
+ * MODULE:  PIL_CACHE.C                                                     *
+ *                                                                          *
+ * DESCRIPTION: Persistent cache of per-file results                        *
+ *                                                                          *
+ * FUNCTIONS:                                                               *
+ *            PILCacheOpen - Open (or create) a cache file                  *
+ *            PILCacheFind - Look up the record for a file or directory    *
+ *            PILCacheAdd - Add a record                                    *
+ *            PILCacheClose - Write the new index and close the cache       *
+ * COMMENTS:                                                                *
+ *            The file is a header, a log of variable length records and    *
+ *            an open addressing hash index on (st_dev, st_ino) at the end. *
+ *            It is memory mapped read-only, so a lookup touches a slot     *
+ *            and a record and nothing is loaded up front. New records are  *
+ *            appended after the old index and found through an in-memory   *
+ *            index of this run's records, read back through windows of     *
+ *            the file mapped as it grows, so a long running process (the   *
+ *            --serve daemon) hits on what it has already probed. At close  *
+ *            a new index is appended and the header switched to it last,   *
+ *            so a crash leaves the previous state intact. When more than   *
+ *            half of the file is dead (replaced records, old indexes,      *
+ *            records not seen for CACHE_MAX_AGE runs) it is compacted.     *
+ *            One process at a time; the file is locked while open.         *
+ ****************************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#include "my_windows.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include "pil_cache.h"
+
+#define CACHE_MAGIC "IMGINFC1"
+#define CACHE_VERSION 1
+#define CACHE_HEADER_SIZE 64
+#define CACHE_MIN_SLOTS 1024
+#define CACHE_WRITE_SIZE 65536     // records are appended in blocks this big
+#define CACHE_MAX_AGE 8            // runs a record survives without being seen
+#define CACHE_COMPACT_MIN 0x100000 // don't bother compacting small files
+#define CACHE_WINDOW_SIZE 0x4000000 // address space per mapping of new records
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+#ifdef __APPLE__
+#define MTIME_NS(pst) ((int64_t)(pst)->st_mtimespec.tv_sec * 1000000000LL + (pst)->st_mtimespec.tv_nsec)
+#else
+#define MTIME_NS(pst) ((int64_t)(pst)->st_mtim.tv_sec * 1000000000LL + (pst)->st_mtim.tv_nsec)
+#endif
+
+typedef struct pil_cache_header_tag
+{
+   char szMagic[8];
+   uint32_t uiVersion;
+   uint32_t uiFormat;      // layout of the caller's data
+   uint64_t ullIndex;      // file offset of the hash index
+   uint32_t uiSlots;       // size of the index (power of 2)
+   uint32_t uiCount;       // records in the index
+   uint64_t ullEnd;        // bytes in use
+   uint64_t ullDead;       // bytes no longer referenced
+   uint32_t uiGeneration;  // incremented by every run
+   uint32_t uiReserved;
+} PIL_CACHE_HEADER;
+
+typedef struct pil_cache_rec_tag
+{
+   uint32_t uiLen;         // total bytes including this header (multiple of 8)
+   uint32_t uiKind;        // PIL_CACHE_FILE/DIR
+   uint32_t uiDataLen;     // bytes of data following the header
+   uint32_t uiReserved;
+   uint64_t ullDev;
+   uint64_t ullIno;
+   uint64_t ullSize;
+   int64_t llMtime;        // nanoseconds
+} PIL_CACHE_REC;
+
+typedef struct pil_cache_slot_tag
+{
+   uint32_t uiHash;
+   uint32_t uiGeneration;  // last run which used the record
+   uint64_t ullOffset;     // 0 = empty slot
+} PIL_CACHE_SLOT;
+
+typedef struct pil_cache_entry_tag // a record for the index being built
+{
+   uint64_t ullDev;
+   uint64_t ullIno;
+   uint64_t ullOffset;
+   uint32_t uiLen;
+   uint32_t uiGeneration;
+} PIL_CACHE_ENTRY;
+
+typedef struct pil_cache_window_tag // a mapping of records added this run
+{
+   uint64_t ullOffset;
+   size_t len;
+   unsigned char *pMap;
+} PIL_CACHE_WINDOW;
+
+typedef struct pil_cache_tag
+{
+   int iFD;
+   char *szFile;
+   unsigned char *pMap;       // contents of the file at open time
+   size_t mapLen;
+   PIL_CACHE_HEADER hdr;
+   PIL_CACHE_SLOT *pSlots;    // index in pMap, NULL if there wasn't one
+   unsigned char *pTouched;   // one flag per old slot used this run
+   pthread_mutex_t mutex;     // protects everything below
+   uint64_t ullEnd;           // where the next record goes
+   unsigned char *pWrite;     // the last iWriteLen bytes before ullEnd
+   int iWriteLen;
+   BOOL bError;               // a write failed, keep the old index
+   PIL_CACHE_ENTRY *pNew;     // records added this run
+   int iNewCount;
+   int iNewMax;
+   int *piLive;               // hash of the newest of them by file (pNew index + 1)
+   uint32_t uiLiveSlots;
+   PIL_CACHE_WINDOW *pWindows;
+   int iWindows;
+} PIL_CACHE;
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheHash(uint64_t, uint64_t)                              *
+ *                                                                          *
+ *  PURPOSE    : Hash a file identity.                                      *
+ *                                                                          *
+ ****************************************************************************/
+static uint32_t CacheHash(uint64_t ullDev, uint64_t ullIno)
+{
+uint64_t h;
+
+   h = (ullIno * 0x9e3779b97f4a7c15ULL) ^ (ullDev + 0x632be59bd9b4e019ULL);
+   h ^= h >> 31;
+   h *= 0xbf58476d1ce4e5b9ULL;
+   h ^= h >> 29;
+   return (uint32_t)h;
+} /* CacheHash() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheWrite(int, void *, size_t, uint64_t)                  *
+ *                                                                          *
+ *  PURPOSE    : Write a block at an offset, retrying short writes.         *
+ *                                                                          *
+ *  RETURNS    : TRUE if successful.                                        *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL CacheWrite(int fd, void *pData, size_t len, uint64_t ullOffset)
+{
+unsigned char *p = (unsigned char *)pData;
+ssize_t i;
+
+   while (len)
+      {
+      i = pwrite(fd, p, len, (off_t)ullOffset);
+      if (i <= 0)
+         return FALSE;
+      p += i;
+      len -= i;
+      ullOffset += i;
+      }
+   return TRUE;
+} /* CacheWrite() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILCacheOpen(char *, unsigned int)                         *
+ *                                                                          *
+ *  PURPOSE    : Open a cache file, creating it if needed. An unreadable    *
+ *               file or one written for a different format starts over.    *
+ *                                                                          *
+ *  RETURNS    : Cache handle or NULL if it couldn't be opened or another   *
+ *               process is using it.                                       *
+ *                                                                          *
+ ****************************************************************************/
+void * PILCacheOpen(char *szFile, unsigned int uiFormat)
+{
+PIL_CACHE *pCache;
+PIL_CACHE_HEADER *pHdr;
+struct stat st;
+BOOL bValid = FALSE;
+
+   pCache = (PIL_CACHE *)calloc(1, sizeof(PIL_CACHE));
+   if (pCache == NULL)
+      return NULL;
+   pCache->szFile = strdup(szFile);
+   pCache->pWrite = (unsigned char *)malloc(CACHE_WRITE_SIZE);
+   pCache->iFD = open(szFile, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (pCache->szFile == NULL || pCache->pWrite == NULL || pCache->iFD < 0)
+      goto open_error;
+   if (flock(pCache->iFD, LOCK_EX | LOCK_NB) != 0 || fstat(pCache->iFD, &st) != 0)
+      goto open_error;
+   if (st.st_size >= CACHE_HEADER_SIZE)
+      {
+      pCache->mapLen = (size_t)st.st_size;
+      pCache->pMap = (unsigned char *)mmap(NULL, pCache->mapLen, PROT_READ, MAP_SHARED, pCache->iFD, 0);
+      if (pCache->pMap == (unsigned char *)MAP_FAILED)
+         pCache->pMap = NULL;
+      }
+   if (pCache->pMap)
+      {
+      pHdr = (PIL_CACHE_HEADER *)pCache->pMap;
+      bValid = (memcmp(pHdr->szMagic, CACHE_MAGIC, 8) == 0 && pHdr->uiVersion == CACHE_VERSION &&
+                pHdr->uiFormat == uiFormat && pHdr->ullEnd <= pCache->mapLen &&
+                pHdr->uiSlots >= CACHE_MIN_SLOTS && (pHdr->uiSlots & (pHdr->uiSlots - 1)) == 0 &&
+                pHdr->ullIndex >= CACHE_HEADER_SIZE && (pHdr->ullIndex & 7) == 0 &&
+                pHdr->ullIndex + (uint64_t)pHdr->uiSlots * sizeof(PIL_CACHE_SLOT) <= pHdr->ullEnd);
+      }
+   if (bValid)
+      {
+      memcpy(&pCache->hdr, pCache->pMap, sizeof(PIL_CACHE_HEADER));
+      pCache->pSlots = (PIL_CACHE_SLOT *)&pCache->pMap[pCache->hdr.ullIndex];
+      pCache->pTouched = (unsigned char *)calloc(pCache->hdr.uiSlots, 1);
+      if (pCache->pTouched == NULL)
+         goto open_error;
+      madvise(pCache->pMap, pCache->mapLen, MADV_RANDOM); // lookups hop around
+      }
+   else // start over
+      {
+      if (pCache->pMap)
+         munmap(pCache->pMap, pCache->mapLen);
+      pCache->pMap = NULL;
+      if (ftruncate(pCache->iFD, 0) != 0)
+         goto open_error;
+      memset(&pCache->hdr, 0, sizeof(PIL_CACHE_HEADER));
+      memcpy(pCache->hdr.szMagic, CACHE_MAGIC, 8);
+      pCache->hdr.uiVersion = CACHE_VERSION;
+      pCache->hdr.uiFormat = uiFormat;
+      pCache->hdr.ullEnd = CACHE_HEADER_SIZE;
+      }
+   pCache->hdr.uiGeneration++;
+   pCache->ullEnd = pCache->hdr.ullEnd;
+   pthread_mutex_init(&pCache->mutex, NULL);
+   return (void *)pCache;
+
+open_error:
+   if (pCache->pMap)
+      munmap(pCache->pMap, pCache->mapLen);
+   if (pCache->iFD >= 0)
+      close(pCache->iFD);
+   free(pCache->szFile);
+   free(pCache->pWrite);
+   free(pCache);
+   return NULL;
+} /* PILCacheOpen() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheFlush(PIL_CACHE *)                                    *
+ *                                                                          *
+ *  PURPOSE    : Write out the buffered records. Called with the lock held. *
+ *                                                                          *
+ ****************************************************************************/
+static void CacheFlush(PIL_CACHE *pCache)
+{
+   if (pCache->iWriteLen && !CacheWrite(pCache->iFD, pCache->pWrite, pCache->iWriteLen, pCache->ullEnd - pCache->iWriteLen))
+      pCache->bError = TRUE;
+   pCache->iWriteLen = 0;
+} /* CacheFlush() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheLiveFind(PIL_CACHE *, uint64_t, uint64_t)             *
+ *                                                                          *
+ *  PURPOSE    : Find this run's newest record for a file. Called with the  *
+ *               lock held.                                                 *
+ *                                                                          *
+ *  RETURNS    : Index into pNew or -1.                                     *
+ *                                                                          *
+ ****************************************************************************/
+static int CacheLiveFind(PIL_CACHE *pCache, uint64_t ullDev, uint64_t ullIno)
+{
+PIL_CACHE_ENTRY *pEntry;
+uint32_t i, uiMask = pCache->uiLiveSlots - 1;
+
+   if (pCache->piLive == NULL)
+      return -1;
+   for (i = CacheHash(ullDev, ullIno) & uiMask; pCache->piLive[i] != 0; i = (i + 1) & uiMask)
+      {
+      pEntry = &pCache->pNew[pCache->piLive[i] - 1];
+      if (pEntry->ullDev == ullDev && pEntry->ullIno == ullIno)
+         return pCache->piLive[i] - 1;
+      }
+   return -1;
+} /* CacheLiveFind() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheLiveAdd(PIL_CACHE *, int)                             *
+ *                                                                          *
+ *  PURPOSE    : Make pNew[iEntry] the record found for its file. Called    *
+ *               with the lock held and room in the table.                  *
+ *                                                                          *
+ ****************************************************************************/
+static void CacheLiveAdd(PIL_CACHE *pCache, int iEntry)
+{
+PIL_CACHE_ENTRY *pEntry = &pCache->pNew[iEntry], *p;
+uint32_t i, uiMask = pCache->uiLiveSlots - 1;
+
+   for (i = CacheHash(pEntry->ullDev, pEntry->ullIno) & uiMask; pCache->piLive[i] != 0; i = (i + 1) & uiMask)
+      {
+      p = &pCache->pNew[pCache->piLive[i] - 1];
+      if (p->ullDev == pEntry->ullDev && p->ullIno == pEntry->ullIno)
+         break; // replaced
+      }
+   pCache->piLive[i] = iEntry + 1;
+} /* CacheLiveAdd() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheLiveGrow(PIL_CACHE *)                                 *
+ *                                                                          *
+ *  PURPOSE    : Keep the table of this run's records at most half full.    *
+ *               Called with the lock held.                                 *
+ *                                                                          *
+ *  RETURNS    : FALSE if there is no room (out of memory); the record is   *
+ *               then only indexed at close.                                *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL CacheLiveGrow(PIL_CACHE *pCache)
+{
+uint32_t uiSlots;
+int *piTable, i;
+
+   if ((uint32_t)(pCache->iNewCount + 1) * 2 <= pCache->uiLiveSlots)
+      return TRUE;
+   uiSlots = pCache->uiLiveSlots ? pCache->uiLiveSlots : CACHE_MIN_SLOTS;
+   while ((uint32_t)(pCache->iNewCount + 1) * 2 > uiSlots)
+      uiSlots *= 2;
+   piTable = (int *)calloc(uiSlots, sizeof(int));
+   if (piTable == NULL)
+      return FALSE;
+   free(pCache->piLive);
+   pCache->piLive = piTable;
+   pCache->uiLiveSlots = uiSlots;
+   for (i=0; i<pCache->iNewCount; i++) // oldest first, so the newest of each file wins
+      CacheLiveAdd(pCache, i);
+   return TRUE;
+} /* CacheLiveGrow() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheLiveRecord(PIL_CACHE *, PIL_CACHE_ENTRY *)            *
+ *                                                                          *
+ *  PURPOSE    : Return a record added this run. The write buffer is        *
+ *               flushed if it is still there, and the file is mapped in    *
+ *               windows of CACHE_WINDOW_SIZE which stay until the cache is *
+ *               closed. Called with the lock held.                         *
+ *                                                                          *
+ *  RETURNS    : Pointer to the record or NULL.                             *
+ *                                                                          *
+ ****************************************************************************/
+static PIL_CACHE_REC * CacheLiveRecord(PIL_CACHE *pCache, PIL_CACHE_ENTRY *pEntry)
+{
+PIL_CACHE_WINDOW *pWindow;
+uint64_t ullStart;
+size_t len;
+unsigned char *pMap;
+int i;
+
+   if (pEntry->ullOffset + pEntry->uiLen > pCache->ullEnd - pCache->iWriteLen)
+      CacheFlush(pCache);
+   if (pCache->bError)
+      return NULL;
+   for (i=pCache->iWindows-1; i>=0; i--)
+      {
+      pWindow = &pCache->pWindows[i];
+      if (pEntry->ullOffset >= pWindow->ullOffset && pEntry->ullOffset + pEntry->uiLen <= pWindow->ullOffset + pWindow->len)
+         return (PIL_CACHE_REC *)&pWindow->pMap[pEntry->ullOffset - pWindow->ullOffset];
+      }
+   // Map from the record's page on; the records written after it will be
+   // in the same window (a shared mapping sees the file grow)
+   ullStart = pEntry->ullOffset & ~(uint64_t)(sysconf(_SC_PAGESIZE) - 1);
+   len = CACHE_WINDOW_SIZE;
+   if (pEntry->ullOffset + pEntry->uiLen - ullStart > len)
+      len = (size_t)(pEntry->ullOffset + pEntry->uiLen - ullStart);
+   pWindow = (PIL_CACHE_WINDOW *)realloc(pCache->pWindows, (pCache->iWindows + 1) * sizeof(PIL_CACHE_WINDOW));
+   if (pWindow == NULL)
+      return NULL;
+   pCache->pWindows = pWindow;
+   pMap = (unsigned char *)mmap(NULL, len, PROT_READ, MAP_SHARED, pCache->iFD, (off_t)ullStart);
+   if (pMap == (unsigned char *)MAP_FAILED)
+      return NULL;
+   pWindow = &pCache->pWindows[pCache->iWindows++];
+   pWindow->ullOffset = ullStart;
+   pWindow->len = len;
+   pWindow->pMap = pMap;
+   return (PIL_CACHE_REC *)&pMap[pEntry->ullOffset - ullStart];
+} /* CacheLiveRecord() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheOldFind(PIL_CACHE *, uint64_t, uint64_t, uint32_t *)  *
+ *                                                                          *
+ *  PURPOSE    : Find a file's record in the index the cache was opened     *
+ *               with. No locks are needed, it doesn't change.              *
+ *                                                                          *
+ *  RETURNS    : Pointer to the record and its slot in *puiSlot, or NULL.   *
+ *                                                                          *
+ ****************************************************************************/
+static PIL_CACHE_REC * CacheOldFind(PIL_CACHE *pCache, uint64_t ullDev, uint64_t ullIno, uint32_t *puiSlot)
+{
+PIL_CACHE_SLOT *pSlot;
+PIL_CACHE_REC *pRec;
+uint32_t uiHash, uiMask, i;
+
+   if (pCache->pSlots == NULL)
+      return NULL;
+   uiHash = CacheHash(ullDev, ullIno);
+   uiMask = pCache->hdr.uiSlots - 1;
+   for (i = uiHash & uiMask; ; i = (i + 1) & uiMask)
+      {
+      pSlot = &pCache->pSlots[i];
+      if (pSlot->ullOffset == 0) // not there
+         return NULL;
+      if (pSlot->uiHash != uiHash)
+         continue;
+      if (pSlot->ullOffset + sizeof(PIL_CACHE_REC) > pCache->hdr.ullIndex)
+         return NULL; // damaged
+      pRec = (PIL_CACHE_REC *)&pCache->pMap[pSlot->ullOffset];
+      if (pRec->ullDev != ullDev || pRec->ullIno != ullIno)
+         continue;
+      if (pSlot->ullOffset + sizeof(PIL_CACHE_REC) + pRec->uiDataLen > pCache->hdr.ullIndex)
+         return NULL;
+      *puiSlot = i;
+      return pRec;
+      }
+} /* CacheOldFind() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheMatch(PIL_CACHE_REC *, int, struct stat *)            *
+ *                                                                          *
+ *  PURPOSE    : Check that a record is of the right kind and the file      *
+ *               hasn't changed since it was written.                       *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL CacheMatch(PIL_CACHE_REC *pRec, int iKind, struct stat *pst)
+{
+   return (pRec != NULL && pRec->uiKind == (uint32_t)iKind && pRec->ullSize == (uint64_t)pst->st_size && pRec->llMtime == MTIME_NS(pst));
+} /* CacheMatch() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILCacheFind(void *, int, struct stat *, int *)            *
+ *                                                                          *
+ *  PURPOSE    : Look up the record for a file or directory. It is only     *
+ *               returned if the size and modification time still match.    *
+ *               Records added this run come first. Safe to call from       *
+ *               several threads; the lock is only taken once records have  *
+ *               been added.                                                *
+ *                                                                          *
+ *  RETURNS    : Pointer to the record's data (valid until the cache is     *
+ *               closed) and its length in *piLen, or NULL.                 *
+ *                                                                          *
+ ****************************************************************************/
+void * PILCacheFind(void *p, int iKind, struct stat *pst, int *piLen)
+{
+PIL_CACHE *pCache = (PIL_CACHE *)p;
+PIL_CACHE_REC *pRec = NULL;
+uint64_t ullDev, ullIno;
+uint32_t uiSlot;
+int i;
+
+   if (pCache == NULL)
+      return NULL;
+   ullDev = (uint64_t)pst->st_dev;
+   ullIno = (uint64_t)pst->st_ino;
+   if (__atomic_load_n(&pCache->iNewCount, __ATOMIC_ACQUIRE) != 0)
+      {
+      pthread_mutex_lock(&pCache->mutex);
+      i = CacheLiveFind(pCache, ullDev, ullIno);
+      if (i >= 0)
+         pRec = CacheLiveRecord(pCache, &pCache->pNew[i]);
+      pthread_mutex_unlock(&pCache->mutex);
+      if (i >= 0) // it replaces the old one
+         {
+         if (!CacheMatch(pRec, iKind, pst))
+            return NULL;
+         *piLen = (int)pRec->uiDataLen;
+         return (void *)&pRec[1];
+         }
+      }
+   pRec = CacheOldFind(pCache, ullDev, ullIno, &uiSlot);
+   if (!CacheMatch(pRec, iKind, pst))
+      return NULL; // not there or changed
+   __atomic_store_n(&pCache->pTouched[uiSlot], 1, __ATOMIC_RELAXED);
+   *piLen = (int)pRec->uiDataLen;
+   return (void *)&pRec[1];
+} /* PILCacheFind() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILCacheAdd(void *, int, struct stat *, void *, int)       *
+ *                                                                          *
+ *  PURPOSE    : Append a record for a file or directory. It replaces any   *
+ *               older record for the same file, for PILCacheFind() right   *
+ *               away and in the file's index when the cache is closed. A   *
+ *               record the same as the one there is not added again.       *
+ *                                                                          *
+ ****************************************************************************/
+void PILCacheAdd(void *p, int iKind, struct stat *pst, void *pData, int iLen)
+{
+PIL_CACHE *pCache = (PIL_CACHE *)p;
+PIL_CACHE_ENTRY *pEntry;
+PIL_CACHE_REC rec, *pOld;
+unsigned char *pRec;
+uint32_t uiLen, uiSlot;
+int i;
+
+   if (pCache == NULL || iLen < 0)
+      return;
+   uiLen = (uint32_t)((sizeof(PIL_CACHE_REC) + iLen + 7) & ~7);
+   memset(&rec, 0, sizeof(rec));
+   rec.uiLen = uiLen;
+   rec.uiKind = (uint32_t)iKind;
+   rec.uiDataLen = (uint32_t)iLen;
+   rec.ullDev = (uint64_t)pst->st_dev;
+   rec.ullIno = (uint64_t)pst->st_ino;
+   rec.ullSize = (uint64_t)pst->st_size;
+   rec.llMtime = MTIME_NS(pst);
+   pthread_mutex_lock(&pCache->mutex);
+   // Two threads may have probed the same file, or a hard link to it
+   i = CacheLiveFind(pCache, rec.ullDev, rec.ullIno);
+   pOld = (i >= 0) ? CacheLiveRecord(pCache, &pCache->pNew[i]) : CacheOldFind(pCache, rec.ullDev, rec.ullIno, &uiSlot);
+   if (CacheMatch(pOld, iKind, pst) && pOld->uiDataLen == rec.uiDataLen && memcmp(&pOld[1], pData, iLen) == 0)
+      {
+      if (i < 0) // keep it
+         __atomic_store_n(&pCache->pTouched[uiSlot], 1, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&pCache->mutex);
+      return;
+      }
+   if (pCache->iNewCount == pCache->iNewMax)
+      {
+      pEntry = (PIL_CACHE_ENTRY *)realloc(pCache->pNew, (pCache->iNewMax + 1024) * 2 * sizeof(PIL_CACHE_ENTRY));
+      if (pEntry == NULL)
+         {
+         pthread_mutex_unlock(&pCache->mutex);
+         return;
+         }
+      pCache->pNew = pEntry;
+      pCache->iNewMax = (pCache->iNewMax + 1024) * 2;
+      }
+   if (pCache->iWriteLen + uiLen > CACHE_WRITE_SIZE)
+      CacheFlush(pCache);
+   if (uiLen > CACHE_WRITE_SIZE) // too big to buffer, write it on its own
+      {
+      pRec = (unsigned char *)calloc(1, uiLen);
+      if (pRec == NULL)
+         {
+         pthread_mutex_unlock(&pCache->mutex);
+         return;
+         }
+      memcpy(pRec, &rec, sizeof(rec));
+      memcpy(&pRec[sizeof(rec)], pData, iLen);
+      if (!CacheWrite(pCache->iFD, pRec, uiLen, pCache->ullEnd))
+         pCache->bError = TRUE;
+      free(pRec);
+      }
+   else
+      {
+      pRec = &pCache->pWrite[pCache->iWriteLen];
+      memcpy(pRec, &rec, sizeof(rec));
+      memcpy(&pRec[sizeof(rec)], pData, iLen);
+      memset(&pRec[sizeof(rec) + iLen], 0, uiLen - sizeof(rec) - iLen);
+      pCache->iWriteLen += uiLen;
+      }
+   pEntry = &pCache->pNew[pCache->iNewCount];
+   pEntry->ullDev = rec.ullDev;
+   pEntry->ullIno = rec.ullIno;
+   pEntry->ullOffset = pCache->ullEnd;
+   pEntry->uiLen = uiLen;
+   pEntry->uiGeneration = pCache->hdr.uiGeneration;
+   pCache->ullEnd += uiLen;
+   if (CacheLiveGrow(pCache))
+      CacheLiveAdd(pCache, pCache->iNewCount);
+   __atomic_store_n(&pCache->iNewCount, pCache->iNewCount + 1, __ATOMIC_RELEASE);
+   pthread_mutex_unlock(&pCache->mutex);
+} /* PILCacheAdd() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheInsert(PIL_CACHE_ENTRY *, int *, uint32_t, ...)       *
+ *                                                                          *
+ *  PURPOSE    : Add an entry to the table of live records being built.     *
+ *                                                                          *
+ *  RETURNS    : FALSE if the file already has a (newer) record.            *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL CacheInsert(PIL_CACHE_ENTRY *pEntries, int *piTable, uint32_t uiSlots, PIL_CACHE_ENTRY *pEntry, int *piCount)
+{
+uint32_t i, uiMask = uiSlots - 1;
+PIL_CACHE_ENTRY *p;
+
+   for (i = CacheHash(pEntry->ullDev, pEntry->ullIno) & uiMask; piTable[i] != 0; i = (i + 1) & uiMask)
+      {
+      p = &pEntries[piTable[i] - 1];
+      if (p->ullDev == pEntry->ullDev && p->ullIno == pEntry->ullIno)
+         return FALSE;
+      }
+   pEntries[*piCount] = *pEntry;
+   piTable[i] = ++(*piCount);
+   return TRUE;
+} /* CacheInsert() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheCompact(PIL_CACHE *, PIL_CACHE_ENTRY *, int)          *
+ *                                                                          *
+ *  PURPOSE    : Copy the live records to a new file. The entries are       *
+ *               updated with their new offsets.                            *
+ *                                                                          *
+ *  RETURNS    : New file descriptor (at the same path once renamed by the  *
+ *               caller) or -1 on failure; szTemp receives its name.        *
+ *                                                                          *
+ ****************************************************************************/
+static int CacheCompact(PIL_CACHE *pCache, PIL_CACHE_ENTRY *pEntries, int iCount, char *szTemp, uint64_t *pullEnd)
+{
+unsigned char *pBuf = NULL;
+uint32_t uiBufLen = 0;
+uint64_t ullOut = CACHE_HEADER_SIZE;
+int i, fd;
+
+   fd = open(szTemp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd < 0)
+      return -1;
+   for (i=0; i<iCount; i++)
+      {
+      if (pEntries[i].uiLen > uiBufLen)
+         {
+         free(pBuf);
+         uiBufLen = pEntries[i].uiLen * 2;
+         pBuf = (unsigned char *)malloc(uiBufLen);
+         if (pBuf == NULL)
+            break;
+         }
+      if (pread(pCache->iFD, pBuf, pEntries[i].uiLen, (off_t)pEntries[i].ullOffset) != (ssize_t)pEntries[i].uiLen ||
+          !CacheWrite(fd, pBuf, pEntries[i].uiLen, ullOut))
+         break;
+      pEntries[i].ullOffset = ullOut;
+      ullOut += pEntries[i].uiLen;
+      }
+   free(pBuf);
+   if (i != iCount)
+      {
+      close(fd);
+      unlink(szTemp);
+      return -1;
+      }
+   *pullEnd = ullOut;
+   return fd;
+} /* CacheCompact() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CacheWriteIndex(PIL_CACHE *)                               *
+ *                                                                          *
+ *  PURPOSE    : Merge the old index with this run's records and write the  *
+ *               result, compacting the file if it is mostly dead space.    *
+ *                                                                          *
+ ****************************************************************************/
+static void CacheWriteIndex(PIL_CACHE *pCache)
+{
+PIL_CACHE_ENTRY *pEntries, entry;
+PIL_CACHE_SLOT *pSlots;
+PIL_CACHE_REC *pRec;
+PIL_CACHE_HEADER hdr;
+int *piTable;
+int i, iMax, iCount = 0, fd;
+uint32_t j, uiSlots, uiGen = pCache->hdr.uiGeneration;
+uint64_t ullDead, ullLive = 0, ullEnd;
+char *szTemp = NULL;
+
+   iMax = pCache->iNewCount + (pCache->pSlots ? (int)pCache->hdr.uiCount : 0);
+   uiSlots = CACHE_MIN_SLOTS; // keep it at most half full
+   while (uiSlots < (uint32_t)iMax * 2)
+      uiSlots *= 2;
+   pEntries = (PIL_CACHE_ENTRY *)malloc((iMax + 1) * sizeof(PIL_CACHE_ENTRY));
+   piTable = (int *)calloc(uiSlots, sizeof(int));
+   pSlots = (PIL_CACHE_SLOT *)calloc(uiSlots, sizeof(PIL_CACHE_SLOT));
+   if (pEntries == NULL || piTable == NULL || pSlots == NULL)
+      goto index_exit;
+   ullDead = pCache->hdr.ullDead;
+   // This run's records first (newest first), they replace the old ones
+   for (i=pCache->iNewCount-1; i>=0; i--)
+      {
+      if (!CacheInsert(pEntries, piTable, uiSlots, &pCache->pNew[i], &iCount))
+         ullDead += pCache->pNew[i].uiLen;
+      }
+   if (pCache->pSlots)
+      {
+      ullDead += (uint64_t)pCache->hdr.uiSlots * sizeof(PIL_CACHE_SLOT); // the old index
+      for (j=0; j<pCache->hdr.uiSlots; j++)
+         {
+         if (pCache->pSlots[j].ullOffset == 0 || pCache->pSlots[j].ullOffset + sizeof(PIL_CACHE_REC) > pCache->hdr.ullIndex)
+            continue;
+         pRec = (PIL_CACHE_REC *)&pCache->pMap[pCache->pSlots[j].ullOffset];
+         entry.ullDev = pRec->ullDev;
+         entry.ullIno = pRec->ullIno;
+         entry.ullOffset = pCache->pSlots[j].ullOffset;
+         entry.uiLen = pRec->uiLen;
+         entry.uiGeneration = pCache->pTouched[j] ? uiGen : pCache->pSlots[j].uiGeneration;
+         if (iCount >= iMax || uiGen - entry.uiGeneration > CACHE_MAX_AGE || !CacheInsert(pEntries, piTable, uiSlots, &entry, &iCount))
+            ullDead += entry.uiLen; // stale or replaced
+         }
+      }
+   for (i=0; i<iCount; i++)
+      ullLive += pEntries[i].uiLen;
+   fd = pCache->iFD;
+   ullEnd = pCache->ullEnd;
+   if (ullDead > ullLive && ullEnd > CACHE_COMPACT_MIN)
+      {
+      szTemp = (char *)malloc(strlen(pCache->szFile) + 5);
+      if (szTemp)
+         {
+         sprintf(szTemp, "%s.tmp", pCache->szFile);
+         fd = CacheCompact(pCache, pEntries, iCount, szTemp, &ullEnd);
+         if (fd < 0) // carry on with the old file
+            {
+            free(szTemp);
+            szTemp = NULL;
+            fd = pCache->iFD;
+            ullEnd = pCache->ullEnd;
+            }
+         else
+            ullDead = 0;
+         }
+      }
+   for (i=0; i<iCount; i++) // fill in the index
+      {
+      j = CacheHash(pEntries[i].ullDev, pEntries[i].ullIno);
+      while (pSlots[j & (uiSlots-1)].ullOffset != 0)
+         j++;
+      pSlots[j & (uiSlots-1)].uiHash = CacheHash(pEntries[i].ullDev, pEntries[i].ullIno);
+      pSlots[j & (uiSlots-1)].uiGeneration = pEntries[i].uiGeneration;
+      pSlots[j & (uiSlots-1)].ullOffset = pEntries[i].ullOffset;
+      }
+   memcpy(&hdr, &pCache->hdr, sizeof(hdr));
+   hdr.ullIndex = ullEnd;
+   hdr.uiSlots = uiSlots;
+   hdr.uiCount = (uint32_t)iCount;
+   hdr.ullEnd = ullEnd + (uint64_t)uiSlots * sizeof(PIL_CACHE_SLOT);
+   hdr.ullDead = ullDead;
+   // the header goes last so the old index stays in use until it's done;
+   // the records and index have to be on disk before the header points at
+   // them, and a compacted file complete before it replaces the old one
+   if (CacheWrite(fd, pSlots, (size_t)uiSlots * sizeof(PIL_CACHE_SLOT), ullEnd) && fsync(fd) == 0 &&
+       CacheWrite(fd, &hdr, sizeof(hdr), 0) && (szTemp == NULL || fsync(fd) == 0))
+      {
+      if (szTemp && rename(szTemp, pCache->szFile) != 0)
+         unlink(szTemp);
+      }
+   else if (szTemp)
+      unlink(szTemp);
+   if (fd != pCache->iFD)
+      close(fd);
+
+index_exit:
+   free(szTemp);
+   free(pEntries);
+   free(piTable);
+   free(pSlots);
+} /* CacheWriteIndex() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILCacheClose(void *)                                      *
+ *                                                                          *
+ *  PURPOSE    : Write the new index and close the cache.                   *
+ *                                                                          *
+ ****************************************************************************/
+void PILCacheClose(void *p)
+{
+PIL_CACHE *pCache = (PIL_CACHE *)p;
+int i;
+
+   if (pCache == NULL)
+      return;
+   CacheFlush(pCache);
+   if (!pCache->bError)
+      CacheWriteIndex(pCache);
+   if (pCache->pMap)
+      munmap(pCache->pMap, pCache->mapLen);
+   for (i=0; i<pCache->iWindows; i++)
+      munmap(pCache->pWindows[i].pMap, pCache->pWindows[i].len);
+   close(pCache->iFD); // releases the lock
+   pthread_mutex_destroy(&pCache->mutex);
+   free(pCache->pTouched);
+   free(pCache->pNew);
+   free(pCache->piLive);
+   free(pCache->pWindows);
+   free(pCache->pWrite);
+   free(pCache->szFile);
+   free(pCache);
+} /* PILCacheClose() */
@@ -0,0 +1,42 @@
+/************************************************************/
+/*--- Persistent result cache keyed on file identity     ---*/
+/* Copyright (c) 2017 BitBank Software, Inc.                */
+/************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#ifndef _PIL_CACHE_H_
+#define _PIL_CACHE_H_
+
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Kinds of records; a record is only returned for the same kind
+#define PIL_CACHE_FILE 0
+#define PIL_CACHE_DIR 1
+
+// Records are keyed on (st_dev, st_ino) and are valid as long as st_size
+// and st_mtime still match. uiFormat identifies the layout of the caller's
+// data; a cache written with a different one is discarded.
+extern void * PILCacheOpen(char *szFile, unsigned int uiFormat);
+extern void * PILCacheFind(void *pCache, int iKind, struct stat *pst, int *piLen);
+extern void PILCacheAdd(void *pCache, int iKind, struct stat *pst, void *pData, int iLen);
+extern void PILCacheClose(void *pCache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // #ifndef _PIL_CACHE_H_
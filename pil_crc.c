@@ -0,0 +1,306 @@
+/****************************************************************************
+ *                                                                          *
+ * MODULE:  PIL_CRC.C                                                       *
+ *                                                                          *
+ * DESCRIPTION: CRC-32 (ISO 3309) used by PNG chunks and zlib streams       *
+ *                                                                          *
+ * FUNCTIONS:                                                               *
+ *            PILCRC32 - Add bytes to a running CRC                         *
+ *            PILCRCImpl - Choose the code to use                           *
+ * COMMENTS:                                                                *
+ *            The portable code is slice-by-8: eight 256-entry tables so    *
+ *            8 bytes are folded in per step instead of one. On x86 CPUs    *
+ *            with PCLMULQDQ, blocks of 64 bytes and more are folded 512    *
+ *            bits at a time with carry-less multiplies and reduced with    *
+ *            a Barrett step, as in Intel's paper "Fast CRC Computation     *
+ *            for Generic Polynomials Using PCLMULQDQ Instruction"; the     *
+ *            ends are done with the tables. The choice is made at run      *
+ *            time.                                                         *
+ ****************************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#include "my_windows.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "pil_crc.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC_X86
+#include <immintrin.h>
+#endif
+
+// The tables are built on first use and published with a compare and
+// swap, so threads which race to build them all end up using one copy
+#if defined(__GNUC__) || defined(__clang__)
+#define CRC_LOAD(pp) __atomic_load_n(pp, __ATOMIC_ACQUIRE)
+#define CRC_PUBLISH(pp, pOld, pNew) __atomic_compare_exchange_n(pp, &pOld, pNew, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define CRC_STORE(pp, v) __atomic_store_n(pp, v, __ATOMIC_RELEASE)
+#else // single threaded builds
+#define CRC_LOAD(pp) (*(pp))
+#define CRC_STORE(pp, v) (*(pp) = (v))
+#define CRC_PUBLISH(pp, pOld, pNew) (*(pp) == pOld ? (*(pp) = pNew, TRUE) : FALSE)
+#endif
+
+#define CRC_POLY 0xedb88320 /* bit reflected x^32+x^26+x^23+...+x+1 */
+#define CRC_FOLD_MIN 64     /* smallest block worth folding */
+
+enum
+{
+   CRC_IMPL_SLICE8 = 0,
+   CRC_IMPL_PCLMUL,
+   CRC_IMPL_COUNT
+};
+static const char *szImplName[CRC_IMPL_COUNT] = {"slice8", "pclmul"};
+
+typedef uint32_t CRC_TABLES[8][256];
+static CRC_TABLES *pTables = NULL;
+static int iImpl = -1; // CRC_IMPL_xxx, -1 until chosen
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CRCGetTables(void)                                         *
+ *                                                                          *
+ *  PURPOSE    : Return the slice-by-8 tables, building them the first      *
+ *               time. Table n gives the CRC of a byte followed by n zero   *
+ *               bytes.                                                     *
+ *                                                                          *
+ ****************************************************************************/
+static CRC_TABLES * CRCGetTables(void)
+{
+CRC_TABLES *pT, *pOld;
+uint32_t c;
+int i, j;
+
+   pT = CRC_LOAD(&pTables);
+   if (pT != NULL)
+      return pT;
+   pT = (CRC_TABLES *)malloc(sizeof(CRC_TABLES));
+   if (pT == NULL)
+      return NULL;
+   for (i=0; i<256; i++)
+      {
+      c = (uint32_t)i;
+      for (j=0; j<8; j++)
+         c = (c & 1) ? (c >> 1) ^ CRC_POLY : (c >> 1);
+      (*pT)[0][i] = c;
+      }
+   for (i=0; i<256; i++)
+      {
+      c = (*pT)[0][i];
+      for (j=1; j<8; j++)
+         {
+         c = (c >> 8) ^ (*pT)[0][c & 0xff];
+         (*pT)[j][i] = c;
+         }
+      }
+   pOld = NULL;
+   if (!CRC_PUBLISH(&pTables, pOld, pT)) // someone else got there first
+      {
+      free(pT);
+      pT = pOld;
+      }
+   return pT;
+} /* CRCGetTables() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CRCSlice8(CRC_TABLES *, uint32_t, ...)                     *
+ *                                                                          *
+ *  PURPOSE    : Table driven CRC of inverted ulCRC, 8 bytes at a time.     *
+ *                                                                          *
+ ****************************************************************************/
+static uint32_t CRCSlice8(CRC_TABLES *pT, uint32_t c, const unsigned char *p, int iLen)
+{
+uint32_t h;
+
+   while (iLen && ((uintptr_t)p & 7)) // align the 8 byte steps
+      {
+      c = (c >> 8) ^ (*pT)[0][(c ^ *p++) & 0xff];
+      iLen--;
+      }
+   while (iLen >= 8)
+      {
+      c ^= (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+      h = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+      c = (*pT)[7][c & 0xff] ^ (*pT)[6][(c >> 8) & 0xff] ^ (*pT)[5][(c >> 16) & 0xff] ^ (*pT)[4][c >> 24] ^
+          (*pT)[3][h & 0xff] ^ (*pT)[2][(h >> 8) & 0xff] ^ (*pT)[1][(h >> 16) & 0xff] ^ (*pT)[0][h >> 24];
+      p += 8;
+      iLen -= 8;
+      }
+   while (iLen--)
+      c = (c >> 8) ^ (*pT)[0][(c ^ *p++) & 0xff];
+   return c;
+} /* CRCSlice8() */
+
+#ifdef CRC_X86
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CRCFold(uint32_t, const unsigned char *, int)              *
+ *                                                                          *
+ *  PURPOSE    : CRC of inverted ulCRC with carry-less multiplies. iLen is  *
+ *               at least CRC_FOLD_MIN and a multiple of 16. The constants  *
+ *               are x^(4*128+32), x^(4*128-32), x^(128+32), x^(128-32)     *
+ *               and x^64 mod P (bit reflected), then floor(x^64 / P) and P *
+ *               for the Barrett reduction.                                 *
+ *                                                                          *
+ ****************************************************************************/
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t CRCFold(uint32_t c, const unsigned char *p, int iLen)
+{
+__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+__m128i xMask;
+
+   x1 = _mm_loadu_si128((const __m128i *)&p[0]);
+   x2 = _mm_loadu_si128((const __m128i *)&p[16]);
+   x3 = _mm_loadu_si128((const __m128i *)&p[32]);
+   x4 = _mm_loadu_si128((const __m128i *)&p[48]);
+   x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+   x0 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL); // k2:k1
+   p += 64;
+   iLen -= 64;
+   while (iLen >= 64) // four lanes of 128 bits
+      {
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+      x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+      x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)&p[0]));
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)&p[16]));
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)&p[32]));
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)&p[48]));
+      p += 64;
+      iLen -= 64;
+      }
+   // fold the lanes into one
+   x0 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL); // k4:k3
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+   while (iLen >= 16) // and any 16 byte blocks left
+      {
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)p)), x5);
+      p += 16;
+      iLen -= 16;
+      }
+   // 128 bits to 64
+   xMask = _mm_setr_epi32(~0, 0, ~0, 0);
+   x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+   x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+   x0 = _mm_set_epi64x(0, 0x0163cd6124LL); // k5
+   x2 = _mm_srli_si128(x1, 4);
+   x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, xMask), x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+   // Barrett reduction to 32 bits
+   x0 = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL); // mu:P
+   x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, xMask), x0, 0x10);
+   x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, xMask), x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+   return (uint32_t)_mm_extract_epi32(x1, 1);
+} /* CRCFold() */
+#endif // CRC_X86
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : CRCImplSupported(int)                                      *
+ *                                                                          *
+ *  PURPOSE    : See if the CPU can run one of the implementations.         *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL CRCImplSupported(int i)
+{
+#ifdef CRC_X86
+   __builtin_cpu_init(); // in case we're called from a constructor
+   if (i == CRC_IMPL_PCLMUL)
+      return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+   return (i == CRC_IMPL_SLICE8);
+} /* CRCImplSupported() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILCRCImpl(const char *)                                   *
+ *                                                                          *
+ *  PURPOSE    : Choose the code by name ("slice8" or "pclmul"), or the     *
+ *               fastest one the CPU supports for NULL.                     *
+ *                                                                          *
+ *  RETURNS    : The name of the one in use, NULL if the one asked for      *
+ *               isn't available (the choice is left alone then).           *
+ *                                                                          *
+ ****************************************************************************/
+const char * PILCRCImpl(const char *szName)
+{
+int i;
+
+   if (szName == NULL)
+      {
+      for (i=CRC_IMPL_COUNT-1; !CRCImplSupported(i); i--)
+         ;
+      }
+   else
+      {
+      for (i=0; i<CRC_IMPL_COUNT && strcmp(szName, szImplName[i]) != 0; i++)
+         ;
+      if (i == CRC_IMPL_COUNT || !CRCImplSupported(i))
+         return NULL;
+      }
+   CRC_STORE(&iImpl, i);
+   return szImplName[i];
+} /* PILCRCImpl() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILCRC32(uint32_t, const unsigned char *, int)             *
+ *                                                                          *
+ *  PURPOSE    : Add iLen bytes to a CRC-32. Start with 0.                  *
+ *                                                                          *
+ *  RETURNS    : The new CRC (0 if the tables can't be allocated).          *
+ *                                                                          *
+ ****************************************************************************/
+uint32_t PILCRC32(uint32_t ulCRC, const unsigned char *pData, int iLen)
+{
+CRC_TABLES *pT;
+uint32_t c;
+#ifdef CRC_X86
+int iFold;
+#endif
+
+   pT = CRCGetTables();
+   if (pT == NULL || iLen <= 0)
+      return (pT == NULL) ? 0 : ulCRC;
+   c = ~ulCRC;
+#ifdef CRC_X86
+   if (CRC_LOAD(&iImpl) < 0)
+      PILCRCImpl(NULL);
+   if (CRC_LOAD(&iImpl) == CRC_IMPL_PCLMUL && iLen >= CRC_FOLD_MIN)
+      {
+      iFold = iLen & ~15;
+      c = CRCFold(c, pData, iFold);
+      pData += iFold;
+      iLen -= iFold;
+      }
+#endif
+   return ~CRCSlice8(pT, c, pData, iLen);
+} /* PILCRC32() */
@@ -0,0 +1,39 @@
+/************************************************************/
+/*--- CRC-32 of PNG chunks and zlib streams              ---*/
+/* Copyright (c) 2017 BitBank Software, Inc.                */
+/************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#ifndef _PIL_CRC_H_
+#define _PIL_CRC_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Add iLen bytes to a CRC-32 (ISO 3309, as in PNG and zlib). Start with 0;
+// the pre and post inversion are done here, so a running value can be
+// passed back in for the next piece.
+extern uint32_t PILCRC32(uint32_t ulCRC, const unsigned char *pData, int iLen);
+// Choose the code by name ("slice8" or "pclmul"), or the fastest one the
+// CPU supports for NULL (the default). Returns the name of the one in use,
+// or NULL if the one asked for isn't available.
+extern const char * PILCRCImpl(const char *szName);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // #ifndef _PIL_CRC_H_
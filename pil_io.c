@@ -6,14 +6,26 @@
  *                                                                          *
  * FUNCTIONS:                                                               *
  *            PILIOOpen - Open a file for reading or writing                *
+ *            PILIOOpenAtRO - Open a file relative to a directory           *
+ *            PILIOOpenFD - Wrap a descriptor owned by the caller           *
+ *            PILIOOpenMem - Wrap pieces of a file already in memory        *
+ *            PILIOOpenRange - Open part of another handle as a file        *
+ *            PILIOOpenReader - Open any source of bytes as a file          *
+ *            PILIOMap - Open a file as a read-only memory mapping          *
+ *            PILIOData - Get a pointer to file data already in memory      *
  *            PILIOCreate - Create a file for writing                       *
  *            PILIOClose - Close a file                                     *
  *            PILIORead - Read a block of data from a file                  *
  *            PILIOWrite - write a block of data to a file                  *
+ *            PILIOCopy - Copy part of a file to a descriptor (zero-copy)   *
  *            PILIOSeek - Seek to a specific section in a file              *
  *            PILIODate - Provide date and time in TIFF 6.0 format          *
  *            PILIOAlloc - Allocate a block of memory                       *
  *            PILIOFree - Free a block of memory                            *
+ *            PILIOWindowAlloc - Get a 64K buffer from the thread's list    *
+ *            PILIOArenaAlloc - Allocate scratch memory for the thread      *
+ *            PILIOArenaRelease - Give back the scratch memory since a mark *
+ *            PILIOTraceMem - Trace allocations to find leaks               *
  *            PILIOSignalThread - Send command to sub-thread                *
  *            PILIOMsgBox - Display a message box                           *
  * COMMENTS:                                                                *
@@ -33,13 +45,24 @@
 // limitations under the License.
 //===========================================================================
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // copy_file_range()
+#endif
 #include "my_windows.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 //#include <android/log.h>
-#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
 #include <unistd.h>
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
 #endif
 #include <errno.h>
 #include <string.h>
@@ -47,42 +70,449 @@
 
 #include "pil_io.h"
 #define MAX_SIZE 0x400000 /* 4MB is good */
-#define MAX_LIST 100
-static int iTotalMem = 0;
-static int iMemPtrs[MAX_LIST];
-static int iMemSizes[MAX_LIST];
+#define PILIO_COPY_SIZE 0x10000 /* buffer for PILIOCopy() when the kernel can't copy */
+#define PILIO_MAP_MIN_SIZE 0x10000 /* below this a single read is cheaper than a mapping */
+
+#ifdef _WIN32
+#define open _open
+#define close _close
+#define write _write
+#define fstat _fstat64
+#define stat _stat64
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+static int pread(int fd, void *pBuf, unsigned int iLen, PILOffset llOffset)
+{
+   if (_lseeki64(fd, llOffset, SEEK_SET) != llOffset)
+      return -1;
+   return _read(fd, pBuf, iLen);
+}
+static int pwrite(int fd, void *pBuf, unsigned int iLen, PILOffset llOffset)
+{
+   if (_lseeki64(fd, llOffset, SEEK_SET) != llOffset)
+      return -1;
+   return _write(fd, pBuf, iLen);
+}
+#else
+#define O_BINARY 0
+#endif
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+// A handle reads its bytes through a PILIO_READER: an open file descriptor,
+// a memory mapping, a set of file pieces that are already in memory (e.g.
+// read ahead by an asynchronous engine), a range of another handle or one
+// supplied by the caller. File handles use positional reads, so a seek is
+// just a change of llPos and costs no system call; the size comes from a
+// single fstat() at open. Reads from a memory handle that fall outside of
+// its pieces fail and remember the first missing range so the caller can
+// fetch it and retry.
+typedef struct pil_io_seg_tag
+{
+   PILOffset llOffset;     // file offset of this piece
+   unsigned long ulLen;
+   unsigned char *pData;
+} PILIO_SEG;
+
+typedef struct pil_io_file_tag
+{
+   const PILIO_READER *pReader;
+   void *pContext;         // passed to the reader (the handle itself for ours)
+   int iFD;                // -1 unless reading from a descriptor
+   PILOffset llPos;        // current position
+   PILOffset llSize;       // total file size
+   int iSegCount;
+   PILIO_SEG segs[PILIO_MAX_SEGS];
+   BOOL bNeedMore;         // a read fell outside of the pieces
+   PILOffset llNeedOffset;
+   unsigned int uiNeedLen;
+   void *pMap;             // non-NULL if the whole file is memory mapped
+   BOOL bKeepFD;           // descriptor belongs to the caller, don't close it
+   struct pil_io_file_tag *pParent; // range handles: the handle they are part of
+   PILOffset llBase;       // and where they start in it
+   unsigned char *pCache;  // the last block read for the reader's uiReadSize
+   PILOffset llCacheOffset;
+   int iCacheLen;
+   PILIO_STATS stats;      // only kept when enabled with PILIOSetStats()
+} PILIO_FILE;
+
+static BOOL bIOStats = FALSE;
+
+#if defined(_MSC_VER)
+#define PIL_THREAD __declspec(thread)
+#else
+#define PIL_THREAD __thread
+#endif
+
+// Memory from PILIOAlloc() can be traced (PILIOTraceMem) to find leaks and
+// the high water mark. The blocks live in an open addressed hash table of
+// fixed size guarded by a spin lock, so tracing costs no allocation and is
+// safe from any thread; blocks beyond 3/4 of it are counted, not tracked.
+#define TRACE_SLOTS 0x10000 /* power of 2 */
+#define TRACE_HASH(p) (((uint32_t)((uintptr_t)(p) >> 4) * 0x9e3779b1) >> 16)
+#if defined(__GNUC__) || defined(__clang__)
+static char bTraceLock = 0;
+#define TRACE_LOCK() while (__atomic_test_and_set(&bTraceLock, __ATOMIC_ACQUIRE)) {}
+#define TRACE_UNLOCK() __atomic_clear(&bTraceLock, __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+static volatile long lTraceLock = 0;
+#define TRACE_LOCK() while (_InterlockedExchange(&lTraceLock, 1)) {}
+#define TRACE_UNLOCK() _InterlockedExchange(&lTraceLock, 0)
+#else // single threaded builds
+#define TRACE_LOCK()
+#define TRACE_UNLOCK()
+#endif
+typedef struct pil_io_trace_tag
+{
+   void *p;                // NULL if the slot is free
+   unsigned long ulSize;
+} PILIO_TRACE;
+static PILIO_TRACE traceSlots[TRACE_SLOTS];
+static PILOffset llTotalMem = 0, llPeakMem = 0;
 static int iMemCount = 0;
+static int iMemLost = 0;   // allocated while the table was full
+static BOOL bTraceMem = FALSE;
+
+// Handles and window buffers which are freed go on short per-thread lists
+// for the next file, and scratch memory comes from a per-thread arena
+// (PILIOArenaAlloc), so a thread which has warmed up opens, reads and
+// probes files without calling malloc()
+#define PILIO_POOL_MAX 16 /* free blocks of each kind a thread keeps */
+#define PILIO_ARENA_SIZE 0x40000 /* the arena grows in chunks this big */
+#define PILIO_ARENA_SPARE 2 /* empty chunks kept after a release */
+typedef struct pil_io_pool_tag
+{
+   void *pFree;            // linked through their first word
+   int iFree;
+} PILIO_POOL;
 
-BOOL bTraceMem = FALSE;
+typedef struct pil_io_chunk_tag
+{
+   struct pil_io_chunk_tag *pNext;
+   unsigned long ulSize;   // usable bytes, after CHUNK_HEADER
+   unsigned long ulUsed;
+} PILIO_CHUNK;
+#define CHUNK_HEADER ((sizeof(PILIO_CHUNK) + 15) & ~15)
 
-//#define LOG_MEM
+static PIL_THREAD PILIO_POOL handlePool, windowPool;
+// Chunks in the order they are used; those after pArenaCur are empty
+static PIL_THREAD PILIO_CHUNK *pArenaFirst, *pArenaCur;
 
-void TraceAdd(void * p, int size)
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TraceAdd(void *, unsigned long)                            *
+ *                                                                          *
+ *  PURPOSE    : Add a block to the table of traced memory.                 *
+ *                                                                          *
+ ****************************************************************************/
+static void TraceAdd(void * p, unsigned long size)
 {
-   iMemPtrs[iMemCount] = (int)(intptr_t)p;
-   iMemSizes[iMemCount] = size;
-   iTotalMem += size;
-   iMemCount++;
-   
+unsigned int i;
+
+   TRACE_LOCK();
+   if (iMemCount >= TRACE_SLOTS / 4 * 3)
+      iMemLost++;
+   else
+      {
+      for (i=TRACE_HASH(p); traceSlots[i].p != NULL; i = (i+1) & (TRACE_SLOTS-1))
+         ;
+      traceSlots[i].p = p;
+      traceSlots[i].ulSize = size;
+      iMemCount++;
+      llTotalMem += size;
+      if (llTotalMem > llPeakMem)
+         llPeakMem = llTotalMem;
+      }
+   TRACE_UNLOCK();
 } /* TraceAdd() */
 
-void TraceRemove(void * p)
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : TraceRemove(void *)                                        *
+ *                                                                          *
+ *  PURPOSE    : Remove a block from the table of traced memory. The rest   *
+ *               of its run is moved back so that lookups don't stop at     *
+ *               the hole.                                                  *
+ *                                                                          *
+ ****************************************************************************/
+static void TraceRemove(void * p)
 {
-int i;
-	for (i=0; i<iMemCount; i++)
-	   {
-	   if ((int)(intptr_t)p == iMemPtrs[i])
-	      break;
-	   }
-	if (i < iMemCount)
-	   {
-	   iTotalMem -= iMemSizes[i]; // subtract from total
-	   memcpy(&iMemSizes[i], &iMemSizes[i+1], (iMemCount-i)*sizeof(int));
-	   memcpy(&iMemPtrs[i], &iMemPtrs[i+1], (iMemCount-i)*sizeof(int));
-	   iMemCount--;
-	   }
+unsigned int i, j, k;
+
+   TRACE_LOCK();
+   for (i=TRACE_HASH(p); traceSlots[i].p != NULL && traceSlots[i].p != p; i = (i+1) & (TRACE_SLOTS-1))
+      ;
+   if (traceSlots[i].p == p) // not there if allocated before tracing began
+      {
+      llTotalMem -= traceSlots[i].ulSize;
+      iMemCount--;
+      for (j = (i+1) & (TRACE_SLOTS-1); traceSlots[j].p != NULL; j = (j+1) & (TRACE_SLOTS-1))
+         {
+         k = TRACE_HASH(traceSlots[j].p);
+         if (((j - k) & (TRACE_SLOTS-1)) >= ((j - i) & (TRACE_SLOTS-1))) // can fill the hole
+            {
+            traceSlots[i] = traceSlots[j];
+            i = j;
+            }
+         }
+      traceSlots[i].p = NULL;
+      }
+   TRACE_UNLOCK();
 } /* TraceRemove() */
 
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PoolGet(PILIO_POOL *, unsigned long)                       *
+ *                                                                          *
+ *  PURPOSE    : Take a block from a free list, or allocate one if empty.   *
+ *               The contents are not cleared.                              *
+ *                                                                          *
+ ****************************************************************************/
+static void * PoolGet(PILIO_POOL *pPool, unsigned long ulSize)
+{
+void *p = pPool->pFree;
+
+   if (p == NULL)
+      return PILIOAllocNoClear(ulSize);
+   pPool->pFree = *(void **)p;
+   pPool->iFree--;
+   return p;
+} /* PoolGet() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PoolPut(PILIO_POOL *, void *)                              *
+ *                                                                          *
+ *  PURPOSE    : Return a block to a free list, or free it if that is full. *
+ *                                                                          *
+ ****************************************************************************/
+static void PoolPut(PILIO_POOL *pPool, void *p)
+{
+   if (p == NULL)
+      return;
+   if (pPool->iFree >= PILIO_POOL_MAX)
+      {
+      PILIOFree(p);
+      return;
+      }
+   *(void **)p = pPool->pFree;
+   pPool->pFree = p;
+   pPool->iFree++;
+} /* PoolPut() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PoolEmpty(PILIO_POOL *)                                    *
+ *                                                                          *
+ *  PURPOSE    : Free the blocks on a free list.                            *
+ *                                                                          *
+ ****************************************************************************/
+static void PoolEmpty(PILIO_POOL *pPool)
+{
+void *p;
+
+   while ((p = pPool->pFree) != NULL)
+      {
+      pPool->pFree = *(void **)p;
+      PILIOFree(p);
+      }
+   pPool->iFree = 0;
+} /* PoolEmpty() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOWindowAlloc(void)                                     *
+ *                                                                          *
+ *  PURPOSE    : Get a buffer of PILIO_WINDOW_SIZE bytes (not cleared) from *
+ *               the calling thread's free list.                            *
+ *                                                                          *
+ *  RETURNS    : Pointer to the buffer, NULL if out of memory.              *
+ *                                                                          *
+ ****************************************************************************/
+void * PILIOWindowAlloc(void)
+{
+   return PoolGet(&windowPool, PILIO_WINDOW_SIZE);
+} /* PILIOWindowAlloc() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOWindowFree(void *)                                    *
+ *                                                                          *
+ *  PURPOSE    : Give back a buffer from PILIOWindowAlloc().                *
+ *                                                                          *
+ ****************************************************************************/
+void PILIOWindowFree(void *p)
+{
+   PoolPut(&windowPool, p);
+} /* PILIOWindowFree() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOArenaAlloc(unsigned long)                             *
+ *                                                                          *
+ *  PURPOSE    : Allocate scratch memory (16-byte aligned, not cleared)     *
+ *               from the calling thread's arena. It isn't freed on its     *
+ *               own; PILIOArenaRelease() gives back everything allocated   *
+ *               since a PILIOArenaMark().                                  *
+ *                                                                          *
+ *  RETURNS    : Pointer to the memory, NULL if out of memory.              *
+ *                                                                          *
+ ****************************************************************************/
+void * PILIOArenaAlloc(unsigned long ulSize)
+{
+PILIO_CHUNK *pChunk = pArenaCur;
+unsigned char *p;
+unsigned long ulChunk;
+
+   ulSize = (ulSize + 15) & ~15UL;
+   if (pChunk == NULL || pChunk->ulUsed + ulSize > pChunk->ulSize)
+      {
+      // move on to the next chunk, or put a big enough one there
+      pChunk = (pArenaCur != NULL) ? pArenaCur->pNext : pArenaFirst;
+      if (pChunk == NULL || ulSize > pChunk->ulSize)
+         {
+         ulChunk = (ulSize > PILIO_ARENA_SIZE) ? ulSize : PILIO_ARENA_SIZE;
+         pChunk = (PILIO_CHUNK *)PILIOAllocNoClear(CHUNK_HEADER + ulChunk);
+         if (pChunk == NULL)
+            return NULL;
+         pChunk->ulSize = ulChunk;
+         if (pArenaCur != NULL)
+            {
+            pChunk->pNext = pArenaCur->pNext;
+            pArenaCur->pNext = pChunk;
+            }
+         else
+            {
+            pChunk->pNext = pArenaFirst;
+            pArenaFirst = pChunk;
+            }
+         }
+      pChunk->ulUsed = 0;
+      pArenaCur = pChunk;
+      }
+   p = (unsigned char *)pChunk + CHUNK_HEADER + pChunk->ulUsed;
+   pChunk->ulUsed += ulSize;
+   return p;
+} /* PILIOArenaAlloc() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOArenaMark(void)                                       *
+ *                                                                          *
+ *  PURPOSE    : Remember how much of the calling thread's arena is in use. *
+ *                                                                          *
+ *  RETURNS    : Mark for PILIOArenaRelease().                              *
+ *                                                                          *
+ ****************************************************************************/
+void * PILIOArenaMark(void)
+{
+   if (pArenaCur == NULL)
+      return NULL;
+   return (unsigned char *)pArenaCur + CHUNK_HEADER + pArenaCur->ulUsed;
+} /* PILIOArenaMark() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOArenaRelease(void *)                                  *
+ *                                                                          *
+ *  PURPOSE    : Give back everything allocated from the calling thread's   *
+ *               arena since pMark was taken. Marks are released in the     *
+ *               opposite order to the one they were taken in. A couple of  *
+ *               the chunks freed up are kept for reuse, if of usual size.  *
+ *                                                                          *
+ ****************************************************************************/
+void PILIOArenaRelease(void *pMark)
+{
+PILIO_CHUNK *pChunk = NULL, **ppNext;
+unsigned char *pData;
+int iSpare = 0;
+
+   if (pMark != NULL)
+      {
+      for (pChunk = pArenaFirst; pChunk != NULL; pChunk = pChunk->pNext)
+         {
+         pData = (unsigned char *)pChunk + CHUNK_HEADER;
+         if ((unsigned char *)pMark >= pData && (unsigned char *)pMark <= pData + pChunk->ulSize)
+            {
+            pChunk->ulUsed = (unsigned long)((unsigned char *)pMark - pData);
+            break;
+            }
+         }
+      }
+   pArenaCur = pChunk;
+   ppNext = (pChunk != NULL) ? &pChunk->pNext : &pArenaFirst;
+   while ((pChunk = *ppNext) != NULL)
+      {
+      if (pChunk->ulSize > PILIO_ARENA_SIZE || iSpare >= PILIO_ARENA_SPARE)
+         {
+         *ppNext = pChunk->pNext;
+         PILIOFree(pChunk);
+         }
+      else
+         {
+         pChunk->ulUsed = 0;
+         ppNext = &pChunk->pNext;
+         iSpare++;
+         }
+      }
+} /* PILIOArenaRelease() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOThreadDone(void)                                      *
+ *                                                                          *
+ *  PURPOSE    : Free the free lists and the arena of the calling thread.   *
+ *               Call it before a thread which used pil_io exits.           *
+ *                                                                          *
+ ****************************************************************************/
+void PILIOThreadDone(void)
+{
+PILIO_CHUNK *pChunk;
+
+   PoolEmpty(&handlePool);
+   PoolEmpty(&windowPool);
+   while ((pChunk = pArenaFirst) != NULL)
+      {
+      pArenaFirst = pChunk->pNext;
+      PILIOFree(pChunk);
+      }
+   pArenaCur = NULL;
+} /* PILIOThreadDone() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOTraceMem(BOOL)                                        *
+ *                                                                          *
+ *  PURPOSE    : Turn tracing of the memory from PILIOAlloc() on or off.    *
+ *               Turn it on before the memory to watch is allocated.        *
+ *                                                                          *
+ ****************************************************************************/
+void PILIOTraceMem(BOOL bTrace)
+{
+   bTraceMem = bTrace;
+} /* PILIOTraceMem() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOMemStats(int *, PILOffset *, PILOffset *)             *
+ *                                                                          *
+ *  PURPOSE    : Get the number of traced blocks still allocated, their     *
+ *               total size and the largest total so far. The count also    *
+ *               has the blocks which couldn't be tracked (table full).     *
+ *                                                                          *
+ ****************************************************************************/
+void PILIOMemStats(int *piBlocks, PILOffset *pllBytes, PILOffset *pllPeak)
+{
+   TRACE_LOCK();
+   *piBlocks = iMemCount + iMemLost;
+   *pllBytes = llTotalMem;
+   *pllPeak = llPeakMem;
+   TRACE_UNLOCK();
+} /* PILIOMemStats() */
+
 // DEBUG - shim for now
 BOOL PILSecurity(TCHAR *szCompany, unsigned long ulKey)
 {
@@ -167,22 +597,249 @@ int PILIORename(char *szSrc, char *szDest)
  ****************************************************************************/
 BOOL PILIOExists(char *szName)
 {
-void *ihandle;
-
-	ihandle = (void *)fopen(szName, "rb");
+struct stat st;
 
-	if (ihandle == 0)
-	{
-		return FALSE;
-	}
-    else
-    {
-    	fclose((FILE *)ihandle);
-    	return TRUE;
-    }
+	return (stat(szName, &st) == 0);
 
 } /* PILIOExists() */
 
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOReadAt(PILIO_FILE *, void *, unsigned int, PILOffset) *
+ *                                                                          *
+ *  PURPOSE    : Read through a handle's reader, without moving it or       *
+ *               counting. Only descriptors are read past llSize (a file    *
+ *               which is still growing or a pipe). Reads smaller than the  *
+ *               reader's uiReadSize are served from a block that big.      *
+ *                                                                          *
+ *  RETURNS    : Number of bytes read, 0 at the end or -1 on an error.      *
+ *                                                                          *
+ ****************************************************************************/
+static int PILIOReadAt(PILIO_FILE *pIO, void *pBuf, unsigned int uiLen, PILOffset llOffset)
+{
+unsigned int uiReadSize = pIO->pReader->uiReadSize;
+PILOffset llBlock;
+int iLen;
+
+   if (pIO->iFD < 0)
+      {
+      if (llOffset >= pIO->llSize)
+         return 0;
+      if (uiLen > pIO->llSize - llOffset)
+         uiLen = (unsigned int)(pIO->llSize - llOffset);
+      }
+   if (uiLen == 0 || uiReadSize <= uiLen)
+      return (*pIO->pReader->pfnRead)(pIO->pContext, pBuf, uiLen, llOffset);
+   if (llOffset < pIO->llCacheOffset || llOffset + uiLen > pIO->llCacheOffset + pIO->iCacheLen)
+      {
+      if (pIO->pCache == NULL)
+         pIO->pCache = (unsigned char *)((uiReadSize <= PILIO_WINDOW_SIZE) ? PILIOWindowAlloc() : PILIOAllocNoClear(uiReadSize));
+      if (pIO->pCache == NULL)
+         return (*pIO->pReader->pfnRead)(pIO->pContext, pBuf, uiLen, llOffset);
+      llBlock = llOffset - (llOffset % uiReadSize); // aligned, unless that leaves part out
+      if (llOffset + uiLen > llBlock + uiReadSize)
+         llBlock = llOffset;
+      pIO->llCacheOffset = llBlock;
+      pIO->iCacheLen = (*pIO->pReader->pfnRead)(pIO->pContext, pIO->pCache, uiReadSize, llBlock);
+      if (pIO->iCacheLen < 0)
+         {
+         pIO->iCacheLen = 0;
+         return -1;
+         }
+      }
+   iLen = (int)(pIO->llCacheOffset + pIO->iCacheLen - llOffset);
+   if (iLen <= 0)
+      return 0; // the block ended first
+   if ((unsigned int)iLen > uiLen)
+      iLen = (int)uiLen;
+   memcpy(pBuf, &pIO->pCache[llOffset - pIO->llCacheOffset], iLen);
+   return iLen;
+} /* PILIOReadAt() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIODataAt(PILIO_FILE *, PILOffset, unsigned int, int *)  *
+ *                                                                          *
+ *  PURPOSE    : PILIOData() without the counting.                          *
+ *                                                                          *
+ ****************************************************************************/
+static unsigned char * PILIODataAt(PILIO_FILE *pIO, PILOffset llOffset, unsigned int uiLen, int *piLen)
+{
+   if (pIO->pReader->pfnData == NULL || llOffset < 0 || llOffset >= pIO->llSize)
+      return NULL;
+   if (uiLen > pIO->llSize - llOffset)
+      uiLen = (unsigned int)(pIO->llSize - llOffset);
+   return (*pIO->pReader->pfnData)(pIO->pContext, llOffset, uiLen, piLen);
+} /* PILIODataAt() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : FDRead / FDClose                                           *
+ *                                                                          *
+ *  PURPOSE    : Reader of file descriptors, with pread.                    *
+ *                                                                          *
+ ****************************************************************************/
+static int FDRead(void *pContext, void *pBuf, unsigned int uiLen, PILOffset llOffset)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)pContext;
+int iBytes;
+
+   do
+      {
+      iBytes = (int)pread(pIO->iFD, pBuf, uiLen, llOffset);
+      } while (iBytes < 0 && errno == EINTR);
+   return iBytes;
+} /* FDRead() */
+
+static void FDClose(void *pContext)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)pContext;
+
+   if (!pIO->bKeepFD)
+      close(pIO->iFD);
+} /* FDClose() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : MemRead / MemData / MapClose                               *
+ *                                                                          *
+ *  PURPOSE    : Reader of memory handles and mappings (one piece for a     *
+ *               mapping). A read which no piece holds in full fails and    *
+ *               the first one is remembered for PILIONeedMore().           *
+ *                                                                          *
+ ****************************************************************************/
+static int MemRead(void *pContext, void *pBuf, unsigned int uiLen, PILOffset llOffset)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)pContext;
+PILIO_SEG *pSeg;
+int i;
+
+   for (i=0; i<pIO->iSegCount; i++)
+      {
+      pSeg = &pIO->segs[i];
+      if (llOffset >= pSeg->llOffset && llOffset + uiLen <= pSeg->llOffset + (PILOffset)pSeg->ulLen)
+         {
+         memcpy(pBuf, &pSeg->pData[llOffset - pSeg->llOffset], uiLen);
+         return (int)uiLen;
+         }
+      }
+   if (!pIO->bNeedMore) // only the first miss matters, the rest may be bogus
+      {
+      pIO->bNeedMore = TRUE;
+      pIO->llNeedOffset = llOffset;
+      pIO->uiNeedLen = uiLen;
+      }
+   return 0;
+} /* MemRead() */
+
+static unsigned char * MemData(void *pContext, PILOffset llOffset, unsigned int uiLen, int *piLen)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)pContext;
+PILIO_SEG *pSeg;
+int i;
+
+   for (i=0; i<pIO->iSegCount; i++)
+      {
+      pSeg = &pIO->segs[i];
+      if (llOffset >= pSeg->llOffset && llOffset < pSeg->llOffset + (PILOffset)pSeg->ulLen)
+         {
+         if (llOffset + uiLen > pSeg->llOffset + (PILOffset)pSeg->ulLen)
+            uiLen = (unsigned int)(pSeg->llOffset + (PILOffset)pSeg->ulLen - llOffset);
+         *piLen = (int)uiLen;
+         return &pSeg->pData[llOffset - pSeg->llOffset];
+         }
+      }
+   return NULL;
+} /* MemData() */
+
+#ifndef _WIN32
+static void MapClose(void *pContext)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)pContext;
+
+   munmap(pIO->pMap, (size_t)pIO->llSize);
+} /* MapClose() */
+#endif
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : RangeRead / RangeData                                      *
+ *                                                                          *
+ *  PURPOSE    : Reader of ranges, through the reader of the parent.        *
+ *                                                                          *
+ ****************************************************************************/
+static int RangeRead(void *pContext, void *pBuf, unsigned int uiLen, PILOffset llOffset)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)pContext;
+
+   return PILIOReadAt(pIO->pParent, pBuf, uiLen, pIO->llBase + llOffset);
+} /* RangeRead() */
+
+static unsigned char * RangeData(void *pContext, PILOffset llOffset, unsigned int uiLen, int *piLen)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)pContext;
+
+   return PILIODataAt(pIO->pParent, pIO->llBase + llOffset, uiLen, piLen);
+} /* RangeData() */
+
+static const PILIO_READER fdReader = {FDRead, NULL, FDClose, 0};
+static const PILIO_READER memReader = {MemRead, MemData, NULL, 0};
+#ifndef _WIN32
+static const PILIO_READER mapReader = {MemRead, MemData, MapClose, 0};
+#endif
+static const PILIO_READER rangeReader = {RangeRead, RangeData, NULL, 0};
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIONew(const PILIO_READER *)                             *
+ *                                                                          *
+ *  PURPOSE    : Allocate a handle which uses one of our readers.           *
+ *                                                                          *
+ ****************************************************************************/
+static PILIO_FILE * PILIONew(const PILIO_READER *pReader)
+{
+PILIO_FILE *pIO;
+
+   pIO = (PILIO_FILE *)PoolGet(&handlePool, sizeof(PILIO_FILE));
+   if (pIO == NULL)
+      return NULL;
+   memset(pIO, 0, sizeof(PILIO_FILE));
+   pIO->pReader = pReader;
+   pIO->pContext = pIO;
+   pIO->iFD = -1;
+   return pIO;
+} /* PILIONew() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOWrapFD(int, unsigned long long)                       *
+ *                                                                          *
+ *  PURPOSE    : Create a handle for an open file descriptor.               *
+ *                                                                          *
+ *  RETURNS    : Handle to file if successful, -1 if failure                *
+ *                                                                          *
+ ****************************************************************************/
+static void * PILIOWrapFD(int fd, unsigned long long ullStart)
+{
+PILIO_FILE *pIO;
+struct stat st;
+
+   if (fd < 0)
+      return (void *)-1;
+   pIO = PILIONew(&fdReader);
+   if (pIO == NULL || fstat(fd, &st) != 0)
+      {
+      PoolPut(&handlePool, pIO);
+      close(fd);
+      return (void *)-1;
+      }
+   pIO->iFD = fd;
+   pIO->llSize = (PILOffset)st.st_size;
+   if (ullStart) // time spent in open + fstat
+      pIO->stats.ullOpenNs = PILIOTime() - ullStart;
+   return (void *)pIO;
+} /* PILIOWrapFD() */
+
 /****************************************************************************
  *                                                                          *
  *  FUNCTION   : PILIOOpenRO(char *)                                        *
@@ -196,18 +853,61 @@ void *ihandle;
  ****************************************************************************/
 void * PILIOOpenRO(char * fname)
 {
-   void * ihandle;
+unsigned long long ullStart = bIOStats ? PILIOTime() : 0;
 
-   ihandle = (void *)fopen(fname, "rb");
-   if (ihandle == NULL)
-      {
-      return (void *)-1;
-      }
-   else
-      return ihandle;
+   return PILIOWrapFD(open(fname, O_RDONLY | O_BINARY | O_CLOEXEC), ullStart);
 
 } /* PILIOOpenRO() */
 
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOOpenFD(int)                                           *
+ *                                                                          *
+ *  PURPOSE    : Create a handle for a descriptor opened by the caller.     *
+ *               Reads use pread so the descriptor's own file position is   *
+ *               not disturbed, and PILIOClose leaves it open.              *
+ *                                                                          *
+ *  RETURNS    : Handle to file if successful, -1 if failure                *
+ *                                                                          *
+ ****************************************************************************/
+void * PILIOOpenFD(int fd)
+{
+PILIO_FILE *pIO;
+struct stat st;
+
+   if (fd < 0 || fstat(fd, &st) != 0)
+      return (void *)-1;
+   pIO = PILIONew(&fdReader);
+   if (pIO == NULL)
+      return (void *)-1;
+   pIO->iFD = fd;
+   pIO->bKeepFD = TRUE;
+   pIO->llSize = (PILOffset)st.st_size;
+   return (void *)pIO;
+} /* PILIOOpenFD() */
+
+#ifndef _WIN32
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOOpenAtRO(int, char *)                                 *
+ *                                                                          *
+ *  PURPOSE    : Opens a file for reading only, relative to an open         *
+ *               directory (avoids a full path lookup per file).            *
+ *                                                                          *
+ *  PARAMETERS : directory file descriptor, leaf filename                   *
+ *                                                                          *
+ *  RETURNS    : Handle to file if successful, -1 if failure                *
+ *                                                                          *
+ ****************************************************************************/
+void * PILIOOpenAtRO(int iDirFD, char * fname)
+{
+unsigned long long ullStart = bIOStats ? PILIOTime() : 0;
+
+   return PILIOWrapFD(openat(iDirFD, fname, O_RDONLY | O_CLOEXEC), ullStart);
+
+} /* PILIOOpenAtRO() */
+#endif // !_WIN32
+
 /****************************************************************************
  *                                                                          *
  *  FUNCTION   : PILIOOpen(char *)                                          *
@@ -221,12 +921,12 @@ void * PILIOOpenRO(char * fname)
  ****************************************************************************/
 void * PILIOOpen(char * fname)
 {
-   void *ihandle;
+   int fd;
 
-   ihandle = (void *)fopen(fname, "r+b");
-   if (ihandle == NULL)
-      ihandle = PILIOOpenRO(fname); /* Try readonly */
-   return ihandle;
+   fd = open(fname, O_RDWR | O_BINARY | O_CLOEXEC);
+   if (fd < 0)
+      return PILIOOpenRO(fname); /* Try readonly */
+   return PILIOWrapFD(fd, 0);
 
 } /* PILIOOpen() */
 
@@ -243,35 +943,323 @@ void * PILIOOpen(char * fname)
  ****************************************************************************/
 void * PILIOCreate(char * fname)
 {
-void *ohandle;
+int fd;
 
-   ohandle = (void *)fopen(fname, "w+b");
-   if (ohandle == 0) // NULL means failure
+   fd = open(fname, O_RDWR | O_CREAT | O_TRUNC | O_BINARY | O_CLOEXEC, 0666);
+   if (fd < 0)
    {
 #ifdef LOG_OUTPUT
 	  __android_log_print(ANDROID_LOG_VERBOSE, "PILIOCreate", "Error = %d", errno);
 #endif
-      ohandle = (void *)-1;
+      return (void *)-1;
    }
-   return ohandle;
+   return PILIOWrapFD(fd, 0);
 
 } /* PILIOCreate() */
 
-unsigned long PILIOSize(void *iHandle)
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOOpenMem(void *, unsigned long, PILOffset)             *
+ *                                                                          *
+ *  PURPOSE    : Create a read-only handle over the start of a file that    *
+ *               is already in memory. More pieces can be added with        *
+ *               PILIOAddMem(); reads outside of them are remembered and    *
+ *               reported by PILIONeedMore(). The data is not copied.       *
+ *                                                                          *
+ *  PARAMETERS : data, length of data, total size of the file               *
+ *                                                                          *
+ *  RETURNS    : Handle if successful, -1 if failure                        *
+ *                                                                          *
+ ****************************************************************************/
+void * PILIOOpenMem(void *pData, unsigned long ulLen, PILOffset llFileSize)
+{
+PILIO_FILE *pIO;
+
+   pIO = PILIONew(&memReader);
+   if (pIO == NULL)
+      return (void *)-1;
+   pIO->llSize = llFileSize;
+   PILIOAddMem(pIO, 0, pData, ulLen);
+   return (void *)pIO;
+
+} /* PILIOOpenMem() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOOpenRange(void *, PILOffset, PILOffset)               *
+ *                                                                          *
+ *  PURPOSE    : Open llLen bytes of another handle starting at llOffset    *
+ *               (a member of an archive) as a file of its own. Reads go    *
+ *               through the parent's reader, so nothing is read or copied  *
+ *               up front, and are clipped to the range. The parent must    *
+ *               stay open until the range handle is closed. Reads outside  *
+ *               the pieces of a memory parent are remembered by the        *
+ *               parent, not the range.                                     *
+ *                                                                          *
+ *  RETURNS    : Handle if successful, -1 if failure                        *
+ *                                                                          *
+ ****************************************************************************/
+void * PILIOOpenRange(void *iHandle, PILOffset llOffset, PILOffset llLen)
+{
+PILIO_FILE *pParent = (PILIO_FILE *)iHandle;
+PILIO_FILE *pIO;
+
+   if (llOffset < 0 || llLen < 0 || llOffset > pParent->llSize)
+      return (void *)-1;
+   if (llLen > pParent->llSize - llOffset)
+      llLen = pParent->llSize - llOffset;
+   pIO = PILIONew(&rangeReader);
+   if (pIO == NULL)
+      return (void *)-1;
+   pIO->pParent = pParent;
+   pIO->llBase = llOffset;
+   pIO->llSize = llLen;
+   return (void *)pIO;
+
+} /* PILIOOpenRange() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOOpenReader(const PILIO_READER *, void *, PILOffset)   *
+ *                                                                          *
+ *  PURPOSE    : Create a read-only handle over a source of bytes supplied  *
+ *               by the caller (a socket, a cache, a decompressor). The     *
+ *               reader is not copied and must outlive the handle;          *
+ *               pContext is passed to each of its functions.               *
+ *                                                                          *
+ *  RETURNS    : Handle if successful, -1 if failure                        *
+ *                                                                          *
+ ****************************************************************************/
+void * PILIOOpenReader(const PILIO_READER *pReader, void *pContext, PILOffset llSize)
+{
+PILIO_FILE *pIO;
+
+   if (pReader == NULL || pReader->pfnRead == NULL || llSize < 0)
+      return (void *)-1;
+   pIO = PILIONew(pReader);
+   if (pIO == NULL)
+      return (void *)-1;
+   pIO->pContext = pContext;
+   pIO->llSize = llSize;
+   return (void *)pIO;
+
+} /* PILIOOpenReader() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOReadSize(void *)                                      *
+ *                                                                          *
+ *  PURPOSE    : Return the read granularity a handle's reader prefers      *
+ *               (see PILIO_READER), 0 if any size is as good.              *
+ *                                                                          *
+ ****************************************************************************/
+unsigned int PILIOReadSize(void *iHandle)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)iHandle;
+
+   while (pIO->pParent != NULL) // a range reads like its parent
+      pIO = pIO->pParent;
+   return pIO->pReader->uiReadSize;
+} /* PILIOReadSize() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOAddMem(void *, PILOffset, void *, unsigned long)      *
+ *                                                                          *
+ *  PURPOSE    : Add another piece of the file to a memory handle.          *
+ *                                                                          *
+ *  RETURNS    : TRUE if successful, FALSE if there is no room.             *
+ *                                                                          *
+ ****************************************************************************/
+BOOL PILIOAddMem(void *iHandle, PILOffset llOffset, void *pData, unsigned long ulLen)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)iHandle;
+
+   if (pIO->pReader != &memReader || pIO->iSegCount >= PILIO_MAX_SEGS)
+      return FALSE;
+   pIO->segs[pIO->iSegCount].llOffset = llOffset;
+   pIO->segs[pIO->iSegCount].ulLen = ulLen;
+   pIO->segs[pIO->iSegCount].pData = (unsigned char *)pData;
+   pIO->iSegCount++;
+   pIO->bNeedMore = FALSE; // start over with the new piece
+   pIO->llPos = 0;
+   return TRUE;
+
+} /* PILIOAddMem() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIONeedMore(void *, PILOffset *, unsigned int *)         *
+ *                                                                          *
+ *  PURPOSE    : Report the first read which a memory handle couldn't       *
+ *               satisfy since it was opened or last had a piece added.     *
+ *                                                                          *
+ *  RETURNS    : TRUE if more data is needed, FALSE if all reads worked.    *
+ *                                                                          *
+ ****************************************************************************/
+BOOL PILIONeedMore(void *iHandle, PILOffset *pllOffset, unsigned int *puiLen)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)iHandle;
+
+   if (!pIO->bNeedMore)
+      return FALSE;
+   *pllOffset = pIO->llNeedOffset;
+   *puiLen = pIO->uiNeedLen;
+   return TRUE;
+
+} /* PILIONeedMore() */
+
+#ifndef _WIN32
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOMapFD(int, unsigned long, unsigned long long)         *
+ *                                                                          *
+ *  PURPOSE    : Map an open file read-only. Anything that isn't a regular  *
+ *               file (FIFOs, devices) or is smaller than ulMinSize keeps   *
+ *               using the descriptor with pread instead.                   *
+ *                                                                          *
+ ****************************************************************************/
+static void * PILIOMapFD(int fd, unsigned long ulMinSize, unsigned long long ullStart)
+{
+PILIO_FILE *pIO;
+struct stat st;
+void *pMap;
+
+   if (fd < 0)
+      return (void *)-1;
+   if (fstat(fd, &st) != 0)
+      {
+      close(fd);
+      return (void *)-1;
+      }
+   if (ulMinSize == 0)
+      ulMinSize = PILIO_MAP_MIN_SIZE;
+   if (!S_ISREG(st.st_mode) || (unsigned long long)st.st_size < ulMinSize || (unsigned long long)st.st_size > (size_t)-1)
+      pMap = MAP_FAILED; // too small, or too big for the address space
+   else
+      pMap = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   pIO = PILIONew((pMap == MAP_FAILED) ? &fdReader : &mapReader);
+   if (pIO == NULL)
+      {
+      if (pMap != MAP_FAILED)
+         munmap(pMap, (size_t)st.st_size);
+      close(fd);
+      return (void *)-1;
+      }
+   pIO->llSize = (PILOffset)st.st_size;
+   if (ullStart) // time spent in open + fstat + mmap
+      pIO->stats.ullOpenNs = PILIOTime() - ullStart;
+   if (pMap == MAP_FAILED) // not a good fit, read it normally
+      {
+      pIO->iFD = fd;
+      return (void *)pIO;
+      }
+   // We only touch a few pages; don't let the kernel read ahead for us
+   madvise(pMap, (size_t)st.st_size, MADV_RANDOM);
+   close(fd); // the mapping keeps its own reference
+   pIO->pMap = pMap;
+   pIO->iSegCount = 1;
+   pIO->segs[0].llOffset = 0;
+   pIO->segs[0].ulLen = (unsigned long)pIO->llSize;
+   pIO->segs[0].pData = (unsigned char *)pMap;
+   return (void *)pIO;
+
+} /* PILIOMapFD() */
+#endif // !_WIN32
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOMap(char *, unsigned long)                            *
+ *                                                                          *
+ *  PURPOSE    : Open a file for reading through a read-only memory map.    *
+ *               Reads and PILIOData() are then served from the page cache  *
+ *               without any system calls. Files smaller than ulMinSize     *
+ *               (0 = default) and non-regular files are opened normally.   *
+ *                                                                          *
+ *  RETURNS    : Handle to file if successful, -1 if failure                *
+ *                                                                          *
+ ****************************************************************************/
+void * PILIOMap(char *fname, unsigned long ulMinSize)
+{
+#ifdef _WIN32
+   return PILIOOpenRO(fname);
+#else
+   unsigned long long ullStart = bIOStats ? PILIOTime() : 0;
+
+   return PILIOMapFD(open(fname, O_RDONLY | O_CLOEXEC), ulMinSize, ullStart);
+#endif
+} /* PILIOMap() */
+
+#ifndef _WIN32
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOMapAt(int, char *, unsigned long)                     *
+ *                                                                          *
+ *  PURPOSE    : Same as PILIOMap(), relative to an open directory.         *
+ *                                                                          *
+ ****************************************************************************/
+void * PILIOMapAt(int iDirFD, char *fname, unsigned long ulMinSize)
+{
+unsigned long long ullStart = bIOStats ? PILIOTime() : 0;
+
+   return PILIOMapFD(openat(iDirFD, fname, O_RDONLY | O_CLOEXEC), ulMinSize, ullStart);
+} /* PILIOMapAt() */
+#endif // !_WIN32
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOUnmap(void *)                                         *
+ *                                                                          *
+ *  PURPOSE    : Release a handle returned by PILIOMap().                   *
+ *                                                                          *
+ ****************************************************************************/
+void PILIOUnmap(void *iHandle)
+{
+   PILIOClose(iHandle);
+} /* PILIOUnmap() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOData(void *, PILOffset, unsigned int, int *)          *
+ *                                                                          *
+ *  PURPOSE    : Return a pointer to file data which is already in memory   *
+ *               (mapped or memory handles), so it can be parsed in place.  *
+ *               The range is clipped to the end of the file and to the     *
+ *               end of the piece holding llOffset, so check *piLen.        *
+ *                                                                          *
+ *  RETURNS    : Pointer to the data and the number of bytes available      *
+ *               in *piLen, or NULL if the data must be read.               *
+ *                                                                          *
+ ****************************************************************************/
+unsigned char * PILIOData(void *iHandle, PILOffset llOffset, unsigned int uiLen, int *piLen)
 {
-unsigned long ulStart, ulSize;
+PILIO_FILE *pIO = (PILIO_FILE *)iHandle;
+unsigned char *p;
+
+   p = PILIODataAt(pIO, llOffset, uiLen, piLen);
+   if (p != NULL && bIOStats)
+      pIO->stats.ullBytes += *piLen;
+   return p;
+} /* PILIOData() */
 
-    ulStart = ftell((FILE *)iHandle);
-	fseek((FILE *)iHandle, 0L, SEEK_END);
-	ulSize = ftell((FILE *)iHandle);
-	fseek((FILE *)iHandle, ulStart, SEEK_SET);
-    return ulSize;
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOSize(void *)                                          *
+ *                                                                          *
+ *  PURPOSE    : Return the size of an open file (no system call).          *
+ *                                                                          *
+ ****************************************************************************/
+PILOffset PILIOSize(void *iHandle)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)iHandle;
+
+    return pIO->llSize;
    
 } /* PILIOSize() */
 
 /****************************************************************************
  *                                                                          *
- *  FUNCTION   : PILIOSeek(int, signed long, int)                           *
+ *  FUNCTION   : PILIOSeek(int, PILOffset, int)                             *
  *                                                                          *
  *  PURPOSE    : Seeks within an open file                                  *
  *                                                                          *
@@ -282,19 +1270,18 @@ unsigned long ulStart, ulSize;
  *  RETURNS    : New offset within file.                                    *
  *                                                                          *
  ****************************************************************************/
-unsigned long PILIOSeek(void * iHandle, unsigned long lOffset, int iMethod)
+PILOffset PILIOSeek(void * iHandle, PILOffset llOffset, int iMethod)
 {
-	   int iType;
-	   unsigned long ulNewPos;
-
-	   if (iMethod == 0) iType = SEEK_SET;
-	   else if (iMethod == 1) iType = SEEK_CUR;
-	   else iType = SEEK_END;
-
-	   fseek((FILE *)iHandle, lOffset, iType);
-	   ulNewPos = fgetpos((FILE *)iHandle, (fpos_t *)&ulNewPos);
+	   PILIO_FILE *pIO = (PILIO_FILE *)iHandle;
+	   PILOffset llOld = pIO->llPos;
 
-	   return ulNewPos;
+	   // reads are positional, so there's nothing to tell the OS
+	   if (iMethod == 0) pIO->llPos = llOffset;
+	   else if (iMethod == 1) pIO->llPos += llOffset;
+	   else pIO->llPos = pIO->llSize + llOffset;
+	   if (bIOStats && pIO->llPos != llOld)
+	      pIO->stats.uiSeeks++;
+	   return pIO->llPos;
 
 } /* PILIOSeek() */
 
@@ -313,9 +1300,22 @@ unsigned long PILIOSeek(void * iHandle, unsigned long lOffset, int iMethod)
  ****************************************************************************/
 signed int PILIORead(void * iHandle, void * lpBuff, unsigned int iNumBytes)
 {
-	   unsigned int iBytes;
+	   PILIO_FILE *pIO = (PILIO_FILE *)iHandle;
+	   int iBytes;
+	   unsigned long long ullStart;
 
-	   iBytes = (int)fread(lpBuff, 1, iNumBytes, (FILE *)iHandle);
+	   ullStart = bIOStats ? PILIOTime() : 0;
+	   iBytes = PILIOReadAt(pIO, lpBuff, iNumBytes, pIO->llPos);
+	   if (ullStart)
+	   {
+	      pIO->stats.ullReadNs += PILIOTime() - ullStart;
+	      pIO->stats.uiReads++;
+	      if (iBytes > 0)
+	         pIO->stats.ullBytes += iBytes;
+	   }
+	   if (iBytes <= 0)
+	      return 0;
+	   pIO->llPos += iBytes;
 	   return iBytes;
 
 } /* PILIORead() */
@@ -335,13 +1335,193 @@ signed int PILIORead(void * iHandle, void * lpBuff, unsigned int iNumBytes)
  ****************************************************************************/
 unsigned int PILIOWrite(void * iHandle, void * lpBuff, unsigned int iNumBytes)
 {
-	   unsigned int iBytes;
+	   PILIO_FILE *pIO = (PILIO_FILE *)iHandle;
+	   int iBytes;
 
-	   iBytes = (int)fwrite(lpBuff, 1, iNumBytes, (FILE *)iHandle);
+	   if (pIO->iFD < 0)
+	      return 0; // only descriptors can be written
+	   iBytes = (int)pwrite(pIO->iFD, lpBuff, iNumBytes, pIO->llPos);
+	   if (iBytes < 0)
+	      return 0;
+	   pIO->llPos += iBytes;
+	   if (pIO->llPos > pIO->llSize)
+	      pIO->llSize = pIO->llPos;
 	   return iBytes;
 
 } /* PILIOWrite() */
 
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOWriteAll(int, unsigned char *, PILOffset)             *
+ *                                                                          *
+ *  PURPOSE    : Write a whole block to a descriptor.                       *
+ *                                                                          *
+ *  RETURNS    : TRUE if successful, FALSE on a write error.                *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL PILIOWriteAll(int iFD, unsigned char *pData, PILOffset llLen)
+{
+int iLen, iBytes;
+
+   while (llLen > 0)
+      {
+      iLen = (llLen > 0x40000000) ? 0x40000000 : (int)llLen;
+      iBytes = (int)write(iFD, pData, iLen);
+      if (iBytes < 0 && errno == EINTR)
+         continue;
+      if (iBytes <= 0)
+         return FALSE;
+      pData += iBytes;
+      llLen -= iBytes;
+      }
+   return TRUE;
+} /* PILIOWriteAll() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOCopy(void *, PILOffset, PILOffset, int)               *
+ *                                                                          *
+ *  PURPOSE    : Copy llLen bytes of an open file at llOffset to the end    *
+ *               of a descriptor (a file, pipe or terminal) without them    *
+ *               passing through a buffer of ours. On Linux the kernel      *
+ *               copies them with copy_file_range(), or sendfile() when     *
+ *               the output isn't a regular file on the same kind of file   *
+ *               system; elsewhere they are read and written in chunks.     *
+ *               Ranges of a descriptor are copied from the descriptor.     *
+ *               Mapped and memory handles are written straight from        *
+ *               memory, and nothing is written unless all of the range is  *
+ *               there. Other readers are read and written in chunks.       *
+ *                                                                          *
+ *  RETURNS    : Number of bytes copied (llLen) or -1 if not successful.    *
+ *                                                                          *
+ ****************************************************************************/
+PILOffset PILIOCopy(void *iHandle, PILOffset llOffset, PILOffset llLen, int iOutFD)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)iHandle;
+PILIO_FILE *pRoot;
+PILOffset llDone, llPos, llBase = 0;
+unsigned char *p, ucBuf[PILIO_COPY_SIZE];
+int iLen, iBytes;
+#ifdef __linux__
+loff_t llIn;
+off_t oIn;
+ssize_t n;
+#endif
+
+   if (llOffset < 0 || llLen < 0 || llOffset + llLen > pIO->llSize)
+      return -1;
+   for (pRoot = pIO; pRoot->pParent != NULL; pRoot = pRoot->pParent) // where a range really is
+      llBase += pRoot->llBase;
+   if (pRoot->iFD < 0 && pIO->pReader->pfnData != NULL)
+      {
+      for (llPos = llOffset; llPos < llOffset + llLen; llPos += iBytes) // is it all here?
+         {
+         iLen = (llOffset + llLen - llPos > 0x40000000) ? 0x40000000 : (int)(llOffset + llLen - llPos);
+         if (PILIODataAt(pIO, llPos, iLen, &iBytes) == NULL)
+            break;
+         }
+      if (llPos >= llOffset + llLen)
+         {
+         for (llPos = llOffset; llPos < llOffset + llLen; llPos += iBytes)
+            {
+            iLen = (llOffset + llLen - llPos > 0x40000000) ? 0x40000000 : (int)(llOffset + llLen - llPos);
+            p = PILIOData(iHandle, llPos, iLen, &iBytes);
+            if (!PILIOWriteAll(iOutFD, p, iBytes))
+               return -1;
+            }
+         return llLen;
+         }
+      if (pRoot->pReader->pfnRead == MemRead)
+         return -1; // and there's no way to read the rest
+      }
+   llDone = 0;
+#ifdef __linux__
+   if (pRoot->iFD >= 0)
+      {
+      llIn = llBase + llOffset;
+      while (llDone < llLen) // file to file, within the kernel (maybe a reflink)
+         {
+         n = copy_file_range(pRoot->iFD, &llIn, iOutFD, NULL, (size_t)(llLen - llDone), 0);
+         if (n < 0 && errno == EINTR)
+            continue;
+         if (n <= 0) // not supported between these two, try the next way
+            break;
+         llDone += n;
+         }
+      oIn = (off_t)(llBase + llOffset + llDone);
+      while (llDone < llLen) // any kind of output
+         {
+         n = sendfile(iOutFD, pRoot->iFD, &oIn, (size_t)(llLen - llDone));
+         if (n < 0 && errno == EINTR)
+            continue;
+         if (n <= 0)
+            break;
+         llDone += n;
+         }
+      }
+#endif
+   while (llDone < llLen)
+      {
+      iLen = (llLen - llDone > PILIO_COPY_SIZE) ? PILIO_COPY_SIZE : (int)(llLen - llDone);
+      iBytes = PILIOReadAt(pIO, ucBuf, iLen, llOffset + llDone);
+      if (iBytes <= 0 || !PILIOWriteAll(iOutFD, ucBuf, iBytes))
+         return -1;
+      llDone += iBytes;
+      }
+   return llDone;
+
+} /* PILIOCopy() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOSetStats(BOOL)                                        *
+ *                                                                          *
+ *  PURPOSE    : Turn the per-handle I/O counters and timers on or off.     *
+ *               When off (the default) each call only pays for a test of   *
+ *               the flag. Set it before opening any handles.               *
+ *                                                                          *
+ ****************************************************************************/
+void PILIOSetStats(BOOL bEnable)
+{
+   bIOStats = bEnable;
+} /* PILIOSetStats() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOGetStats(void *, PILIO_STATS *)                       *
+ *                                                                          *
+ *  PURPOSE    : Return the counters of a handle gathered since it was      *
+ *               opened (all zero unless PILIOSetStats(TRUE) was called).   *
+ *                                                                          *
+ ****************************************************************************/
+void PILIOGetStats(void *iHandle, PILIO_STATS *pStats)
+{
+PILIO_FILE *pIO = (PILIO_FILE *)iHandle;
+
+   memcpy(pStats, &pIO->stats, sizeof(PILIO_STATS));
+} /* PILIOGetStats() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOTime(void)                                            *
+ *                                                                          *
+ *  PURPOSE    : Read a monotonic clock.                                    *
+ *                                                                          *
+ *  RETURNS    : Time in nanoseconds from an arbitrary starting point.      *
+ *                                                                          *
+ ****************************************************************************/
+unsigned long long PILIOTime(void)
+{
+#ifdef _WIN32
+   return (unsigned long long)clock() * (1000000000ULL / CLOCKS_PER_SEC);
+#else
+struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#endif
+} /* PILIOTime() */
+
 /****************************************************************************
  *                                                                          *
  *  FUNCTION   : PILIOClose(int)                                            *
@@ -355,8 +1535,15 @@ unsigned int PILIOWrite(void * iHandle, void * lpBuff, unsigned int iNumBytes)
  ****************************************************************************/
 void PILIOClose(void * iHandle)
 {
-	   fflush((FILE *)iHandle);
-	   fclose((FILE *)iHandle);
+	   PILIO_FILE *pIO = (PILIO_FILE *)iHandle;
+
+	   if (pIO->pReader->pfnClose != NULL)
+	      (*pIO->pReader->pfnClose)(pIO->pContext);
+	   if (pIO->pReader->uiReadSize <= PILIO_WINDOW_SIZE)
+	      PILIOWindowFree(pIO->pCache);
+	   else
+	      PILIOFree(pIO->pCache);
+	   PoolPut(&handlePool, pIO);
 
 } /* PILIOClose() */
 
@@ -364,24 +1551,40 @@ void PILIOClose(void * iHandle)
  *                                                                          *
  *  FUNCTION   : PILIOAlloc(long)                                           *
  *                                                                          *
- *  PURPOSE    : Allocate a block of writable memory.                       *
+ *  PURPOSE    : Allocate a block of writable memory, cleared to 0.         *
  *                                                                          *
  ****************************************************************************/
 void * PILIOAlloc(unsigned long size)
 {
-    void *p = NULL;
-    void* i;
+void *p;
 
-	   if (size == 0)
-          {
-          return NULL; // Linux seems to return a non-NULL pointer for 0 size
-          }
-
-	   i = malloc(size);
-	   return p;
-   
+   if (size == 0)
+      return NULL; // Linux seems to return a non-NULL pointer for 0 size
+   p = calloc(1, size);
+   if (p != NULL && bTraceMem)
+      TraceAdd(p, size);
+   return p;
 } /* PILIOAlloc() */
 
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILIOAllocNoClear(long)                                    *
+ *                                                                          *
+ *  PURPOSE    : Allocate a block of writable memory without clearing it.   *
+ *                                                                          *
+ ****************************************************************************/
+void * PILIOAllocNoClear(unsigned long size)
+{
+void *p;
+
+   if (size == 0)
+      return NULL;
+   p = malloc(size);
+   if (p != NULL && bTraceMem)
+      TraceAdd(p, size);
+   return p;
+} /* PILIOAllocNoClear() */
+
 /****************************************************************************
  *                                                                          *
  *  FUNCTION   : PILIOFree(void *)                                          *
@@ -393,6 +1596,8 @@ void PILIOFree(void *p)
 {
     if (p == NULL || p == (void *)-1)
        return; /* Don't try to free bogus pointer */
+    if (bTraceMem)
+       TraceRemove(p);
 	free(p);
 } /* PILIOFree() */
 
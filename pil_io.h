@@ -28,8 +28,10 @@ extern "C" {
 // PILHALError Is a typedef that is equivalent to the native environment's
 // filesystem error code
 typedef void * PILHALError;
-typedef signed long PILOffset;
-//typedef signed long long int PILOffset;
+// File offsets and sizes are 64-bits everywhere, even where long is 32-bits
+typedef signed long long int PILOffset;
+#define PILIO_MAX_SEGS 8 /* pieces a memory handle can hold */
+#define PILIO_WINDOW_SIZE 0x10000 /* buffers from PILIOWindowAlloc() */
 
 // OS independent date structure
 typedef struct pil_date_tag
@@ -42,18 +44,69 @@ typedef struct pil_date_tag
 	int iSecond;
 } PIL_DATE;
 
+// Per-handle I/O counters, see PILIOSetStats()
+typedef struct pil_io_stats_tag
+{
+	unsigned long long ullOpenNs;  // open (and map) time
+	unsigned long long ullReadNs;  // time spent in read system calls
+	unsigned long long ullBytes;   // bytes read or accessed in memory
+	unsigned int uiReads;          // PILIORead() calls
+	unsigned int uiSeeks;          // PILIOSeek() calls which moved
+} PILIO_STATS;
+
+// Where the bytes of a handle come from. The stock handles (PILIOOpenRO,
+// PILIOOpenFD, PILIOMap, PILIOOpenMem, PILIOOpenRange) each have one of
+// their own; PILIOOpenReader() makes a handle from any other source
+// (a socket, a cache, a decompressor), which the parsers then read
+// through PILIORead/PILIOData like a file.
+typedef struct pil_io_reader_tag
+{
+   // Read up to uiLen bytes at llOffset. Returns the number read (0 at the
+   // end of the data) or -1 on an error.
+   int (*pfnRead)(void *pContext, void *pBuf, unsigned int uiLen, PILOffset llOffset);
+   // Optional (NULL): return a pointer to bytes already in memory and the
+   // count in *piLen, or NULL if they must be read. The pointer has to stay
+   // valid until the handle is closed.
+   unsigned char * (*pfnData)(void *pContext, PILOffset llOffset, unsigned int uiLen, int *piLen);
+   // Optional (NULL): called when the handle is closed
+   void (*pfnClose)(void *pContext);
+   // Preferred read granularity in bytes, 0 for any size. Smaller reads are
+   // made this big and kept, so a run of small reads costs one.
+   unsigned int uiReadSize;
+} PILIO_READER;
+
 extern BOOL PILIOExists(char *szName);
-extern unsigned long PILIOSize(void *iHandle);
+extern PILOffset PILIOSize(void *iHandle);
 extern int PILIOMsgBox(char *, char *);
 extern void * PILIOOpen(char *);
 extern void * PILIOOpenRO(char *);
+#ifndef _WIN32
+extern void * PILIOOpenAtRO(int, char *);
+#endif
+extern void * PILIOOpenFD(int);
+extern void * PILIOOpenMem(void *, unsigned long, PILOffset);
+extern void * PILIOOpenRange(void *, PILOffset, PILOffset);
+extern void * PILIOOpenReader(const PILIO_READER *, void *, PILOffset);
+extern unsigned int PILIOReadSize(void *);
+extern BOOL PILIOAddMem(void *, PILOffset, void *, unsigned long);
+extern BOOL PILIONeedMore(void *, PILOffset *, unsigned int *);
+extern void * PILIOMap(char *, unsigned long);
+#ifndef _WIN32
+extern void * PILIOMapAt(int, char *, unsigned long);
+#endif
+extern void PILIOUnmap(void *);
+extern unsigned char * PILIOData(void *, PILOffset, unsigned int, int *);
 extern void * PILIOCreate(char *);
 extern int PILIODelete(char *);
 extern int PILIORename(char *, char *);
-extern unsigned long PILIOSeek(void *, unsigned long, int);
+extern PILOffset PILIOSeek(void *, PILOffset, int);
 extern signed int PILIORead(void *, void *, unsigned int);
 extern unsigned int PILIOWrite(void *, void *, unsigned int);
+extern PILOffset PILIOCopy(void *, PILOffset, PILOffset, int);
 extern void PILIOClose(void *);
+extern void PILIOSetStats(BOOL);
+extern void PILIOGetStats(void *, PILIO_STATS *);
+extern unsigned long long PILIOTime(void);
 void * PILIOAlloc(unsigned long size);
 void PILIOGetCurDir(int iMaxLen, char *szPath);
 void * PILIOAllocNoClear(unsigned long size);
@@ -64,6 +117,15 @@ void * PILIOAllocOutbuf(void);
 //#define PILIOAllocOutbufInternal()	PILIOAllocInternal(MAX_SIZE, __FILE__, __LINE__, TRUE)
 extern void PILIOFree(void *);
 extern void PILIOFreeOutbuf(void *);
+// Per-thread memory for the work on each file, see pil_io.c
+extern void * PILIOWindowAlloc(void);
+extern void PILIOWindowFree(void *);
+extern void * PILIOArenaAlloc(unsigned long);
+extern void * PILIOArenaMark(void);
+extern void PILIOArenaRelease(void *);
+extern void PILIOThreadDone(void);
+extern void PILIOTraceMem(BOOL);
+extern void PILIOMemStats(int *, PILOffset *, PILOffset *);
 extern void PILIOSignalThread(unsigned long dwTID, unsigned int iMsg, unsigned long wParam, unsigned long lParam);
 extern void PILAssertHandlerProc(char *pExpression, char *pFile, unsigned long int ulLineNumber);
 // Assertions
@@ -0,0 +1,299 @@
+/****************************************************************************
+ *                                                                          *
+ * MODULE:  PIL_OUT.C                                                       *
+ *                                                                          *
+ * DESCRIPTION: Buffered output writer                                      *
+ *                                                                          *
+ * FUNCTIONS:                                                               *
+ *            PILOutOpen - Create a writer for a file descriptor            *
+ *            PILOutReserve - Get room for a piece of text                  *
+ *            PILOutCommit - Add the text written to the reserved room      *
+ *            PILOutRecord - Add a fixed size record and its string         *
+ *            PILOutFlush - Write out what is buffered                      *
+ *            PILOutClose - Flush and free a writer                         *
+ * COMMENTS:                                                                *
+ *            Output is collected in a large buffer per writer and sent    *
+ *            with one write() per buffer instead of one stdio call per    *
+ *            line. Writers sharing a descriptor take turns through a       *
+ *            mutex, so each buffer arrives in one piece. When the output   *
+ *            is a terminal the buffer is flushed after every line.         *
+ ****************************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#include "my_windows.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#define isatty _isatty
+#else
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+#include "pil_out.h"
+
+#define OUT_BUF_SIZE 0x40000 // 256K
+
+typedef struct pil_out_tag
+{
+   int iFD;
+   int iRecordSize;     // 0 = text
+   BOOL bLine;          // flush every line (terminal)
+   BOOL bError;         // a write failed, drop everything after it
+   char *pBuf;          // text, or the block header and records
+   int iSize;           // capacity of pBuf (and pStrings)
+   int iLen;            // bytes used in pBuf
+   int iRecords;
+   char *pStrings;      // string table of the current block
+   int iStringLen;
+} PIL_OUT;
+
+#ifndef _WIN32
+static pthread_mutex_t outMutex = PTHREAD_MUTEX_INITIALIZER; // one write() at a time
+#endif
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : OutWrite(PIL_OUT *, char *, int)                           *
+ *                                                                          *
+ *  PURPOSE    : Write a buffer, retrying short writes, while holding the   *
+ *               lock so it isn't split up by another writer.               *
+ *                                                                          *
+ *  RETURNS    : 0 if successful, -1 on error.                              *
+ *                                                                          *
+ ****************************************************************************/
+static int OutWrite(PIL_OUT *pOut, char *pData, int iLen)
+{
+int i;
+
+   if (pOut->bError)
+      return -1;
+#ifndef _WIN32
+   pthread_mutex_lock(&outMutex);
+#endif
+   while (iLen > 0)
+      {
+      i = (int)write(pOut->iFD, pData, iLen);
+      if (i < 0 && errno == EINTR)
+         continue;
+      if (i <= 0)
+         {
+         pOut->bError = TRUE;
+         break;
+         }
+      pData += i;
+      iLen -= i;
+      }
+#ifndef _WIN32
+   pthread_mutex_unlock(&outMutex);
+#endif
+   return pOut->bError ? -1 : 0;
+} /* OutWrite() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : OutGrow(PIL_OUT *, int)                                    *
+ *                                                                          *
+ *  PURPOSE    : Make the (empty) buffers big enough for iLen bytes.        *
+ *                                                                          *
+ *  RETURNS    : TRUE if successful, FALSE if out of memory.                *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL OutGrow(PIL_OUT *pOut, int iLen)
+{
+char *p;
+
+   iLen = (iLen + OUT_BUF_SIZE - 1) & ~(OUT_BUF_SIZE - 1);
+   p = (char *)realloc(pOut->pBuf, iLen);
+   if (p == NULL)
+      return FALSE;
+   pOut->pBuf = p;
+   if (pOut->iRecordSize)
+      {
+      p = (char *)realloc(pOut->pStrings, iLen);
+      if (p == NULL)
+         return FALSE;
+      pOut->pStrings = p;
+      }
+   pOut->iSize = iLen;
+   return TRUE;
+} /* OutGrow() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILOutOpen(int, int)                                       *
+ *                                                                          *
+ *  PURPOSE    : Create a writer for a file descriptor. iRecordSize is 0    *
+ *               for text or the size of a record (a multiple of 8).        *
+ *                                                                          *
+ *  RETURNS    : Writer handle or NULL if out of memory.                    *
+ *                                                                          *
+ ****************************************************************************/
+void * PILOutOpen(int iFD, int iRecordSize)
+{
+PIL_OUT *pOut;
+
+   pOut = (PIL_OUT *)calloc(1, sizeof(PIL_OUT));
+   if (pOut == NULL)
+      return NULL;
+   pOut->iFD = iFD;
+   pOut->iRecordSize = iRecordSize;
+   pOut->bLine = (iRecordSize == 0 && isatty(iFD));
+   if (!OutGrow(pOut, OUT_BUF_SIZE))
+      {
+      PILOutClose(pOut);
+      return NULL;
+      }
+   if (iRecordSize)
+      pOut->iLen = sizeof(PIL_OUT_BLOCK);
+   return pOut;
+} /* PILOutOpen() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILOutReserve(void *, int)                                 *
+ *                                                                          *
+ *  PURPOSE    : Return room for up to iLen bytes of text, flushing the     *
+ *               buffer first if it doesn't fit.                            *
+ *                                                                          *
+ *  RETURNS    : Pointer to the room or NULL if out of memory.              *
+ *                                                                          *
+ ****************************************************************************/
+char * PILOutReserve(void *pOut, int iLen)
+{
+PIL_OUT *pO = (PIL_OUT *)pOut;
+
+   if (pO->iLen + iLen > pO->iSize)
+      {
+      PILOutFlush(pO);
+      if (iLen > pO->iSize && !OutGrow(pO, iLen))
+         return NULL;
+      }
+   return &pO->pBuf[pO->iLen];
+} /* PILOutReserve() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILOutCommit(void *, int)                                  *
+ *                                                                          *
+ *  PURPOSE    : Add iLen bytes written to the room from PILOutReserve().   *
+ *                                                                          *
+ ****************************************************************************/
+void PILOutCommit(void *pOut, int iLen)
+{
+PIL_OUT *pO = (PIL_OUT *)pOut;
+
+   pO->iLen += iLen;
+   if (pO->bLine)
+      PILOutFlush(pO);
+} /* PILOutCommit() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILOutRecord(void *, const char *, unsigned int *)         *
+ *                                                                          *
+ *  PURPOSE    : Add a record to the current block along with its string.   *
+ *               The block is written out first if they don't fit.          *
+ *                                                                          *
+ *  RETURNS    : Pointer to the zeroed record for the caller to fill in,    *
+ *               or NULL if out of memory.                                  *
+ *                                                                          *
+ ****************************************************************************/
+void * PILOutRecord(void *pOut, const char *szString, unsigned int *puiString)
+{
+PIL_OUT *pO = (PIL_OUT *)pOut;
+int iStrLen = (int)strlen(szString) + 1;
+int iNeed;
+char *pRecord;
+
+   // the strings are copied behind the records when the block is written
+   iNeed = pO->iLen + pO->iRecordSize + pO->iStringLen + iStrLen + 8;
+   if (iNeed > pO->iSize)
+      {
+      PILOutFlush(pO);
+      iNeed = pO->iLen + pO->iRecordSize + iStrLen + 8;
+      if (iNeed > pO->iSize && !OutGrow(pO, iNeed))
+         return NULL;
+      }
+   memcpy(&pO->pStrings[pO->iStringLen], szString, iStrLen);
+   *puiString = (unsigned int)pO->iStringLen;
+   pO->iStringLen += iStrLen;
+   pRecord = &pO->pBuf[pO->iLen];
+   memset(pRecord, 0, pO->iRecordSize);
+   pO->iLen += pO->iRecordSize;
+   pO->iRecords++;
+   return pRecord;
+} /* PILOutRecord() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILOutFlush(void *)                                        *
+ *                                                                          *
+ *  PURPOSE    : Write out the buffered text or the current block.          *
+ *                                                                          *
+ *  RETURNS    : 0 if successful, -1 if the output couldn't be written.     *
+ *                                                                          *
+ ****************************************************************************/
+int PILOutFlush(void *pOut)
+{
+PIL_OUT *pO = (PIL_OUT *)pOut;
+PIL_OUT_BLOCK *pBlock;
+int rc = 0;
+
+   if (pO->iRecordSize == 0)
+      {
+      if (pO->iLen)
+         rc = OutWrite(pO, pO->pBuf, pO->iLen);
+      pO->iLen = 0;
+      return rc;
+      }
+   if (pO->iRecords)
+      {
+      while (pO->iStringLen & 7) // keep the next block aligned
+         pO->pStrings[pO->iStringLen++] = '\0';
+      pBlock = (PIL_OUT_BLOCK *)pO->pBuf;
+      memcpy(pBlock->szMagic, PIL_OUT_MAGIC, 4);
+      pBlock->uiRecordSize = (unsigned int)pO->iRecordSize;
+      pBlock->uiRecords = (unsigned int)pO->iRecords;
+      pBlock->uiStringLen = (unsigned int)pO->iStringLen;
+      memcpy(&pO->pBuf[pO->iLen], pO->pStrings, pO->iStringLen);
+      rc = OutWrite(pO, pO->pBuf, pO->iLen + pO->iStringLen);
+      }
+   pO->iLen = sizeof(PIL_OUT_BLOCK);
+   pO->iRecords = 0;
+   pO->iStringLen = 0;
+   return rc;
+} /* PILOutFlush() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILOutClose(void *)                                        *
+ *                                                                          *
+ *  PURPOSE    : Flush a writer and free it. The descriptor stays open.     *
+ *                                                                          *
+ ****************************************************************************/
+void PILOutClose(void *pOut)
+{
+PIL_OUT *pO = (PIL_OUT *)pOut;
+
+   if (pO == NULL)
+      return;
+   if (pO->pBuf)
+      PILOutFlush(pO);
+   free(pO->pBuf);
+   free(pO->pStrings);
+   free(pO);
+} /* PILOutClose() */
@@ -0,0 +1,57 @@
+/************************************************************/
+/*--- Buffered output writer                             ---*/
+/* Copyright (c) 2017 BitBank Software, Inc.                */
+/************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#ifndef _PIL_OUT_H_
+#define _PIL_OUT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Each thread gets its own writer; any number of them can share a file
+// descriptor. A writer's buffer goes out with a single write() call, so
+// the output of different threads is never mixed within a buffer.
+//
+// With iRecordSize = 0 the writer holds text. Otherwise it holds blocks of
+// fixed size records and their strings; every flush writes one block:
+//    PIL_OUT_BLOCK header
+//    uiRecords records of uiRecordSize bytes
+//    uiStringLen bytes of NUL-terminated strings
+// A record refers to a string by its offset in the block's string table.
+typedef struct pil_out_block_tag
+{
+   char szMagic[4];           // PIL_OUT_MAGIC
+   unsigned int uiRecordSize;
+   unsigned int uiRecords;
+   unsigned int uiStringLen;  // a multiple of 8, so blocks stay aligned
+} PIL_OUT_BLOCK;
+
+#define PIL_OUT_MAGIC "PIB1"
+
+extern void * PILOutOpen(int iFD, int iRecordSize);
+// Return room for up to iLen bytes of text; PILOutCommit() the amount used
+extern char * PILOutReserve(void *pOut, int iLen);
+extern void PILOutCommit(void *pOut, int iLen);
+// Return a zeroed record and store szString for it; *puiString is its offset
+extern void * PILOutRecord(void *pOut, const char *szString, unsigned int *puiString);
+extern int PILOutFlush(void *pOut);
+extern void PILOutClose(void *pOut);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // #ifndef _PIL_OUT_H_
@@ -0,0 +1,670 @@
+/****************************************************************************
+ *                                                                          *
+ * MODULE:  PIL_SCAN.C                                                      *
+ *                                                                          *
+ * DESCRIPTION: Multi-threaded directory tree scanner                       *
+ *                                                                          *
+ * FUNCTIONS:                                                               *
+ *            PILScanThreadCount - Number of worker threads to use          *
+ *            PILScanTree - Recursively scan a directory tree               *
+ *            PILScanTreeEx - Same, with hooks to reuse directory contents  *
+ * COMMENTS:                                                                *
+ *            Each worker owns a deque of work items. New items (batches    *
+ *            of file names or a subdirectory) are pushed and popped at     *
+ *            the bottom of the owner's deque; idle workers steal the       *
+ *            oldest item from the top of someone else's deque. Files are   *
+ *            opened relative to their directory's descriptor so the        *
+ *            kernel never walks the full pathname again.                   *
+ ****************************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#include "my_windows.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "pil_io.h"
+#include "pil_scan.h"
+
+#define SCAN_BATCH_SIZE 64     // max file names handed out per work item
+#define SCAN_ITEM_BYTES 4096   // max bytes of names per work item
+#define SCAN_DENTS_SIZE 32768  // directory entry buffer per worker
+#define SCAN_DEQUE_SIZE 256    // initial slots per deque (power of 2)
+#define SCAN_MAX_THREADS 256
+#define SCAN_LIST_SIZE 4096    // initial directory list buffer (see PIL_SCAN_HOOKS)
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+typedef struct pil_scan_dir_tag
+{
+   int iFD;             // open directory, the names in items are relative to it
+   int iRefCount;       // items (plus the enumerating worker) still using it
+   char szPath[1];      // pathname used when reporting files
+} PIL_SCAN_DIR;
+
+typedef struct pil_scan_item_tag
+{
+   PIL_SCAN_DIR *pDir;  // directory the names are relative to (NULL = cwd)
+   BOOL bSubDir;        // TRUE if the name is a directory to descend into
+   int iCount;          // number of NUL-terminated names in szNames
+   int iLen;            // bytes used in szNames
+   char szNames[1];
+} PIL_SCAN_ITEM;
+
+typedef struct pil_scan_deque_tag
+{
+   pthread_mutex_t mutex;
+   PIL_SCAN_ITEM **pItems; // ring buffer of items
+   int iMask;              // ring size - 1
+   int iTop;               // thieves take the oldest item from here
+   int iBottom;            // the owner pushes and pops here
+} PIL_SCAN_DEQUE;
+
+typedef struct pil_scan_state_tag
+{
+   PIL_SCAN_CALLBACK pfnCallback;
+   PIL_SCAN_HOOKS *pHooks; // NULL if not used
+   void *pUser;
+   int iThreads;
+   PIL_SCAN_DEQUE *pDeques;
+   int iPending;           // items queued or being worked on
+   int iQueued;            // items sitting in a deque
+   int iSleepers;          // workers waiting for something to steal
+   BOOL bSkipped;          // work was dropped for lack of memory
+   pthread_mutex_t mutex;  // protects sleeping and waking
+   pthread_cond_t cond;
+} PIL_SCAN_STATE;
+
+typedef struct pil_scan_worker_tag
+{
+   PIL_SCAN_STATE *pState;
+   int iThread;
+   pthread_t tid;
+   PIL_SCAN_DIR *pDir;     // directory being enumerated
+   PIL_SCAN_ITEM *pBatch;  // file names collected so far
+   unsigned char *pList;   // entries of the directory for pfnDirRead
+   int iListLen;
+   int iListMax;
+   unsigned char ucDents[SCAN_DENTS_SIZE];
+} PIL_SCAN_WORKER;
+
+#ifdef __linux__
+struct pil_dirent64
+{
+   uint64_t d_ino;
+   int64_t d_off;
+   unsigned short d_reclen;
+   unsigned char d_type;
+   char d_name[1];
+};
+#endif
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILScanThreadCount(void)                                   *
+ *                                                                          *
+ *  PURPOSE    : Return the default number of worker threads.               *
+ *                                                                          *
+ ****************************************************************************/
+int PILScanThreadCount(void)
+{
+long l;
+
+   l = sysconf(_SC_NPROCESSORS_ONLN);
+   if (l < 1)
+      l = 1;
+   else if (l > SCAN_MAX_THREADS)
+      l = SCAN_MAX_THREADS;
+   return (int)l;
+
+} /* PILScanThreadCount() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ScanDirRelease(PIL_SCAN_DIR *)                             *
+ *                                                                          *
+ *  PURPOSE    : Drop a reference to a directory; close it when unused.     *
+ *                                                                          *
+ ****************************************************************************/
+static void ScanDirRelease(PIL_SCAN_DIR *pDir)
+{
+   if (pDir == NULL)
+      return;
+   if (__atomic_sub_fetch(&pDir->iRefCount, 1, __ATOMIC_ACQ_REL) == 0)
+      {
+      close(pDir->iFD);
+      free(pDir);
+      }
+} /* ScanDirRelease() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ScanItemDone(PIL_SCAN_STATE *)                             *
+ *                                                                          *
+ *  PURPOSE    : Retire an item; wake everyone when it was the last one.    *
+ *                                                                          *
+ ****************************************************************************/
+static void ScanItemDone(PIL_SCAN_STATE *pState)
+{
+   if (__atomic_sub_fetch(&pState->iPending, 1, __ATOMIC_SEQ_CST) == 0)
+      {
+      pthread_mutex_lock(&pState->mutex);
+      pthread_cond_broadcast(&pState->cond);
+      pthread_mutex_unlock(&pState->mutex);
+      }
+} /* ScanItemDone() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ScanPush(PIL_SCAN_STATE *, int, PIL_SCAN_ITEM *)           *
+ *                                                                          *
+ *  PURPOSE    : Add a work item to the bottom of a worker's deque. If the  *
+ *               deque is full and can't grow, the item is dropped and the  *
+ *               scan reported as incomplete.                               *
+ *                                                                          *
+ ****************************************************************************/
+static void ScanPush(PIL_SCAN_STATE *pState, int iThread, PIL_SCAN_ITEM *pItem)
+{
+PIL_SCAN_DEQUE *pDQ = &pState->pDeques[iThread];
+PIL_SCAN_ITEM **pNew;
+int i, iCount;
+
+   __atomic_add_fetch(&pState->iPending, 1, __ATOMIC_SEQ_CST);
+   pthread_mutex_lock(&pDQ->mutex);
+   iCount = pDQ->iBottom - pDQ->iTop;
+   if (iCount > pDQ->iMask) // full, double the ring
+      {
+      pNew = (PIL_SCAN_ITEM **)malloc((pDQ->iMask+1) * 2 * sizeof(PIL_SCAN_ITEM *));
+      if (pNew == NULL)
+         {
+         pthread_mutex_unlock(&pDQ->mutex);
+         __atomic_store_n(&pState->bSkipped, TRUE, __ATOMIC_RELAXED);
+         ScanDirRelease(pItem->pDir);
+         free(pItem);
+         ScanItemDone(pState);
+         return;
+         }
+      for (i=0; i<iCount; i++)
+         pNew[i] = pDQ->pItems[(pDQ->iTop + i) & pDQ->iMask];
+      free(pDQ->pItems);
+      pDQ->pItems = pNew;
+      pDQ->iMask = pDQ->iMask*2 + 1;
+      __atomic_store_n(&pDQ->iTop, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&pDQ->iBottom, iCount, __ATOMIC_RELAXED);
+      }
+   pDQ->pItems[pDQ->iBottom & pDQ->iMask] = pItem;
+   __atomic_store_n(&pDQ->iBottom, pDQ->iBottom + 1, __ATOMIC_RELAXED); // others peek at it unlocked
+   pthread_mutex_unlock(&pDQ->mutex);
+   __atomic_add_fetch(&pState->iQueued, 1, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&pState->iSleepers, __ATOMIC_SEQ_CST))
+      {
+      pthread_mutex_lock(&pState->mutex);
+      pthread_cond_signal(&pState->cond);
+      pthread_mutex_unlock(&pState->mutex);
+      }
+} /* ScanPush() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ScanTake(PIL_SCAN_STATE *, int, BOOL)                      *
+ *                                                                          *
+ *  PURPOSE    : Remove an item from a deque; the newest one for the        *
+ *               owner, the oldest one for a thief.                         *
+ *                                                                          *
+ ****************************************************************************/
+static PIL_SCAN_ITEM * ScanTake(PIL_SCAN_STATE *pState, int iThread, BOOL bSteal)
+{
+PIL_SCAN_DEQUE *pDQ = &pState->pDeques[iThread];
+PIL_SCAN_ITEM *pItem = NULL;
+
+   if (__atomic_load_n(&pDQ->iBottom, __ATOMIC_RELAXED) == __atomic_load_n(&pDQ->iTop, __ATOMIC_RELAXED))
+      return NULL; // quick check to avoid taking the lock of an empty deque
+   pthread_mutex_lock(&pDQ->mutex);
+   if (pDQ->iBottom != pDQ->iTop)
+      {
+      if (bSteal)
+         {
+         pItem = pDQ->pItems[pDQ->iTop & pDQ->iMask];
+         __atomic_store_n(&pDQ->iTop, pDQ->iTop + 1, __ATOMIC_RELAXED);
+         }
+      else
+         {
+         __atomic_store_n(&pDQ->iBottom, pDQ->iBottom - 1, __ATOMIC_RELAXED);
+         pItem = pDQ->pItems[pDQ->iBottom & pDQ->iMask];
+         }
+      }
+   pthread_mutex_unlock(&pDQ->mutex);
+   if (pItem)
+      __atomic_sub_fetch(&pState->iQueued, 1, __ATOMIC_SEQ_CST);
+   return pItem;
+} /* ScanTake() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ScanGetWork(PIL_SCAN_WORKER *)                             *
+ *                                                                          *
+ *  PURPOSE    : Get the next item for a worker; sleep when there is        *
+ *               nothing to steal. Returns NULL when the scan is finished.  *
+ *                                                                          *
+ ****************************************************************************/
+static PIL_SCAN_ITEM * ScanGetWork(PIL_SCAN_WORKER *pWorker)
+{
+PIL_SCAN_STATE *pState = pWorker->pState;
+PIL_SCAN_ITEM *pItem;
+int i;
+BOOL bDone;
+
+   for (;;)
+      {
+      pItem = ScanTake(pState, pWorker->iThread, FALSE);
+      for (i=1; pItem == NULL && i<pState->iThreads; i++)
+         pItem = ScanTake(pState, (pWorker->iThread + i) % pState->iThreads, TRUE);
+      if (pItem)
+         return pItem;
+      pthread_mutex_lock(&pState->mutex);
+      __atomic_add_fetch(&pState->iSleepers, 1, __ATOMIC_SEQ_CST);
+      while (__atomic_load_n(&pState->iQueued, __ATOMIC_SEQ_CST) == 0 && __atomic_load_n(&pState->iPending, __ATOMIC_SEQ_CST) != 0)
+         pthread_cond_wait(&pState->cond, &pState->mutex);
+      __atomic_sub_fetch(&pState->iSleepers, 1, __ATOMIC_SEQ_CST);
+      bDone = (__atomic_load_n(&pState->iPending, __ATOMIC_SEQ_CST) == 0);
+      pthread_mutex_unlock(&pState->mutex);
+      if (bDone)
+         return NULL;
+      }
+} /* ScanGetWork() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ScanNewItem(PIL_SCAN_DIR *, BOOL, int)                     *
+ *                                                                          *
+ *  PURPOSE    : Allocate an empty work item holding a directory reference. *
+ *                                                                          *
+ ****************************************************************************/
+static PIL_SCAN_ITEM * ScanNewItem(PIL_SCAN_DIR *pDir, BOOL bSubDir, int iBytes)
+{
+PIL_SCAN_ITEM *pItem;
+
+   pItem = (PIL_SCAN_ITEM *)malloc(sizeof(PIL_SCAN_ITEM) + iBytes);
+   if (pItem == NULL)
+      return NULL;
+   pItem->pDir = pDir;
+   pItem->bSubDir = bSubDir;
+   pItem->iCount = 0;
+   pItem->iLen = 0;
+   if (pDir)
+      __atomic_add_fetch(&pDir->iRefCount, 1, __ATOMIC_RELAXED);
+   return pItem;
+} /* ScanNewItem() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ScanAddEntry(PIL_SCAN_WORKER *, char *, int)               *
+ *                                                                          *
+ *  PURPOSE    : Queue one directory entry. Files are collected into        *
+ *               batches, each subdirectory becomes its own item.           *
+ *                                                                          *
+ *  RETURNS    : DT_REG or DT_DIR as queued, DT_UNKNOWN if skipped.         *
+ *                                                                          *
+ ****************************************************************************/
+static int ScanAddEntry(PIL_SCAN_WORKER *pWorker, char *szName, int iType)
+{
+PIL_SCAN_DIR *pDir = pWorker->pDir;
+PIL_SCAN_ITEM *pItem;
+struct stat st;
+int iLen;
+
+   if (szName[0] == '.' && (szName[1] == '\0' || (szName[1] == '.' && szName[2] == '\0')))
+      return DT_UNKNOWN;
+   if (iType == DT_UNKNOWN || iType == DT_LNK) // file system didn't say, ask
+      {
+      if (fstatat(pDir->iFD, szName, &st, (iType == DT_LNK) ? 0 : AT_SYMLINK_NOFOLLOW) != 0)
+         return DT_UNKNOWN;
+      if (S_ISREG(st.st_mode))
+         iType = DT_REG;
+      else if (S_ISDIR(st.st_mode) && iType != DT_LNK) // don't follow directory links (loops)
+         iType = DT_DIR;
+      else
+         return DT_UNKNOWN;
+      }
+   iLen = (int)strlen(szName) + 1;
+   if (iType == DT_DIR)
+      {
+      pItem = ScanNewItem(pDir, TRUE, iLen);
+      if (pItem == NULL)
+         {
+         __atomic_store_n(&pWorker->pState->bSkipped, TRUE, __ATOMIC_RELAXED);
+         return DT_UNKNOWN;
+         }
+      memcpy(pItem->szNames, szName, iLen);
+      pItem->iCount = 1;
+      pItem->iLen = iLen;
+      ScanPush(pWorker->pState, pWorker->iThread, pItem);
+      }
+   else if (iType == DT_REG)
+      {
+      pItem = pWorker->pBatch;
+      if (pItem && (pItem->iCount == SCAN_BATCH_SIZE || pItem->iLen + iLen > SCAN_ITEM_BYTES))
+         {
+         ScanPush(pWorker->pState, pWorker->iThread, pItem);
+         pItem = NULL;
+         }
+      if (pItem == NULL)
+         {
+         pItem = ScanNewItem(pDir, FALSE, SCAN_ITEM_BYTES);
+         if (pItem == NULL)
+            {
+            __atomic_store_n(&pWorker->pState->bSkipped, TRUE, __ATOMIC_RELAXED);
+            return DT_UNKNOWN;
+            }
+         }
+      memcpy(&pItem->szNames[pItem->iLen], szName, iLen);
+      pItem->iLen += iLen;
+      pItem->iCount++;
+      pWorker->pBatch = pItem;
+      }
+   else
+      return DT_UNKNOWN;
+   return iType;
+} /* ScanAddEntry() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ScanAddListEntry(PIL_SCAN_WORKER *, char *, int)           *
+ *                                                                          *
+ *  PURPOSE    : Queue a directory entry and remember it for pfnDirRead.    *
+ *                                                                          *
+ ****************************************************************************/
+static void ScanAddListEntry(PIL_SCAN_WORKER *pWorker, char *szName, int iType)
+{
+unsigned char *p;
+int iLen;
+
+   iType = ScanAddEntry(pWorker, szName, iType);
+   if (iType == DT_UNKNOWN || pWorker->pList == NULL)
+      return;
+   iLen = (int)strlen(szName) + 2;
+   if (pWorker->iListLen + iLen > pWorker->iListMax)
+      {
+      p = (unsigned char *)realloc(pWorker->pList, (pWorker->iListMax + iLen) * 2);
+      if (p == NULL)
+         {
+         free(pWorker->pList); // give up on the list, the scan carries on
+         pWorker->pList = NULL;
+         return;
+         }
+      pWorker->pList = p;
+      pWorker->iListMax = (pWorker->iListMax + iLen) * 2;
+      }
+   pWorker->pList[pWorker->iListLen] = (unsigned char)iType;
+   memcpy(&pWorker->pList[pWorker->iListLen + 1], szName, iLen - 1);
+   pWorker->iListLen += iLen;
+} /* ScanAddListEntry() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ScanDirectory(PIL_SCAN_WORKER *, PIL_SCAN_ITEM *)          *
+ *                                                                          *
+ *  PURPOSE    : Open a directory and queue its contents.                   *
+ *                                                                          *
+ ****************************************************************************/
+static void ScanDirectory(PIL_SCAN_WORKER *pWorker, PIL_SCAN_ITEM *pItem)
+{
+PIL_SCAN_HOOKS *pHooks = pWorker->pState->pHooks;
+PIL_SCAN_DIR *pDir;
+struct stat st;
+unsigned char *pList = NULL;
+char *szParent;
+int fd, iLen, iParentLen, iListLen;
+BOOL bComplete; // the whole directory was read
+#ifdef __linux__
+struct pil_dirent64 *pEnt;
+long lBytes, lOff;
+#else
+DIR *pDirStream;
+struct dirent *pEnt;
+#endif
+
+   szParent = pItem->pDir ? pItem->pDir->szPath : "";
+   iParentLen = (int)strlen(szParent);
+   iLen = iParentLen + 1 + (int)strlen(pItem->szNames);
+   pDir = (PIL_SCAN_DIR *)malloc(sizeof(PIL_SCAN_DIR) + iLen);
+   if (pDir == NULL)
+      {
+      __atomic_store_n(&pWorker->pState->bSkipped, TRUE, __ATOMIC_RELAXED);
+      return;
+      }
+   if (iParentLen == 0)
+      strcpy(pDir->szPath, pItem->szNames);
+   else if (szParent[iParentLen-1] == '/') // parent is the root directory
+      sprintf(pDir->szPath, "%s%s", szParent, pItem->szNames);
+   else
+      sprintf(pDir->szPath, "%s/%s", szParent, pItem->szNames);
+   fd = openat(pItem->pDir ? pItem->pDir->iFD : AT_FDCWD, pItem->szNames, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (fd < 0) // let the caller report it with the files
+      {
+      (*pWorker->pState->pfnCallback)(pWorker->pState->pUser, pWorker->iThread, -1, pDir->szPath, "");
+      free(pDir);
+      return;
+      }
+   pDir->iFD = fd;
+   pDir->iRefCount = 1; // our own reference while enumerating
+   pWorker->pDir = pDir;
+   pWorker->pBatch = NULL;
+   if (pHooks && fstat(fd, &st) != 0)
+      pHooks = NULL;
+   if (pHooks && pHooks->pfnDirList)
+      pList = (*pHooks->pfnDirList)(pWorker->pState->pUser, &st, pDir->szPath, &iListLen);
+   if (pList) // the caller knows what's in it
+      {
+      for (iLen = 0; iLen < iListLen; iLen += (int)strlen((char *)&pList[iLen+1]) + 2)
+         ScanAddEntry(pWorker, (char *)&pList[iLen+1], pList[iLen]);
+      goto scan_done;
+      }
+   if (pHooks && pHooks->pfnDirRead && pWorker->pList == NULL)
+      {
+      pWorker->pList = (unsigned char *)malloc(SCAN_LIST_SIZE);
+      pWorker->iListMax = (pWorker->pList) ? SCAN_LIST_SIZE : 0;
+      }
+   pWorker->iListLen = 0;
+#ifdef __linux__
+   // getdents64 directly, it returns many entries per call without the
+   // extra copy and allocation done by readdir()
+   while ((lBytes = syscall(SYS_getdents64, fd, pWorker->ucDents, SCAN_DENTS_SIZE)) > 0)
+      {
+      for (lOff = 0; lOff < lBytes; lOff += pEnt->d_reclen)
+         {
+         pEnt = (struct pil_dirent64 *)&pWorker->ucDents[lOff];
+         ScanAddListEntry(pWorker, pEnt->d_name, pEnt->d_type);
+         }
+      }
+   bComplete = (lBytes == 0);
+#else
+   pDirStream = fdopendir(dup(fd));
+   bComplete = (pDirStream != NULL);
+   if (pDirStream)
+      {
+      while ((pEnt = readdir(pDirStream)) != NULL)
+         ScanAddListEntry(pWorker, pEnt->d_name, pEnt->d_type);
+      closedir(pDirStream);
+      }
+#endif
+   if (pHooks && pHooks->pfnDirRead && pWorker->pList && bComplete)
+      (*pHooks->pfnDirRead)(pWorker->pState->pUser, &st, pDir->szPath, pWorker->pList, pWorker->iListLen);
+scan_done:
+   if (pWorker->pBatch)
+      ScanPush(pWorker->pState, pWorker->iThread, pWorker->pBatch);
+   pWorker->pBatch = NULL;
+   pWorker->pDir = NULL;
+   ScanDirRelease(pDir);
+
+} /* ScanDirectory() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ScanWorker(void *)                                         *
+ *                                                                          *
+ *  PURPOSE    : Thread procedure; run work items until the scan is done.   *
+ *                                                                          *
+ ****************************************************************************/
+static void * ScanWorker(void *pArg)
+{
+PIL_SCAN_WORKER *pWorker = (PIL_SCAN_WORKER *)pArg;
+PIL_SCAN_STATE *pState = pWorker->pState;
+PIL_SCAN_ITEM *pItem;
+char *szName;
+int i;
+
+   while ((pItem = ScanGetWork(pWorker)) != NULL)
+      {
+      if (pItem->bSubDir)
+         ScanDirectory(pWorker, pItem);
+      else
+         {
+         szName = pItem->szNames;
+         for (i=0; i<pItem->iCount; i++)
+            {
+            (*pState->pfnCallback)(pState->pUser, pWorker->iThread, pItem->pDir->iFD, pItem->pDir->szPath, szName);
+            szName += strlen(szName) + 1;
+            }
+         }
+      ScanDirRelease(pItem->pDir);
+      free(pItem);
+      ScanItemDone(pState);
+      }
+   PILIOThreadDone(); // the callback's handles and scratch memory
+   return NULL;
+} /* ScanWorker() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILScanTree(char *, int, PIL_SCAN_CALLBACK, void *)        *
+ *                                                                          *
+ *  PURPOSE    : Recursively visit every regular file below a directory     *
+ *               using a pool of work-stealing threads.                     *
+ *                                                                          *
+ *  PARAMETERS : root directory, number of threads (0 = one per CPU),       *
+ *               callback for each file, user pointer for the callback      *
+ *                                                                          *
+ *  RETURNS    : 0 if successful, 1 if directories or files were skipped    *
+ *               for lack of memory, -1 if the scan could not be started.   *
+ *                                                                          *
+ ****************************************************************************/
+int PILScanTree(char *szRoot, int iThreads, PIL_SCAN_CALLBACK pfnCallback, void *pUser)
+{
+   return PILScanTreeEx(szRoot, iThreads, pfnCallback, NULL, pUser);
+} /* PILScanTree() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILScanTreeEx(char *, int, PIL_SCAN_CALLBACK,              *
+ *                             PIL_SCAN_HOOKS *, void *)                    *
+ *                                                                          *
+ *  PURPOSE    : Same as PILScanTree() with optional hooks which can supply *
+ *               the contents of directories instead of reading them.       *
+ *                                                                          *
+ ****************************************************************************/
+int PILScanTreeEx(char *szRoot, int iThreads, PIL_SCAN_CALLBACK pfnCallback, PIL_SCAN_HOOKS *pHooks, void *pUser)
+{
+PIL_SCAN_STATE state;
+PIL_SCAN_WORKER *pWorkers;
+PIL_SCAN_ITEM *pItem;
+struct stat st;
+int i, iLen, iStarted, rc = -1;
+
+   if (stat(szRoot, &st) != 0 || !S_ISDIR(st.st_mode))
+      return -1;
+   if (iThreads <= 0)
+      iThreads = PILScanThreadCount();
+   if (iThreads > SCAN_MAX_THREADS)
+      iThreads = SCAN_MAX_THREADS;
+   memset(&state, 0, sizeof(state));
+   state.pfnCallback = pfnCallback;
+   state.pHooks = pHooks;
+   state.pUser = pUser;
+   state.iThreads = iThreads;
+   pthread_mutex_init(&state.mutex, NULL);
+   pthread_cond_init(&state.cond, NULL);
+   state.pDeques = (PIL_SCAN_DEQUE *)calloc(iThreads, sizeof(PIL_SCAN_DEQUE));
+   pWorkers = (PIL_SCAN_WORKER *)calloc(iThreads, sizeof(PIL_SCAN_WORKER));
+   if (state.pDeques == NULL || pWorkers == NULL)
+      {
+      free(state.pDeques);
+      free(pWorkers);
+      return -1;
+      }
+   for (i=0; i<iThreads; i++)
+      {
+      pthread_mutex_init(&state.pDeques[i].mutex, NULL);
+      state.pDeques[i].pItems = (PIL_SCAN_ITEM **)malloc(SCAN_DEQUE_SIZE * sizeof(PIL_SCAN_ITEM *));
+      state.pDeques[i].iMask = SCAN_DEQUE_SIZE - 1;
+      pWorkers[i].pState = &state;
+      pWorkers[i].iThread = i;
+      }
+   for (i=0; i<iThreads; i++)
+      {
+      if (state.pDeques[i].pItems == NULL)
+         goto scan_exit;
+      }
+   // Seed worker 0 with the root directory (trailing slashes removed)
+   iLen = (int)strlen(szRoot);
+   while (iLen > 1 && szRoot[iLen-1] == '/')
+      iLen--;
+   pItem = ScanNewItem(NULL, TRUE, iLen + 1);
+   if (pItem == NULL)
+      goto scan_exit;
+   memcpy(pItem->szNames, szRoot, iLen);
+   pItem->szNames[iLen] = '\0';
+   pItem->iCount = 1;
+   pItem->iLen = iLen + 1;
+   ScanPush(&state, 0, pItem);
+
+   // Run with the threads which could be started (e.g. RLIMIT_NPROC);
+   // the deques of the others stay empty
+   for (iStarted=1; iStarted<iThreads; iStarted++)
+      {
+      if (pthread_create(&pWorkers[iStarted].tid, NULL, ScanWorker, &pWorkers[iStarted]) != 0)
+         break;
+      }
+   ScanWorker(&pWorkers[0]); // the calling thread is worker 0
+   for (i=1; i<iStarted; i++)
+      pthread_join(pWorkers[i].tid, NULL);
+   rc = state.bSkipped ? 1 : 0;
+
+scan_exit:
+   for (i=0; i<iThreads; i++)
+      {
+      pthread_mutex_destroy(&state.pDeques[i].mutex);
+      free(state.pDeques[i].pItems);
+      free(pWorkers[i].pList);
+      }
+   free(state.pDeques);
+   free(pWorkers);
+   pthread_cond_destroy(&state.cond);
+   pthread_mutex_destroy(&state.mutex);
+   return rc;
+
+} /* PILScanTreeEx() */
@@ -0,0 +1,55 @@
+/************************************************************/
+/*--- Multi-threaded directory tree scanner               ---*/
+/* Copyright (c) 2017 BitBank Software, Inc.                */
+/************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#ifndef _PIL_SCAN_H_
+#define _PIL_SCAN_H_
+
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Called once for every regular file found. iThread is the index (0..n-1)
+// of the worker making the call, iDirFD is an open descriptor of the
+// directory holding the file (valid only for the duration of the call)
+// and szDir is that directory's pathname without a trailing slash. A
+// directory which can't be opened is passed with an iDirFD of -1, its own
+// pathname in szDir and an empty szName.
+typedef void (*PIL_SCAN_CALLBACK)(void *pUser, int iThread, int iDirFD, char *szDir, char *szName);
+
+// Optional hooks which let a caller supply the contents of a directory it
+// has seen before instead of reading it again. A directory list is a
+// sequence of entries made of a type byte (DT_REG or DT_DIR) followed by
+// a NUL-terminated name. pst is the directory's fstat() taken before it
+// was read.
+typedef struct pil_scan_hooks_tag
+{
+   // Return the list to use for the directory or NULL to read it
+   unsigned char * (*pfnDirList)(void *pUser, struct stat *pst, char *szDir, int *piLen);
+   // Called with the list of a directory which was read
+   void (*pfnDirRead)(void *pUser, struct stat *pst, char *szDir, unsigned char *pList, int iLen);
+} PIL_SCAN_HOOKS;
+
+extern int PILScanThreadCount(void);
+extern int PILScanTree(char *szRoot, int iThreads, PIL_SCAN_CALLBACK pfnCallback, void *pUser);
+extern int PILScanTreeEx(char *szRoot, int iThreads, PIL_SCAN_CALLBACK pfnCallback, PIL_SCAN_HOOKS *pHooks, void *pUser);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // #ifndef _PIL_SCAN_H_
@@ -0,0 +1,809 @@
+/****************************************************************************
+ *                                                                          *
+ * MODULE:  PIL_SERVE.C                                                     *
+ *                                                                          *
+ * DESCRIPTION: Probe server on a Unix domain socket                        *
+ *                                                                          *
+ * FUNCTIONS:                                                               *
+ *            PILServe - Answer requests until SIGINT or SIGTERM            *
+ * COMMENTS:                                                                *
+ *            One thread owns the sockets and waits on them with epoll; it  *
+ *            reads the requests, queues them and sends the replies. A      *
+ *            pool of workers runs the callback. Connections with work      *
+ *            waiting take turns, and one connection only gets half of the  *
+ *            workers at a time, so a client whose files are slow to open   *
+ *            (a stalled network mount) can't hold up the others. A client  *
+ *            which sends more than SERVE_MAX_PENDING requests ahead, or    *
+ *            doesn't read its replies, is not read from until it catches   *
+ *            up; the socket buffer then pushes back on it.                 *
+ ****************************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // accept4()
+#endif
+#include "my_windows.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "pil_io.h"
+#include "pil_serve.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#define SERVE_IN_SIZE 65536      // request bytes buffered per connection
+#define SERVE_MAX_FDS 16         // descriptors taken with each recvmsg()
+#define SERVE_FD_QUEUE 64        // descriptors received ahead of their requests
+#define SERVE_MAX_PENDING 256    // unanswered requests before reading stops
+#define SERVE_MAX_OUT 0x100000   // unsent reply bytes before reading stops
+#define SERVE_MAX_EVENTS 64
+#define SERVE_MAX_THREADS 256
+
+typedef struct pil_serve_job_tag
+{
+   struct pil_serve_job_tag *pNext;
+   uint32_t uiID;
+   int iFD;                // descriptor sent with the request, or -1
+   char szPath[1];         // empty for a descriptor
+} PIL_SERVE_JOB;
+
+typedef struct pil_serve_conn_tag
+{
+   int iSock;
+   unsigned int uiEvents;  // what epoll is watching for
+   // Only used by the epoll thread
+   unsigned char *pIn;     // SERVE_IN_SIZE bytes of requests
+   int iInLen;
+   int iFDs[SERVE_FD_QUEUE]; // descriptors waiting for their requests
+   int iFDCount;
+   BOOL bEOF;              // the client won't send any more
+   BOOL bClosed;           // freed after this round of events
+   struct pil_serve_conn_tag *pPrev, *pNext; // all connections
+   // Protected by the server's mutex
+   BOOL bDead;             // the connection failed, replies are dropped
+   PIL_SERVE_JOB *pHead, *pTail; // waiting for a worker
+   int iPending;           // requests not answered yet (waiting or running)
+   int iBusy;              // running
+   BOOL bReady;            // on the ready list
+   BOOL bDirty;            // on the dirty list
+   struct pil_serve_conn_tag *pNextReady;
+   struct pil_serve_conn_tag *pNextDirty;
+   unsigned char *pOut;    // replies not sent yet
+   int iOutLen;
+   int iOutMax;
+} PIL_SERVE_CONN;
+
+typedef struct pil_serve_state_tag
+{
+   PIL_SERVE_CALLBACK pfnCallback;
+   void *pUser;
+   int iResultSize;
+   int iBusyMax;           // workers one connection can have at once
+   int iEpollFD;
+   int iListenFD;
+   int iWakeFD;            // eventfd, written when there are replies to send
+   int iSignalFD;
+   PIL_SERVE_CONN *pConns; // all open connections
+   PIL_SERVE_CONN *pClosed; // closed this round, to be freed
+   pthread_mutex_t mutex;  // protects everything below
+   pthread_cond_t cond;    // workers wait here for work
+   BOOL bStop;
+   PIL_SERVE_CONN *pReadyHead, *pReadyTail; // connections with work, in turn
+   PIL_SERVE_CONN *pDirty; // connections with new replies
+} PIL_SERVE_STATE;
+
+typedef struct pil_serve_worker_tag
+{
+   PIL_SERVE_STATE *pState;
+   int iThread;
+   pthread_t tid;
+} PIL_SERVE_WORKER;
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeReady(PIL_SERVE_STATE *, PIL_SERVE_CONN *)            *
+ *                                                                          *
+ *  PURPOSE    : Put a connection at the back of the ready list if it has   *
+ *               work waiting and may use another worker. Call with the     *
+ *               mutex held.                                                *
+ *                                                                          *
+ ****************************************************************************/
+static void ServeReady(PIL_SERVE_STATE *pState, PIL_SERVE_CONN *pConn)
+{
+   if (pConn->bReady || pConn->pHead == NULL || pConn->iBusy >= pState->iBusyMax)
+      return;
+   pConn->bReady = TRUE;
+   pConn->pNextReady = NULL;
+   if (pState->pReadyTail != NULL)
+      pState->pReadyTail->pNextReady = pConn;
+   else
+      pState->pReadyHead = pConn;
+   pState->pReadyTail = pConn;
+   pthread_cond_signal(&pState->cond);
+} /* ServeReady() */
+
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeUnready(PIL_SERVE_STATE *, PIL_SERVE_CONN *)          *
+ *                                                                          *
+ *  PURPOSE    : Take a connection off the ready list. Call with the mutex  *
+ *               held.                                                      *
+ *                                                                          *
+ ****************************************************************************/
+static void ServeUnready(PIL_SERVE_STATE *pState, PIL_SERVE_CONN *pConn)
+{
+PIL_SERVE_CONN *pPrev = NULL, *p;
+
+   if (!pConn->bReady)
+      return;
+   for (p = pState->pReadyHead; p != pConn; p = p->pNextReady)
+      pPrev = p;
+   if (pPrev == NULL)
+      pState->pReadyHead = pConn->pNextReady;
+   else
+      pPrev->pNextReady = pConn->pNextReady;
+   if (pState->pReadyTail == pConn)
+      pState->pReadyTail = pPrev;
+   pConn->bReady = FALSE;
+} /* ServeUnready() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeCancel(PIL_SERVE_STATE *, PIL_SERVE_CONN *)           *
+ *                                                                          *
+ *  PURPOSE    : Drop the waiting requests and the unsent replies of a      *
+ *               connection which failed. Call with the mutex held.         *
+ *                                                                          *
+ ****************************************************************************/
+static void ServeCancel(PIL_SERVE_STATE *pState, PIL_SERVE_CONN *pConn)
+{
+PIL_SERVE_JOB *pJob;
+
+   ServeUnready(pState, pConn);
+   while ((pJob = pConn->pHead) != NULL)
+      {
+      pConn->pHead = pJob->pNext;
+      if (pJob->iFD >= 0)
+         close(pJob->iFD);
+      free(pJob);
+      pConn->iPending--;
+      }
+   pConn->pTail = NULL;
+   pConn->iOutLen = 0;
+} /* ServeCancel() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeFail(PIL_SERVE_STATE *, PIL_SERVE_CONN *)             *
+ *                                                                          *
+ *  PURPOSE    : Mark a connection as failed; it is closed once the         *
+ *               requests running for it have finished.                     *
+ *                                                                          *
+ ****************************************************************************/
+static void ServeFail(PIL_SERVE_STATE *pState, PIL_SERVE_CONN *pConn)
+{
+   pthread_mutex_lock(&pState->mutex);
+   pConn->bDead = TRUE;
+   pthread_mutex_unlock(&pState->mutex);
+} /* ServeFail() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeReply(PIL_SERVE_CONN *, unsigned char *, int)         *
+ *                                                                          *
+ *  PURPOSE    : Add a reply to the ones waiting to be sent. Call with the  *
+ *               mutex held.                                                *
+ *                                                                          *
+ ****************************************************************************/
+static void ServeReply(PIL_SERVE_CONN *pConn, unsigned char *pData, int iLen)
+{
+unsigned char *p;
+int iMax;
+
+   if (pConn->iOutLen + iLen > pConn->iOutMax)
+      {
+      iMax = (pConn->iOutLen + iLen) * 2;
+      p = (unsigned char *)realloc(pConn->pOut, iMax);
+      if (p == NULL)
+         {
+         pConn->bDead = TRUE; // the client would wait forever
+         return;
+         }
+      pConn->pOut = p;
+      pConn->iOutMax = iMax;
+      }
+   memcpy(&pConn->pOut[pConn->iOutLen], pData, iLen);
+   pConn->iOutLen += iLen;
+} /* ServeReply() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeWorker(void *)                                        *
+ *                                                                          *
+ *  PURPOSE    : Thread procedure; take requests from the connections in    *
+ *               turn, run the callback and queue the reply, until the      *
+ *               server stops.                                              *
+ *                                                                          *
+ ****************************************************************************/
+static void * ServeWorker(void *pArg)
+{
+PIL_SERVE_WORKER *pWorker = (PIL_SERVE_WORKER *)pArg;
+PIL_SERVE_STATE *pState = pWorker->pState;
+PIL_SERVE_CONN *pConn;
+PIL_SERVE_JOB *pJob;
+PIL_SERVE_REPLY *pReply;
+unsigned char *pBuf;
+uint64_t ullOne = 1;
+int iLen = (int)sizeof(PIL_SERVE_REPLY) + pState->iResultSize;
+BOOL bWake;
+
+   pBuf = (unsigned char *)malloc(iLen);
+   if (pBuf == NULL)
+      return NULL; // the others will do the work
+   pReply = (PIL_SERVE_REPLY *)pBuf;
+   pthread_mutex_lock(&pState->mutex);
+   for (;;)
+      {
+      while (!pState->bStop && pState->pReadyHead == NULL)
+         pthread_cond_wait(&pState->cond, &pState->mutex);
+      if (pState->bStop)
+         break;
+      pConn = pState->pReadyHead;
+      ServeUnready(pState, pConn);
+      pJob = pConn->pHead;
+      pConn->pHead = pJob->pNext;
+      if (pConn->pHead == NULL)
+         pConn->pTail = NULL;
+      pConn->iBusy++;
+      ServeReady(pState, pConn); // to the back of the line if it has more
+      pthread_mutex_unlock(&pState->mutex);
+
+      memset(pBuf, 0, iLen);
+      pReply->uiLen = (uint32_t)pState->iResultSize;
+      pReply->uiID = pJob->uiID;
+      (*pState->pfnCallback)(pState->pUser, pWorker->iThread, pJob->szPath[0] ? pJob->szPath : NULL, pJob->iFD, &pReply[1]);
+      if (pJob->iFD >= 0)
+         close(pJob->iFD);
+      free(pJob);
+
+      pthread_mutex_lock(&pState->mutex);
+      pConn->iBusy--;
+      pConn->iPending--;
+      if (!pConn->bDead)
+         ServeReply(pConn, pBuf, iLen);
+      ServeReady(pState, pConn);
+      if (!pConn->bDirty) // let the epoll thread know
+         {
+         bWake = (pState->pDirty == NULL); // otherwise it hasn't got to the list yet
+         pConn->bDirty = TRUE;
+         pConn->pNextDirty = pState->pDirty;
+         pState->pDirty = pConn;
+         while (bWake && write(pState->iWakeFD, &ullOne, sizeof(ullOne)) < 0 && errno == EINTR)
+            ;
+         }
+      }
+   pthread_mutex_unlock(&pState->mutex);
+   free(pBuf);
+   PILIOThreadDone();
+   return NULL;
+} /* ServeWorker() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeParse(PIL_SERVE_STATE *, PIL_SERVE_CONN *)            *
+ *                                                                          *
+ *  PURPOSE    : Queue the complete requests in a connection's buffer, up   *
+ *               to SERVE_MAX_PENDING unanswered; the rest wait there.      *
+ *               Requests without a pathname take the oldest descriptor     *
+ *               received.                                                  *
+ *                                                                          *
+ ****************************************************************************/
+static void ServeParse(PIL_SERVE_STATE *pState, PIL_SERVE_CONN *pConn)
+{
+PIL_SERVE_REQUEST req;
+PIL_SERVE_JOB *pJob;
+unsigned char *p = pConn->pIn;
+int iLeft = pConn->iInLen;
+BOOL bFull;
+
+   while (iLeft >= (int)sizeof(req))
+      {
+      memcpy(&req, p, sizeof(req));
+      if (req.uiPathLen > PIL_SERVE_MAX_PATH)
+         {
+         ServeFail(pState, pConn); // not speaking our protocol
+         break;
+         }
+      if (iLeft < (int)(sizeof(req) + req.uiPathLen))
+         break; // the rest hasn't arrived yet
+      pthread_mutex_lock(&pState->mutex);
+      bFull = pConn->bDead || pConn->iPending >= SERVE_MAX_PENDING;
+      pthread_mutex_unlock(&pState->mutex);
+      if (bFull)
+         break;
+      pJob = (PIL_SERVE_JOB *)malloc(sizeof(PIL_SERVE_JOB) + req.uiPathLen);
+      if (pJob == NULL)
+         {
+         ServeFail(pState, pConn);
+         break;
+         }
+      pJob->pNext = NULL;
+      pJob->uiID = req.uiID;
+      pJob->iFD = -1;
+      memcpy(pJob->szPath, &p[sizeof(req)], req.uiPathLen);
+      pJob->szPath[req.uiPathLen] = '\0';
+      if (req.uiPathLen == 0 && pConn->iFDCount > 0)
+         {
+         pJob->iFD = pConn->iFDs[0];
+         pConn->iFDCount--;
+         memmove(&pConn->iFDs[0], &pConn->iFDs[1], pConn->iFDCount * sizeof(int));
+         }
+      pthread_mutex_lock(&pState->mutex);
+      if (pConn->pTail != NULL)
+         pConn->pTail->pNext = pJob;
+      else
+         pConn->pHead = pJob;
+      pConn->pTail = pJob;
+      pConn->iPending++;
+      ServeReady(pState, pConn);
+      pthread_mutex_unlock(&pState->mutex);
+      p += sizeof(req) + req.uiPathLen;
+      iLeft -= (int)sizeof(req) + req.uiPathLen;
+      }
+   if (p != pConn->pIn)
+      memmove(pConn->pIn, p, iLeft);
+   pConn->iInLen = iLeft;
+} /* ServeParse() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeRead(PIL_SERVE_STATE *, PIL_SERVE_CONN *)             *
+ *                                                                          *
+ *  PURPOSE    : Read what a client has sent (requests and descriptors)     *
+ *               into the connection's buffer.                              *
+ *                                                                          *
+ ****************************************************************************/
+static void ServeRead(PIL_SERVE_STATE *pState, PIL_SERVE_CONN *pConn)
+{
+struct msghdr msg;
+struct iovec iov;
+struct cmsghdr *pCmsg;
+union
+   {
+   struct cmsghdr align;
+   char c[CMSG_SPACE(SERVE_MAX_FDS * sizeof(int))];
+   } ctl;
+ssize_t iLen;
+int i, iCount, iFD;
+BOOL bLost = FALSE;
+
+   if (pConn->iInLen >= SERVE_IN_SIZE)
+      return;
+   iov.iov_base = &pConn->pIn[pConn->iInLen];
+   iov.iov_len = SERVE_IN_SIZE - pConn->iInLen;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = ctl.c;
+   msg.msg_controllen = sizeof(ctl.c);
+   iLen = recvmsg(pConn->iSock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+   if (iLen < 0)
+      {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+         ServeFail(pState, pConn);
+      return;
+      }
+   for (pCmsg = CMSG_FIRSTHDR(&msg); pCmsg != NULL; pCmsg = CMSG_NXTHDR(&msg, pCmsg))
+      {
+      if (pCmsg->cmsg_level != SOL_SOCKET || pCmsg->cmsg_type != SCM_RIGHTS)
+         continue;
+      iCount = (int)((pCmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+      for (i=0; i<iCount; i++)
+         {
+         memcpy(&iFD, CMSG_DATA(pCmsg) + i * sizeof(int), sizeof(int));
+         if (pConn->iFDCount < SERVE_FD_QUEUE)
+            pConn->iFDs[pConn->iFDCount++] = iFD;
+         else
+            {
+            close(iFD);
+            bLost = TRUE;
+            }
+         }
+      }
+   // A lost descriptor would shift every later request onto the wrong
+   // file, so the connection is dropped instead
+   if (bLost || (msg.msg_flags & MSG_CTRUNC))
+      ServeFail(pState, pConn);
+   if (iLen == 0)
+      pConn->bEOF = TRUE;
+   else
+      pConn->iInLen += (int)iLen;
+} /* ServeRead() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeClose(PIL_SERVE_STATE *, PIL_SERVE_CONN *)            *
+ *                                                                          *
+ *  PURPOSE    : Close a connection which has nothing left to do. It is     *
+ *               freed after the current round of events.                   *
+ *                                                                          *
+ ****************************************************************************/
+static void ServeClose(PIL_SERVE_STATE *pState, PIL_SERVE_CONN *pConn)
+{
+PIL_SERVE_CONN *pPrev = NULL, *p;
+
+   epoll_ctl(pState->iEpollFD, EPOLL_CTL_DEL, pConn->iSock, NULL);
+   close(pConn->iSock);
+   while (pConn->iFDCount > 0)
+      close(pConn->iFDs[--pConn->iFDCount]);
+   pthread_mutex_lock(&pState->mutex);
+   if (pConn->bDirty) // a last reply was dropped
+      {
+      for (p = pState->pDirty; p != pConn; p = p->pNextDirty)
+         pPrev = p;
+      if (pPrev == NULL)
+         pState->pDirty = pConn->pNextDirty;
+      else
+         pPrev->pNextDirty = pConn->pNextDirty;
+      pConn->bDirty = FALSE;
+      }
+   pthread_mutex_unlock(&pState->mutex);
+   if (pConn->pPrev != NULL)
+      pConn->pPrev->pNext = pConn->pNext;
+   else
+      pState->pConns = pConn->pNext;
+   if (pConn->pNext != NULL)
+      pConn->pNext->pPrev = pConn->pPrev;
+   pConn->bClosed = TRUE;
+   pConn->pNext = pState->pClosed;
+   pState->pClosed = pConn;
+} /* ServeClose() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeUpdate(PIL_SERVE_STATE *, PIL_SERVE_CONN *)           *
+ *                                                                          *
+ *  PURPOSE    : Queue any requests held back, send what replies the        *
+ *               socket takes, then decide what to wait for: more requests  *
+ *               unless the client is too far ahead, room to send if        *
+ *               replies are left over. Close the connection when done.     *
+ *                                                                          *
+ ****************************************************************************/
+static void ServeUpdate(PIL_SERVE_STATE *pState, PIL_SERVE_CONN *pConn)
+{
+struct epoll_event ev;
+unsigned int uiEvents = 0;
+ssize_t iLen;
+BOOL bDone;
+
+   if (pConn->bClosed)
+      return;
+   ServeParse(pState, pConn);
+   pthread_mutex_lock(&pState->mutex);
+   while (!pConn->bDead && pConn->iOutLen > 0)
+      {
+      iLen = send(pConn->iSock, pConn->pOut, pConn->iOutLen, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (iLen < 0)
+         {
+         if (errno == EINTR)
+            continue;
+         if (errno != EAGAIN && errno != EWOULDBLOCK)
+            pConn->bDead = TRUE;
+         break; // socket buffer is full
+         }
+      memmove(pConn->pOut, &pConn->pOut[iLen], pConn->iOutLen - iLen);
+      pConn->iOutLen -= (int)iLen;
+      }
+   if (pConn->bDead)
+      ServeCancel(pState, pConn);
+   else
+      {
+      if (!pConn->bEOF && pConn->iPending < SERVE_MAX_PENDING && pConn->iOutLen < SERVE_MAX_OUT && pConn->iInLen < SERVE_IN_SIZE)
+         uiEvents |= EPOLLIN;
+      if (pConn->iOutLen > 0)
+         uiEvents |= EPOLLOUT;
+      }
+   bDone = pConn->iPending == 0 && (pConn->bDead || (pConn->bEOF && pConn->iOutLen == 0));
+   pthread_mutex_unlock(&pState->mutex);
+   if (bDone)
+      ServeClose(pState, pConn);
+   else if (uiEvents != pConn->uiEvents)
+      {
+      ev.events = uiEvents;
+      ev.data.ptr = pConn;
+      epoll_ctl(pState->iEpollFD, EPOLL_CTL_MOD, pConn->iSock, &ev);
+      pConn->uiEvents = uiEvents;
+      }
+} /* ServeUpdate() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeAccept(PIL_SERVE_STATE *)                             *
+ *                                                                          *
+ *  PURPOSE    : Accept the clients waiting to connect.                     *
+ *                                                                          *
+ ****************************************************************************/
+static void ServeAccept(PIL_SERVE_STATE *pState)
+{
+PIL_SERVE_CONN *pConn;
+struct epoll_event ev;
+int iSock;
+
+   while ((iSock = accept4(pState->iListenFD, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+      {
+      pConn = (PIL_SERVE_CONN *)calloc(1, sizeof(PIL_SERVE_CONN));
+      if (pConn != NULL)
+         pConn->pIn = (unsigned char *)malloc(SERVE_IN_SIZE);
+      ev.events = EPOLLIN;
+      ev.data.ptr = pConn;
+      if (pConn == NULL || pConn->pIn == NULL || epoll_ctl(pState->iEpollFD, EPOLL_CTL_ADD, iSock, &ev) != 0)
+         {
+         close(iSock);
+         if (pConn != NULL)
+            free(pConn->pIn);
+         free(pConn);
+         continue;
+         }
+      pConn->iSock = iSock;
+      pConn->uiEvents = EPOLLIN;
+      pConn->pNext = pState->pConns;
+      if (pState->pConns != NULL)
+         pState->pConns->pPrev = pConn;
+      pState->pConns = pConn;
+      }
+} /* ServeAccept() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : ServeListen(char *)                                        *
+ *                                                                          *
+ *  PURPOSE    : Create the listening socket. A socket file left behind by  *
+ *               a server which is no longer running is replaced.           *
+ *                                                                          *
+ *  RETURNS    : The socket, -1 if failure.                                 *
+ *                                                                          *
+ ****************************************************************************/
+static int ServeListen(char *szSocket)
+{
+struct sockaddr_un sa;
+int iSock, iProbe;
+BOOL bStale = FALSE;
+
+   if (strlen(szSocket) >= sizeof(sa.sun_path))
+      return -1;
+   memset(&sa, 0, sizeof(sa));
+   sa.sun_family = AF_UNIX;
+   strcpy(sa.sun_path, szSocket);
+   iSock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+   if (iSock < 0)
+      return -1;
+   if (bind(iSock, (struct sockaddr *)&sa, sizeof(sa)) != 0)
+      {
+      if (errno == EADDRINUSE)
+         {
+         iProbe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+         if (iProbe >= 0)
+            {
+            bStale = (connect(iProbe, (struct sockaddr *)&sa, sizeof(sa)) != 0 && errno == ECONNREFUSED);
+            close(iProbe);
+            }
+         }
+      if (!bStale || unlink(szSocket) != 0 || bind(iSock, (struct sockaddr *)&sa, sizeof(sa)) != 0)
+         {
+         close(iSock);
+         return -1;
+         }
+      }
+   if (listen(iSock, SOMAXCONN) != 0)
+      {
+      close(iSock);
+      unlink(szSocket);
+      return -1;
+      }
+   return iSock;
+} /* ServeListen() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILServe(char *, int, int, PIL_SERVE_CALLBACK, void *)     *
+ *                                                                          *
+ *  PURPOSE    : Listen on a Unix domain socket and answer requests (see    *
+ *               pil_serve.h) with a pool of worker threads until SIGINT    *
+ *               or SIGTERM arrives. Requests not started by then are       *
+ *               dropped and the socket file is removed.                    *
+ *                                                                          *
+ *  PARAMETERS : socket pathname, number of threads (0 = one per CPU),      *
+ *               size of each result, callback, user pointer for it         *
+ *                                                                          *
+ *  RETURNS    : 0 if successful, -1 if the server could not be started.    *
+ *                                                                          *
+ ****************************************************************************/
+int PILServe(char *szSocket, int iThreads, int iResultSize, PIL_SERVE_CALLBACK pfnCallback, void *pUser)
+{
+PIL_SERVE_STATE state;
+PIL_SERVE_WORKER *pWorkers = NULL;
+PIL_SERVE_CONN *pConn;
+struct epoll_event ev, events[SERVE_MAX_EVENTS];
+struct signalfd_siginfo si;
+sigset_t sigs, oldSigs;
+uint64_t ullWake;
+void *p;
+int i, iEvents, iStarted = 0, rc = -1;
+BOOL bStop = FALSE;
+
+   if (iThreads <= 0)
+      iThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+   if (iThreads < 1)
+      iThreads = 1;
+   else if (iThreads > SERVE_MAX_THREADS)
+      iThreads = SERVE_MAX_THREADS;
+   memset(&state, 0, sizeof(state));
+   state.pfnCallback = pfnCallback;
+   state.pUser = pUser;
+   state.iResultSize = iResultSize;
+   state.iBusyMax = (iThreads + 1) / 2;
+   pthread_mutex_init(&state.mutex, NULL);
+   pthread_cond_init(&state.cond, NULL);
+   // The signals to stop on arrive through a descriptor; they are blocked
+   // before the workers start so that none of them takes one instead
+   sigemptyset(&sigs);
+   sigaddset(&sigs, SIGINT);
+   sigaddset(&sigs, SIGTERM);
+   pthread_sigmask(SIG_BLOCK, &sigs, &oldSigs);
+   state.iListenFD = ServeListen(szSocket);
+   state.iEpollFD = epoll_create1(EPOLL_CLOEXEC);
+   state.iWakeFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   state.iSignalFD = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC);
+   pWorkers = (PIL_SERVE_WORKER *)calloc(iThreads, sizeof(PIL_SERVE_WORKER));
+   if (state.iListenFD < 0 || state.iEpollFD < 0 || state.iWakeFD < 0 || state.iSignalFD < 0 || pWorkers == NULL)
+      goto serve_exit;
+   ev.events = EPOLLIN;
+   ev.data.ptr = &state.iListenFD;
+   if (epoll_ctl(state.iEpollFD, EPOLL_CTL_ADD, state.iListenFD, &ev) != 0)
+      goto serve_exit;
+   ev.data.ptr = &state.iWakeFD;
+   if (epoll_ctl(state.iEpollFD, EPOLL_CTL_ADD, state.iWakeFD, &ev) != 0)
+      goto serve_exit;
+   ev.data.ptr = &state.iSignalFD;
+   if (epoll_ctl(state.iEpollFD, EPOLL_CTL_ADD, state.iSignalFD, &ev) != 0)
+      goto serve_exit;
+   for (iStarted=0; iStarted<iThreads; iStarted++)
+      {
+      pWorkers[iStarted].pState = &state;
+      pWorkers[iStarted].iThread = iStarted;
+      if (pthread_create(&pWorkers[iStarted].tid, NULL, ServeWorker, &pWorkers[iStarted]) != 0)
+         break;
+      }
+   if (iStarted == 0)
+      goto serve_exit;
+   rc = 0;
+
+   while (!bStop)
+      {
+      iEvents = epoll_wait(state.iEpollFD, events, SERVE_MAX_EVENTS, -1);
+      if (iEvents < 0)
+         {
+         if (errno == EINTR)
+            continue;
+         rc = -1;
+         break;
+         }
+      for (i=0; i<iEvents; i++)
+         {
+         p = events[i].data.ptr;
+         if (p == &state.iListenFD)
+            ServeAccept(&state);
+         else if (p == &state.iWakeFD)
+            {
+            while (read(state.iWakeFD, &ullWake, sizeof(ullWake)) < 0 && errno == EINTR)
+               ;
+            for (;;) // one at a time, the workers keep adding to the list
+               {
+               pthread_mutex_lock(&state.mutex);
+               pConn = state.pDirty;
+               if (pConn != NULL)
+                  {
+                  state.pDirty = pConn->pNextDirty;
+                  pConn->bDirty = FALSE;
+                  }
+               pthread_mutex_unlock(&state.mutex);
+               if (pConn == NULL)
+                  break;
+               ServeUpdate(&state, pConn);
+               }
+            }
+         else if (p == &state.iSignalFD)
+            {
+            while (read(state.iSignalFD, &si, sizeof(si)) < 0 && errno == EINTR)
+               ;
+            bStop = TRUE;
+            }
+         else
+            {
+            pConn = (PIL_SERVE_CONN *)p;
+            if (pConn->bClosed)
+               continue;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) // the client has gone
+               ServeFail(&state, pConn);
+            else if (events[i].events & EPOLLIN)
+               ServeRead(&state, pConn);
+            ServeUpdate(&state, pConn);
+            }
+         }
+      while ((pConn = state.pClosed) != NULL)
+         {
+         state.pClosed = pConn->pNext;
+         free(pConn->pIn);
+         free(pConn->pOut);
+         free(pConn);
+         }
+      }
+
+   pthread_mutex_lock(&state.mutex);
+   state.bStop = TRUE;
+   pthread_cond_broadcast(&state.cond);
+   pthread_mutex_unlock(&state.mutex);
+   for (i=0; i<iStarted; i++)
+      pthread_join(pWorkers[i].tid, NULL);
+   while ((pConn = state.pConns) != NULL)
+      {
+      pthread_mutex_lock(&state.mutex);
+      ServeCancel(&state, pConn);
+      pthread_mutex_unlock(&state.mutex);
+      ServeClose(&state, pConn);
+      }
+   while ((pConn = state.pClosed) != NULL)
+      {
+      state.pClosed = pConn->pNext;
+      free(pConn->pIn);
+      free(pConn->pOut);
+      free(pConn);
+      }
+serve_exit:
+   if (state.iListenFD >= 0)
+      {
+      close(state.iListenFD);
+      unlink(szSocket);
+      }
+   if (state.iEpollFD >= 0)
+      close(state.iEpollFD);
+   if (state.iWakeFD >= 0)
+      close(state.iWakeFD);
+   if (state.iSignalFD >= 0)
+      close(state.iSignalFD);
+   free(pWorkers);
+   pthread_sigmask(SIG_SETMASK, &oldSigs, NULL);
+   pthread_cond_destroy(&state.cond);
+   pthread_mutex_destroy(&state.mutex);
+   return rc;
+} /* PILServe() */
+
+#else // !__linux__
+
+int PILServe(char *szSocket, int iThreads, int iResultSize, PIL_SERVE_CALLBACK pfnCallback, void *pUser)
+{
+   return -1; // needs epoll
+} /* PILServe() */
+
+#endif // __linux__
@@ -0,0 +1,62 @@
+/************************************************************/
+/*--- Probe server on a Unix domain socket                ---*/
+/* Copyright (c) 2017 BitBank Software, Inc.                */
+/************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#ifndef _PIL_SERVE_H_
+#define _PIL_SERVE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A request is a PIL_SERVE_REQUEST followed by uiPathLen bytes of pathname
+// (not NUL-terminated). With uiPathLen = 0 the file is a descriptor sent
+// with SCM_RIGHTS in the same sendmsg() as the request; descriptors are
+// matched to these requests in order, so a connection which sends more
+// than 16 in one sendmsg() or gets 64 ahead of its requests is closed
+// rather than have one dropped. Requests can be sent without waiting for
+// the replies. Each is answered with a PIL_SERVE_REPLY and uiLen bytes of
+// result as soon as it is done, so the replies come in any order; uiID
+// tells which request they belong to. Values are in the byte order of the
+// machine.
+typedef struct pil_serve_request_tag
+{
+   uint32_t uiPathLen;
+   uint32_t uiID;       // chosen by the client, returned in the reply
+} PIL_SERVE_REQUEST;
+
+typedef struct pil_serve_reply_tag
+{
+   uint32_t uiLen;      // bytes of result which follow
+   uint32_t uiID;
+} PIL_SERVE_REPLY;
+
+#define PIL_SERVE_MAX_PATH 4096 /* longer requests close the connection */
+
+// Called on a worker thread (0..n-1) for each request, with the pathname
+// or, if NULL, the descriptor the client sent (-1 if it didn't send one).
+// Fill in the result at pResult (iResultSize bytes, zeroed). The
+// descriptor is closed when the callback returns.
+typedef void (*PIL_SERVE_CALLBACK)(void *pUser, int iThread, char *szPath, int iFD, void *pResult);
+
+extern int PILServe(char *szSocket, int iThreads, int iResultSize, PIL_SERVE_CALLBACK pfnCallback, void *pUser);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // #ifndef _PIL_SERVE_H_
@@ -0,0 +1,649 @@
+/****************************************************************************
+ *                                                                          *
+ * MODULE:  PIL_URING.C                                                     *
+ *                                                                          *
+ * DESCRIPTION: Asynchronous header reader built on Linux io_uring          *
+ *                                                                          *
+ * FUNCTIONS:                                                               *
+ *            PILUringInit - Create the ring, NULL if not supported         *
+ *            PILUringSetClassifier - Classify each batch of first reads    *
+ *            PILUringAdd - Queue a file to be identified                   *
+ *            PILUringFinish - Wait for all queued files and clean up       *
+ * COMMENTS:                                                                *
+ *            Hundreds of files are kept in flight at once. For each one    *
+ *            an openat, a statx and a read of the first URING_READ_SIZE    *
+ *            bytes are submitted together; the openat puts the file in a   *
+ *            registered slot and the read is linked to it, so the header   *
+ *            arrives without a trip back to us for the descriptor. On      *
+ *            kernels without sparse file tables (before 5.19) the read is  *
+ *            queued when the openat completes instead. The callback        *
+ *            parses from memory; when it needs a piece further into the    *
+ *            file (TIFF IFD, JPEG marker, etc.) that read is submitted on  *
+ *            the same slot and the callback runs again when it             *
+ *            completes. Files which need too many rounds fall back to      *
+ *            ordinary blocking reads. The ring is driven with the raw      *
+ *            system calls so there is no dependency on liburing.           *
+ *            Completions are drained before any callback runs, so the      *
+ *            headers which arrived together can be classified together.    *
+ ****************************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#include "my_windows.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "pil_io.h"
+#include "pil_uring.h"
+
+#ifdef __linux__
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/stat.h>
+#include <linux/io_uring.h>
+
+#define URING_READ_SIZE 4096    // first read and minimum follow-up read
+#define URING_SLOT_SIZE 32768   // buffer space per file in flight
+#define URING_MAX_ROUNDS 8      // follow-up reads before falling back
+#define URING_MAX_DEPTH 1024
+
+enum
+{
+   URING_OP_OPEN = 0,
+   URING_OP_STATX,
+   URING_OP_READ
+};
+
+typedef struct pil_uring_slot_tag
+{
+   char *szName;
+   int iFD;
+   int iPending;          // operations still in flight
+   int iError;            // open or statx failed
+   int iRounds;           // reads done so far
+   int iClass;            // from the classifier, -1 if not classified
+   int iReadResult;       // bytes returned by the last read (or -errno)
+   int iUsed;             // bytes of ucBuf holding file data
+   PILOffset llReadOffset; // file offset of the read in flight
+   void *iHandle;         // memory handle over ucBuf
+   struct statx stx;
+   int iNext;             // free list link
+   unsigned char ucBuf[URING_SLOT_SIZE];
+} PIL_URING_SLOT;
+
+typedef struct pil_uring_tag
+{
+   int iRingFD;
+   unsigned int *pSQHead, *pSQTail, *pSQMask, *pSQArray;
+   unsigned int *pCQHead, *pCQTail, *pCQMask;
+   struct io_uring_sqe *pSQEs;
+   struct io_uring_cqe *pCQEs;
+   void *pSQRing, *pCQRing;
+   size_t sqSize, cqSize, sqeSize;
+   unsigned int uiSQEntries;
+   unsigned int uiToSubmit;  // SQEs queued but not yet given to the kernel
+   int iInFlight;            // slots in use
+   int iFree;                // head of the free slot list
+   int iDepth;
+   BOOL bDirect;             // files are opened into registered slot iSlot
+   PIL_URING_CALLBACK pfnCallback;
+   PIL_URING_CLASSIFY pfnClassify;
+   void *pUser;
+   PIL_URING_SLOT *pSlots;
+   int *piReady;             // slots whose I/O finished in this pass
+   const unsigned char **ppHeaders; // classifier arguments
+   int *piLens, *piClasses;
+} PIL_URING;
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : UringEnter(PIL_URING *, unsigned int)                      *
+ *                                                                          *
+ *  PURPOSE    : Submit queued SQEs and optionally wait for completions.    *
+ *                                                                          *
+ ****************************************************************************/
+static int UringEnter(PIL_URING *pRing, unsigned int uiWait)
+{
+int rc;
+
+   rc = (int)syscall(__NR_io_uring_enter, pRing->iRingFD, pRing->uiToSubmit, uiWait, uiWait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+   if (rc > 0)
+      pRing->uiToSubmit -= (rc > (int)pRing->uiToSubmit) ? pRing->uiToSubmit : (unsigned int)rc;
+   return rc;
+} /* UringEnter() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : UringGetSQE(PIL_URING *)                                   *
+ *                                                                          *
+ *  PURPOSE    : Return the next free submission queue entry.               *
+ *                                                                          *
+ ****************************************************************************/
+static struct io_uring_sqe * UringGetSQE(PIL_URING *pRing)
+{
+unsigned int uiTail, uiIndex;
+struct io_uring_sqe *pSQE;
+
+   uiTail = *pRing->pSQTail;
+   while (uiTail - __atomic_load_n(pRing->pSQHead, __ATOMIC_ACQUIRE) >= pRing->uiSQEntries)
+      UringEnter(pRing, 0); // full, hand what we have to the kernel
+   uiIndex = uiTail & *pRing->pSQMask;
+   pSQE = &pRing->pSQEs[uiIndex];
+   memset(pSQE, 0, sizeof(struct io_uring_sqe));
+   pRing->pSQArray[uiIndex] = uiIndex;
+   __atomic_store_n(pRing->pSQTail, uiTail + 1, __ATOMIC_RELEASE);
+   pRing->uiToSubmit++;
+   return pSQE;
+} /* UringGetSQE() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : UringQueueRead(PIL_URING *, int, PILOffset, int)           *
+ *                                                                          *
+ *  PURPOSE    : Queue a read of the file into the slot's free space.       *
+ *                                                                          *
+ ****************************************************************************/
+static void UringQueueRead(PIL_URING *pRing, int iSlot, PILOffset llOffset, int iLen)
+{
+PIL_URING_SLOT *pSlot = &pRing->pSlots[iSlot];
+struct io_uring_sqe *pSQE;
+
+   pSQE = UringGetSQE(pRing);
+   pSQE->opcode = IORING_OP_READ;
+   if (pRing->bDirect)
+      {
+      pSQE->fd = iSlot;
+      pSQE->flags = IOSQE_FIXED_FILE;
+      }
+   else
+      pSQE->fd = pSlot->iFD;
+   pSQE->addr = (uint64_t)(uintptr_t)&pSlot->ucBuf[pSlot->iUsed];
+   pSQE->len = iLen;
+   pSQE->off = (uint64_t)llOffset;
+   pSQE->user_data = ((uint64_t)iSlot << 2) | URING_OP_READ;
+   pSlot->llReadOffset = llOffset;
+   pSlot->iPending++;
+   pSlot->iRounds++;
+} /* UringQueueRead() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : UringFreeSlot(PIL_URING *, int)                            *
+ *                                                                          *
+ *  PURPOSE    : Close a finished file and return its slot to the pool.     *
+ *                                                                          *
+ ****************************************************************************/
+static void UringFreeSlot(PIL_URING *pRing, int iSlot)
+{
+PIL_URING_SLOT *pSlot = &pRing->pSlots[iSlot];
+
+   if (pSlot->iHandle != (void *)-1)
+      PILIOClose(pSlot->iHandle);
+   if (pSlot->iFD >= 0)
+      close(pSlot->iFD);
+   free(pSlot->szName);
+   pSlot->szName = NULL;
+   pSlot->iNext = pRing->iFree;
+   pRing->iFree = iSlot;
+   pRing->iInFlight--;
+} /* UringFreeSlot() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : UringFallback(PIL_URING *, int)                            *
+ *                                                                          *
+ *  PURPOSE    : Finish a file with ordinary blocking reads.                *
+ *                                                                          *
+ ****************************************************************************/
+static void UringFallback(PIL_URING *pRing, int iSlot)
+{
+PIL_URING_SLOT *pSlot = &pRing->pSlots[iSlot];
+void *iHandle;
+
+   iHandle = PILIOOpenRO(pSlot->szName);
+   if (iHandle != (void *)-1)
+      {
+      (*pRing->pfnCallback)(pRing->pUser, pSlot->szName, iHandle, PILIOSize(iHandle), pSlot->iClass);
+      PILIOClose(iHandle);
+      }
+   else
+      (*pRing->pfnCallback)(pRing->pUser, pSlot->szName, (void *)-1, 0, -1);
+} /* UringFallback() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : UringSlotReady(PIL_URING *, int)                           *
+ *                                                                          *
+ *  PURPOSE    : All I/O for a slot has finished; run the callback and      *
+ *               either queue the next read or retire the file.             *
+ *                                                                          *
+ ****************************************************************************/
+static void UringSlotReady(PIL_URING *pRing, int iSlot)
+{
+PIL_URING_SLOT *pSlot = &pRing->pSlots[iSlot];
+PILOffset llOffset, llSize;
+unsigned int uiLen;
+int iLen, iBytes = pSlot->iReadResult;
+
+   if (pSlot->iError)
+      {
+      (*pRing->pfnCallback)(pRing->pUser, pSlot->szName, (void *)-1, 0, -1);
+      UringFreeSlot(pRing, iSlot);
+      return;
+      }
+   llSize = (PILOffset)pSlot->stx.stx_size;
+   if (iBytes < 0) // read error, let the blocking path report it
+      {
+      UringFallback(pRing, iSlot);
+      UringFreeSlot(pRing, iSlot);
+      return;
+      }
+   if (pSlot->iHandle == (void *)-1) // first read
+      pSlot->iHandle = PILIOOpenMem(pSlot->ucBuf, iBytes, llSize);
+   else if (!PILIOAddMem(pSlot->iHandle, pSlot->llReadOffset, &pSlot->ucBuf[pSlot->iUsed], iBytes))
+      {
+      UringFallback(pRing, iSlot);
+      UringFreeSlot(pRing, iSlot);
+      return;
+      }
+   pSlot->iUsed += iBytes;
+   if (pSlot->iHandle == (void *)-1 ||
+       (*pRing->pfnCallback)(pRing->pUser, pSlot->szName, pSlot->iHandle, llSize, pSlot->iClass) == 0)
+      {
+      UringFreeSlot(pRing, iSlot);
+      return;
+      }
+   // The parser wants another piece of the file
+   PILIONeedMore(pSlot->iHandle, &llOffset, &uiLen);
+   iLen = (uiLen < URING_READ_SIZE) ? URING_READ_SIZE : (int)uiLen;
+   if (llOffset >= 0 && llOffset < llSize && iLen > llSize - llOffset)
+      iLen = (int)(llSize - llOffset);
+   if (llOffset < 0 || llOffset >= llSize || (int)uiLen > URING_SLOT_SIZE - pSlot->iUsed || pSlot->iRounds >= URING_MAX_ROUNDS)
+      {
+      UringFallback(pRing, iSlot);
+      UringFreeSlot(pRing, iSlot);
+      return;
+      }
+   if (iLen > URING_SLOT_SIZE - pSlot->iUsed)
+      iLen = URING_SLOT_SIZE - pSlot->iUsed;
+   UringQueueRead(pRing, iSlot, llOffset, iLen);
+
+} /* UringSlotReady() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : UringClassify(PIL_URING *, int)                            *
+ *                                                                          *
+ *  PURPOSE    : Pass the headers of the ready slots which just finished    *
+ *               their first read to the classifier in one call.            *
+ *                                                                          *
+ ****************************************************************************/
+static void UringClassify(PIL_URING *pRing, int iReady)
+{
+PIL_URING_SLOT *pSlot;
+int i, iCount;
+
+   iCount = 0;
+   for (i=0; i<iReady; i++)
+      {
+      pSlot = &pRing->pSlots[pRing->piReady[i]];
+      if (!pSlot->iError && pSlot->iHandle == (void *)-1 && pSlot->iReadResult > 0)
+         {
+         pRing->ppHeaders[iCount] = pSlot->ucBuf;
+         pRing->piLens[iCount++] = pSlot->iReadResult;
+         }
+      }
+   if (iCount == 0)
+      return;
+   (*pRing->pfnClassify)(pRing->ppHeaders, pRing->piLens, iCount, pRing->piClasses);
+   iCount = 0;
+   for (i=0; i<iReady; i++)
+      {
+      pSlot = &pRing->pSlots[pRing->piReady[i]];
+      if (!pSlot->iError && pSlot->iHandle == (void *)-1 && pSlot->iReadResult > 0)
+         pSlot->iClass = pRing->piClasses[iCount++];
+      }
+} /* UringClassify() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : UringReap(PIL_URING *)                                     *
+ *                                                                          *
+ *  PURPOSE    : Process every completion waiting in the queue.             *
+ *                                                                          *
+ ****************************************************************************/
+static void UringReap(PIL_URING *pRing)
+{
+unsigned int uiHead, uiTail;
+struct io_uring_cqe *pCQE;
+PIL_URING_SLOT *pSlot;
+int i, iSlot, iOp, iResult, iReady;
+
+   do
+      {
+      // Drain the queue first; a slot can only become ready once per pass
+      // since nothing new is queued for it until its callback runs
+      iReady = 0;
+      uiHead = *pRing->pCQHead;
+      uiTail = __atomic_load_n(pRing->pCQTail, __ATOMIC_ACQUIRE);
+      while (uiHead != uiTail)
+         {
+         pCQE = &pRing->pCQEs[uiHead & *pRing->pCQMask];
+         iSlot = (int)(pCQE->user_data >> 2);
+         iOp = (int)(pCQE->user_data & 3);
+         iResult = pCQE->res;
+         uiHead++;
+         pSlot = &pRing->pSlots[iSlot];
+         pSlot->iPending--;
+         switch (iOp)
+            {
+            case URING_OP_OPEN:
+               if (iResult < 0)
+                  pSlot->iError = 1; // a linked read is cancelled
+               else if (!pRing->bDirect)
+                  {
+                  pSlot->iFD = iResult;
+                  UringQueueRead(pRing, iSlot, 0, URING_READ_SIZE); // now we can ask for the header
+                  }
+               break;
+            case URING_OP_STATX:
+               if (iResult < 0)
+                  pSlot->iError = 1;
+               break;
+            case URING_OP_READ:
+               pSlot->iReadResult = iResult;
+               break;
+            }
+         if (pSlot->iPending == 0) // the statx and read can finish in either order
+            pRing->piReady[iReady++] = iSlot;
+         if (uiHead == uiTail)
+            uiTail = __atomic_load_n(pRing->pCQTail, __ATOMIC_ACQUIRE);
+         }
+      __atomic_store_n(pRing->pCQHead, uiHead, __ATOMIC_RELEASE);
+      if (pRing->pfnClassify != NULL && iReady > 0)
+         UringClassify(pRing, iReady);
+      for (i=0; i<iReady; i++) // callbacks may queue more reads
+         UringSlotReady(pRing, pRing->piReady[i]);
+      } while (iReady > 0);
+} /* UringReap() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : UringProbe(int)                                            *
+ *                                                                          *
+ *  PURPOSE    : Make sure the kernel supports the operations we need.      *
+ *                                                                          *
+ ****************************************************************************/
+static BOOL UringProbe(int iRingFD)
+{
+struct io_uring_probe *pProbe;
+size_t size;
+BOOL bOK = FALSE;
+
+   size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+   pProbe = (struct io_uring_probe *)calloc(1, size);
+   if (pProbe == NULL)
+      return FALSE;
+   if (syscall(__NR_io_uring_register, iRingFD, IORING_REGISTER_PROBE, pProbe, 256) == 0)
+      {
+      bOK = pProbe->last_op >= IORING_OP_READ &&
+            (pProbe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) &&
+            (pProbe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) &&
+            (pProbe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+      }
+   free(pProbe);
+   return bOK;
+} /* UringProbe() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILUringInit(int, PIL_URING_CALLBACK, void *)              *
+ *                                                                          *
+ *  PURPOSE    : Set up a ring able to keep iDepth files in flight.         *
+ *                                                                          *
+ *  RETURNS    : Engine pointer, or NULL if io_uring isn't available; the   *
+ *               caller should use blocking I/O in that case.               *
+ *                                                                          *
+ ****************************************************************************/
+void * PILUringInit(int iDepth, PIL_URING_CALLBACK pfnCallback, void *pUser)
+{
+PIL_URING *pRing;
+struct io_uring_params params;
+#ifdef IORING_RSRC_REGISTER_SPARSE
+struct io_uring_rsrc_register reg;
+#endif
+int i;
+
+   if (iDepth <= 0)
+      iDepth = 256;
+   if (iDepth > URING_MAX_DEPTH)
+      iDepth = URING_MAX_DEPTH;
+   pRing = (PIL_URING *)calloc(1, sizeof(PIL_URING));
+   if (pRing == NULL)
+      return NULL;
+   memset(&params, 0, sizeof(params));
+   pRing->iRingFD = (int)syscall(__NR_io_uring_setup, iDepth * 4, &params); // open, statx and read per file
+   if (pRing->iRingFD < 0)
+      {
+      free(pRing);
+      return NULL;
+      }
+   if (!UringProbe(pRing->iRingFD))
+      goto init_error;
+   pRing->sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+   pRing->cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   if (params.features & IORING_FEAT_SINGLE_MMAP)
+      {
+      if (pRing->cqSize > pRing->sqSize)
+         pRing->sqSize = pRing->cqSize;
+      pRing->cqSize = pRing->sqSize;
+      }
+   pRing->pSQRing = mmap(NULL, pRing->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->iRingFD, IORING_OFF_SQ_RING);
+   if (pRing->pSQRing == MAP_FAILED)
+      goto init_error;
+   if (params.features & IORING_FEAT_SINGLE_MMAP)
+      pRing->pCQRing = pRing->pSQRing;
+   else
+      {
+      pRing->pCQRing = mmap(NULL, pRing->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->iRingFD, IORING_OFF_CQ_RING);
+      if (pRing->pCQRing == MAP_FAILED)
+         {
+         munmap(pRing->pSQRing, pRing->sqSize);
+         goto init_error;
+         }
+      }
+   pRing->sqeSize = params.sq_entries * sizeof(struct io_uring_sqe);
+   pRing->pSQEs = (struct io_uring_sqe *)mmap(NULL, pRing->sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->iRingFD, IORING_OFF_SQES);
+   if (pRing->pSQEs == MAP_FAILED)
+      {
+      if (pRing->pCQRing != pRing->pSQRing)
+         munmap(pRing->pCQRing, pRing->cqSize);
+      munmap(pRing->pSQRing, pRing->sqSize);
+      goto init_error;
+      }
+   pRing->pSQHead = (unsigned int *)((char *)pRing->pSQRing + params.sq_off.head);
+   pRing->pSQTail = (unsigned int *)((char *)pRing->pSQRing + params.sq_off.tail);
+   pRing->pSQMask = (unsigned int *)((char *)pRing->pSQRing + params.sq_off.ring_mask);
+   pRing->pSQArray = (unsigned int *)((char *)pRing->pSQRing + params.sq_off.array);
+   pRing->pCQHead = (unsigned int *)((char *)pRing->pCQRing + params.cq_off.head);
+   pRing->pCQTail = (unsigned int *)((char *)pRing->pCQRing + params.cq_off.tail);
+   pRing->pCQMask = (unsigned int *)((char *)pRing->pCQRing + params.cq_off.ring_mask);
+   pRing->pCQEs = (struct io_uring_cqe *)((char *)pRing->pCQRing + params.cq_off.cqes);
+   pRing->uiSQEntries = params.sq_entries;
+#ifdef IORING_RSRC_REGISTER_SPARSE
+   // An empty table of one file per slot for the direct opens; a file
+   // stays there until the slot's next open replaces it
+   memset(&reg, 0, sizeof(reg));
+   reg.nr = iDepth;
+   reg.flags = IORING_RSRC_REGISTER_SPARSE;
+   pRing->bDirect = (syscall(__NR_io_uring_register, pRing->iRingFD, IORING_REGISTER_FILES2, &reg, sizeof(reg)) == 0);
+#endif
+
+   pRing->pSlots = (PIL_URING_SLOT *)calloc(iDepth, sizeof(PIL_URING_SLOT));
+   pRing->piReady = (int *)malloc(iDepth * 3 * sizeof(int));
+   pRing->ppHeaders = (const unsigned char **)malloc(iDepth * sizeof(unsigned char *));
+   if (pRing->pSlots == NULL || pRing->piReady == NULL || pRing->ppHeaders == NULL)
+      {
+      PILUringFinish(pRing);
+      return NULL;
+      }
+   pRing->piLens = &pRing->piReady[iDepth];
+   pRing->piClasses = &pRing->piReady[iDepth * 2];
+   for (i=0; i<iDepth; i++)
+      pRing->pSlots[i].iNext = i+1;
+   pRing->pSlots[iDepth-1].iNext = -1;
+   pRing->iFree = 0;
+   pRing->iDepth = iDepth;
+   pRing->pfnCallback = pfnCallback;
+   pRing->pUser = pUser;
+   return (void *)pRing;
+
+init_error:
+   close(pRing->iRingFD);
+   free(pRing);
+   return NULL;
+} /* PILUringInit() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILUringSetClassifier(void *, PIL_URING_CLASSIFY)          *
+ *                                                                          *
+ *  PURPOSE    : Have the headers of each batch of completed first reads    *
+ *               classified together before their callbacks run.           *
+ *                                                                          *
+ ****************************************************************************/
+void PILUringSetClassifier(void *pEngine, PIL_URING_CLASSIFY pfnClassify)
+{
+PIL_URING *pRing = (PIL_URING *)pEngine;
+
+   pRing->pfnClassify = pfnClassify;
+} /* PILUringSetClassifier() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILUringAdd(void *, char *)                                *
+ *                                                                          *
+ *  PURPOSE    : Queue a file. If every slot is busy this waits for some    *
+ *               of the files in flight to finish first.                    *
+ *                                                                          *
+ ****************************************************************************/
+void PILUringAdd(void *pEngine, char *szName)
+{
+PIL_URING *pRing = (PIL_URING *)pEngine;
+PIL_URING_SLOT *pSlot;
+struct io_uring_sqe *pSQE;
+int iSlot;
+
+   while (pRing->iFree < 0)
+      {
+      UringEnter(pRing, 1);
+      UringReap(pRing);
+      }
+   iSlot = pRing->iFree;
+   pSlot = &pRing->pSlots[iSlot];
+   pRing->iFree = pSlot->iNext;
+   pRing->iInFlight++;
+   pSlot->szName = strdup(szName);
+   pSlot->iFD = -1;
+   pSlot->iError = 0;
+   pSlot->iRounds = 0;
+   pSlot->iClass = -1;
+   pSlot->iUsed = 0;
+   pSlot->iHandle = (void *)-1;
+   pSlot->iPending = 2;
+   // the openat and its linked read have to go to the kernel together
+   while (*pRing->pSQTail + 3 - __atomic_load_n(pRing->pSQHead, __ATOMIC_ACQUIRE) > pRing->uiSQEntries)
+      UringEnter(pRing, 0);
+
+   pSQE = UringGetSQE(pRing);
+   pSQE->opcode = IORING_OP_OPENAT;
+   pSQE->fd = AT_FDCWD;
+   pSQE->addr = (uint64_t)(uintptr_t)pSlot->szName;
+   pSQE->open_flags = O_RDONLY | O_CLOEXEC;
+   pSQE->user_data = ((uint64_t)iSlot << 2) | URING_OP_OPEN;
+   if (pRing->bDirect)
+      {
+#ifdef IORING_RSRC_REGISTER_SPARSE
+      pSQE->file_index = iSlot + 1;
+      pSQE->open_flags = O_RDONLY; // O_CLOEXEC is refused, there's no descriptor
+#endif
+      pSQE->flags = IOSQE_IO_LINK;
+      UringQueueRead(pRing, iSlot, 0, URING_READ_SIZE);
+      }
+
+   pSQE = UringGetSQE(pRing);
+   pSQE->opcode = IORING_OP_STATX;
+   pSQE->fd = AT_FDCWD;
+   pSQE->addr = (uint64_t)(uintptr_t)pSlot->szName;
+   pSQE->len = STATX_SIZE;
+   pSQE->off = (uint64_t)(uintptr_t)&pSlot->stx;
+   pSQE->user_data = ((uint64_t)iSlot << 2) | URING_OP_STATX;
+
+   if (pRing->uiToSubmit >= 64) // get the I/O started without waiting for it
+      {
+      UringEnter(pRing, 0);
+      UringReap(pRing);
+      }
+} /* PILUringAdd() */
+
+/****************************************************************************
+ *                                                                          *
+ *  FUNCTION   : PILUringFinish(void *)                                     *
+ *                                                                          *
+ *  PURPOSE    : Wait for every queued file, then free the engine.          *
+ *                                                                          *
+ ****************************************************************************/
+void PILUringFinish(void *pEngine)
+{
+PIL_URING *pRing = (PIL_URING *)pEngine;
+
+   if (pRing == NULL)
+      return;
+   if (pRing->pSlots)
+      {
+      while (pRing->iInFlight > 0)
+         {
+         UringEnter(pRing, 1);
+         UringReap(pRing);
+         }
+      free(pRing->pSlots);
+      }
+   free(pRing->piReady);
+   free(pRing->ppHeaders);
+   munmap(pRing->pSQEs, pRing->sqeSize);
+   if (pRing->pCQRing != pRing->pSQRing)
+      munmap(pRing->pCQRing, pRing->cqSize);
+   munmap(pRing->pSQRing, pRing->sqSize);
+   close(pRing->iRingFD);
+   free(pRing);
+} /* PILUringFinish() */
+
+#else // !__linux__
+
+void * PILUringInit(int iDepth, PIL_URING_CALLBACK pfnCallback, void *pUser)
+{
+   return NULL; // not available, use blocking I/O
+}
+void PILUringSetClassifier(void *pRing, PIL_URING_CLASSIFY pfnClassify)
+{
+}
+void PILUringAdd(void *pRing, char *szName)
+{
+}
+void PILUringFinish(void *pRing)
+{
+}
+
+#endif // __linux__
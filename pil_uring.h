@@ -0,0 +1,45 @@
+/************************************************************/
+/*--- Asynchronous (io_uring) header reader for Linux     ---*/
+/* Copyright (c) 2017 BitBank Software, Inc.                */
+/************************************************************/
+// Copyright 2012 BitBank Software, Inc. All Rights Reserved.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//    http://www.apache.org/licenses/LICENSE-2.0
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//===========================================================================
+
+#ifndef _PIL_URING_H_
+#define _PIL_URING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Called with a memory handle (see PILIOOpenMem) holding the start of the
+// file, or with a normal file handle if the engine had to fall back to
+// blocking reads. iHandle is -1 if the file couldn't be opened.
+// Return 0 when done with the file or 1 if PILIONeedMore() reports a
+// piece that must be read before calling again. iClass is what the
+// classifier (if any) made of the start of the file, otherwise -1.
+typedef int (*PIL_URING_CALLBACK)(void *pUser, char *szName, void *iHandle, PILOffset llSize, int iClass);
+// Optional: called with the start of every file whose first read finished
+// in the same pass over the completion queue, before their callbacks, to
+// classify them all at once
+typedef void (*PIL_URING_CLASSIFY)(const unsigned char * const *ppHeaders, const int *piLens, int iCount, int *piClasses);
+
+extern void * PILUringInit(int iDepth, PIL_URING_CALLBACK pfnCallback, void *pUser);
+extern void PILUringSetClassifier(void *pRing, PIL_URING_CLASSIFY pfnClassify);
+extern void PILUringAdd(void *pRing, char *szName);
+extern void PILUringFinish(void *pRing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // #ifndef _PIL_URING_H_